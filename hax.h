@@ -75,6 +75,7 @@ typedef struct Hax_Interp{
 typedef void *Hax_Trace;
 typedef void *Hax_CmdBuf;
 typedef void *Hax_Memoryp;
+typedef void *Hax_Pattern;
 
 /*
  * When a HAX command returns, the string pointer interp->result points to
@@ -103,6 +104,47 @@ typedef void *Hax_Memoryp;
 
 #define HAX_RESULT_SIZE 199
 
+/*
+ * Structure definition for a value passed to or returned from an
+ * object-based command (see Hax_CreateObjCommand).  Every value has a
+ * string form, which may be generated on demand, and may also cache
+ * an internal form so that it needn't be re-parsed each time it is
+ * used as an integer, a double or a list.  Values are reference
+ * counted:  a value with more than one reference is shared and must
+ * not be modified.  No-one outside Hax should access these fields
+ * directly;  use the procedures and macros defined below.
+ */
+
+typedef struct Hax_Obj {
+    int refCount;		/* Number of references to this value;  it
+				 * is freed when this drops to zero. */
+    int type;			/* Which internal form is valid:  one of
+				 * the HAX_OBJ_* values below. */
+    char *bytes;		/* String form, terminated by a null
+				 * character, or NULL if it must be
+				 * regenerated from the internal form. */
+    int length;			/* Number of characters at bytes, not
+				 * counting the terminating null. */
+    union {			/* Internal form, according to type: */
+	long longValue;		/* HAX_OBJ_INT. */
+	double doubleValue;	/* HAX_OBJ_DOUBLE. */
+	struct {		/* HAX_OBJ_LIST: */
+	    int objc;		/* Number of elements. */
+	    int avail;		/* Number of slots in objv. */
+	    struct Hax_Obj **objv;
+				/* Elements, each holding a reference. */
+	    int *spans;		/* Where each element's text starts and
+				 * ends in the string form (two offsets per
+				 * element), or NULL if not computed yet. */
+	} list;
+    } internalRep;
+} Hax_Obj;
+
+#define HAX_OBJ_STRING	0
+#define HAX_OBJ_INT	1
+#define HAX_OBJ_DOUBLE	2
+#define HAX_OBJ_LIST	3
+
 /*
  * Procedure types defined by Hax:
  */
@@ -110,6 +152,8 @@ typedef void *Hax_Memoryp;
 typedef void (Hax_CmdDeleteProc) (Hax_Interp *interp, ClientData clientData);
 typedef int (Hax_CmdProc) (ClientData clientData,
 	Hax_Interp *interp, int argc, char *argv[]);
+typedef int (Hax_ObjCmdProc) (ClientData clientData,
+	Hax_Interp *interp, int objc, Hax_Obj *objv[]);
 typedef void (Hax_CmdTraceProc) (ClientData clientData,
 	Hax_Interp *interp, int level, char *command, Hax_CmdProc *proc,
 	ClientData cmdClientData, int argc, char *argv[]);
@@ -179,9 +223,20 @@ typedef void (Hax_EnvDestroyProc) (Hax_Interp *interp, ClientData clientData);
 
 /*
  * The following declarations map ckalloc and ckfree to procedures
- * with all sorts of debugging hooks defined in haxCkalloc.c.
+ * with all sorts of debugging hooks defined in haxCkalloc.c.  A memory
+ * context created by Hax_CreateReleaseMemoryManagement (or by any of
+ * the creation procedures, if Hax was compiled with
+ * HAX_RELEASE_MEMORY defined) skips all of the debugging.  Either
+ * way, small blocks come from per-context pools of size-class pages
+ * rather than straight from malloc, unless Hax was compiled with
+ * HAX_NO_SLABS defined.  Compiling with HAX_RELEASE_MEMORY also makes
+ * the macros below leave out the file and line information.
  */
 
+HAX_EXTERN void *	Hax_Ckalloc (Hax_Memoryp *, unsigned long int size);
+HAX_EXTERN int		Hax_Ckfree (Hax_Memoryp *, void *ptr);
+HAX_EXTERN void *	Hax_Ckrealloc (Hax_Memoryp *, void *ptr,
+			    unsigned long int size);
 HAX_EXTERN void *	Hax_DbCkalloc (Hax_Memoryp *, unsigned long int size,
 			    char *file, int line);
 HAX_EXTERN int		Hax_DbCkfree (Hax_Memoryp *, void *ptr,
@@ -192,10 +247,16 @@ HAX_EXTERN int		Hax_DumpActiveMemory (Hax_Memoryp *);
 HAX_EXTERN void		Hax_ValidateAllMemory (Hax_Memoryp *, char *file,
 			    int line);
 
+#ifdef HAX_RELEASE_MEMORY
+#define ckalloc(m,x) Hax_Ckalloc((m), (x))
+#define ckfree(m,x)  Hax_Ckfree((m), (x))
+#define ckrealloc(m,x,y) Hax_Ckrealloc((m), (x), (y))
+#else
 #define ckalloc(m,x) Hax_DbCkalloc((m), (x), (char *) __FILE__, __LINE__)
 #define ckfree(m,x)  Hax_DbCkfree((m), (x), (char *) __FILE__, __LINE__)
 #define ckrealloc(m,x,y)					\
 	Hax_DbCkrealloc((m), (x), (y), (char *) __FILE__, __LINE__)
+#endif
 #define ckvalidateallmemory(m)					\
 	Hax_ValidateAllMemory((m), (char *) __FILE__, __LINE__)
 
@@ -217,6 +278,19 @@ HAX_EXTERN void		Hax_ValidateAllMemory (Hax_Memoryp *, char *file,
 	}							\
     } while (0)
 
+/*
+ * Macros to manage the reference counts of Hax_Obj values.
+ */
+
+#define Hax_IncrRefCount(objPtr) ((objPtr)->refCount++)
+#define Hax_DecrRefCount(interp, objPtr)			\
+    do {							\
+	if (--(objPtr)->refCount <= 0) {			\
+	    Hax_FreeObj((interp), (objPtr));			\
+	}							\
+    } while (0)
+#define Hax_IsShared(objPtr) ((objPtr)->refCount > 1)
+
 /*
  * Exported Hax procedures:
  */
@@ -231,6 +305,8 @@ HAX_EXTERN void		Hax_AddErrorInfo (Hax_Interp *interp,
 HAX_EXTERN char		Hax_Backslash (char *src,
 			    int *readPtr);
 HAX_EXTERN int		Hax_CommandComplete(char *cmd);
+HAX_EXTERN Hax_Pattern	Hax_CompilePattern (Hax_Interp *interp,
+			    char *pattern);
 HAX_EXTERN char *	Hax_Concat (Hax_Interp *interp, int argc, char **argv);
 HAX_EXTERN int		Hax_ConvertElement (char *src,
 			    char *dst, int flags);
@@ -243,10 +319,15 @@ HAX_EXTERN Hax_Memoryp *Hax_CreateMemoryManagement (
 			    int break_on_malloc, int trace_on_at_malloc,
 			    int alloc_tracing, int init_malloced_bodies,
 			    int validate_memory);
+HAX_EXTERN Hax_Memoryp *Hax_CreateReleaseMemoryManagement (void);
 HAX_EXTERN Hax_Memoryp *Hax_GetMemoryp (Hax_Interp *interp);
 HAX_EXTERN char *	Hax_GetLibraryPath (Hax_Interp *interp);
 HAX_EXTERN void		Hax_SetLibraryPath (Hax_Interp *interp, char *path);
 HAX_EXTERN Hax_Interp *	Hax_CreateInterp (Hax_Memoryp *memoryp);
+HAX_EXTERN void		Hax_CreateObjCommand (Hax_Interp *interp,
+			    char *cmdName, Hax_ObjCmdProc *proc,
+			    ClientData clientData,
+			    Hax_CmdDeleteProc *deleteProc);
 HAX_EXTERN int		Hax_CreatePipeline (Hax_Interp *interp,
 			    ClientData clientData,
 			    int argc, char **argv, int **pidArrayPtr,
@@ -264,11 +345,15 @@ HAX_EXTERN void		Hax_DeleteTrace (Hax_Interp *interp,
 			    Hax_Trace trace);
 HAX_EXTERN void		Hax_DetachPids (ClientData clientData,
 			    int numPids, int *pidPtr);
+HAX_EXTERN Hax_Obj *	Hax_DuplicateObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
 HAX_EXTERN char *	Hax_ErrnoId (void);
 HAX_EXTERN int		Hax_Eval (Hax_Interp *interp, char *scriptFile,
 			    char *cmd, int flags, char **termPtr);
 HAX_EXTERN int		Hax_EvalFile (Hax_Interp *interp,
 			    ClientData clientData, char *fileName);
+HAX_EXTERN int		Hax_EvalObjv (Hax_Interp *interp, int objc,
+			    Hax_Obj *objv[]);
 HAX_EXTERN int		Hax_ExprBoolean (Hax_Interp *interp,
 			    char *string, int *ptr);
 HAX_EXTERN int		Hax_ExprDouble (Hax_Interp *interp,
@@ -281,16 +366,29 @@ HAX_EXTERN int		Hax_ExprString (Hax_Interp *interp,
 			    char *string);
 HAX_EXTERN int		Hax_Fork (Hax_Interp *interp,
 			    ClientData clientData);
+HAX_EXTERN void		Hax_FreeObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
+HAX_EXTERN void		Hax_FreePattern (Hax_Interp *interp,
+			    Hax_Pattern pattern);
 HAX_EXTERN int		Hax_GetBoolean (Hax_Interp *interp,
 			    char *string, int *boolPtr);
 HAX_EXTERN int		Hax_GetDouble (Hax_Interp *interp,
 			    char *string, void *doublePtr);
+HAX_EXTERN int		Hax_GetDoubleFromObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, double *doublePtr);
 HAX_EXTERN int		Hax_GetInt (Hax_Interp *interp,
 			    char *string, int *intPtr);
+HAX_EXTERN int		Hax_GetIntFromObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, int *intPtr);
 HAX_EXTERN int		Hax_GetLong (Hax_Interp *interp,
 			    char *string, long int *longPtr);
+HAX_EXTERN int		Hax_GetLongFromObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, long int *longPtr);
 HAX_EXTERN int		Hax_GetLongLong (Hax_Interp *interp,
 			    char *string, long long int *llongPtr);
+HAX_EXTERN Hax_Obj *	Hax_GetObjResult (Hax_Interp *interp);
+HAX_EXTERN char *	Hax_GetStringFromObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, int *lengthPtr);
 HAX_EXTERN char *	Hax_GetVar (Hax_Interp *interp,
 			    char *varName, int flags);
 HAX_EXTERN char *	Hax_GetVar2 (Hax_Interp *interp,
@@ -299,23 +397,58 @@ HAX_EXTERN int		Hax_GlobalEval (Hax_Interp *interp,
 			    char *command);
 HAX_EXTERN void		Hax_InitHistory (Hax_Interp *interp);
 HAX_EXTERN void		Hax_InitMemory (Hax_Interp *interp);
+HAX_EXTERN void		Hax_InvalidateStringRep (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
+HAX_EXTERN int		Hax_ListObjAppendElement (Hax_Interp *interp,
+			    Hax_Obj *listPtr, Hax_Obj *objPtr);
+HAX_EXTERN int		Hax_ListObjGetElements (Hax_Interp *interp,
+			    Hax_Obj *listPtr, int *objcPtr,
+			    Hax_Obj ***objvPtr);
+HAX_EXTERN int		Hax_ListObjIndex (Hax_Interp *interp,
+			    Hax_Obj *listPtr, int index,
+			    Hax_Obj **objPtrPtr);
+HAX_EXTERN int		Hax_ListObjLength (Hax_Interp *interp,
+			    Hax_Obj *listPtr, int *lengthPtr);
 HAX_EXTERN char *	Hax_Merge (Hax_Interp *interp, int argc, char **argv);
+HAX_EXTERN Hax_Obj *	Hax_NewDoubleObj (Hax_Interp *interp,
+			    double doubleValue);
+HAX_EXTERN Hax_Obj *	Hax_NewIntObj (Hax_Interp *interp, int intValue);
+HAX_EXTERN Hax_Obj *	Hax_NewListObj (Hax_Interp *interp, int objc,
+			    Hax_Obj *objv[]);
+HAX_EXTERN Hax_Obj *	Hax_NewLongObj (Hax_Interp *interp,
+			    long int longValue);
+HAX_EXTERN Hax_Obj *	Hax_NewStringObj (Hax_Interp *interp,
+			    char *bytes, int length);
 HAX_EXTERN char *	Hax_ParseVar (Hax_Interp *interp,
 			    char *string, char **termPtr);
+HAX_EXTERN int		Hax_PatternMatch (Hax_Pattern pattern,
+			    char *string);
 HAX_EXTERN int		Hax_RecordAndEval (Hax_Interp *interp,
 			    char *cmd, int flags);
 HAX_EXTERN void		Hax_ResetResult (Hax_Interp *interp);
 #define Hax_Return Hax_SetResult
 HAX_EXTERN int		Hax_ScanElement (char *string,
 			    int *flagPtr);
+HAX_EXTERN void		Hax_SetDoubleObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, double doubleValue);
 HAX_EXTERN void		Hax_SetErrorCode (Hax_Interp *interp, ...);
+HAX_EXTERN long		Hax_SetEvalBudget (Hax_Interp *interp,
+			    long bytes);
+HAX_EXTERN void		Hax_SetLongObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, long int longValue);
+HAX_EXTERN void		Hax_SetObjResult (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
 HAX_EXTERN void		Hax_SetResult (Hax_Interp *interp,
 			    char *string, Hax_FreeProc *freeProc);
+HAX_EXTERN int		Hax_SetSortThreads (Hax_Interp *interp,
+			    int threads);
 HAX_EXTERN char *	Hax_SetVar (Hax_Interp *interp,
 			    char *varName, char *newValue, int flags);
 HAX_EXTERN char *	Hax_SetVar2 (Hax_Interp *interp,
 			    char *part1, char *part2, char *newValue,
 			    int flags);
+HAX_EXTERN void		Hax_SetStringObj (Hax_Interp *interp,
+			    Hax_Obj *objPtr, char *bytes, int length);
 HAX_EXTERN char *	Hax_SignalId (int sig);
 HAX_EXTERN char *	Hax_SignalMsg (int sig);
 HAX_EXTERN int		Hax_SplitList (Hax_Interp *interp,
@@ -374,10 +507,24 @@ typedef struct Hax_HashEntry {
 					 * chain. */
     struct Hax_HashTable *tablePtr;	/* Pointer to table containing entry. */
     struct Hax_HashEntry **bucketPtr;	/* Pointer to bucket that points to
-					 * first entry in this entry's chain:
+					 * first entry in this entry's chain
+					 * (or, in HAX_OPEN_STRING_KEYS
+					 * tables, to the entry's slot):
 					 * used for deleting the entry. */
     ClientData clientData;		/* Application stores something here
 					 * with Hax_SetHashValue. */
+    unsigned int hash;			/* Full hash value of a string key,
+					 * compared before the key itself
+					 * and reused when the table is
+					 * rebuilt.  Unused for one-word
+					 * and array keys. */
+    struct Hax_HashEntry *nextInTablePtr;
+					/* Next entry created in the table,
+					 * or NULL:  the list followed by
+					 * Hax_NextHashEntry. */
+    struct Hax_HashEntry *prevInTablePtr;
+					/* Previous entry created in the
+					 * table, or NULL. */
     union {				/* Key has one of these forms: */
 	char *oneWordValue;		/* One-word value for key. */
 	int words[1];			/* Multiple integer words for key.
@@ -400,7 +547,10 @@ typedef struct Hax_HashEntry {
 typedef struct Hax_HashTable {
     Hax_HashEntry **buckets;		/* Pointer to bucket array.  Each
 					 * element points to first entry in
-					 * bucket's hash chain, or NULL. */
+					 * bucket's hash chain, or NULL.  In
+					 * HAX_OPEN_STRING_KEYS tables each
+					 * element is a slot holding at most
+					 * one entry. */
     Hax_HashEntry *staticBuckets[HAX_SMALL_HASH_TABLE];
 					/* Bucket array used for small tables
 					 * (to avoid mallocs and frees). */
@@ -417,9 +567,39 @@ typedef struct Hax_HashTable {
 					 * function. */
     int keyType;			/* Type of keys used in this table.
 					 * It's either HAX_STRING_KEYS,
+					 * HAX_OPEN_STRING_KEYS,
 					 * HAX_ONE_WORD_KEYS, or an integer
 					 * giving the number of ints in a
 					 */
+    unsigned char *ctrl;		/* HAX_OPEN_STRING_KEYS only: one
+					 * control byte per slot in buckets,
+					 * telling whether the slot is empty,
+					 * deleted, or full (with 7 bits of
+					 * the entry's hash).  NULL for other
+					 * key types. */
+    unsigned char staticCtrl[HAX_SMALL_HASH_TABLE];
+					/* Control bytes used with
+					 * staticBuckets. */
+    int numDeleted;			/* HAX_OPEN_STRING_KEYS only: number
+					 * of slots holding deleted-entry
+					 * markers. */
+    Hax_HashEntry **oldBuckets;		/* While the table is being rebuilt,
+					 * the bucket array its entries are
+					 * being moved out of;  otherwise
+					 * NULL. */
+    unsigned char *oldCtrl;		/* Control bytes for oldBuckets. */
+    int oldNumBuckets;			/* Number of buckets in oldBuckets. */
+    int oldDownShift;			/* Shift count for oldBuckets. */
+    int rehashIndex;			/* Index of the next old bucket whose
+					 * entries are to be moved;  those
+					 * below it are already empty. */
+    Hax_HashEntry *firstEntryPtr;	/* Oldest entry in the table, or
+					 * NULL. */
+    Hax_HashEntry *lastEntryPtr;	/* Newest entry in the table, or
+					 * NULL. */
+    Hax_Memoryp *memoryp;		/* Memory pool the bucket arrays were
+					 * allocated from, so that a rebuild
+					 * can finish during a lookup. */
     Hax_HashEntry *(*findProc) (struct Hax_HashTable *tablePtr,
 	    char *key);
     Hax_HashEntry *(*createProc) (Hax_Interp *interp,
@@ -433,10 +613,8 @@ typedef struct Hax_HashTable {
 
 typedef struct Hax_HashSearch {
     Hax_HashTable *tablePtr;		/* Table being searched. */
-    int nextIndex;			/* Index of next bucket to be
-					 * enumerated after present one. */
-    Hax_HashEntry *nextEntryPtr;	/* Next entry to be enumerated in the
-					 * the current bucket. */
+    Hax_HashEntry *nextEntryPtr;	/* Next entry to be enumerated, or
+					 * NULL at the end of the table. */
 } Hax_HashSearch;
 
 /*
@@ -445,6 +623,7 @@ typedef struct Hax_HashSearch {
 
 #define HAX_STRING_KEYS		0
 #define HAX_ONE_WORD_KEYS	1
+#define HAX_OPEN_STRING_KEYS	(-1)
 
 /*
  * Macros for clients to use to access fields of hash entries:
@@ -28,7 +28,16 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclBasic.c,v 1.133 92/08/2
 
 typedef struct {
     const char *name;		/* Name of command. */
-    Hax_CmdProc *proc;		/* Procedure that executes command. */
+    Hax_CmdProc *proc;		/* Procedure that executes command, or NULL
+				 * if objProc is used instead. */
+    Hax_ObjCmdProc *objProc;	/* Procedure that executes command with
+				 * its arguments as values, or NULL.  If
+				 * both are given, objProc is only used
+				 * when the arguments are already values
+				 * (see Command in haxInt.h). */
+    HaxNRCmdProc *nrProc;	/* Procedure that compiled scripts use to
+				 * execute the command without recursing,
+				 * or NULL. */
 } CmdInfo;
 
 /*
@@ -44,43 +53,51 @@ static CmdInfo builtInCmds[] = {
     {"array",		Hax_ArrayCmd},
     {"break",		Hax_BreakCmd},
     {"case",		Hax_CaseCmd},
-    {"catch",		Hax_CatchCmd},
+    {"catch",		Hax_CatchCmd, (Hax_ObjCmdProc *) NULL,
+	    Hax_CatchNRCmd},
     {"concat",		Hax_ConcatCmd},
     {"continue",	Hax_ContinueCmd},
     {"error",		Hax_ErrorCmd},
-    {"eval",		Hax_EvalCmd},
+    {"eval",		Hax_EvalCmd, (Hax_ObjCmdProc *) NULL,
+	    Hax_EvalNRCmd},
     {"expr",		Hax_ExprCmd},
-    {"for",		Hax_ForCmd},
-    {"foreach",		Hax_ForeachCmd},
+    {"for",		Hax_ForCmd, (Hax_ObjCmdProc *) NULL,
+	    Hax_ForNRCmd},
+    {"foreach",		(Hax_CmdProc *) NULL, Hax_ForeachObjCmd,
+	    Hax_ForeachNRCmd},
     {"format",		Hax_FormatCmd},
     {"global",		Hax_GlobalCmd},
-    {"if",		Hax_IfCmd},
-    {"incr",		Hax_IncrCmd},
+    {"if",		Hax_IfCmd, (Hax_ObjCmdProc *) NULL,
+	    Hax_IfNRCmd},
+    {"incr",		(Hax_CmdProc *) NULL, Hax_IncrObjCmd},
     {"info",		Hax_InfoCmd},
-    {"join",		Hax_JoinCmd},
+    {"join",		(Hax_CmdProc *) NULL, Hax_JoinObjCmd},
     {"lappend",		Hax_LappendCmd},
-    {"lindex",		Hax_LindexCmd},
-    {"linsert",		Hax_LinsertCmd},
-    {"list",		Hax_ListCmd},
-    {"llength",		Hax_LlengthCmd},
-    {"lrange",		Hax_LrangeCmd},
-    {"lreplace",	Hax_LreplaceCmd},
-    {"lsearch",		Hax_LsearchCmd},
-    {"lsort",		Hax_LsortCmd},
+    {"lindex",		(Hax_CmdProc *) NULL, Hax_LindexObjCmd},
+    {"linsert",		(Hax_CmdProc *) NULL, Hax_LinsertObjCmd},
+    {"list",		(Hax_CmdProc *) NULL, Hax_ListObjCmd},
+    {"llength",		(Hax_CmdProc *) NULL, Hax_LlengthObjCmd},
+    {"lrange",		(Hax_CmdProc *) NULL, Hax_LrangeObjCmd},
+    {"lreplace",	(Hax_CmdProc *) NULL, Hax_LreplaceObjCmd},
+    {"lsearch",		(Hax_CmdProc *) NULL, Hax_LsearchObjCmd},
+    {"lsort",		(Hax_CmdProc *) NULL, Hax_LsortObjCmd},
     {"proc",		Hax_ProcCmd},
     {"regexp",		Hax_RegexpCmd},
     {"regsub",		Hax_RegsubCmd},
     {"rename",		Hax_RenameCmd},
-    {"return",		Hax_ReturnCmd},
+    {"return",		Hax_ReturnCmd, Hax_ReturnObjCmd},
     {"scan",		Hax_ScanCmd},
-    {"set",		Hax_SetCmd},
+    {"set",		Hax_SetCmd, Hax_SetObjCmd},
     {"split",		Hax_SplitCmd},
     {"string",		Hax_StringCmd},
+    {"tailcall",	Hax_TailcallCmd},
     {"trace",		Hax_TraceCmd},
     {"unset",		Hax_UnsetCmd},
-    {"uplevel",		Hax_UplevelCmd},
+    {"uplevel",		Hax_UplevelCmd, (Hax_ObjCmdProc *) NULL,
+	    Hax_UplevelNRCmd},
     {"upvar",		Hax_UpvarCmd},
-    {"while",		Hax_WhileCmd},
+    {"while",		Hax_WhileCmd, (Hax_ObjCmdProc *) NULL,
+	    Hax_WhileNRCmd},
     {NULL,		(Hax_CmdProc *) NULL}
 };
 
@@ -120,8 +137,17 @@ Hax_CreateInterp(
     iPtr->result = iPtr->resultSpace;
     iPtr->freeProc = 0;
     iPtr->errorLine = 0;
-    Hax_InitHashTable(&iPtr->commandTable, HAX_STRING_KEYS);
-    Hax_InitHashTable(&iPtr->globalTable, HAX_STRING_KEYS);
+    iPtr->errorFrames = NULL;
+    iPtr->numErrorFrames = 0;
+    iPtr->errorFramesAvl = 0;
+    iPtr->errorText = NULL;
+    iPtr->errorTextUsed = 0;
+    iPtr->errorTextAvl = 0;
+    Hax_InitHashTable(&iPtr->commandTable, HAX_OPEN_STRING_KEYS);
+    iPtr->cmdEpoch = 1;
+    iPtr->objResultPtr = NULL;
+    iPtr->objFreePtr = NULL;
+    Hax_InitHashTable(&iPtr->globalTable, HAX_OPEN_STRING_KEYS);
     iPtr->numLevels = 0;
     iPtr->framePtr = NULL;
     iPtr->varFramePtr = NULL;
@@ -149,6 +175,28 @@ Hax_CreateInterp(
     iPtr->tracePtr = NULL;
     iPtr->resultSpace[0] = 0;
     iPtr->internalErrno = 0;
+    Hax_InitHashTable(&iPtr->scriptCache, HAX_STRING_KEYS);
+    iPtr->cacheFirstPtr = NULL;
+    iPtr->cacheLastPtr = NULL;
+    iPtr->scriptCacheHits = 0;
+    iPtr->scriptCacheMisses = 0;
+    Hax_InitHashTable(&iPtr->exprCache, HAX_STRING_KEYS);
+    iPtr->exprFirstPtr = NULL;
+    iPtr->exprLastPtr = NULL;
+    iPtr->exprCacheHits = 0;
+    iPtr->exprCacheMisses = 0;
+    iPtr->exprCmdPtr = NULL;
+    iPtr->exprCmdString = NULL;
+    iPtr->exprProcPtr = NULL;
+    iPtr->scratchFirstPtr = NULL;
+    iPtr->scratchPtr = NULL;
+    iPtr->scratchTop = NULL;
+    iPtr->execTopPtr = NULL;
+    iPtr->execFreePtr = NULL;
+    iPtr->execBytes = 0;
+    iPtr->evalBudget = DEFAULT_EVAL_BUDGET;
+    iPtr->evalDepth = 0;
+    iPtr->sortThreads = DEFAULT_SORT_THREADS;
     iPtr->haxRegexpError = NULL;
     iPtr->regparse = NULL;
     iPtr->regnpar = 0;
@@ -181,9 +229,18 @@ Hax_CreateInterp(
 		(char *) cmdInfoPtr->name, &newPtr);
 	if (newPtr) {
 	    cmdPtr = (Command *) ckalloc(memoryp, sizeof(Command));
-	    cmdPtr->proc = cmdInfoPtr->proc;
-	    cmdPtr->clientData = (ClientData) NULL;
+	    if (cmdInfoPtr->proc == NULL) {
+		cmdPtr->proc = HaxInvokeObjCommand;
+		cmdPtr->clientData = (ClientData) cmdPtr;
+	    } else {
+		cmdPtr->proc = cmdInfoPtr->proc;
+		cmdPtr->clientData = (ClientData) NULL;
+	    }
+	    cmdPtr->objProc = cmdInfoPtr->objProc;
+	    cmdPtr->objClientData = (ClientData) NULL;
 	    cmdPtr->deleteProc = NULL;
+	    cmdPtr->deleteData = (ClientData) NULL;
+	    cmdPtr->nrProc = cmdInfoPtr->nrProc;
 	    Hax_SetHashValue(hPtr, cmdPtr);
 	}
     }
@@ -239,7 +296,7 @@ Hax_DeleteInterp(
 	    hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
 	cmdPtr = (Command *) Hax_GetHashValue(hPtr);
 	if (cmdPtr->deleteProc != NULL) {
-	    (*cmdPtr->deleteProc)(interp, cmdPtr->clientData);
+	    (*cmdPtr->deleteProc)(interp, cmdPtr->deleteData);
 	}
 	ckfree(memoryp, (char *) cmdPtr);
     }
@@ -262,6 +319,12 @@ Hax_DeleteInterp(
     if (iPtr->appendResult != NULL) {
 	ckfree(memoryp, iPtr->appendResult);
     }
+    if (iPtr->errorFrames != NULL) {
+	ckfree(memoryp, (char *) iPtr->errorFrames);
+    }
+    if (iPtr->errorText != NULL) {
+	ckfree(memoryp, iPtr->errorText);
+    }
     for (i = 0; i < NUM_REGEXPS; i++) {
 	if (iPtr->patterns[i] == NULL) {
 	    break;
@@ -269,6 +332,15 @@ Hax_DeleteInterp(
 	ckfree(memoryp, iPtr->patterns[i]);
 	ckfree(memoryp, (char *) iPtr->regexps[i]);
     }
+    HaxDeleteScriptCache(iPtr);
+    HaxDeleteExecLevels(iPtr);
+    HaxDeleteExprCache(iPtr);
+    if (iPtr->objResultPtr != NULL) {
+	Hax_DecrRefCount(interp, iPtr->objResultPtr);
+	iPtr->objResultPtr = NULL;
+    }
+    HaxDeleteObjs(iPtr);
+    HaxDeleteScratch(iPtr);
     while (iPtr->tracePtr != NULL) {
 	Trace *nextPtr = iPtr->tracePtr->nextPtr;
 
@@ -321,6 +393,7 @@ Hax_CreateCommand(
     Hax_HashEntry *hPtr;
     int newPtr;
 
+    iPtr->cmdEpoch++;
     hPtr = Hax_CreateHashEntry(interp, &iPtr->commandTable, cmdName, &newPtr);
     if (!newPtr) {
 	/*
@@ -329,7 +402,7 @@ Hax_CreateCommand(
 
 	cmdPtr = (Command *) Hax_GetHashValue(hPtr);
 	if (cmdPtr->deleteProc != NULL) {
-	    (*cmdPtr->deleteProc)(interp, cmdPtr->clientData);
+	    (*cmdPtr->deleteProc)(interp, cmdPtr->deleteData);
 	}
     } else {
 	cmdPtr = (Command *) ckalloc(memoryp, sizeof(Command));
@@ -337,7 +410,144 @@ Hax_CreateCommand(
     }
     cmdPtr->proc = proc;
     cmdPtr->clientData = clientData;
+    cmdPtr->objProc = NULL;
+    cmdPtr->objClientData = (ClientData) NULL;
     cmdPtr->deleteProc = deleteProc;
+    cmdPtr->deleteData = clientData;
+    cmdPtr->nrProc = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_CreateObjCommand --
+ *
+ *	Define a new command whose procedure receives its arguments
+ *	as values (Hax_Obj's) rather than strings.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Just as for Hax_CreateCommand, except that objProc will be
+ *	called to execute the command.  The command can still be
+ *	invoked through the string interfaces;  its words are then
+ *	converted to values first.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Hax_CreateObjCommand(
+    Hax_Interp *interp,		/* Token for command interpreter (returned
+				 * by a previous call to Hax_CreateInterp). */
+    char *cmdName,		/* Name of command. */
+    Hax_ObjCmdProc *objProc,	/* Object-based command procedure to
+				 * associate with cmdName. */
+    ClientData clientData,	/* Arbitrary one-word value to pass to
+				 * objProc. */
+    Hax_CmdDeleteProc *deleteProc
+				/* If not NULL, gives a procedure to call when
+				 * this command is deleted. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    Command *cmdPtr;
+    Hax_HashEntry *hPtr;
+
+    Hax_CreateCommand(interp, cmdName, HaxInvokeObjCommand, (ClientData) NULL,
+	    deleteProc);
+    hPtr = Hax_FindHashEntry(&iPtr->commandTable, cmdName);
+    cmdPtr = (Command *) Hax_GetHashValue(hPtr);
+    cmdPtr->clientData = (ClientData) cmdPtr;
+    cmdPtr->objProc = objProc;
+    cmdPtr->objClientData = clientData;
+    cmdPtr->deleteData = clientData;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxInvokeObjCommand --
+ *
+ *	This is the string-based command procedure for every command
+ *	created with Hax_CreateObjCommand.  It is used whenever such a
+ *	command is invoked through a string interface such as Hax_Eval.
+ *
+ * Results:
+ *	Whatever the command's object procedure returns.
+ *
+ * Side effects:
+ *	A value is made for each word of the command, and released
+ *	again afterwards.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxInvokeObjCommand(
+    ClientData clientData,	/* The command's Command structure. */
+    Hax_Interp *interp,		/* Current interpreter. */
+    int argc,			/* Number of arguments. */
+    char **argv			/* Argument strings. */)
+{
+    return HaxInvokeObjv((Interp *) interp, (Command *) clientData, argc,
+	    argv, (Hax_Obj **) NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxInvokeObjv --
+ *
+ *	Call a command's object procedure with the words in argv, some
+ *	of which may already be available as values.
+ *
+ * Results:
+ *	Whatever the command's object procedure returns.
+ *
+ * Side effects:
+ *	A value is made for each word that doesn't have one in refs,
+ *	and released again afterwards.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxInvokeObjv(
+    Interp *iPtr,		/* Current interpreter. */
+    Command *cmdPtr,		/* Command to invoke;  must have an
+				 * object procedure. */
+    int argc,			/* Number of arguments. */
+    char **argv,		/* Argument strings. */
+    Hax_Obj **refs		/* If not NULL, refs[i] is either NULL or
+				 * a value whose string form is argv[i]. */)
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+#   define NUM_OBJS 10
+    Hax_Obj *objStorage[NUM_OBJS];
+    Hax_Obj **objv = objStorage;
+    ScratchMark mark;
+    int i, result;
+
+    HaxScratchMark(iPtr, &mark);
+    if (argc > NUM_OBJS) {
+	objv = (Hax_Obj **) HaxScratchAlloc(iPtr,
+		(int) (argc * sizeof(Hax_Obj *)));
+    }
+    for (i = 0; i < argc; i++) {
+	if ((refs != NULL) && (refs[i] != NULL)) {
+	    objv[i] = refs[i];
+	} else {
+	    objv[i] = Hax_NewStringObj(interp, argv[i], -1);
+	}
+	Hax_IncrRefCount(objv[i]);
+    }
+    result = (*cmdPtr->objProc)(cmdPtr->objClientData, interp, argc, objv);
+    for (i = 0; i < argc; i++) {
+	Hax_DecrRefCount(interp, objv[i]);
+    }
+    HaxScratchRelease(iPtr, &mark);
+    return result;
 }
 
 /*
@@ -374,15 +584,49 @@ Hax_DeleteCommand(
     if (hPtr == NULL) {
 	return -1;
     }
+    iPtr->cmdEpoch++;
     cmdPtr = (Command *) Hax_GetHashValue(hPtr);
     if (cmdPtr->deleteProc != NULL) {
-	(*cmdPtr->deleteProc)(interp, cmdPtr->clientData);
+	(*cmdPtr->deleteProc)(interp, cmdPtr->deleteData);
     }
     ckfree(memoryp, (char *) cmdPtr);
     Hax_DeleteHashEntry(interp, hPtr);
     return 0;
 }
 
+/*
+ *-----------------------------------------------------------------
+ *
+ * ReleaseWords --
+ *
+ *	Drop the references that Hax_Eval holds to the words of a
+ *	command that HaxParseWords passed by reference.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The entries of refs are released and set to NULL.
+ *
+ *-----------------------------------------------------------------
+ */
+
+static void
+ReleaseWords(
+    Interp *iPtr,		/* Interpreter that owns the values. */
+    Hax_Obj **refs,		/* References, or NULL entries. */
+    int argc)			/* Number of entries in refs. */
+{
+    int i;
+
+    for (i = 0; i < argc; i++) {
+	if (refs[i] != NULL) {
+	    Hax_DecrRefCount((Hax_Interp *) iPtr, refs[i]);
+	    refs[i] = NULL;
+	}
+    }
+}
+
 /*
  *-----------------------------------------------------------------
  *
@@ -432,15 +676,21 @@ Hax_Eval(
 
     /*
      * This procedure generates an (argv, argc) array for the command,
-     * It starts out with stack-allocated space but uses dynamically-
-     * allocated storage to increase it if needed.
+     * It starts out with stack-allocated space but uses the scratch
+     * space to increase it if needed.  The same goes for pv, and for
+     * refs, which holds the values of words that HaxParseWords passed
+     * by reference rather than copying them into pv.  All of these
+     * are given back at once by releasing evalMark at the end.
      */
 
 #   define NUM_ARGS 10
     char *(argStorage[NUM_ARGS]);
     char **argv = argStorage;
-    int argc;
+    Hax_Obj *(refStorage[NUM_ARGS]);
+    Hax_Obj **refs = refStorage;
+    int argc, haveRefs, i;
     int argSize = NUM_ARGS;
+    ScratchMark evalMark, cmdMark;
 
     char *src;			/* Points to current character
 					 * in cmd. */
@@ -449,7 +699,6 @@ Hax_Eval(
 					 * that newlines terminate commands. */
     int result;				/* Return value. */
     Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
     char *oldScriptFile = iPtr->scriptFile;
     Hax_HashEntry *hPtr;
     Command *cmdPtr;
@@ -486,22 +735,23 @@ Hax_Eval(
      * it's probably because of an infinite loop somewhere.
      */
 
-    iPtr->numLevels++;
-    if (iPtr->numLevels > MAX_NESTING_DEPTH) {
-	iPtr->numLevels--;
+    if (iPtr->evalDepth >= MAX_NESTING_DEPTH) {
 	iPtr->result =
 	    (char *) "too many nested calls to Hax_Eval (infinite loop?)";
 	result = HAX_ERROR;
 	goto finish;
     }
+    iPtr->numLevels++;
+    iPtr->evalDepth++;
 
     /*
      * Initialize the area in which command copies will be assembled.
      */
 
+    HaxScratchMark(iPtr, &evalMark);
     pv.buffer = copyStorage;
     pv.end = copyStorage + NUM_CHARS - 1;
-    pv.expandProc = HaxExpandParseValue;
+    pv.expandProc = HaxExpandScratchParseValue;
     pv.clientData = (ClientData) NULL;
 
     src = cmd;
@@ -561,6 +811,7 @@ Hax_Eval(
 	while (1) {
 	    int newArgs, maxArgs;
 	    char **newArgv;
+	    Hax_Obj **newRefs;
 	    int i;
 
 	    /*
@@ -573,9 +824,11 @@ Hax_Eval(
 
 	    maxArgs = argSize - argc - 2;
 	    result = HaxParseWords((Hax_Interp *) iPtr, src, flags,
-		    maxArgs, termPtr, &newArgs, &argv[argc], &pv);
+		    maxArgs, termPtr, &newArgs, &argv[argc], &refs[argc],
+		    &pv);
 	    src = *termPtr;
 	    if (result != HAX_OK) {
+		ReleaseWords(iPtr, refs, argc);
 		ellipsis = "...";
 		goto done;
 	    }
@@ -590,7 +843,9 @@ Hax_Eval(
 		int i;
 
 		for (i = 0; i < argc; i++) {
-		    argv[i] = pv.buffer + (argv[i] - oldBuffer);
+		    if (refs[i] == NULL) {
+			argv[i] = pv.buffer + (argv[i] - oldBuffer);
+		    }
 		}
 		oldBuffer = pv.buffer;
 	    }
@@ -605,15 +860,16 @@ Hax_Eval(
 	     */
 
 	    argSize *= 2;
-	    newArgv = (char **)
-		    ckalloc(memoryp, (unsigned) argSize * sizeof(char *));
+	    newArgv = (char **) HaxScratchAlloc(iPtr,
+		    argSize * (int) sizeof(char *));
+	    newRefs = (Hax_Obj **) HaxScratchAlloc(iPtr,
+		    argSize * (int) sizeof(Hax_Obj *));
 	    for (i = 0; i < argc; i++) {
 		newArgv[i] = argv[i];
-	    }
-	    if (argv != argStorage) {
-		ckfree(memoryp, (char *) argv);
+		newRefs[i] = refs[i];
 	    }
 	    argv = newArgv;
+	    refs = newRefs;
 	}
 
 	/*
@@ -623,6 +879,7 @@ Hax_Eval(
 	 */
 
 	if ((argc == 0) || iPtr->noEval) {
+	    ReleaseWords(iPtr, refs, argc);
 	    continue;
 	}
 	argv[argc] = NULL;
@@ -652,17 +909,29 @@ Hax_Eval(
 		Hax_ResetResult(interp);
 		Hax_AppendResult(interp, "invalid command name: \"",
 			argv[0], "\"", (char *) NULL);
+		ReleaseWords(iPtr, refs, argc);
 		result = HAX_ERROR;
 		goto done;
 	    }
 	    for (i = argc; i >= 0; i--) {
 		argv[i+1] = argv[i];
 	    }
+	    for (i = argc-1; i >= 0; i--) {
+		refs[i+1] = refs[i];
+	    }
 	    argv[0] = (char *) "unknown";
+	    refs[0] = NULL;
 	    argc++;
 	}
 	cmdPtr = (Command *) Hax_GetHashValue(hPtr);
 
+	/*
+	 * Anything the command puts in the scratch space is given back
+	 * as soon as it returns.
+	 */
+
+	HaxScratchMark(iPtr, &cmdMark);
+
 	/*
 	 * Call trace procedures, if any.
 	 */
@@ -685,14 +954,34 @@ Hax_Eval(
 	 * At long last, invoke the command procedure.  Reset the
 	 * result to its default empty value first (it could have
 	 * gotten changed by earlier commands in the same command
-	 * string).
+	 * string).  If some words were passed by reference and the
+	 * command has an object procedure, call that, so that it gets
+	 * the values themselves;  a string procedure gets pointers to
+	 * their strings, which stay valid until the references are
+	 * released below.
 	 */
 
 	iPtr->cmdCount++;
 	Hax_FreeResult((Hax_Interp *) iPtr);
+	HaxReleaseObjResult(iPtr);
 	iPtr->result = iPtr->resultSpace;
 	iPtr->resultSpace[0] = 0;
-	result = (*cmdPtr->proc)(cmdPtr->clientData, interp, argc, argv);
+	haveRefs = 0;
+	for (i = 0; i < argc; i++) {
+	    if (refs[i] != NULL) {
+		haveRefs = 1;
+		break;
+	    }
+	}
+	if (haveRefs && (cmdPtr->objProc != NULL)) {
+	    result = HaxInvokeObjv(iPtr, cmdPtr, argc, argv, refs);
+	} else {
+	    result = (*cmdPtr->proc)(cmdPtr->clientData, interp, argc, argv);
+	}
+	if (haveRefs) {
+	    ReleaseWords(iPtr, refs, argc);
+	}
+	HaxScratchRelease(iPtr, &cmdMark);
 	if (result != HAX_OK) {
 	    break;
 	}
@@ -703,13 +992,9 @@ Hax_Eval(
      */
 
     done:
-    if (pv.buffer != copyStorage) {
-	ckfree(memoryp, (char *) pv.buffer);
-    }
-    if (argv != argStorage) {
-	ckfree(memoryp, (char *) argv);
-    }
+    HaxScratchRelease(iPtr, &evalMark);
     iPtr->numLevels--;
+    iPtr->evalDepth--;
     if (iPtr->numLevels == 0) {
 	if (result == HAX_RETURN) {
 	    result = HAX_OK;
@@ -769,25 +1054,202 @@ Hax_Eval(
 	    numChars = NUM_CHARS-50;
 	    ellipsis = " ...";
 	}
-
-	if (!(iPtr->flags & ERR_IN_PROGRESS)) {
-	    sprintf(copyStorage, "\n    while executing\n\"%.*s%s\"",
-		    numChars, cmdStart, ellipsis);
-	} else {
-	    sprintf(copyStorage, "\n    invoked from within\n\"%.*s%s\"",
-		    numChars, cmdStart, ellipsis);
-	}
-	Hax_AddErrorInfo(interp, copyStorage);
+	HaxLogErrorCommand(iPtr, cmdStart, numChars, ellipsis);
 	iPtr->flags &= ~ERR_ALREADY_LOGGED;
     } else {
 	iPtr->flags &= ~ERR_ALREADY_LOGGED;
     }
 
+    /*
+     * Once an error gets back to top level, store the information
+     * about it in errorInfo and errorCode.
+     */
+
+    if (iPtr->numLevels == 0) {
+	HaxFlushPendingError(iPtr);
+    }
+
 finish:
     iPtr->scriptFile = oldScriptFile;
     return result;
 }
 
+/*
+ *-----------------------------------------------------------------
+ *
+ * Hax_EvalObjv --
+ *
+ *	Execute a single command whose words are already available
+ *	as values, without parsing or substituting anything.
+ *
+ * Results:
+ *	The return value is one of the return codes defined in hax.h
+ *	(such as HAX_OK), and interp->result contains a string value
+ *	to supplement the return code, just as for Hax_Eval.
+ *
+ * Side effects:
+ *	Almost certainly;  depends on the command.
+ *
+ *-----------------------------------------------------------------
+ */
+
+int
+Hax_EvalObjv(
+    Hax_Interp *interp,		/* Token for command interpreter (returned
+				 * by a previous call to Hax_CreateInterp). */
+    int objc,			/* Number of words in command. */
+    Hax_Obj **objv		/* The words of the command:  objv[0] is
+				 * the name of the command. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_HashEntry *hPtr;
+    Command *cmdPtr;
+    Trace *tracePtr;
+    ScratchMark mark;
+    Hax_Obj *unknownPtr = NULL;
+    char **argv;
+    char *cmd;
+    int i, result;
+
+    Hax_ResetResult(interp);
+    if (objc == 0) {
+	return HAX_OK;
+    }
+    if (iPtr->evalDepth >= MAX_NESTING_DEPTH) {
+	iPtr->result =
+	    (char *) "too many nested calls to Hax_Eval (infinite loop?)";
+	return HAX_ERROR;
+    }
+    iPtr->numLevels++;
+    iPtr->evalDepth++;
+    iPtr->flags &= ~(ERR_IN_PROGRESS | ERROR_CODE_SET);
+
+    /*
+     * Make room for the string forms of the words, plus a slot for
+     * "unknown" and one for the NULL at the end, just as in Hax_Eval.
+     */
+
+    HaxScratchMark(iPtr, &mark);
+    argv = (char **) HaxScratchAlloc(iPtr,
+	    (int) ((objc + 2) * sizeof(char *)));
+    for (i = 0; i < objc; i++) {
+	argv[i] = Hax_GetStringFromObj(interp, objv[i], (int *) NULL);
+    }
+    argv[objc] = NULL;
+
+    hPtr = Hax_FindHashEntry(&iPtr->commandTable, argv[0]);
+    if (hPtr == NULL) {
+	Hax_Obj **newObjv;
+
+	hPtr = Hax_FindHashEntry(&iPtr->commandTable, (char *) "unknown");
+	if (hPtr == NULL) {
+	    Hax_AppendResult(interp, "invalid command name: \"",
+		    argv[0], "\"", (char *) NULL);
+	    result = HAX_ERROR;
+	    goto done;
+	}
+	for (i = objc; i >= 0; i--) {
+	    argv[i+1] = argv[i];
+	}
+	argv[0] = (char *) "unknown";
+	newObjv = (Hax_Obj **) HaxScratchAlloc(iPtr,
+		(int) ((objc + 1) * sizeof(Hax_Obj *)));
+	unknownPtr = Hax_NewStringObj(interp, argv[0], -1);
+	Hax_IncrRefCount(unknownPtr);
+	newObjv[0] = unknownPtr;
+	for (i = 0; i < objc; i++) {
+	    newObjv[i+1] = objv[i];
+	}
+	objv = newObjv;
+	objc++;
+    }
+    cmdPtr = (Command *) Hax_GetHashValue(hPtr);
+
+    /*
+     * Call trace procedures, if any.  They get the words merged
+     * into a list as the text of the command.
+     */
+
+    cmd = NULL;
+    for (tracePtr = iPtr->tracePtr; tracePtr != NULL;
+	    tracePtr = tracePtr->nextPtr) {
+	if (tracePtr->level < iPtr->numLevels) {
+	    continue;
+	}
+	if (cmd == NULL) {
+	    cmd = Hax_Merge(interp, objc, argv);
+	}
+	(*tracePtr->proc)(tracePtr->clientData, interp, iPtr->numLevels,
+		cmd, cmdPtr->proc, cmdPtr->clientData, objc, argv);
+    }
+    if (cmd != NULL) {
+	ckfree(memoryp, cmd);
+    }
+
+    iPtr->cmdCount++;
+    if (cmdPtr->objProc != NULL) {
+	result = (*cmdPtr->objProc)(cmdPtr->objClientData, interp, objc,
+		objv);
+    } else {
+	result = (*cmdPtr->proc)(cmdPtr->clientData, interp, objc, argv);
+    }
+
+    done:
+    iPtr->numLevels--;
+    iPtr->evalDepth--;
+    if (iPtr->numLevels == 0) {
+	if (result == HAX_RETURN) {
+	    result = HAX_OK;
+	}
+	if ((result != HAX_OK) && (result != HAX_ERROR)) {
+	    Hax_ResetResult(interp);
+	    if (result == HAX_BREAK) {
+		iPtr->result = (char *) "invoked \"break\" outside of a loop";
+	    } else if (result == HAX_CONTINUE) {
+		iPtr->result =
+		    (char *) "invoked \"continue\" outside of a loop";
+	    } else {
+		iPtr->result = iPtr->resultSpace;
+		sprintf(iPtr->resultSpace,
+		    (char *) "command returned bad code: %d", result);
+	    }
+	    result = HAX_ERROR;
+	}
+    }
+
+    /*
+     * If an error occurred, record the command in errorInfo, the same
+     * way Hax_Eval does.
+     */
+
+    if ((result == HAX_ERROR) && !(iPtr->flags & ERR_ALREADY_LOGGED)) {
+	const char *ellipsis = "";
+	int numChars;
+
+	cmd = Hax_Merge(interp, objc, argv);
+	numChars = strlen(cmd);
+	if (numChars > 150) {
+	    numChars = 150;
+	    ellipsis = " ...";
+	}
+	HaxLogErrorCommand(iPtr, cmd, numChars, ellipsis);
+	ckfree(memoryp, cmd);
+    }
+    iPtr->flags &= ~ERR_ALREADY_LOGGED;
+    if (iPtr->numLevels == 0) {
+	HaxFlushPendingError(iPtr);
+    }
+    if (unknownPtr != NULL) {
+	Hax_DecrRefCount(interp, unknownPtr);
+    }
+    HaxScratchRelease(iPtr, &mark);
+    if ((iPtr->numLevels == 0) && (iPtr->flags & DELETED)) {
+	Hax_DeleteInterp(interp);
+    }
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -897,6 +1359,136 @@ Hax_DeleteTrace(
     }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddErrorFrame --
+ *
+ *	Add a frame to the errorInfo text being recorded for the
+ *	current error.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The characters are copied into iPtr->errorText, and the
+ *	frame and text arrays are grown if necessary.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddErrorFrame(
+    Interp *iPtr,		/* Interpreter in which error occurred. */
+    int kind,			/* ERROR_FRAME_TEXT, etc. */
+    const char *text,		/* Characters to record. */
+    int length,			/* Number of characters at text. */
+    const char *ellipsis)	/* Static string to add after a command,
+				 * or "". */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ErrorFrame *framePtr;
+
+    if (iPtr->numErrorFrames >= iPtr->errorFramesAvl) {
+	ErrorFrame *newFrames;
+	int newAvl;
+
+	newAvl = 2*iPtr->errorFramesAvl + 8;
+	newFrames = (ErrorFrame *) ckalloc(memoryp,
+		(unsigned) (newAvl * sizeof(ErrorFrame)));
+	if (iPtr->errorFrames != NULL) {
+	    memcpy(newFrames, iPtr->errorFrames,
+		    iPtr->numErrorFrames * sizeof(ErrorFrame));
+	    ckfree(memoryp, (char *) iPtr->errorFrames);
+	}
+	iPtr->errorFrames = newFrames;
+	iPtr->errorFramesAvl = newAvl;
+    }
+    if (iPtr->errorTextUsed + length > iPtr->errorTextAvl) {
+	char *newText;
+	int newAvl;
+
+	newAvl = 2*(iPtr->errorTextUsed + length) + 200;
+	newText = (char *) ckalloc(memoryp, (unsigned) newAvl);
+	if (iPtr->errorText != NULL) {
+	    memcpy(newText, iPtr->errorText,
+		    iPtr->errorTextUsed);
+	    ckfree(memoryp, iPtr->errorText);
+	}
+	iPtr->errorText = newText;
+	iPtr->errorTextAvl = newAvl;
+    }
+    framePtr = &iPtr->errorFrames[iPtr->numErrorFrames];
+    framePtr->kind = kind;
+    framePtr->start = iPtr->errorTextUsed;
+    framePtr->length = length;
+    framePtr->ellipsis = ellipsis;
+    memcpy((iPtr->errorText + iPtr->errorTextUsed),
+	    text, length);
+    iPtr->errorTextUsed += length;
+    iPtr->numErrorFrames++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ErrorVarProc --
+ *
+ *	This procedure is the trace set on the global errorInfo and
+ *	errorCode variables while text for them is being recorded.
+ *
+ * Results:
+ *	Always returns NULL.
+ *
+ * Side effects:
+ *	Reading either variable stores the pending text in both of
+ *	them.  Setting or unsetting one of them throws away the text
+ *	pending for it, since the new value replaces it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+	/* ARGSUSED */
+static char *
+ErrorVarProc(
+    ClientData clientData,	/* ERR_INFO_TRACED or ERR_CODE_TRACED, to
+				 * say which variable this is. */
+    Hax_Interp *interp,		/* Interpreter containing variable. */
+    char *name1,		/* Not used. */
+    char *name2,		/* Not used. */
+    int flags)			/* Information about what happened. */
+{
+    Interp *iPtr = (Interp *) interp;
+    int which = (int) (long) clientData;
+
+    if (flags & HAX_TRACE_READS) {
+	HaxFlushPendingError(iPtr);
+	return NULL;
+    }
+    if (which == ERR_INFO_TRACED) {
+	if (iPtr->flags & ERR_INFO_PENDING) {
+	    iPtr->numErrorFrames = 0;
+	    iPtr->errorTextUsed = 0;
+	    iPtr->flags &= ~ERR_INFO_PENDING;
+
+	    /*
+	     * If the error is still unwinding, the rest of its text
+	     * goes after the value just stored.
+	     */
+
+	    if (iPtr->flags & ERR_IN_PROGRESS) {
+		iPtr->flags |= ERR_INFO_APPEND;
+	    }
+	}
+    } else {
+	iPtr->flags &= ~ERR_CODE_PENDING;
+    }
+    if (flags & HAX_TRACE_DESTROYED) {
+	iPtr->flags &= ~which;
+    }
+    return NULL;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -912,6 +1504,8 @@ Hax_DeleteTrace(
  *	The contents of message are added to the "errorInfo" variable.
  *	If Hax_Eval has been called since the current value of errorInfo
  *	was set, errorInfo is cleared before adding the new message.
+ *	The variables aren't actually set until they are used (see
+ *	HaxFlushErrorInfo).
  *
  *----------------------------------------------------------------------
  */
@@ -924,33 +1518,171 @@ Hax_AddErrorInfo(
 {
     Interp *iPtr = (Interp *) interp;
 
-    /*
-     * If an error is already being logged, then the new errorInfo
-     * is the concatenation of the old info and the new message.
-     * If this is the first piece of info for the error, then the
-     * new errorInfo is the concatenation of the message in
-     * interp->result and the new message.
-     */
+    if (!(iPtr->flags & ERR_IN_PROGRESS)) {
+	HaxLogErrorCommand(iPtr, (char *) NULL, 0, "");
+    }
+    AddErrorFrame(iPtr, ERROR_FRAME_TEXT, message, (int) strlen(message), "");
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxLogErrorCommand --
+ *
+ *	Record in errorInfo the command that was being executed when an
+ *	error occurred, in the same form that Hax_AddErrorInfo would be
+ *	given it:  "while executing" for the command where the error
+ *	happened and "invoked from within" for the ones it unwinds
+ *	through.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If an error is already being logged, then the command is added
+ *	to the text for it.  If this is the first piece of information
+ *	for the error, then the text starts with the message in
+ *	interp->result, and errorCode will be set to "NONE" unless the
+ *	code that generated the error set it.  If cmd is NULL only this
+ *	first step is done.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxLogErrorCommand(
+    Interp *iPtr,		/* Interpreter in which error occurred. */
+    char *cmd,			/* First character of command, or NULL. */
+    int numChars,		/* Number of characters of the command to
+				 * record. */
+    const char *ellipsis)	/* Static string to add after them:  "..."
+				 * or " ..." if that isn't all of the
+				 * command, else "". */
+{
+    int kind = ERROR_FRAME_INVOKED;
 
     if (!(iPtr->flags & ERR_IN_PROGRESS)) {
-	Hax_SetVar2(interp, (char *) "errorInfo", (char *) NULL,
-		interp->result, HAX_GLOBAL_ONLY);
-	iPtr->flags |= ERR_IN_PROGRESS;
+	int which;
 
 	/*
-	 * If the errorCode variable wasn't set by the code that generated
-	 * the error, set it to "NONE".
+	 * The traces that store the text when a variable is used only
+	 * need to be set once, unless a variable is unset.
 	 */
 
+	for (which = ERR_INFO_TRACED; which <= ERR_CODE_TRACED;
+		which <<= 1) {
+	    if (!(iPtr->flags & which)) {
+		iPtr->flags |= which;
+		Hax_TraceVar2((Hax_Interp *) iPtr, (char *)
+			((which == ERR_INFO_TRACED) ? "errorInfo"
+			: "errorCode"), (char *) NULL,
+			HAX_GLOBAL_ONLY|HAX_TRACE_READS|HAX_TRACE_WRITES
+			|HAX_TRACE_UNSETS, ErrorVarProc,
+			(ClientData) (long) which);
+	    }
+	}
+	iPtr->numErrorFrames = 0;
+	iPtr->errorTextUsed = 0;
+	iPtr->flags = (iPtr->flags & ~(ERR_INFO_APPEND|ERR_CODE_PENDING))
+		| ERR_IN_PROGRESS;
 	if (!(iPtr->flags & ERROR_CODE_SET)) {
-	    (void) Hax_SetVar2(interp, (char *) "errorCode", (char *) NULL,
-		    (char *) "NONE", HAX_GLOBAL_ONLY);
+	    iPtr->flags |= ERR_CODE_PENDING;
 	}
+	AddErrorFrame(iPtr, ERROR_FRAME_TEXT, iPtr->result,
+		(int) strlen(iPtr->result), "");
+	kind = ERROR_FRAME_EXECUTING;
+    }
+    iPtr->flags |= ERR_INFO_PENDING;
+    if (cmd != NULL) {
+	AddErrorFrame(iPtr, kind, cmd, numChars, ellipsis);
     }
-    Hax_SetVar2(interp, (char *) "errorInfo", (char *) NULL, message,
-	    HAX_GLOBAL_ONLY|HAX_APPEND_VALUE);
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxFlushErrorInfo --
+ *
+ *	Store the text recorded for the current error in the errorInfo
+ *	and errorCode variables.  This is called when either variable
+ *	is read, and when an error gets back to top level.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The variables are set, and the recorded frames are discarded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxFlushErrorInfo(
+    Interp *iPtr)		/* Interpreter whose error is to be
+				 * stored. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    int flags = iPtr->flags;
+    ErrorFrame *framePtr;
+    char *info, *dst;
+    int i, length;
+
+    /*
+     * Clear the flags first:  setting the variables below calls
+     * ErrorVarProc (unless it is the caller).  Anything added by the
+     * rest of an error that is still unwinding goes after this text.
+     */
+
+    iPtr->flags &= ~(ERR_INFO_PENDING|ERR_CODE_PENDING|ERR_INFO_APPEND);
+    if (iPtr->flags & ERR_IN_PROGRESS) {
+	iPtr->flags |= ERR_INFO_APPEND;
+    }
+    if (flags & ERR_INFO_PENDING) {
+	length = 0;
+	for (i = 0; i < iPtr->numErrorFrames; i++) {
+	    /*
+	     * 27 covers the longer of the two headers and the closing
+	     * quote.
+	     */
+
+	    length += iPtr->errorFrames[i].length
+		    + strlen(iPtr->errorFrames[i].ellipsis) + 27;
+	}
+	info = dst = (char *) ckalloc(memoryp, (unsigned) (length + 1));
+	for (i = 0; i < iPtr->numErrorFrames; i++) {
+	    framePtr = &iPtr->errorFrames[i];
+	    if (framePtr->kind == ERROR_FRAME_EXECUTING) {
+		strcpy(dst, "\n    while executing\n\"");
+		dst += strlen(dst);
+	    } else if (framePtr->kind == ERROR_FRAME_INVOKED) {
+		strcpy(dst, "\n    invoked from within\n\"");
+		dst += strlen(dst);
+	    }
+	    memcpy(dst,
+		    (iPtr->errorText + framePtr->start),
+		    framePtr->length);
+	    dst += framePtr->length;
+	    if (framePtr->kind != ERROR_FRAME_TEXT) {
+		strcpy(dst, framePtr->ellipsis);
+		dst += strlen(dst);
+		*dst = '"';
+		dst++;
+	    }
+	}
+	*dst = 0;
+	iPtr->numErrorFrames = 0;
+	iPtr->errorTextUsed = 0;
+	Hax_SetVar2((Hax_Interp *) iPtr, (char *) "errorInfo", (char *) NULL,
+		info, HAX_GLOBAL_ONLY
+		| ((flags & ERR_INFO_APPEND) ? HAX_APPEND_VALUE : 0));
+	ckfree(memoryp, info);
+    }
+    if (flags & ERR_CODE_PENDING) {
+	(void) Hax_SetVar2((Hax_Interp *) iPtr, (char *) "errorCode",
+		(char *) NULL, (char *) "NONE", HAX_GLOBAL_ONLY);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1062,6 +1794,42 @@ Hax_GlobalEval(
     iPtr->varFramePtr = savedVarFramePtr;
     return result;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_SetEvalBudget --
+ *
+ *	Set the amount of memory that an interpreter may use to keep
+ *	track of nested scripts, procedure calls and command
+ *	substitutions, which limits how deeply they can be nested.
+ *
+ * Results:
+ *	The previous budget, in bytes.
+ *
+ * Side effects:
+ *	If bytes is greater than zero it becomes the new budget;
+ *	otherwise the budget is unchanged.  A script that would start
+ *	when more than the budget is in use fails with a "too many
+ *	nested calls" error.
+ *
+ *----------------------------------------------------------------------
+ */
+
+long
+Hax_SetEvalBudget(
+    Hax_Interp *interp,		/* Interpreter whose budget is to be
+				 * set. */
+    long bytes)			/* New budget, or <= 0 to just query. */
+{
+    Interp *iPtr = (Interp *) interp;
+    long old = iPtr->evalBudget;
+
+    if (bytes > 0) {
+	iPtr->evalBudget = bytes;
+    }
+    return old;
+}
 
 /*
  *----------------------------------------------------------------------
@@ -33,7 +33,56 @@ struct mem_header {
         char               body[1];
 };
 
+/*
+ * Small blocks are carved out of SLAB_PAGE_SIZE byte pages, one size
+ * class per page.  Every block, small or large, is preceded by a
+ * SlabBlock that names the page it came from (NULL for blocks too big
+ * for any class, which come from malloc);  while a small block is free
+ * the same word links it into its page's free list.
+ */
+
+#define SLAB_PAGE_SIZE		16384
+#define SLAB_NUM_CLASSES	13
+#define SLAB_MAX_SIZE		512
+
+typedef union SlabBlock {
+        struct SlabPage *pagePtr;   /* Page holding an allocated block */
+        union SlabBlock *nextPtr;   /* Next free block in the page */
+        double           align;     /* Forces alignment of the body */
+        long long int    align2;
+} SlabBlock;
+
+typedef struct SlabPage {
+        struct SlabPage *nextPtr;   /* Other pages of the same class with */
+        struct SlabPage *prevPtr;   /* free blocks, or NULL */
+        SlabBlock       *freePtr;   /* First free block in this page */
+        int              classIdx;  /* Size class of all blocks here */
+        int              inUse;     /* Number of blocks allocated */
+} SlabPage;
+
+typedef struct SlabClass {
+        SlabPage         *availPtr; /* Pages with at least one free block */
+        unsigned long int pages;    /* Pages owned by the class */
+        unsigned long int inUse;    /* Blocks allocated from the class */
+} SlabClass;
+
+/*
+ * Block sizes, header included, of each class.  They are multiples of
+ * 16 so that all the bodies in a page have the same alignment.
+ */
+
+static const unsigned short slabSizes[SLAB_NUM_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 128, 160, 192, 256, 320, 384, 512
+};
+
+#define SLAB_PAGE_HEADER	((sizeof(SlabPage) + 15) & ~15)
+#define SLAB_PAGE_BLOCKS(idx)	\
+	((SLAB_PAGE_SIZE - SLAB_PAGE_HEADER) / slabSizes[idx])
+
 typedef struct Memoryp {
+        int                release;   /* Non-zero means no debugging:
+                                       * blocks have no mem_header and
+                                       * no guard bands */
         struct mem_header *allocHead; /* List of allocated structures */
         long long int      total_mallocs;
         long long int      total_frees;
@@ -46,12 +95,276 @@ typedef struct Memoryp {
         int                alloc_tracing;
         int                init_malloced_bodies;
         int                validate_memory;
+        int                validate_budget;   /* Blocks checked per call
+                                               * when validating;  zero
+                                               * means all of them */
+        struct mem_header *validateNext;      /* Next block for the
+                                               * incremental validator */
+        SlabClass          slabs[SLAB_NUM_CLASSES];
+        unsigned long int  large_blocks;      /* Blocks too big for any
+                                               * class, from malloc */
 } Memoryp;
 
 #define GUARD_VALUE  0341
 
+/*
+ * Number of blocks checked on each allocation and free when validation
+ * is on.  The blocks are visited round-robin, so every live block is
+ * checked once every current_malloc_packets / DEFAULT_VALIDATE_BUDGET
+ * calls while keeping the cost per call bounded.
+ */
+
+#define DEFAULT_VALIDATE_BUDGET	8
+
 /* static char high_guard[] = {0x89, 0xab, 0xcd, 0xef}; */
 
+/*
+ * Compiling with HAX_RELEASE_MEMORY makes every memory context a
+ * release context.
+ */
+
+#ifdef HAX_RELEASE_MEMORY
+#define FORCE_RELEASE	TRUE
+#else
+#define FORCE_RELEASE	FALSE
+#endif
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlabAlloc --
+ *     Allocate a block of at least size bytes, from a page of the
+ *     smallest class that holds it, or from malloc for big blocks.
+ *
+ * Results:
+ *     The address of the block's body, or NULL if the system is out
+ *     of memory.
+ *
+ * Side effects:
+ *     A new page is allocated if the class has no free blocks.
+ *
+ *----------------------------------------------------------------------
+ */
+static void *
+SlabAlloc(
+    Memoryp          *memCtx,
+    unsigned long int size)
+{
+    SlabBlock *blockPtr;
+    unsigned long int need = size + sizeof(SlabBlock);
+#ifndef HAX_NO_SLABS
+    SlabPage *pagePtr;
+    SlabClass *classPtr;
+    int idx;
+    char *first, *p;
+
+    if (need <= SLAB_MAX_SIZE) {
+	for (idx = 0; slabSizes[idx] < need; idx++) {
+	    /* Empty loop body. */
+	}
+	classPtr = &memCtx->slabs[idx];
+	pagePtr = classPtr->availPtr;
+	if (pagePtr == NULL) {
+	    pagePtr = (SlabPage *) malloc(SLAB_PAGE_SIZE);
+	    if (pagePtr == NULL) {
+		return NULL;
+	    }
+	    pagePtr->nextPtr = pagePtr->prevPtr = NULL;
+	    pagePtr->freePtr = NULL;
+	    pagePtr->classIdx = idx;
+	    pagePtr->inUse = 0;
+
+	    /*
+	     * Carve the page up, leaving the blocks on its free list in
+	     * address order.
+	     */
+
+	    first = ((char *) pagePtr) + SLAB_PAGE_HEADER;
+	    for (p = first + SLAB_PAGE_BLOCKS(idx)*slabSizes[idx];
+		    p > first; ) {
+		p -= slabSizes[idx];
+		blockPtr = (SlabBlock *) p;
+		blockPtr->nextPtr = pagePtr->freePtr;
+		pagePtr->freePtr = blockPtr;
+	    }
+	    classPtr->availPtr = pagePtr;
+	    classPtr->pages++;
+	}
+	blockPtr = pagePtr->freePtr;
+	pagePtr->freePtr = blockPtr->nextPtr;
+	pagePtr->inUse++;
+	classPtr->inUse++;
+	if (pagePtr->freePtr == NULL) {
+	    classPtr->availPtr = pagePtr->nextPtr;
+	    if (pagePtr->nextPtr != NULL) {
+		pagePtr->nextPtr->prevPtr = NULL;
+	    }
+	    pagePtr->nextPtr = NULL;
+	}
+	blockPtr->pagePtr = pagePtr;
+	return (void *) (blockPtr + 1);
+    }
+#endif
+
+    blockPtr = (SlabBlock *) malloc(need);
+    if (blockPtr == NULL) {
+	return NULL;
+    }
+    blockPtr->pagePtr = NULL;
+    memCtx->large_blocks++;
+    return (void *) (blockPtr + 1);
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlabFree --
+ *     Give back a block obtained from SlabAlloc.
+ *
+ * Results:
+ *     None.
+ *
+ * Side effects:
+ *     A page whose blocks are all free is returned to the system,
+ *     unless it is the only page of its class with free blocks.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+SlabFree(
+    Memoryp *memCtx,
+    void    *ptr)
+{
+    SlabBlock *blockPtr = ((SlabBlock *) ptr) - 1;
+    SlabPage *pagePtr = blockPtr->pagePtr;
+    SlabClass *classPtr;
+
+    if (pagePtr == NULL) {
+	memCtx->large_blocks--;
+	free((char *) blockPtr);
+	return;
+    }
+    classPtr = &memCtx->slabs[pagePtr->classIdx];
+    classPtr->inUse--;
+    pagePtr->inUse--;
+    if (pagePtr->freePtr == NULL) {
+	/*
+	 * The page was full, so it isn't on the available list yet.
+	 */
+
+	pagePtr->prevPtr = NULL;
+	pagePtr->nextPtr = classPtr->availPtr;
+	if (classPtr->availPtr != NULL) {
+	    classPtr->availPtr->prevPtr = pagePtr;
+	}
+	classPtr->availPtr = pagePtr;
+    } else if ((pagePtr->inUse == 0)
+	    && ((pagePtr->prevPtr != NULL) || (pagePtr->nextPtr != NULL))) {
+	if (pagePtr->prevPtr != NULL) {
+	    pagePtr->prevPtr->nextPtr = pagePtr->nextPtr;
+	} else {
+	    classPtr->availPtr = pagePtr->nextPtr;
+	}
+	if (pagePtr->nextPtr != NULL) {
+	    pagePtr->nextPtr->prevPtr = pagePtr->prevPtr;
+	}
+	classPtr->pages--;
+	free((char *) pagePtr);
+	return;
+    }
+    blockPtr->nextPtr = pagePtr->freePtr;
+    pagePtr->freePtr = blockPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlabRealloc --
+ *     Change the size of a block obtained from SlabAlloc.
+ *
+ * Results:
+ *     The address of the resized block, or NULL if the system is out
+ *     of memory, in which case the old block is left alone.
+ *
+ * Side effects:
+ *     The contents may move to a new block.
+ *
+ *----------------------------------------------------------------------
+ */
+static void *
+SlabRealloc(
+    Memoryp          *memCtx,
+    void             *ptr,
+    unsigned long int size)
+{
+    SlabBlock *blockPtr = ((SlabBlock *) ptr) - 1;
+    unsigned long int oldSize;
+    void *newPtr;
+
+    /*
+     * A large block doesn't record its size, so it stays a malloc
+     * block even if it shrinks enough to fit in a class.
+     */
+
+    if (blockPtr->pagePtr == NULL) {
+	blockPtr = (SlabBlock *) realloc((char *) blockPtr,
+		size + sizeof(SlabBlock));
+	return (blockPtr == NULL) ? NULL : (void *) (blockPtr + 1);
+    }
+    oldSize = slabSizes[blockPtr->pagePtr->classIdx] - sizeof(SlabBlock);
+    if (size <= oldSize) {
+	return ptr;
+    }
+    newPtr = SlabAlloc(memCtx, size);
+    if (newPtr == NULL) {
+	return NULL;
+    }
+    memcpy(newPtr, ptr, oldSize);
+    SlabFree(memCtx, ptr);
+    return newPtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SlabInfo --
+ *     Describe the occupancy of each size class, for the "memory
+ *     slabs" command.
+ *
+ * Results:
+ *     None.
+ *
+ * Side effects:
+ *     Appends one element per class to interp's result, followed by
+ *     the number of blocks that came straight from malloc.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+SlabInfo(
+    Memoryp    *memCtx,
+    Hax_Interp *interp)
+{
+    SlabClass *classPtr;
+    char buffer[200];
+    int idx;
+
+    for (idx = 0; idx < SLAB_NUM_CLASSES; idx++) {
+	classPtr = &memCtx->slabs[idx];
+	sprintf(buffer, "%d {pages %lu used %lu free %lu}",
+		(int) (slabSizes[idx] - sizeof(SlabBlock)), classPtr->pages,
+		classPtr->inUse,
+		classPtr->pages*SLAB_PAGE_BLOCKS(idx) - classPtr->inUse);
+	Hax_AppendElement(interp, buffer, 0);
+    }
+    sprintf(buffer, "large %lu", memCtx->large_blocks);
+    Hax_AppendElement(interp, buffer, 0);
+}
+
 
 /*
  *----------------------------------------------------------------------
@@ -168,6 +481,48 @@ Hax_ValidateAllMemory (
 
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * ValidateSomeMemory --
+ *     Validates guard regions for the next validate_budget allocated
+ *     blocks, carrying on from where the previous call stopped and
+ *     wrapping around to the start of the list.  A budget of zero
+ *     turns incremental validation off and validates all allocated
+ *     memory each time.
+ *
+ *----------------------------------------------------------------------
+ */
+static void
+ValidateSomeMemory (
+    Memoryp *memCtx,
+    char    *file,
+    int      line)
+{
+    struct mem_header *memScanP;
+    unsigned long int count;
+
+    if (memCtx->validate_budget <= 0) {
+        Hax_ValidateAllMemory ((Hax_Memoryp *) memCtx, file, line);
+        return;
+    }
+
+    count = memCtx->current_malloc_packets;
+    if (count > (unsigned long int) memCtx->validate_budget)
+        count = memCtx->validate_budget;
+    memScanP = memCtx->validateNext;
+    while (count-- > 0) {
+        if (memScanP == NULL) {
+            memScanP = memCtx->allocHead;
+            if (memScanP == NULL)
+                break;
+        }
+        ValidateMemory (memCtx, memScanP, file, line, FALSE);
+        memScanP = memScanP->flink;
+    }
+    memCtx->validateNext = memScanP;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -229,10 +584,13 @@ Hax_DbCkalloc(
     Memoryp           *memCtx = (Memoryp *) memoryp;
     struct mem_header *result;
 
+    if (memCtx->release)
+        return Hax_Ckalloc(memoryp, size);
+
     if (memCtx->validate_memory)
-        Hax_ValidateAllMemory (memoryp, file, line);
+        ValidateSomeMemory (memCtx, file, line);
 
-    result = (struct mem_header *)malloc(size +
+    result = (struct mem_header *) SlabAlloc(memCtx, size +
                               sizeof(struct mem_header) + GUARD_SIZE);
     if (result == NULL) {
         dump_memory_info(memCtx);
@@ -322,6 +680,10 @@ Hax_DbCkfree(
 	Hax_Panic ((char *) "Cannot free memory at addres 0x0, %s line %d",
 	    file, line);
     }
+    if (memCtx->release) {
+        SlabFree(memCtx, ptr);
+        return 0;
+    }
 
     /*
      * Since header ptr is zero, body offset will be size
@@ -334,7 +696,7 @@ Hax_DbCkfree(
                 memp->length, file, line);
 
     if (memCtx->validate_memory)
-        Hax_ValidateAllMemory (memoryp, file, line);
+        ValidateSomeMemory (memCtx, file, line);
 
     ValidateMemory (memCtx, memp, file, line, TRUE);
 
@@ -343,15 +705,18 @@ Hax_DbCkfree(
     memCtx->current_bytes_malloced -= memp->length;
 
     /*
-     * Delink from allocated list
+     * Delink from allocated list, moving the incremental validator
+     * past the block if it was due to be checked next.
      */
+    if (memCtx->validateNext == memp)
+        memCtx->validateNext = memp->flink;
     if (memp->flink != NULL)
         memp->flink->blink = memp->blink;
     if (memp->blink != NULL)
         memp->blink->flink = memp->flink;
     if (memCtx->allocHead == memp)
         memCtx->allocHead = memp->flink;
-    free((char *) memp);
+    SlabFree(memCtx, (void *) memp);
     return 0;
 }
 
@@ -376,13 +741,78 @@ Hax_DbCkrealloc(
     int line)
 {
     void *newPtr;
+    struct mem_header *memp;
 
+    if (((Memoryp *) memoryp)->release)
+        return Hax_Ckrealloc(memoryp, ptr, size);
+
+    memp = (struct mem_header *)(((char *) ptr) -
+	offsetof(struct mem_header, body));
     newPtr = Hax_DbCkalloc(memoryp, size, file, line);
-    memcpy(newPtr, ptr, (int) size);
+    memcpy(newPtr, ptr, (int) ((size < memp->length) ? size : memp->length));
     Hax_DbCkfree(memoryp, ptr, file, line);
     return newPtr;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_Ckalloc, Hax_Ckfree, Hax_Ckrealloc - release allocator
+ *
+ *        Allocate, free and reallocate memory with no guard bands or
+ *        debugging bookkeeping.  These are what the ckalloc macros call
+ *        when Hax is compiled with HAX_RELEASE_MEMORY;  the debugging
+ *        procedures also pass on to them for release contexts.  Memory
+ *        from a debugging context is handed to the debugging procedures,
+ *        so that both kinds of context work with either set of macros.
+ *
+ *----------------------------------------------------------------------
+ */
+void *
+Hax_Ckalloc(
+    Hax_Memoryp *memoryp,
+    unsigned long int size)
+{
+    void *result;
+
+    if (!((Memoryp *) memoryp)->release)
+        return Hax_DbCkalloc(memoryp, size, (char *) "unknown", 0);
+
+    result = SlabAlloc((Memoryp *) memoryp, size);
+    if (result == NULL)
+        Hax_Panic((char *) "unable to alloc %lu bytes", size);
+    return result;
+}
+
+int
+Hax_Ckfree(
+    Hax_Memoryp *memoryp,
+    void        *ptr)
+{
+    if (!((Memoryp *) memoryp)->release)
+        return Hax_DbCkfree(memoryp, ptr, (char *) "unknown", 0);
+
+    SlabFree((Memoryp *) memoryp, ptr);
+    return 0;
+}
+
+void *
+Hax_Ckrealloc(
+    Hax_Memoryp *memoryp,
+    void *ptr,
+    unsigned long int size)
+{
+    void *result;
+
+    if (!((Memoryp *) memoryp)->release)
+        return Hax_DbCkrealloc(memoryp, ptr, size, (char *) "unknown", 0);
+
+    result = SlabRealloc((Memoryp *) memoryp, ptr, size);
+    if (result == NULL)
+        Hax_Panic((char *) "unable to realloc %lu bytes", size);
+    return result;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -394,6 +824,10 @@ Hax_DbCkrealloc(
  *       trace_on_at_malloc count
  *       trace on|off
  *       validate on|off
+ *       validate_budget count   (0 turns incremental validation
+ *                                off:  each check covers every block)
+ *       validate_all
+ *       slabs
  *
  * Results:
  *     Standard HAX results.
@@ -410,12 +844,26 @@ MemoryCmd (
 {
     Interp *iPtr = (Interp *) interp;
     Memoryp *memCtx = (Memoryp *) iPtr->memoryp;
+    int budget;
 
     if (argc < 2) {
 	Hax_AppendResult(interp, "wrong # args:  should be \"",
 		argv[0], " option [args..]\"", (char *) NULL);
 	return HAX_ERROR;
     }
+    if (strcmp(argv[1],"slabs") == 0) {
+        if (argc != 2) {
+	    Hax_AppendResult(interp, "wrong # args:  should be \"",
+		    argv[0], " slabs\"", (char *) NULL);
+	    return HAX_ERROR;
+	}
+        SlabInfo(memCtx, interp);
+        return HAX_OK;
+    }
+    if (memCtx->release) {
+	interp->result = (char *) "memory debugging isn't enabled";
+	return HAX_ERROR;
+    }
 
     if (strcmp(argv[1],"trace") == 0) {
         if (argc != 3)
@@ -435,6 +883,28 @@ MemoryCmd (
         memCtx->validate_memory = (strcmp(argv[2],"on") == 0);
         return HAX_OK;
     }
+    if (strcmp(argv[1],"validate_budget") == 0) {
+        if (argc != 3)
+            goto argError;
+        if (Hax_GetInt(interp, argv[2], &budget) != HAX_OK)
+                return HAX_ERROR;
+        if (budget < 0) {
+	    Hax_AppendResult(interp, "bad budget \"", argv[2],
+		    "\": must be a non-negative integer", (char *) NULL);
+	    return HAX_ERROR;
+	}
+        memCtx->validate_budget = budget;
+        return HAX_OK;
+    }
+    if (strcmp(argv[1],"validate_all") == 0) {
+        if (argc != 2) {
+	    Hax_AppendResult(interp, "wrong # args:  should be \"",
+		    argv[0], " validate_all\"", (char *) NULL);
+	    return HAX_ERROR;
+	}
+        ckvalidateallmemory(iPtr->memoryp);
+        return HAX_OK;
+    }
     if (strcmp(argv[1],"trace_on_at_malloc") == 0) {
         if (argc != 3)
             goto argError;
@@ -469,7 +939,8 @@ MemoryCmd (
     }
     Hax_AppendResult(interp, "bad option \"", argv[1],
 	    "\":  should be info, init, active, break_on_malloc, ",
-	    "trace_on_at_malloc, trace, or validate", (char *) NULL);
+	    "trace_on_at_malloc, trace, validate, validate_all, ",
+	    "validate_budget, or slabs", (char *) NULL);
     return HAX_ERROR;
 
 argError:
@@ -525,6 +996,33 @@ Hax_CreateMemoryManagement(
     memoryp->alloc_tracing = alloc_tracing;
     memoryp->init_malloced_bodies = init_malloced_bodies;
     memoryp->validate_memory = validate_memory;
+    memoryp->validate_budget = DEFAULT_VALIDATE_BUDGET;
+    memoryp->release = FORCE_RELEASE;
+
+    return (Hax_Memoryp *) memoryp;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_CreateReleaseMemoryManagement --
+ *     Create a Memoryp context with no debugging:  ckalloc serves
+ *     blocks of up to SLAB_MAX_SIZE bytes (header included) from the
+ *     context's per-class slab pages and falls back to malloc for
+ *     anything larger (or for everything, if HAX_NO_SLABS is defined),
+ *     and ckfree returns each block to where it came from.  Only the
+ *     "slabs" option of the memory command is available.
+ *
+ *----------------------------------------------------------------------
+ */
+Hax_Memoryp *
+Hax_CreateReleaseMemoryManagement(void)
+{
+    Memoryp *memoryp;
+
+    memoryp = (Memoryp *) malloc(sizeof(Memoryp));
+    memset(memoryp, 0, sizeof(Memoryp));
+    memoryp->release = TRUE;
 
     return (Hax_Memoryp *) memoryp;
 }
@@ -21,6 +21,19 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclCmdAH.c,v 1.79 93/01/29
 
 #include "haxInt.h"
 
+/*
+ * Forward declarations for procedures defined in this file:
+ */
+
+static int		CatchDone (Hax_Interp *interp, ClientData data[],
+			    int result);
+static int		EvalDone (Hax_Interp *interp, ClientData data[],
+			    int result);
+static int		ForNext (Hax_Interp *interp, ClientData data[],
+			    int result);
+static int		ForeachNext (Hax_Interp *interp, ClientData data[],
+			    int result);
+
 
 /*
  *----------------------------------------------------------------------
@@ -80,12 +93,10 @@ Hax_CaseCmd(
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
 {
-    Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
     int i, result;
     int body;
     char *string;
-    int caseArgc, splitArgs;
+    int caseArgc;
     char **caseArgv;
 
     if (argc < 3) {
@@ -109,13 +120,12 @@ Hax_CaseCmd(
      * argument, split them out again.
      */
 
-    splitArgs = 0;
     if (caseArgc == 1) {
-	result = Hax_SplitList(interp, caseArgv[0], &caseArgc, &caseArgv);
+	result = HaxScratchSplitList(interp, caseArgv[0], &caseArgc,
+		&caseArgv);
 	if (result != HAX_OK) {
 	    return result;
 	}
-	splitArgs = 1;
     }
 
     for (i = 0; i < caseArgc; i += 2) {
@@ -125,8 +135,7 @@ Hax_CaseCmd(
 
 	if (i == (caseArgc-1)) {
 	    interp->result = (char *) "extra case pattern with no body";
-	    result = HAX_ERROR;
-	    goto cleanup;
+	    return HAX_ERROR;
 	}
 
 	/*
@@ -156,9 +165,10 @@ Hax_CaseCmd(
 	 * in the list.
 	 */
 
-	result = Hax_SplitList(interp, caseArgv[i], &patArgc, &patArgv);
+	result = HaxScratchSplitList(interp, caseArgv[i], &patArgc,
+		&patArgv);
 	if (result != HAX_OK) {
-	    goto cleanup;
+	    return result;
 	}
 	for (j = 0; j < patArgc; j++) {
 	    if (Hax_StringMatch(string, patArgv[j])) {
@@ -166,7 +176,6 @@ Hax_CaseCmd(
 		break;
 	    }
 	}
-	ckfree(memoryp, (char *) patArgv);
 	if (j < patArgc) {
 	    break;
 	}
@@ -181,32 +190,28 @@ Hax_CaseCmd(
 		    interp->errorLine);
 	    Hax_AddErrorInfo(interp, msg);
 	}
-	goto cleanup;
+	return result;
     }
 
     /*
      * Nothing matched:  return nothing.
      */
 
-    result = HAX_OK;
-
-    cleanup:
-    if (splitArgs) {
-	ckfree(memoryp, (char *) caseArgv);
-    }
-    return result;
+    return HAX_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Hax_CatchCmd --
+ * Hax_CatchCmd, Hax_CatchNRCmd --
  *
- *	This procedure is invoked to process the "catch" Hax command.
+ *	These procedures are invoked to process the "catch" Hax command.
  *	See the user documentation for details on what it does.
+ *	Hax_CatchNRCmd is used by compiled scripts:  it schedules the
+ *	script, followed by a call to CatchDone to record its result.
  *
  * Results:
- *	A standard Hax result.
+ *	A standard Hax result, or HAX_NR_PENDING from Hax_CatchNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -214,7 +219,6 @@ Hax_CaseCmd(
  *----------------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 int
 Hax_CatchCmd(
     ClientData dummy,			/* Not used. */
@@ -222,16 +226,41 @@ Hax_CatchCmd(
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
 {
-    int result;
+    return HaxNRCallCommand(interp, Hax_CatchNRCmd, dummy, argc, argv,
+	    (Hax_Obj **) NULL);
+}
 
+	/* ARGSUSED */
+int
+Hax_CatchNRCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv,			/* Argument strings. */
+    Hax_Obj **objv			/* Not used. */)
+{
     if ((argc != 2) && (argc != 3)) {
 	Hax_AppendResult(interp, "wrong # args: should be \"",
 		argv[0], " command ?varName?\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    result = Hax_Eval(interp, NULL, argv[1], 0, (char **) NULL);
-    if (argc == 3) {
-	if (Hax_SetVar(interp, argv[2], interp->result, 0) == NULL) {
+    HaxNRAddCallback(interp, CatchDone, 0,
+	    (ClientData) ((argc == 3) ? argv[2] : NULL), (ClientData) NULL,
+	    (ClientData) NULL, (ClientData) NULL);
+    return HaxNREvalCached(interp, argv[1]);
+}
+
+static int
+CatchDone(
+    Hax_Interp *interp,			/* Current interpreter. */
+    ClientData data[],			/* data[0] is the variable to hold
+					 * the result, or NULL. */
+    int result)				/* Result of the script. */
+{
+    char *varName = (char *) data[0];
+
+    if (varName != NULL) {
+	if (Hax_SetVar(interp, varName, interp->result, 0) == NULL) {
 	    Hax_SetResult(interp,
 		    (char *) "couldn't save command result in variable",
 		    HAX_STATIC);
@@ -360,13 +389,15 @@ Hax_ErrorCmd(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_EvalCmd --
+ * Hax_EvalCmd, Hax_EvalNRCmd --
  *
- *	This procedure is invoked to process the "eval" Hax command.
+ *	These procedures are invoked to process the "eval" Hax command.
  *	See the user documentation for details on what it does.
+ *	Hax_EvalNRCmd is used by compiled scripts:  it schedules the
+ *	script, followed by a call to EvalDone.
  *
  * Results:
- *	A standard Hax result.
+ *	A standard Hax result, or HAX_NR_PENDING from Hax_EvalNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -374,7 +405,6 @@ Hax_ErrorCmd(
  *----------------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 int
 Hax_EvalCmd(
     ClientData dummy,			/* Not used. */
@@ -382,9 +412,19 @@ Hax_EvalCmd(
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
 {
-    Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
-    int result;
+    return HaxNRCallCommand(interp, Hax_EvalNRCmd, dummy, argc, argv,
+	    (Hax_Obj **) NULL);
+}
+
+	/* ARGSUSED */
+int
+Hax_EvalNRCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv,			/* Argument strings. */
+    Hax_Obj **objv			/* Not used. */)
+{
     char *cmd;
 
     if (argc < 2) {
@@ -393,17 +433,33 @@ Hax_EvalCmd(
 	return HAX_ERROR;
     }
     if (argc == 2) {
-	result = Hax_Eval(interp, NULL, argv[1], 0, (char **) NULL);
-    } else {
+	HaxNRAddCallback(interp, EvalDone, 0, (ClientData) NULL,
+		(ClientData) NULL, (ClientData) NULL, (ClientData) NULL);
+	return HaxNREvalDynamic(interp, argv[1]);
+    }
 
-	/*
-	 * More than one argument:  concatenate them together with spaces
-	 * between, then evaluate the result.
-	 */
+    /*
+     * More than one argument:  concatenate them together with spaces
+     * between, then evaluate the result.  EvalDone frees the string.
+     */
+
+    cmd = Hax_Concat(interp, argc-1, argv+1);
+    HaxNRAddCallback(interp, EvalDone, 0, (ClientData) cmd,
+	    (ClientData) NULL, (ClientData) NULL, (ClientData) NULL);
+    return HaxNREvalDynamic(interp, cmd);
+}
+
+static int
+EvalDone(
+    Hax_Interp *interp,			/* Current interpreter. */
+    ClientData data[],			/* data[0] is the script to free,
+					 * or NULL. */
+    int result)				/* Result of the script. */
+{
+    Hax_Memoryp *memoryp = ((Interp *) interp)->memoryp;
 
-	cmd = Hax_Concat(interp, argc-1, argv+1);
-	result = Hax_Eval(interp, NULL, cmd, 0, (char **) NULL);
-	ckfree(memoryp, cmd);
+    if (data[0] != NULL) {
+	ckfree(memoryp, (char *) data[0]);
     }
     if (result == HAX_ERROR) {
 	char msg[60];
@@ -450,13 +506,16 @@ Hax_ExprCmd(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_ForCmd --
+ * Hax_ForCmd, Hax_ForNRCmd --
  *
- *	This procedure is invoked to process the "for" Hax command.
+ *	These procedures are invoked to process the "for" Hax command.
  *	See the user documentation for details on what it does.
+ *	Hax_ForNRCmd sets up the loop in a ForState and runs the initial
+ *	command, then leaves the loop to ForNext, which schedules the
+ *	body and the loop-end command in turn.
  *
  * Results:
- *	A standard Hax result.
+ *	A standard Hax result, or HAX_NR_PENDING from Hax_ForNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -464,7 +523,15 @@ Hax_ExprCmd(
  *----------------------------------------------------------------------
  */
 
-	/* ARGSUSED */
+typedef struct ForState {
+    char **argv;		/* The command's arguments. */
+    CompiledExpr *testPtr;	/* Compiled test expression, or NULL. */
+    CompiledScript *bodyPtr;	/* Compiled body, or NULL. */
+    CompiledScript *nextPtr;	/* Compiled loop-end command, or NULL. */
+    int inBody;			/* Non-zero means the script that just
+				 * finished was the body. */
+} ForState;
+
 int
 Hax_ForCmd(
     ClientData dummy,			/* Not used. */
@@ -472,7 +539,24 @@ Hax_ForCmd(
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
 {
-    int result, value;
+    return HaxNRCallCommand(interp, Hax_ForNRCmd, dummy, argc, argv,
+	    (Hax_Obj **) NULL);
+}
+
+	/* ARGSUSED */
+int
+Hax_ForNRCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv,			/* Argument strings. */
+    Hax_Obj **objv			/* Not used. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    ForState *statePtr;
+    CompiledExpr *testPtr;
+    ClientData data[4];
+    int result;
 
     if (argc != 5) {
 	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
@@ -480,23 +564,71 @@ Hax_ForCmd(
 	return HAX_ERROR;
     }
 
+    /*
+     * Get the compiled test before running the initial command, while
+     * it can still be found in the invoking command (see
+     * HaxGetCompiledExpr).
+     */
+
+    testPtr = HaxGetCompiledExpr(interp, argv[2]);
     result = Hax_Eval(interp, NULL, argv[1], 0, (char **) NULL);
     if (result != HAX_OK) {
 	if (result == HAX_ERROR) {
 	    Hax_AddErrorInfo(interp,
 		(char *) "\n    (\"for\" initial command)");
 	}
+	if (testPtr != NULL) {
+	    HaxReleaseCompiledExpr(interp, testPtr);
+	}
 	return result;
     }
-    while (1) {
-	result = Hax_ExprBoolean(interp, argv[2], &value);
-	if (result != HAX_OK) {
-	    return result;
-	}
-	if (!value) {
-	    break;
-	}
-	result = Hax_Eval(interp, NULL, argv[4], 0, (char **) NULL);
+
+    /*
+     * Look up the test, the body and the loop-end command just once,
+     * rather than on every iteration.  The state lives in scratch
+     * space, which the command's caller keeps until the loop has
+     * finished.
+     */
+
+    statePtr = (ForState *) HaxScratchAlloc(iPtr, (int) sizeof(ForState));
+    statePtr->argv = argv;
+    statePtr->testPtr = testPtr;
+    statePtr->bodyPtr = HaxGetCachedScript(interp, argv[4]);
+    statePtr->nextPtr = HaxGetCachedScript(interp, argv[3]);
+    statePtr->inBody = 0;
+    data[0] = (ClientData) statePtr;
+    return ForNext(interp, data, HAX_OK);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ForNext --
+ *
+ *	Callback that carries out one step of a "for" loop.  Data[0]
+ *	points to the loop's ForState.
+ *
+ * Results:
+ *	HAX_NR_PENDING if the loop continues, otherwise its result.
+ *
+ * Side effects:
+ *	The next script of the loop is scheduled.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ForNext(
+    Hax_Interp *interp,			/* Current interpreter. */
+    ClientData data[],			/* See above. */
+    int result)				/* Result of the body or loop-end
+					 * command. */
+{
+    ForState *statePtr = (ForState *) data[0];
+    char **argv = statePtr->argv;
+    int value;
+
+    if (statePtr->inBody) {
 	if (result == HAX_CONTINUE) {
 	    result = HAX_OK;
 	} else if (result != HAX_OK) {
@@ -505,18 +637,41 @@ Hax_ForCmd(
 		sprintf(msg, "\n    (\"for\" body line %d)", interp->errorLine);
 		Hax_AddErrorInfo(interp, msg);
 	    }
-	    break;
+	    goto done;
 	}
-	result = Hax_Eval(interp, NULL, argv[3], 0, (char **) NULL);
-	if (result == HAX_BREAK) {
-	    break;
-	} else if (result != HAX_OK) {
-	    if (result == HAX_ERROR) {
-		Hax_AddErrorInfo(interp,
-		    (char *) "\n    (\"for\" loop-end command)");
-	    }
-	    return result;
+	statePtr->inBody = 0;
+	HaxNRAddCallback(interp, ForNext, 0, data[0], (ClientData) NULL,
+		(ClientData) NULL, (ClientData) NULL);
+	return HaxNREvalScript(interp, statePtr->nextPtr, argv[3]);
+    }
+
+    if (result == HAX_BREAK) {
+	goto done;
+    } else if (result != HAX_OK) {
+	if (result == HAX_ERROR) {
+	    Hax_AddErrorInfo(interp,
+		(char *) "\n    (\"for\" loop-end command)");
 	}
+	goto done;
+    }
+    result = HaxExprBooleanCompiled(interp, statePtr->testPtr, argv[2],
+	    &value);
+    if ((result == HAX_OK) && value) {
+	statePtr->inBody = 1;
+	HaxNRAddCallback(interp, ForNext, 0, data[0], (ClientData) NULL,
+		(ClientData) NULL, (ClientData) NULL);
+	return HaxNREvalScript(interp, statePtr->bodyPtr, argv[4]);
+    }
+
+    done:
+    if (statePtr->testPtr != NULL) {
+	HaxReleaseCompiledExpr(interp, statePtr->testPtr);
+    }
+    if (statePtr->bodyPtr != NULL) {
+	HaxReleaseCompiled(interp, statePtr->bodyPtr);
+    }
+    if (statePtr->nextPtr != NULL) {
+	HaxReleaseCompiled(interp, statePtr->nextPtr);
     }
     if (result == HAX_BREAK) {
 	result = HAX_OK;
@@ -526,17 +681,19 @@ Hax_ForCmd(
     }
     return result;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * Hax_ForeachCmd --
+ * Hax_ForeachObjCmd, Hax_ForeachNRCmd --
  *
- *	This procedure is invoked to process the "foreach" Hax command.
- *	See the user documentation for details on what it does.
+ *	These procedures are invoked to process the "foreach" Hax
+ *	command.  See the user documentation for details on what it does.
+ *	Hax_ForeachNRCmd sets up the loop in a ForeachState, then leaves
+ *	it to ForeachNext.
  *
  * Results:
- *	A standard Hax result.
+ *	A standard Hax result, or HAX_NR_PENDING from Hax_ForeachNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -544,67 +701,173 @@ Hax_ForCmd(
  *----------------------------------------------------------------------
  */
 
+typedef struct ForeachState {
+    char *varName;		/* Loop variable. */
+    char *body;			/* Text of the body. */
+    CompiledScript *bodyPtr;	/* Compiled body, or NULL. */
+    int listArgc;		/* Number of list elements. */
+    char **listArgv;		/* Their string values. */
+    int elemc;			/* Number of entries in elemv. */
+    Hax_Obj **elemv;		/* Elements we hold references to. */
+    int i;			/* Index of the element for the body
+				 * that's running, -1 before the first. */
+} ForeachState;
+
+int
+Hax_ForeachObjCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
+{
+    return HaxNRCallCommand(interp, Hax_ForeachNRCmd, dummy, objc,
+	    (char **) NULL, objv);
+}
+
 	/* ARGSUSED */
 int
-Hax_ForeachCmd(
+Hax_ForeachNRCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    char **argv,			/* Not used. */
+    Hax_Obj **objv			/* Argument values. */)
 {
     Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
-    int listArgc, i, result;
-    char **listArgv;
+    ForeachState *statePtr;
+    ClientData data[4];
+    int i, result;
 
-    if (argc != 4) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc != 4) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" varName list command\"", (char *) NULL);
 	return HAX_ERROR;
     }
 
+    /*
+     * The state lives in scratch space, which the command's caller
+     * keeps until the loop has finished.
+     */
+
+    statePtr = (ForeachState *) HaxScratchAlloc(iPtr,
+	    (int) sizeof(ForeachState));
+    statePtr->varName = Hax_GetStringFromObj(interp, objv[1], (int *) NULL);
+    statePtr->body = Hax_GetStringFromObj(interp, objv[3], (int *) NULL);
+
     /*
      * Break the list up into elements, and execute the command once
-     * for each value of the element.
+     * for each value of the element.  If the list value already has
+     * its elements or will be used again (see Hax_LindexObjCmd), use
+     * them, holding a reference to each in case the body changes the
+     * list's internal form;  otherwise split its string form in
+     * scratch space.
      */
 
-    result = Hax_SplitList(interp, argv[2], &listArgc, &listArgv);
-    if (result != HAX_OK) {
-	return result;
+    statePtr->elemc = 0;
+    statePtr->elemv = NULL;
+    if ((objv[2]->type == HAX_OBJ_LIST) || Hax_IsShared(objv[2])) {
+	Hax_Obj **listObjv;
+
+	result = Hax_ListObjGetElements(interp, objv[2],
+		&statePtr->listArgc, &listObjv);
+	if (result != HAX_OK) {
+	    return result;
+	}
+	statePtr->listArgv = (char **) HaxScratchAlloc(iPtr,
+		(int) (statePtr->listArgc * sizeof(char *)));
+	statePtr->elemv = (Hax_Obj **) HaxScratchAlloc(iPtr,
+		(int) (statePtr->listArgc * sizeof(Hax_Obj *)));
+	for (i = 0; i < statePtr->listArgc; i++) {
+	    statePtr->elemv[i] = listObjv[i];
+	    Hax_IncrRefCount(listObjv[i]);
+	    statePtr->listArgv[i] = Hax_GetStringFromObj(interp, listObjv[i],
+		    (int *) NULL);
+	}
+	statePtr->elemc = statePtr->listArgc;
+    } else {
+	result = HaxScratchSplitList(interp,
+		Hax_GetStringFromObj(interp, objv[2], (int *) NULL),
+		&statePtr->listArgc, &statePtr->listArgv);
+	if (result != HAX_OK) {
+	    return result;
+	}
+    }
+    statePtr->bodyPtr = HaxGetCachedScript(interp, statePtr->body);
+    statePtr->i = -1;
+    data[0] = (ClientData) statePtr;
+    return ForeachNext(interp, data, HAX_OK);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ForeachNext --
+ *
+ *	Callback that carries out one step of a "foreach" loop.  Data[0]
+ *	points to the loop's ForeachState.
+ *
+ * Results:
+ *	HAX_NR_PENDING if the loop continues, otherwise its result.
+ *
+ * Side effects:
+ *	The loop variable is set and the body scheduled.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ForeachNext(
+    Hax_Interp *interp,			/* Current interpreter. */
+    ClientData data[],			/* See above. */
+    int result)				/* Result of the body. */
+{
+    ForeachState *statePtr = (ForeachState *) data[0];
+    int i;
+
+    if ((statePtr->i >= 0) && (result != HAX_OK)) {
+	if (result == HAX_CONTINUE) {
+	    result = HAX_OK;
+	} else if (result == HAX_BREAK) {
+	    result = HAX_OK;
+	    goto done;
+	} else if (result == HAX_ERROR) {
+	    char msg[100];
+	    sprintf(msg, "\n    (\"foreach\" body line %d)",
+		    interp->errorLine);
+	    Hax_AddErrorInfo(interp, msg);
+	    goto done;
+	} else {
+	    goto done;
+	}
     }
-    for (i = 0; i < listArgc; i++) {
-	if (Hax_SetVar(interp, argv[1], listArgv[i], 0) == NULL) {
+    statePtr->i++;
+    if (statePtr->i < statePtr->listArgc) {
+	if (Hax_SetVar(interp, statePtr->varName,
+		statePtr->listArgv[statePtr->i], 0) == NULL) {
 	    Hax_SetResult(interp, (char *) "couldn't set loop variable",
 		    HAX_STATIC);
 	    result = HAX_ERROR;
-	    break;
+	    goto done;
 	}
+	HaxNRAddCallback(interp, ForeachNext, 0, data[0], (ClientData) NULL,
+		(ClientData) NULL, (ClientData) NULL);
+	return HaxNREvalScript(interp, statePtr->bodyPtr, statePtr->body);
+    }
 
-	result = Hax_Eval(interp, NULL, argv[3], 0, (char **) NULL);
-	if (result != HAX_OK) {
-	    if (result == HAX_CONTINUE) {
-		result = HAX_OK;
-	    } else if (result == HAX_BREAK) {
-		result = HAX_OK;
-		break;
-	    } else if (result == HAX_ERROR) {
-		char msg[100];
-		sprintf(msg, "\n    (\"foreach\" body line %d)",
-			interp->errorLine);
-		Hax_AddErrorInfo(interp, msg);
-		break;
-	    } else {
-		break;
-	    }
-	}
+    done:
+    if (statePtr->bodyPtr != NULL) {
+	HaxReleaseCompiled(interp, statePtr->bodyPtr);
+    }
+    for (i = 0; i < statePtr->elemc; i++) {
+	Hax_DecrRefCount(interp, statePtr->elemv[i]);
     }
-    ckfree(memoryp, (char *) listArgv);
     if (result == HAX_OK) {
 	Hax_ResetResult(interp);
     }
     return result;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -21,24 +21,161 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclCmdIL.c,v 1.89 93/01/22
 #endif
 
 #include "haxInt.h"
+#ifdef HAX_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+/*
+ * The structures below hold the state of an "lsort" command.  Each
+ * element's sort key is found (and for -integer and -real converted to
+ * a number) once before sorting starts, so comparisons don't have to
+ * parse anything.
+ */
+
+typedef struct SortItem {
+    union {
+	long long intValue;	/* Key for -integer. */
+	double doubleValue;	/* Key for -real. */
+	char *string;		/* Key for -ascii. */
+	Hax_Obj *objPtr;	/* Key for -command. */
+    } key;
+    unsigned long prefix;	/* For -ascii, the first few characters of
+				 * the key packed so that comparing
+				 * prefixes gives the same order as
+				 * comparing the characters;  most
+				 * comparisons can then be settled without
+				 * looking at the string itself.  Unused
+				 * for other modes. */
+    Hax_Obj *elemPtr;		/* List element the key came from. */
+} SortItem;
+
+#define SORT_ASCII	0
+#define SORT_INTEGER	1
+#define SORT_REAL	2
+#define SORT_COMMAND	3
+
+typedef struct SortInfo {
+    int mode;			/* How to compare keys:  SORT_ASCII etc. */
+    int decreasing;		/* Non-zero means sort in decreasing
+				 * order. */
+    Hax_Interp *interp;		/* Interpreter in which to run the
+				 * -command script. */
+    int cmdc;			/* Number of words in cmdv. */
+    Hax_Obj **cmdv;		/* Words of the -command script, followed
+				 * by slots for the two keys to compare. */
+    int result;			/* HAX_OK, or the code from a -command
+				 * that failed, in which case the rest of
+				 * the sort is abandoned. */
+} SortInfo;
+
+/*
+ * The structure below describes what an "lsearch" command is looking
+ * for.
+ */
+
+#define SEARCH_GLOB	0
+#define SEARCH_EXACT	1
+#define SEARCH_REGEXP	2
+
+typedef struct SearchInfo {
+    int mode;			/* How to match elements:  SEARCH_GLOB
+				 * etc. */
+    int type;			/* For SEARCH_EXACT, how to compare an
+				 * element with the pattern:  SORT_ASCII,
+				 * SORT_INTEGER or SORT_REAL. */
+    int decreasing;		/* For -sorted, non-zero means the list is
+				 * in decreasing order. */
+    char *pattern;		/* Pattern to look for. */
+    int length;			/* Number of bytes in pattern. */
+    long long intValue;		/* Pattern's value for SORT_INTEGER. */
+    double doubleValue;		/* Pattern's value for SORT_REAL. */
+    regexp *regexpPtr;		/* Compiled pattern for SEARCH_REGEXP. */
+    Hax_Pattern glob;		/* Compiled pattern for SEARCH_GLOB. */
+} SearchInfo;
+
+/*
+ * Runs of up to this many elements are sorted by insertion rather than
+ * by merging.
+ */
+
+#define SORT_RUN	12
+
+#ifdef HAX_THREADS
+/*
+ * Lists with at least SORT_PARALLEL_MIN elements are sorted on several
+ * threads, if the interpreter allows it (see Hax_SetSortThreads).  Each
+ * thread sorts an equal share of the list, then the sorted runs are
+ * merged in rounds, pairs at a time, with every thread producing an
+ * equal share of each round's output.  Since each merge is stable the
+ * result is the same as a serial sort's.  Only -ascii, -integer and
+ * -real sorts run this way:  their comparisons don't touch the
+ * interpreter.  A SortTask describes one thread's part of one step.
+ */
+
+#define SORT_PARALLEL_MIN	50000
+
+typedef struct SortTask {
+    SortInfo *infoPtr;		/* How to compare items. */
+    SortItem *src;		/* Items to sort or merge. */
+    SortItem *dst;		/* Working space while sorting;  where to
+				 * put the output while merging. */
+    int count;			/* Number of items in the whole list. */
+    int threads;		/* Number of threads sharing the work. */
+    int width;			/* Number of threads' shares in each of the
+				 * runs being merged, or 0 while the shares
+				 * are being sorted. */
+    int thread;			/* Which thread's part this is, from 0 to
+				 * threads-1. */
+} SortTask;
+#endif
 
 /*
  * Forward declarations for procedures defined in this file:
  */
 
-static int		SortCompareProc (const void *first,
-			    const void *second);
+static int		IncrVar (Hax_Interp *interp,
+			    Hax_HashEntry *slotPtr, char *varName,
+			    char *part2, Hax_Obj *incrObjPtr,
+			    char *incrString);
+static int		SearchCompare (Hax_Interp *interp,
+			    SearchInfo *infoPtr, Hax_Obj *elemPtr,
+			    char *string, int *orderPtr);
+static int		SearchMatch (Hax_Interp *interp,
+			    SearchInfo *infoPtr, Hax_Obj *elemPtr,
+			    char *string, int *matchPtr);
+static int		SortCommand (SortInfo *infoPtr, SortItem *firstPtr,
+			    SortItem *secondPtr);
+static int		SortCompare (SortInfo *infoPtr, SortItem *firstPtr,
+			    SortItem *secondPtr);
+static void		SortItems (SortInfo *infoPtr, SortItem *items,
+			    SortItem *tmp, int count);
+static unsigned long	SortPrefix (char *string);
+#ifdef HAX_THREADS
+static int		SortBound (SortTask *taskPtr, int share);
+static void		SortMerge (SortInfo *infoPtr, SortItem *first,
+			    int firstCount, SortItem *second,
+			    int secondCount, SortItem *dst);
+static void		SortParallel (SortInfo *infoPtr, SortItem *items,
+			    SortItem *tmp, int count, int threads);
+static int		SortSplit (SortInfo *infoPtr, int count,
+			    SortItem *first, int firstCount,
+			    SortItem *second, int secondCount);
+static void *		SortThread (void *clientData);
+#endif
 
 /*
  *----------------------------------------------------------------------
  *
- * Hax_IfCmd --
+ * Hax_IfCmd, Hax_IfNRCmd --
  *
- *	This procedure is invoked to process the "if" Hax command.
+ *	These procedures are invoked to process the "if" Hax command.
  *	See the user documentation for details on what it does.
+ *	Hax_IfNRCmd is used by compiled scripts:  it schedules the
+ *	chosen script rather than evaluating it (see HaxNREvalScript).
  *
  * Results:
- *	A standard Hax result.
+ *	A standard Hax result, or HAX_NR_PENDING from Hax_IfNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -46,13 +183,25 @@ static int		SortCompareProc (const void *first,
  *----------------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 int
 Hax_IfCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
+{
+    return HaxNRCallCommand(interp, Hax_IfNRCmd, dummy, argc, argv,
+	    (Hax_Obj **) NULL);
+}
+
+	/* ARGSUSED */
+int
+Hax_IfNRCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv,			/* Argument strings. */
+    Hax_Obj **objv			/* Not used. */)
 {
     int i, result, value;
 
@@ -85,7 +234,7 @@ Hax_IfCmd(
 	    return HAX_ERROR;
 	}
 	if (value) {
-	    return Hax_Eval(interp, NULL, argv[i], 0, (char **) NULL);
+	    return HaxNREvalCached(interp, argv[i]);
 	}
 
 	/*
@@ -119,16 +268,18 @@ Hax_IfCmd(
 	    return HAX_ERROR;
 	}
     }
-    return Hax_Eval(interp, NULL, argv[i], 0, (char **) NULL);
+    return HaxNREvalCached(interp, argv[i]);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Hax_IncrCmd --
+ * Hax_IncrObjCmd --
  *
  *	This procedure is invoked to process the "incr" Hax command.
- *	See the user documentation for details on what it does.
+ *	See the user documentation for details on what it does.  The
+ *	increment is a value, so a literal increment is only parsed
+ *	once.
  *
  * Results:
  *	A standard Hax result.
@@ -141,52 +292,160 @@ Hax_IfCmd(
 
     /* ARGSUSED */
 int
-Hax_IncrCmd(
+Hax_IncrObjCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
-    long long int value;
-    char *oldString, *result;
-    char newString[30];
+    char *varName, *part2, *open, *close, *p;
+    int result;
 
-    if ((argc != 2) && (argc != 3)) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if ((objc != 2) && (objc != 3)) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" varName ?increment?\"", (char *) NULL);
 	return HAX_ERROR;
     }
 
-    oldString = Hax_GetVar(interp, argv[1], HAX_LEAVE_ERR_MSG);
+    /*
+     * Split an array element name into its two parts (the same way
+     * as Hax_GetVar does), so that the variable's cached number can
+     * be used and updated.
+     */
+
+    varName = Hax_GetStringFromObj(interp, objv[1], (int *) NULL);
+    part2 = open = close = NULL;
+    for (p = varName; *p != '\0'; p++) {
+	if (*p == '(') {
+	    open = p;
+	    while (p[1] != '\0') {
+		p++;
+	    }
+	    if (*p == ')') {
+		close = p;
+		*open = '\0';
+		*close = '\0';
+		part2 = open+1;
+	    }
+	    break;
+	}
+    }
+
+    result = IncrVar(interp, (Hax_HashEntry *) NULL, varName, part2,
+	    (objc == 3) ? objv[2] : (Hax_Obj *) NULL, (char *) NULL);
+    if (close != NULL) {
+	*open = '(';
+	*close = ')';
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxIncrSlotCmd --
+ *
+ *	Execute an "incr" command from a compiled script that has
+ *	already resolved the variable's name to a slot in the current
+ *	frame.
+ *
+ * Results:
+ *	A standard Hax result.
+ *
+ * Side effects:
+ *	The same as for Hax_IncrObjCmd.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxIncrSlotCmd(
+    Hax_Interp *interp,			/* Current interpreter. */
+    Hax_HashEntry *slotPtr,		/* Slot that holds the variable. */
+    char *varName,			/* Name of the (scalar) variable. */
+    char *increment)			/* Amount to add, or NULL to add
+					 * 1. */
+{
+    return IncrVar(interp, slotPtr, varName, (char *) NULL,
+	    (Hax_Obj *) NULL, increment);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * IncrVar --
+ *
+ *	Does the work of Hax_IncrObjCmd and HaxIncrSlotCmd:  adds an
+ *	increment to the integer value of a variable.
+ *
+ * Results:
+ *	A standard Hax result.  On success the interpreter's result is
+ *	the variable's new value.
+ *
+ * Side effects:
+ *	The variable's value is changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+IncrVar(
+    Hax_Interp *interp,			/* Current interpreter. */
+    Hax_HashEntry *slotPtr,		/* Slot that holds varName, or NULL
+					 * to look it up. */
+    char *varName,			/* Name of variable (or array, if
+					 * part2 isn't NULL). */
+    char *part2,			/* Name of array element, or NULL. */
+    Hax_Obj *incrObjPtr,		/* Increment, or NULL. */
+    char *incrString)			/* Increment, if incrObjPtr is
+					 * NULL;  if both are NULL the
+					 * increment is 1. */
+{
+    long long int value;
+    long int increment;
+    char *oldString, *result;
+    char newString[30];
+    VarNumber *numberPtr, number;
+
+    oldString = HaxGetVarSlot(interp, slotPtr, varName, part2,
+	    HAX_LEAVE_ERR_MSG, (Hax_Obj **) NULL, &numberPtr);
     if (oldString == NULL) {
 	return HAX_ERROR;
     }
-    if (Hax_GetLongLong(interp, oldString, &value) != HAX_OK) {
+    if (numberPtr->type == VAR_NUM_LLONG) {
+	value = numberPtr->u.llongValue;
+    } else if (Hax_GetLongLong(interp, oldString, &value) != HAX_OK) {
 	Hax_AddErrorInfo(interp,
 		(char *) "\n    (reading value of variable to increment)");
 	return HAX_ERROR;
     }
-    if (argc == 2) {
-	value += 1;
-    } else {
-	long long int increment;
-
-	if (Hax_GetLongLong(interp, argv[2], &increment) != HAX_OK) {
-	    Hax_AddErrorInfo(interp,
-		    (char *) "\n    (reading increment)");
+    if (incrObjPtr != NULL) {
+	if (Hax_GetLongFromObj(interp, incrObjPtr, &increment) != HAX_OK) {
+	    Hax_AddErrorInfo(interp, (char *) "\n    (reading increment)");
 	    return HAX_ERROR;
 	}
-	value += increment;
+    } else if (incrString != NULL) {
+	if (Hax_GetLong(interp, incrString, &increment) != HAX_OK) {
+	    Hax_AddErrorInfo(interp, (char *) "\n    (reading increment)");
+	    return HAX_ERROR;
+	}
+    } else {
+	increment = 1;
     }
+    value += increment;
     sprintf(newString, "%lld", value);
-    result = Hax_SetVar(interp, argv[1], newString, HAX_LEAVE_ERR_MSG);
+    number.type = VAR_NUM_LLONG;
+    number.u.llongValue = value;
+    result = HaxSetVarSlot(interp, slotPtr, varName, part2, newString,
+	    (Hax_Obj *) NULL, &number, HAX_LEAVE_ERR_MSG);
     if (result == NULL) {
 	return HAX_ERROR;
     }
     interp->result = result;
     return HAX_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -217,10 +476,10 @@ Hax_InfoCmd(
     char c;
     Arg *argPtr;
     Proc *procPtr;
-    Var *varPtr;
     Command *cmdPtr;
     Hax_HashEntry *hPtr;
     Hax_HashSearch search;
+    Hax_Pattern pattern;
 
     if (argc < 2) {
 	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
@@ -259,6 +518,26 @@ Hax_InfoCmd(
 	}
 	iPtr->result = procPtr->command;
 	return HAX_OK;
+    } else if ((c == 'c') && (strncmp(argv[1], "cachestats", length) == 0)
+	    && (length >= 2)) {
+	char stats[100];
+
+	if (argc != 2) {
+	    Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+		    " cachestats\"", (char *) NULL);
+	    return HAX_ERROR;
+	}
+	sprintf(stats, "entries %d limit %d hits %d misses %d",
+		iPtr->scriptCache.numEntries, MAX_CACHED_SCRIPTS,
+		iPtr->scriptCacheHits, iPtr->scriptCacheMisses);
+	Hax_AppendElement(interp, (char *) "script", 0);
+	Hax_AppendElement(interp, stats, 0);
+	sprintf(stats, "entries %d limit %d hits %d misses %d",
+		iPtr->exprCache.numEntries, MAX_CACHED_EXPRS,
+		iPtr->exprCacheHits, iPtr->exprCacheMisses);
+	Hax_AppendElement(interp, (char *) "expr", 0);
+	Hax_AppendElement(interp, stats, 0);
+	return HAX_OK;
     } else if ((c == 'c') && (strncmp(argv[1], "cmdcount", length) == 0)
 	    && (length >= 2)) {
 	if (argc != 2) {
@@ -275,14 +554,18 @@ Hax_InfoCmd(
 		    " commands [pattern]\"", (char *) NULL);
 	    return HAX_ERROR;
 	}
+	pattern = (argc == 3) ? Hax_CompilePattern(interp, argv[2]) : NULL;
 	for (hPtr = Hax_FirstHashEntry(&iPtr->commandTable, &search);
 		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
 	    char *name = Hax_GetHashKey(&iPtr->commandTable, hPtr);
-	    if ((argc == 3) && !Hax_StringMatch(name, argv[2])) {
+	    if ((pattern != NULL) && !Hax_PatternMatch(pattern, name)) {
 		continue;
 	    }
 	    Hax_AppendElement(interp, name, 0);
 	}
+	if (pattern != NULL) {
+	    Hax_FreePattern(interp, pattern);
+	}
 	return HAX_OK;
     } else if ((c == 'c') && (strncmp(argv[1], "complete", length) == 0)
 	    && (length >= 4)) {
@@ -360,11 +643,8 @@ Hax_InfoCmd(
 		iPtr->result = (char *) "0";
 		return HAX_OK;
 	    }
-	    if (iPtr->varFramePtr == NULL) {
-		hPtr = Hax_FindHashEntry(&iPtr->globalTable, argv[2]);
-	    } else {
-		hPtr = Hax_FindHashEntry(&iPtr->varFramePtr->varTable, argv[2]);
-	    }
+	    hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, argv[2], 0,
+		    (int *) NULL);
 	    if (hPtr == NULL) {
 		goto noVar;
 	    }
@@ -379,25 +659,13 @@ Hax_InfoCmd(
 	iPtr->result = (char *) "1";
 	return HAX_OK;
     } else if ((c == 'g') && (strncmp(argv[1], "globals", length) == 0)) {
-	char *name;
-
 	if (argc > 3) {
 	    Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
 		    " globals [pattern]\"", (char *) NULL);
 	    return HAX_ERROR;
 	}
-	for (hPtr = Hax_FirstHashEntry(&iPtr->globalTable, &search);
-		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
-	    varPtr = (Var *) Hax_GetHashValue(hPtr);
-	    if (varPtr->flags & VAR_UNDEFINED) {
-		continue;
-	    }
-	    name = Hax_GetHashKey(&iPtr->globalTable, hPtr);
-	    if ((argc == 3) && !Hax_StringMatch(name, argv[2])) {
-		continue;
-	    }
-	    Hax_AppendElement(interp, name, 0);
-	}
+	HaxAppendVarNames(iPtr, (CallFrame *) NULL,
+		(argc == 3) ? argv[2] : (char *) NULL, VAR_UNDEFINED);
 	return HAX_OK;
     } else if ((c == 'l') && (strncmp(argv[1], "level", length) == 0)
 	    && (length >= 2)) {
@@ -457,8 +725,6 @@ Hax_InfoCmd(
 	return HAX_OK;
     } else if ((c == 'l') && (strncmp(argv[1], "locals", length) == 0)
 	    && (length >= 2)) {
-	char *name;
-
 	if (argc > 3) {
 	    Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
 		    " locals [pattern]\"", (char *) NULL);
@@ -467,18 +733,9 @@ Hax_InfoCmd(
 	if (iPtr->varFramePtr == NULL) {
 	    return HAX_OK;
 	}
-	for (hPtr = Hax_FirstHashEntry(&iPtr->varFramePtr->varTable, &search);
-		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
-	    varPtr = (Var *) Hax_GetHashValue(hPtr);
-	    if (varPtr->flags & (VAR_UNDEFINED|VAR_UPVAR)) {
-		continue;
-	    }
-	    name = Hax_GetHashKey(&iPtr->varFramePtr->varTable, hPtr);
-	    if ((argc == 3) && !Hax_StringMatch(name, argv[2])) {
-		continue;
-	    }
-	    Hax_AppendElement(interp, name, 0);
-	}
+	HaxAppendVarNames(iPtr, iPtr->varFramePtr,
+		(argc == 3) ? argv[2] : (char *) NULL,
+		VAR_UNDEFINED|VAR_UPVAR);
 	return HAX_OK;
     } else if ((c == 'p') && (strncmp(argv[1], "patchlevel", length) == 0)) {
 	if (argc != 2) {
@@ -495,6 +752,7 @@ Hax_InfoCmd(
 		    " procs [pattern]\"", (char *) NULL);
 	    return HAX_ERROR;
 	}
+	pattern = (argc == 3) ? Hax_CompilePattern(interp, argv[2]) : NULL;
 	for (hPtr = Hax_FirstHashEntry(&iPtr->commandTable, &search);
 		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
 	    char *name = Hax_GetHashKey(&iPtr->commandTable, hPtr);
@@ -503,11 +761,14 @@ Hax_InfoCmd(
 	    if (!HaxIsProc(cmdPtr)) {
 		continue;
 	    }
-	    if ((argc == 3) && !Hax_StringMatch(name, argv[2])) {
+	    if ((pattern != NULL) && !Hax_PatternMatch(pattern, name)) {
 		continue;
 	    }
 	    Hax_AppendElement(interp, name, 0);
 	}
+	if (pattern != NULL) {
+	    Hax_FreePattern(interp, pattern);
+	}
 	return HAX_OK;
     } else if ((c == 's') && (strncmp(argv[1], "script", length) == 0)) {
 	if (argc != 2) {
@@ -529,35 +790,17 @@ Hax_InfoCmd(
 	strcpy(iPtr->result, HAX_VERSION);
 	return HAX_OK;
     } else if ((c == 'v') && (strncmp(argv[1], "vars", length)) == 0) {
-	Hax_HashTable *tablePtr;
-	char *name;
-
 	if (argc > 3) {
 	    Hax_AppendResult(interp, "wrong # args: should be \"",
 		    argv[0], " vars [pattern]\"", (char *) NULL);
 	    return HAX_ERROR;
 	}
-	if (iPtr->varFramePtr == NULL) {
-	    tablePtr = &iPtr->globalTable;
-	} else {
-	    tablePtr = &iPtr->varFramePtr->varTable;
-	}
-	for (hPtr = Hax_FirstHashEntry(tablePtr, &search);
-		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
-	    varPtr = (Var *) Hax_GetHashValue(hPtr);
-	    if (varPtr->flags & VAR_UNDEFINED) {
-		continue;
-	    }
-	    name = Hax_GetHashKey(tablePtr, hPtr);
-	    if ((argc == 3) && !Hax_StringMatch(name, argv[2])) {
-		continue;
-	    }
-	    Hax_AppendElement(interp, name, 0);
-	}
+	HaxAppendVarNames(iPtr, iPtr->varFramePtr,
+		(argc == 3) ? argv[2] : (char *) NULL, VAR_UNDEFINED);
 	return HAX_OK;
     } else {
 	Hax_AppendResult(interp, "bad option \"", argv[1],
-		"\": should be args, body, cmdcount, commands, ",
+		"\": should be args, body, cachestats, cmdcount, commands, ",
 		"complete, default, ",
 		"exists, globals, level, library, locals, patchlevel, procs, ",
 		"script, tclversion, or vars",
@@ -569,7 +812,7 @@ Hax_InfoCmd(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_JoinCmd --
+ * Hax_JoinObjCmd --
  *
  *	This procedure is invoked to process the "join" Hax command.
  *	See the user documentation for details on what it does.
@@ -585,29 +828,52 @@ Hax_InfoCmd(
 
 	/* ARGSUSED */
 int
-Hax_JoinCmd(
+Hax_JoinObjCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
-    Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
-    char *joinString;
+    char *joinString, *element;
     char **listArgv;
-    int listArgc, i;
+    Hax_Obj **elemv;
+    int elemc, listArgc, i;
 
-    if (argc == 2) {
+    if (objc == 2) {
 	joinString = (char *) " ";
-    } else if (argc == 3) {
-	joinString = argv[2];
+    } else if (objc == 3) {
+	joinString = Hax_GetStringFromObj(interp, objv[2], (int *) NULL);
     } else {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" list ?joinString?\"", (char *) NULL);
 	return HAX_ERROR;
     }
 
-    if (Hax_SplitList(interp, argv[1], &listArgc, &listArgv) != HAX_OK) {
+    /*
+     * Use the list form if the value already has it or will be used
+     * again (see Hax_LindexObjCmd);  otherwise split it in scratch
+     * space.
+     */
+
+    if ((objv[1]->type == HAX_OBJ_LIST) || Hax_IsShared(objv[1])) {
+	if (Hax_ListObjGetElements(interp, objv[1], &elemc, &elemv)
+		!= HAX_OK) {
+	    return HAX_ERROR;
+	}
+	for (i = 0; i < elemc; i++) {
+	    element = Hax_GetStringFromObj(interp, elemv[i], (int *) NULL);
+	    if (i == 0) {
+		Hax_AppendResult(interp, element, (char *) NULL);
+	    } else  {
+		Hax_AppendResult(interp, joinString, element, (char *) NULL);
+	    }
+	}
+	return HAX_OK;
+    }
+    if (HaxScratchSplitList(interp,
+	    Hax_GetStringFromObj(interp, objv[1], (int *) NULL),
+	    &listArgc, &listArgv) != HAX_OK) {
 	return HAX_ERROR;
     }
     for (i = 0; i < listArgc; i++) {
@@ -617,17 +883,18 @@ Hax_JoinCmd(
 	    Hax_AppendResult(interp, joinString, listArgv[i], (char *) NULL);
 	}
     }
-    ckfree(memoryp, (char *) listArgv);
     return HAX_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LindexCmd --
+ * Hax_LindexObjCmd --
  *
  *	This procedure is invoked to process the "lindex" Hax command.
- *	See the user documentation for details on what it does.
+ *	See the user documentation for details on what it does.  The
+ *	list is split into elements once and kept with the value, so
+ *	indexing the same list again doesn't re-scan it.
  *
  * Results:
  *	A standard Hax result.
@@ -640,30 +907,53 @@ Hax_JoinCmd(
 
     /* ARGSUSED */
 int
-Hax_LindexCmd(
+Hax_LindexObjCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_Obj *elemPtr;
     char *p, *element;
     int parenthesized, result;
     long int index, size;
 
-    if (argc != 3) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc != 3) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" list index\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    if (Hax_GetLong(interp, argv[2], &index) != HAX_OK) {
+    if (Hax_GetLongFromObj(interp, objv[2], &index) != HAX_OK) {
 	return HAX_ERROR;
     }
     if (index < 0) {
 	return HAX_OK;
     }
-    for (p = argv[1] ; index >= 0; index--) {
+
+    /*
+     * Splitting the list into element values only pays off if the
+     * value will be used again, i.e. it's already a list or someone
+     * else (such as a compiled script holding a literal) has a
+     * reference to it.  Otherwise, or if it isn't a proper list, scan
+     * the string form directly:  then an error is only reported if
+     * it's in the part of the list before the element wanted.
+     */
+
+    if ((objv[1]->type == HAX_OBJ_LIST) || Hax_IsShared(objv[1])) {
+	if (Hax_ListObjIndex(interp, objv[1], (int) index, &elemPtr)
+		== HAX_OK) {
+	    if (elemPtr != NULL) {
+		Hax_SetObjResult(interp, elemPtr);
+	    }
+	    return HAX_OK;
+	}
+	Hax_ResetResult(interp);
+    }
+    for (p = Hax_GetStringFromObj(interp, objv[1], (int *) NULL);
+	    index >= 0; index--) {
 	result = HaxFindElement(interp, p, &element, &p, &size,
 		&parenthesized);
 	if (result != HAX_OK) {
@@ -689,7 +979,85 @@ Hax_LindexCmd(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LinsertCmd --
+ * ListBoundary --
+ *
+ *	Locate the boundary between element index-1 of a list and
+ *	element index, for commands that copy the text on either side of
+ *	it.  If the list is already split into elements, or will be used
+ *	again (see Hax_LindexObjCmd), the offsets kept with the value by
+ *	HaxListObjSpans are used, so the cost doesn't depend on index;
+ *	otherwise the string form is scanned up to the boundary.
+ *
+ * Results:
+ *	The return value is normally HAX_OK.  *EndPtr is set to the offset
+ *	in the string form just after the text of element index-1
+ *	(including any closing brace or quote), and *startPtr to that of
+ *	the text of element index.  If index is zero or negative both
+ *	are zero;  if there is no element index, *endPtr refers to the
+ *	end of the last element (or is zero) and *startPtr is the length
+ *	of the string.  If the list isn't proper before the boundary,
+ *	HAX_ERROR is returned and an error message is left in
+ *	interp->result.
+ *
+ * Side effects:
+ *	The offsets may be computed and cached with the value.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ListBoundary(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *listPtr,		/* List value. */
+    long int index,		/* Index of the element after the
+				 * boundary. */
+    int *endPtr,		/* Where to store end of element index-1. */
+    int *startPtr		/* Where to store start of element index. */)
+{
+    char *list, *p, *start, *element;
+    int length, objc, *spans;
+    long int size;
+
+    list = Hax_GetStringFromObj(interp, listPtr, &length);
+    *endPtr = 0;
+    *startPtr = 0;
+    if (index <= 0) {
+	return HAX_OK;
+    }
+    if ((listPtr->type == HAX_OBJ_LIST) || Hax_IsShared(listPtr)) {
+	if (HaxListObjSpans(interp, listPtr, &objc, &spans) == HAX_OK) {
+	    if (index > objc) {
+		index = objc;
+	    }
+	    if (index > 0) {
+		*endPtr = spans[2*index - 1];
+	    }
+	    *startPtr = (index < objc) ? spans[2*index] : length;
+	    return HAX_OK;
+	}
+	Hax_ResetResult(interp);
+    }
+    for (p = list; (index > 0) && (*p != 0); index--) {
+	for (start = p; isascii(*start) && isspace(*start); start++) {
+	    /* Empty loop body. */
+	}
+	if (HaxFindElement(interp, p, &element, &p, &size, (int *) NULL)
+		!= HAX_OK) {
+	    return HAX_ERROR;
+	}
+	if (*element == 0) {
+	    break;
+	}
+	*endPtr = (element - list) + size + ((element != start) ? 1 : 0);
+    }
+    *startPtr = p - list;
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_LinsertObjCmd --
  *
  *	This procedure is invoked to process the "linsert" Hax command.
  *	See the user documentation for details on what it does.
@@ -705,77 +1073,57 @@ Hax_LindexCmd(
 
 	/* ARGSUSED */
 int
-Hax_LinsertCmd(
+Hax_LinsertObjCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
-    char *p, *element, savedChar;
-    int i, count, result;
-    long int index, size;
+    char *list, *prefix;
+    int i, length, end, start;
+    long int index;
 
-    if (argc < 4) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc < 4) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" list index element ?element ...?\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    if (Hax_GetLong(interp, argv[2], &index) != HAX_OK) {
+    if (Hax_GetLongFromObj(interp, objv[2], &index) != HAX_OK) {
 	return HAX_ERROR;
     }
 
     /*
-     * Skip over the first "index" elements of the list, then add
-     * all of those elements to the result.
+     * Copy the list up through element index-1, then add the new
+     * elements and the remainder of the original list.
      */
 
-    size = 0;
-    element = argv[1];
-    for (count = 0, p = argv[1]; (count < index) && (*p != 0); count++) {
-	result = HaxFindElement(interp, p, &element, &p, &size, (int *) NULL);
-	if (result != HAX_OK) {
-	    return result;
-	}
+    if (ListBoundary(interp, objv[1], index, &end, &start) != HAX_OK) {
+	return HAX_ERROR;
     }
-    if (*p == 0) {
-	Hax_AppendResult(interp, argv[1], (char *) NULL);
-    } else {
-	char *end;
-
-	end = element+size;
-	if (element != argv[1]) {
-	    while ((*end != 0) && !isspace(*end)) {
-		end++;
-	    }
-	}
-	savedChar = *end;
-	*end = 0;
-	Hax_AppendResult(interp, argv[1], (char *) NULL);
-	*end = savedChar;
+    list = Hax_GetStringFromObj(interp, objv[1], &length);
+    if (start == length) {
+	Hax_AppendResult(interp, list, (char *) NULL);
+    } else if (end > 0) {
+	prefix = HaxScratchAlloc((Interp *) interp, end + 1);
+	memcpy(prefix, list, (size_t) end);
+	prefix[end] = 0;
+	Hax_AppendResult(interp, prefix, (char *) NULL);
     }
-
-    /*
-     * Add the new list elements.
-     */
-
-    for (i = 3; i < argc; i++) {
-	Hax_AppendElement(interp, argv[i], 0);
+    for (i = 3; i < objc; i++) {
+	Hax_AppendElement(interp,
+		Hax_GetStringFromObj(interp, objv[i], (int *) NULL), 0);
     }
-
-    /*
-     * Append the remainder of the original list.
-     */
-
-    if (*p != 0) {
-	Hax_AppendResult(interp, " ", p, (char *) NULL);
+    if (start != length) {
+	Hax_AppendResult(interp, " ", list + start, (char *) NULL);
     }
     return HAX_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * Hax_ListCmd --
+ * Hax_ListObjCmd --
  *
  *	This procedure is invoked to process the "list" Hax command.
  *	See the user documentation for details on what it does.
@@ -791,26 +1139,26 @@ Hax_LinsertCmd(
 
 	/* ARGSUSED */
 int
-Hax_ListCmd(
+Hax_ListObjCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
-    if (argc < 2) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc < 2) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" arg ?arg ...?\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    interp->result = Hax_Merge(interp, argc-1, argv+1);
-    interp->freeProc = (Hax_FreeProc *) free;
+    Hax_SetObjResult(interp, Hax_NewListObj(interp, objc-1, objv+1));
     return HAX_OK;
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LlengthCmd --
+ * Hax_LlengthObjCmd --
  *
  *	This procedure is invoked to process the "llength" Hax command.
  *	See the user documentation for details on what it does.
@@ -826,21 +1174,37 @@ Hax_ListCmd(
 
 	/* ARGSUSED */
 int
-Hax_LlengthCmd(
+Hax_LlengthObjCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
     long int count, result;
     char *element, *p;
+    int length;
 
-    if (argc != 2) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc != 2) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" list\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    for (count = 0, p = argv[1]; *p != 0 ; count++) {
+
+    /*
+     * Use the list form if the value already has it or will be used
+     * again (see Hax_LindexObjCmd);  otherwise just count elements.
+     */
+
+    if ((objv[1]->type == HAX_OBJ_LIST) || Hax_IsShared(objv[1])) {
+	if (Hax_ListObjLength(interp, objv[1], &length) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+	sprintf(interp->result, "%d", length);
+	return HAX_OK;
+    }
+    for (count = 0, p = Hax_GetStringFromObj(interp, objv[1], (int *) NULL);
+	    *p != 0 ; count++) {
 	result = HaxFindElement(interp, p, &element, &p, (long int *) NULL,
 		(int *) NULL);
 	if (result != HAX_OK) {
@@ -857,7 +1221,7 @@ Hax_LlengthCmd(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LrangeCmd --
+ * Hax_LrangeObjCmd --
  *
  *	This procedure is invoked to process the "lrange" Hax command.
  *	See the user documentation for details on what it does.
@@ -873,35 +1237,38 @@ Hax_LlengthCmd(
 
 	/* ARGSUSED */
 int
-Hax_LrangeCmd(
+Hax_LrangeObjCmd(
     ClientData notUsed,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
-    long int first, last, result;
-    char *begin, *end, c, *dummy;
-    int count;
+    long int first, last;
+    char *list, *lastString;
+    int length, begin, end, dummy;
 
-    if (argc != 4) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc != 4) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" list first last\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    if (Hax_GetLong(interp, argv[2], &first) != HAX_OK) {
+    if (Hax_GetLongFromObj(interp, objv[2], &first) != HAX_OK) {
 	return HAX_ERROR;
     }
     if (first < 0) {
 	first = 0;
     }
-    if ((*argv[3] == 'e') && (strncmp(argv[3], "end", strlen(argv[3])) == 0)) {
+    lastString = Hax_GetStringFromObj(interp, objv[3], (int *) NULL);
+    if ((*lastString == 'e')
+	    && (strncmp(lastString, "end", strlen(lastString)) == 0)) {
 	last = 1000000;
     } else {
-	if (Hax_GetLong(interp, argv[3], &last) != HAX_OK) {
+	if (Hax_GetLongFromObj(interp, objv[3], &last) != HAX_OK) {
 	    Hax_ResetResult(interp);
 	    Hax_AppendResult(interp,
 		    "expected integer or \"end\" but got \"",
-		    argv[3], "\"", (char *) NULL);
+		    lastString, "\"", (char *) NULL);
 	    return HAX_ERROR;
 	}
     }
@@ -910,46 +1277,28 @@ Hax_LrangeCmd(
     }
 
     /*
-     * Extract a range of fields.
+     * Extract a range of fields:  from the start of element first to
+     * the end of element last.
      */
 
-    for (count = 0, begin = argv[1]; count < first; count++) {
-	result = HaxFindElement(interp, begin, &dummy, &begin,
-		(long int *) NULL, (int *) NULL);
-	if (result != HAX_OK) {
-	    return result;
-	}
-	if (*begin == 0) {
-	    break;
-	}
-    }
-    for (count = first, end = begin; (count <= last) && (*end != 0);
-	    count++) {
-	result = HaxFindElement(interp, end, &dummy, &end, (long int *) NULL,
-		(int *) NULL);
-	if (result != HAX_OK) {
-	    return result;
-	}
+    if ((ListBoundary(interp, objv[1], first, &dummy, &begin) != HAX_OK)
+	    || (ListBoundary(interp, objv[1], last+1, &end, &dummy)
+	    != HAX_OK)) {
+	return HAX_ERROR;
     }
-
-    /*
-     * Chop off trailing spaces.
-     */
-
-    while (isspace(end[-1])) {
-	end--;
+    list = Hax_GetStringFromObj(interp, objv[1], &length);
+    if ((begin == length) || (end <= begin)) {
+	return HAX_OK;
     }
-    c = *end;
-    *end = 0;
-    Hax_SetResult(interp, begin, HAX_VOLATILE);
-    *end = c;
+    Hax_SetObjResult(interp, Hax_NewStringObj(interp, list + begin,
+	    end - begin));
     return HAX_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LreplaceCmd --
+ * Hax_LreplaceObjCmd --
  *
  *	This procedure is invoked to process the "lreplace" Hax command.
  *	See the user documentation for details on what it does.
@@ -965,25 +1314,28 @@ Hax_LrangeCmd(
 
 	/* ARGSUSED */
 int
-Hax_LreplaceCmd(
+Hax_LreplaceObjCmd(
     ClientData notUsed,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
-    char *p1, *p2, *element, savedChar, *dummy;
-    long int i, first, last, count, size;
-    int result;
+    char *list, *prefix;
+    long int first, last;
+    int i, length, end, start, dummy;
 
-    if (argc < 4) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+    if (objc < 4) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
 		" list first last ?element element ...?\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    if (Hax_GetLong(interp, argv[2], &first) != HAX_OK) {
+    if (Hax_GetLongFromObj(interp, objv[2], &first) != HAX_OK) {
 	return HAX_ERROR;
     }
-    if (HaxGetListIndex(interp, argv[3], &last) != HAX_OK) {
+    if (HaxGetListIndex(interp,
+	    Hax_GetStringFromObj(interp, objv[3], (int *) NULL), &last)
+	    != HAX_OK) {
 	return HAX_ERROR;
     }
     if (first < 0) {
@@ -999,79 +1351,54 @@ Hax_LreplaceCmd(
     }
 
     /*
-     * Skip over the elements of the list before "first".
+     * Find the text before element "first" and the text after element
+     * "last".
      */
 
-    size = 0;
-    element = argv[1];
-    for (count = 0, p1 = argv[1]; (count < first) && (*p1 != 0); count++) {
-	result = HaxFindElement(interp, p1, &element, &p1, &size,
-		(int *) NULL);
-	if (result != HAX_OK) {
-	    return result;
-	}
+    if (ListBoundary(interp, objv[1], first, &end, &start) != HAX_OK) {
+	return HAX_ERROR;
     }
-    if (*p1 == 0) {
+    list = Hax_GetStringFromObj(interp, objv[1], &length);
+    if (start == length) {
 	Hax_AppendResult(interp, "list doesn't contain element ",
-		argv[2], (char *) NULL);
+		Hax_GetStringFromObj(interp, objv[2], (int *) NULL),
+		(char *) NULL);
 	return HAX_ERROR;
     }
-
-    /*
-     * Skip over the elements of the list up through "last".
-     */
-
-    for (p2 = p1 ; (count <= last) && (*p2 != 0); count++) {
-	result = HaxFindElement(interp, p2, &dummy, &p2, (long int *) NULL,
-		(int *) NULL);
-	if (result != HAX_OK) {
-	    return result;
-	}
+    if (ListBoundary(interp, objv[1], last+1, &dummy, &start) != HAX_OK) {
+	return HAX_ERROR;
     }
 
     /*
-     * Add the elements before "first" to the result.  Be sure to
-     * include quote or brace characters that might terminate the
-     * last of these elements.
+     * Add the elements before "first" to the result, including quote
+     * or brace characters that might terminate the last of these
+     * elements, then the new elements and the rest of the list.
      */
 
-    p1 = element+size;
-    if (element != argv[1]) {
-	while ((*p1 != 0) && !isspace(*p1)) {
-	    p1++;
-	}
+    if (end > 0) {
+	prefix = HaxScratchAlloc((Interp *) interp, end + 1);
+	memcpy(prefix, list, (size_t) end);
+	prefix[end] = 0;
+	Hax_AppendResult(interp, prefix, (char *) NULL);
     }
-    savedChar = *p1;
-    *p1 = 0;
-    Hax_AppendResult(interp, argv[1], (char *) NULL);
-    *p1 = savedChar;
-
-    /*
-     * Add the new list elements.
-     */
-
-    for (i = 4; i < argc; i++) {
-	Hax_AppendElement(interp, argv[i], 0);
+    for (i = 4; i < objc; i++) {
+	Hax_AppendElement(interp,
+		Hax_GetStringFromObj(interp, objv[i], (int *) NULL), 0);
     }
-
-    /*
-     * Append the remainder of the original list.
-     */
-
-    if (*p2 != 0) {
+    if (start != length) {
 	if (*interp->result == 0) {
-	    Hax_SetResult(interp, p2, HAX_VOLATILE);
+	    Hax_SetResult(interp, list + start, HAX_VOLATILE);
 	} else {
-	    Hax_AppendResult(interp, " ", p2, (char *) NULL);
+	    Hax_AppendResult(interp, " ", list + start, (char *) NULL);
 	}
     }
     return HAX_OK;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LsearchCmd --
+ * Hax_LsearchObjCmd --
  *
  *	This procedure is invoked to process the "lsearch" Hax command.
  *	See the user documentation for details on what it does.
@@ -1087,42 +1414,375 @@ Hax_LreplaceCmd(
 
 	/* ARGSUSED */
 int
-Hax_LsearchCmd(
+Hax_LsearchObjCmd(
     ClientData notUsed,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
     Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
+    SearchInfo info;
     int listArgc;
     char **listArgv;
-    int i, match;
-
-    if (argc != 3) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
-		" list pattern\"", (char *) NULL);
-	return HAX_ERROR;
+    Hax_Obj **elemv;
+    Hax_Obj *patternPtr;
+    char *option, buffer[30];
+    int *indices = NULL;
+    int i, length, match, found, all, sorted, order, result;
+
+    info.mode = SEARCH_GLOB;
+    info.type = SORT_ASCII;
+    info.decreasing = 0;
+    info.regexpPtr = NULL;
+    info.glob = NULL;
+    all = sorted = 0;
+    for (i = 1; i < objc-2; i++) {
+	option = Hax_GetStringFromObj(interp, objv[i], &length);
+	if ((length > 1) && (strncmp(option, "-all", length) == 0)) {
+	    all = 1;
+	} else if ((length > 1) && (strncmp(option, "-ascii", length) == 0)) {
+	    info.type = SORT_ASCII;
+	} else if ((length > 1)
+		&& (strncmp(option, "-decreasing", length) == 0)) {
+	    info.decreasing = 1;
+	} else if ((length > 1) && (strncmp(option, "-exact", length) == 0)) {
+	    info.mode = SEARCH_EXACT;
+	} else if ((length > 1) && (strncmp(option, "-glob", length) == 0)) {
+	    info.mode = SEARCH_GLOB;
+	} else if ((length > 1) && (strncmp(option, "-integer", length) == 0)) {
+	    info.type = SORT_INTEGER;
+	} else if ((length > 1)
+		&& (strncmp(option, "-increasing", length) == 0)) {
+	    info.decreasing = 0;
+	} else if ((length > 1) && (strncmp(option, "-real", length) == 0)) {
+	    info.type = SORT_REAL;
+	} else if ((length > 1) && (strncmp(option, "-regexp", length) == 0)) {
+	    info.mode = SEARCH_REGEXP;
+	} else if ((length > 1) && (strncmp(option, "-sorted", length) == 0)) {
+	    sorted = 1;
+	} else {
+	    Hax_AppendResult(interp, "bad option \"", option,
+		    "\": must be -all, -ascii, -decreasing, -exact, -glob, ",
+		    "-increasing, -integer, -real, -regexp, or -sorted",
+		    (char *) NULL);
+	    return HAX_ERROR;
+	}
     }
-    if (Hax_SplitList(interp, argv[1], &listArgc, &listArgv) != HAX_OK) {
+    if (objc < 3) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
+		" ?options? list pattern\"", (char *) NULL);
 	return HAX_ERROR;
     }
+
+    /*
+     * A sorted list is searched for an exact match;  the search for a
+     * pattern can't use the order.  -integer and -real only make sense
+     * for exact matches, so they imply -exact.
+     */
+
+    if (sorted || (info.type != SORT_ASCII)) {
+	if (info.mode == SEARCH_REGEXP) {
+	    Hax_AppendResult(interp, "-regexp can't be used with ",
+		    sorted ? "-sorted" : "-integer or -real", (char *) NULL);
+	    return HAX_ERROR;
+	}
+	info.mode = SEARCH_EXACT;
+    }
+    patternPtr = objv[objc-1];
+    info.pattern = Hax_GetStringFromObj(interp, patternPtr, &info.length);
+    if (info.type == SORT_INTEGER) {
+	if (Hax_GetLongLong(interp, info.pattern, &info.intValue) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+    } else if (info.type == SORT_REAL) {
+	if (Hax_GetDoubleFromObj(interp, patternPtr, &info.doubleValue)
+		!= HAX_OK) {
+	    return HAX_ERROR;
+	}
+	if (info.doubleValue != info.doubleValue) {
+	    Hax_AppendResult(interp,
+		    "expected floating-point number but got \"",
+		    info.pattern, "\"", (char *) NULL);
+	    return HAX_ERROR;
+	}
+    } else if (info.mode == SEARCH_REGEXP) {
+	info.regexpPtr = HaxCompileRegexp(interp, info.pattern);
+	if (info.regexpPtr == NULL) {
+	    return HAX_ERROR;
+	}
+    } else if (info.mode == SEARCH_GLOB) {
+	info.glob = Hax_CompilePattern(interp, info.pattern);
+    }
     match = -1;
-    for (i = 0; i < listArgc; i++) {
-	if (Hax_StringMatch(listArgv[i], argv[2])) {
+    found = 0;
+
+    if (sorted) {
+	/*
+	 * Binary search for the first element that doesn't come before
+	 * the pattern, then take it (and under -all, those after it) if
+	 * equal.  This always uses the list form, so the elements are
+	 * split (and for -integer or -real, converted) only once for a
+	 * table that is searched over and over.
+	 */
+
+	int low, high, mid;
+
+	if (Hax_ListObjGetElements(interp, objv[objc-2], &listArgc, &elemv)
+		!= HAX_OK) {
+	    goto error;
+	}
+	if (all) {
+	    indices = (int *) HaxScratchAlloc(iPtr,
+		    (unsigned) ((listArgc + 1) * sizeof(int)));
+	}
+	low = 0;
+	high = listArgc;
+	while (low < high) {
+	    mid = (low + high)/2;
+	    if (SearchCompare(interp, &info, elemv[mid], (char *) NULL,
+		    &order) != HAX_OK) {
+		goto error;
+	    }
+	    if (info.decreasing) {
+		order = -order;
+	    }
+	    if (order < 0) {
+		low = mid + 1;
+	    } else {
+		high = mid;
+	    }
+	}
+	for (i = low; i < listArgc; i++) {
+	    if (SearchCompare(interp, &info, elemv[i], (char *) NULL,
+		    &order) != HAX_OK) {
+		goto error;
+	    }
+	    if (order != 0) {
+		break;
+	    }
 	    match = i;
-	    break;
+	    if (!all) {
+		break;
+	    }
+	    indices[found++] = i;
+	}
+    } else if ((objv[objc-2]->type == HAX_OBJ_LIST)
+	    || Hax_IsShared(objv[objc-2])) {
+	/*
+	 * Use the list form if the value already has it or will be used
+	 * again (see Hax_LindexObjCmd);  otherwise split it in scratch
+	 * space.
+	 */
+
+	if (Hax_ListObjGetElements(interp, objv[objc-2], &listArgc, &elemv)
+		!= HAX_OK) {
+	    goto error;
+	}
+	if (all) {
+	    indices = (int *) HaxScratchAlloc(iPtr,
+		    (unsigned) ((listArgc + 1) * sizeof(int)));
+	}
+	for (i = 0; i < listArgc; i++) {
+	    if (SearchMatch(interp, &info, elemv[i], (char *) NULL,
+		    &result) != HAX_OK) {
+		goto error;
+	    }
+	    if (result) {
+		match = i;
+		if (!all) {
+		    break;
+		}
+		indices[found++] = i;
+	    }
+	}
+    } else {
+	if (HaxScratchSplitList(interp,
+		Hax_GetStringFromObj(interp, objv[objc-2], (int *) NULL),
+		&listArgc, &listArgv) != HAX_OK) {
+	    goto error;
 	}
+	if (all) {
+	    indices = (int *) HaxScratchAlloc(iPtr,
+		    (unsigned) ((listArgc + 1) * sizeof(int)));
+	}
+	for (i = 0; i < listArgc; i++) {
+	    if (SearchMatch(interp, &info, (Hax_Obj *) NULL, listArgv[i],
+		    &result) != HAX_OK) {
+		goto error;
+	    }
+	    if (result) {
+		match = i;
+		if (!all) {
+		    break;
+		}
+		indices[found++] = i;
+	    }
+	}
+    }
+    if (all) {
+	for (i = 0; i < found; i++) {
+	    sprintf(buffer, "%d", indices[i]);
+	    Hax_AppendElement(interp, buffer, 0);
+	}
+    } else {
+	sprintf(interp->result, "%d", match);
+    }
+    if (info.glob != NULL) {
+	Hax_FreePattern(interp, info.glob);
     }
-    sprintf(interp->result, "%d", match);
-    ckfree(memoryp, (char *) listArgv);
     return HAX_OK;
+
+    error:
+    if (info.glob != NULL) {
+	Hax_FreePattern(interp, info.glob);
+    }
+    return HAX_ERROR;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchMatch --
+ *
+ *	Find out whether a list element matches the pattern of an
+ *	"lsearch" command.
+ *
+ * Results:
+ *	A standard Hax result.  If HAX_OK, *matchPtr is set to 1 if the
+ *	element matches and 0 if not.
+ *
+ * Side effects:
+ *	Under -integer or -real, the element is converted to a number.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SearchMatch(
+    Hax_Interp *interp,		/* For error reporting. */
+    SearchInfo *infoPtr,	/* What to look for. */
+    Hax_Obj *elemPtr,		/* Element to check, or NULL to use
+				 * string instead. */
+    char *string,		/* Element to check, if elemPtr is NULL. */
+    int *matchPtr)		/* Where to store the answer. */
+{
+    Interp *iPtr = (Interp *) interp;
+    int order;
+
+    if (infoPtr->mode == SEARCH_EXACT) {
+	if (SearchCompare(interp, infoPtr, elemPtr, string, &order)
+		!= HAX_OK) {
+	    return HAX_ERROR;
+	}
+	*matchPtr = (order == 0);
+	return HAX_OK;
+    }
+    if (elemPtr != NULL) {
+	string = Hax_GetStringFromObj(interp, elemPtr, (int *) NULL);
+    }
+    if (infoPtr->mode == SEARCH_REGEXP) {
+	iPtr->haxRegexpError = NULL;
+	*matchPtr = RegExec(interp, infoPtr->regexpPtr, string);
+	if (iPtr->haxRegexpError != NULL) {
+	    Hax_ResetResult(interp);
+	    Hax_AppendResult(interp, "error while matching pattern: ",
+		    iPtr->haxRegexpError, (char *) NULL);
+	    return HAX_ERROR;
+	}
+    } else {
+	*matchPtr = Hax_PatternMatch(infoPtr->glob, string);
+    }
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SearchCompare --
+ *
+ *	Compare a list element with the pattern of an "lsearch -exact"
+ *	or "lsearch -sorted" command, in the same way "lsort" with the
+ *	same -ascii, -integer or -real option would.
+ *
+ * Results:
+ *	A standard Hax result.  If HAX_OK, *orderPtr is set to a value
+ *	less than, equal to, or greater than zero if the element comes
+ *	before, is equal to, or comes after the pattern in increasing
+ *	order.
+ *
+ * Side effects:
+ *	Under -integer or -real, the element is converted to a number.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SearchCompare(
+    Hax_Interp *interp,		/* For error reporting. */
+    SearchInfo *infoPtr,	/* What to look for. */
+    Hax_Obj *elemPtr,		/* Element to compare, or NULL to use
+				 * string instead. */
+    char *string,		/* Element to compare, if elemPtr is
+				 * NULL. */
+    int *orderPtr)		/* Where to store the answer. */
+{
+    long long intValue;
+    double doubleValue;
+    int length;
+
+    switch (infoPtr->type) {
+	case SORT_INTEGER:
+	    if (elemPtr != NULL) {
+		string = Hax_GetStringFromObj(interp, elemPtr, (int *) NULL);
+	    }
+	    if (Hax_GetLongLong(interp, string, &intValue) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    *orderPtr = (intValue > infoPtr->intValue)
+		    - (intValue < infoPtr->intValue);
+	    break;
+	case SORT_REAL:
+	    if (((elemPtr != NULL)
+		    ? Hax_GetDoubleFromObj(interp, elemPtr, &doubleValue)
+		    : Hax_GetDouble(interp, string, &doubleValue)) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    if (doubleValue != doubleValue) {
+		/*
+		 * NaN never equals the pattern;  it's taken to sort after
+		 * every number.
+		 */
+
+		*orderPtr = 1;
+		break;
+	    }
+	    *orderPtr = (doubleValue > infoPtr->doubleValue)
+		    - (doubleValue < infoPtr->doubleValue);
+	    break;
+	default:
+	    /*
+	     * Neither string holds a null character, so comparing one
+	     * byte past the shorter length orders them as strcmp would.
+	     */
+
+	    if (elemPtr != NULL) {
+		string = Hax_GetStringFromObj(interp, elemPtr, &length);
+	    } else {
+		length = strlen(string);
+	    }
+	    *orderPtr = memcmp(string, infoPtr->pattern,
+		    ((length < infoPtr->length) ? length : infoPtr->length)
+		    + 1);
+	    break;
+    }
+    return HAX_OK;
+}
+
 /*
  *----------------------------------------------------------------------
  *
- * Hax_LsortCmd --
+ * Hax_LsortObjCmd --
  *
  *	This procedure is invoked to process the "lsort" Hax command.
  *	See the user documentation for details on what it does.
@@ -1138,40 +1798,758 @@ Hax_LsearchCmd(
 
 	/* ARGSUSED */
 int
-Hax_LsortCmd(
+Hax_LsortObjCmd(
     ClientData notUsed,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
-    int argc,				/* Number of arguments. */
-    char **argv				/* Argument strings. */)
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
 {
     Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
-    int listArgc;
-    char **listArgv;
+    SortInfo info;
+    SortItem *items, *tmp;
+    Hax_Obj *listPtr, *keyPtr, **elemv, **resultv;
+    Hax_Obj *commandPtr = NULL;
+    int listArgc, cmdArgc, unique, index, count, i, length, result;
+    char **cmdArgv, *option, *indexString = NULL;
+#ifdef HAX_THREADS
+    int threads;
+#endif
 
-    if (argc != 2) {
-	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
-		" list\"", (char *) NULL);
+    info.mode = SORT_ASCII;
+    info.decreasing = 0;
+    info.interp = interp;
+    info.cmdc = 0;
+    info.cmdv = NULL;
+    info.result = HAX_OK;
+    unique = 0;
+    index = -2;
+    for (i = 1; i < objc-1; i++) {
+	option = Hax_GetStringFromObj(interp, objv[i], &length);
+	if ((length > 1) && (strncmp(option, "-ascii", length) == 0)) {
+	    info.mode = SORT_ASCII;
+	} else if ((length > 1) && (strncmp(option, "-integer", length) == 0)) {
+	    info.mode = SORT_INTEGER;
+	} else if ((length > 1) && (strncmp(option, "-real", length) == 0)) {
+	    info.mode = SORT_REAL;
+	} else if ((length > 1)
+		&& (strncmp(option, "-increasing", length) == 0)) {
+	    info.decreasing = 0;
+	} else if ((length > 1)
+		&& (strncmp(option, "-decreasing", length) == 0)) {
+	    info.decreasing = 1;
+	} else if ((length > 1) && (strncmp(option, "-unique", length) == 0)) {
+	    unique = 1;
+	} else if ((length > 1) && (strncmp(option, "-command", length) == 0)) {
+	    if (i == objc-2) {
+		Hax_AppendResult(interp, "\"-command\" option must be ",
+			"followed by a value", (char *) NULL);
+		return HAX_ERROR;
+	    }
+	    info.mode = SORT_COMMAND;
+	    commandPtr = objv[++i];
+	} else if ((length > 1) && (strncmp(option, "-index", length) == 0)) {
+	    if (i == objc-2) {
+		Hax_AppendResult(interp, "\"-index\" option must be ",
+			"followed by a value", (char *) NULL);
+		return HAX_ERROR;
+	    }
+	    indexString = Hax_GetStringFromObj(interp, objv[++i],
+		    (int *) NULL);
+	    if (strcmp(indexString, "end") == 0) {
+		index = -1;
+	    } else if (Hax_GetIntFromObj(interp, objv[i], &index) != HAX_OK) {
+		return HAX_ERROR;
+	    } else if (index < 0) {
+		Hax_AppendResult(interp, "bad index \"", indexString,
+			"\": must be a non-negative integer or end",
+			(char *) NULL);
+		return HAX_ERROR;
+	    }
+	} else {
+	    Hax_AppendResult(interp, "bad option \"", option,
+		    "\": must be -ascii, -command, -decreasing, -increasing, ",
+		    "-index, -integer, -real, or -unique", (char *) NULL);
+	    return HAX_ERROR;
+	}
+    }
+    if (objc < 2) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
+		" ?options? list\"", (char *) NULL);
 	return HAX_ERROR;
     }
-    if (Hax_SplitList(interp, argv[1], &listArgc, &listArgv) != HAX_OK) {
+
+    /*
+     * A -command script could change the list's internal form (and
+     * with it the elements) while the sort is going on, so work from a
+     * private copy in that case.
+     */
+
+    listPtr = objv[objc-1];
+    if (Hax_ListObjGetElements(interp, listPtr, &listArgc, &elemv)
+	    != HAX_OK) {
 	return HAX_ERROR;
     }
-    qsort(listArgv, listArgc, sizeof (char *), SortCompareProc);
-    interp->result = Hax_Merge(interp, listArgc, listArgv);
-    interp->freeProc = (Hax_FreeProc *) free;
-    ckfree(memoryp, (char *) listArgv);
-    return HAX_OK;
+    if (info.mode == SORT_COMMAND) {
+	listPtr = Hax_DuplicateObj(interp, listPtr);
+	Hax_IncrRefCount(listPtr);
+	if (Hax_ListObjGetElements(interp, listPtr, &listArgc, &elemv)
+		!= HAX_OK) {
+	    Hax_DecrRefCount(interp, listPtr);
+	    return HAX_ERROR;
+	}
+	if (HaxScratchSplitList(interp,
+		Hax_GetStringFromObj(interp, commandPtr, (int *) NULL),
+		&cmdArgc, &cmdArgv) != HAX_OK) {
+	    Hax_DecrRefCount(interp, listPtr);
+	    return HAX_ERROR;
+	}
+	info.cmdc = cmdArgc + 2;
+	info.cmdv = (Hax_Obj **) HaxScratchAlloc(iPtr,
+		(unsigned) (info.cmdc * sizeof(Hax_Obj *)));
+	for (i = 0; i < cmdArgc; i++) {
+	    info.cmdv[i] = Hax_NewStringObj(interp, cmdArgv[i], -1);
+	    Hax_IncrRefCount(info.cmdv[i]);
+	}
+    }
+
+    /*
+     * Find each element's key.  Under -command the keys are held for
+     * the same reason the list is copied.
+     */
+
+    result = HAX_OK;
+    items = (SortItem *) HaxScratchAlloc(iPtr,
+	    (unsigned) (listArgc * sizeof(SortItem)));
+    for (count = 0; count < listArgc; count++) {
+	keyPtr = elemv[count];
+	if (index != -2) {
+	    if (Hax_ListObjLength(interp, keyPtr, &i) != HAX_OK) {
+		result = HAX_ERROR;
+		break;
+	    }
+	    i = (index == -1) ? i-1 : index;
+	    if (Hax_ListObjIndex(interp, keyPtr, i, &keyPtr) != HAX_OK) {
+		result = HAX_ERROR;
+		break;
+	    }
+	    if (keyPtr == NULL) {
+		Hax_AppendResult(interp, "element ", indexString,
+			" missing from sublist \"",
+			Hax_GetStringFromObj(interp, elemv[count],
+			(int *) NULL), "\"", (char *) NULL);
+		result = HAX_ERROR;
+		break;
+	    }
+	}
+	items[count].elemPtr = elemv[count];
+	switch (info.mode) {
+	    case SORT_INTEGER:
+		result = Hax_GetLongLong(interp, Hax_GetStringFromObj(interp,
+			keyPtr, (int *) NULL), &items[count].key.intValue);
+		break;
+	    case SORT_REAL:
+		result = Hax_GetDoubleFromObj(interp, keyPtr,
+			&items[count].key.doubleValue);
+
+		/*
+		 * NaN isn't ordered with respect to anything, so it would
+		 * leave the sort's result undefined.
+		 */
+
+		if ((result == HAX_OK) && (items[count].key.doubleValue
+			!= items[count].key.doubleValue)) {
+		    Hax_AppendResult(interp,
+			    "expected floating-point number but got \"",
+			    Hax_GetStringFromObj(interp, keyPtr, (int *) NULL),
+			    "\"", (char *) NULL);
+		    result = HAX_ERROR;
+		}
+		break;
+	    case SORT_COMMAND:
+		items[count].key.objPtr = keyPtr;
+		Hax_IncrRefCount(keyPtr);
+		break;
+	    default:
+		items[count].key.string = Hax_GetStringFromObj(interp,
+			keyPtr, (int *) NULL);
+		items[count].prefix = SortPrefix(items[count].key.string);
+		break;
+	}
+	if (result != HAX_OK) {
+	    break;
+	}
+    }
+
+    if (result == HAX_OK) {
+#ifdef HAX_THREADS
+	threads = 1;
+	if ((info.mode != SORT_COMMAND) && (count >= SORT_PARALLEL_MIN)) {
+	    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	    threads = iPtr->sortThreads;
+	    if ((cpus > 0) && (cpus < threads)) {
+		threads = (int) cpus;
+	    }
+	}
+	if (threads > 1) {
+	    tmp = (SortItem *) HaxScratchAlloc(iPtr,
+		    (unsigned) (count * sizeof(SortItem)));
+	    SortParallel(&info, items, tmp, count, threads);
+	} else
+#endif
+	{
+	    tmp = (SortItem *) HaxScratchAlloc(iPtr,
+		    (unsigned) ((count/2 + 1) * sizeof(SortItem)));
+	    SortItems(&info, items, tmp, count);
+	}
+	result = info.result;
+    }
+    if (result == HAX_OK) {
+	resultv = (Hax_Obj **) HaxScratchAlloc(iPtr,
+		(unsigned) ((count + 1) * sizeof(Hax_Obj *)));
+	listArgc = 0;
+	for (i = 0; i < count; i++) {
+	    /*
+	     * With -unique only the last of a run of equal keys is kept.
+	     */
+
+	    if (unique && (i < count-1)
+		    && (SortCompare(&info, &items[i], &items[i+1]) == 0)) {
+		continue;
+	    }
+	    resultv[listArgc++] = items[i].elemPtr;
+	}
+	result = info.result;
+	if (result == HAX_OK) {
+	    Hax_SetObjResult(interp, Hax_NewListObj(interp, listArgc,
+		    resultv));
+	}
+    }
+
+    if (info.mode == SORT_COMMAND) {
+	for (i = 0; i < count; i++) {
+	    Hax_DecrRefCount(interp, items[i].key.objPtr);
+	}
+	for (i = 0; i < info.cmdc-2; i++) {
+	    Hax_DecrRefCount(interp, info.cmdv[i]);
+	}
+	Hax_DecrRefCount(interp, listPtr);
+    }
+    return result;
 }
 
 /*
- * The procedure below is called back by qsort to determine
- * the proper ordering between two elements.
+ *----------------------------------------------------------------------
+ *
+ * SortItems --
+ *
+ *	Sort an array of items for "lsort".  This is a merge sort, so
+ *	items with equal keys stay in the order they started in.  Short
+ *	runs are sorted by insertion, and two sorted halves that are
+ *	already in order aren't merged at all, so a list that is sorted
+ *	or nearly so takes little more than one comparison per element.
+ *
+ * Results:
+ *	None.  If a -command comparison fails, infoPtr->result is set
+ *	and the items are left in an arbitrary order.
+ *
+ * Side effects:
+ *	The items are reordered.  Tmp is used as working space;  it must
+ *	have room for count/2 items.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SortItems(
+    SortInfo *infoPtr,		/* How to compare items. */
+    SortItem *items,		/* Items to sort. */
+    SortItem *tmp,		/* Working space. */
+    int count)			/* Number of items. */
+{
+    SortItem item;
+    int i, j, k, mid;
+
+    if (count <= SORT_RUN) {
+	for (i = 1; i < count; i++) {
+	    item = items[i];
+	    for (j = i; (j > 0)
+		    && (SortCompare(infoPtr, &items[j-1], &item) > 0); j--) {
+		items[j] = items[j-1];
+	    }
+	    items[j] = item;
+	}
+	return;
+    }
+    mid = count/2;
+    SortItems(infoPtr, items, tmp, mid);
+    SortItems(infoPtr, items+mid, tmp, count-mid);
+    if (SortCompare(infoPtr, &items[mid-1], &items[mid]) <= 0) {
+	return;
+    }
+
+    /*
+     * If everything in the second half comes before the first (as for
+     * a list in reverse order), just swap the halves.
+     */
+
+    memcpy((void *) tmp, (void *) items, mid * sizeof(SortItem));
+    if (SortCompare(infoPtr, &items[count-1], &tmp[0]) < 0) {
+	memmove((void *) items, (void *) (items+mid),
+		(count-mid) * sizeof(SortItem));
+	memcpy((void *) (items+count-mid), (void *) tmp,
+		mid * sizeof(SortItem));
+	return;
+    }
+    i = 0;
+    j = mid;
+    k = 0;
+    while ((i < mid) && (j < count)) {
+	if (SortCompare(infoPtr, &items[j], &tmp[i]) < 0) {
+	    items[k++] = items[j++];
+	} else {
+	    items[k++] = tmp[i++];
+	}
+    }
+    while (i < mid) {
+	items[k++] = tmp[i++];
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortCompare --
+ *
+ *	Compare the keys of two items for "lsort".
+ *
+ * Results:
+ *	Negative if the first item belongs before the second, positive
+ *	if after, and zero if their keys are equal.  Once a -command
+ *	comparison has failed, all items compare equal.
+ *
+ * Side effects:
+ *	Under -command, the command is run.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SortCompare(
+    SortInfo *infoPtr,		/* How to compare items. */
+    SortItem *firstPtr,		/* Items to compare. */
+    SortItem *secondPtr)
+{
+    int order;
+
+    switch (infoPtr->mode) {
+	case SORT_INTEGER:
+	    order = (firstPtr->key.intValue > secondPtr->key.intValue)
+		    - (firstPtr->key.intValue < secondPtr->key.intValue);
+	    break;
+	case SORT_REAL:
+	    order = (firstPtr->key.doubleValue > secondPtr->key.doubleValue)
+		    - (firstPtr->key.doubleValue
+		    < secondPtr->key.doubleValue);
+	    break;
+	case SORT_COMMAND:
+	    order = SortCommand(infoPtr, firstPtr, secondPtr);
+	    break;
+	default:
+	    if (firstPtr->prefix != secondPtr->prefix) {
+		order = (firstPtr->prefix > secondPtr->prefix) ? 1 : -1;
+	    } else if ((firstPtr->prefix & 0xff) == 0) {
+		order = 0;		/* Both strings end within the prefix. */
+	    } else {
+		order = strcmp(firstPtr->key.string + sizeof(unsigned long),
+			secondPtr->key.string + sizeof(unsigned long));
+	    }
+	    break;
+    }
+    return infoPtr->decreasing ? -order : order;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortCommand --
+ *
+ *	Compare two items for "lsort -command" by running the command
+ *	with their keys appended.
+ *
+ * Results:
+ *	The sign of the integer the command returned (-1, 0, or 1).  If
+ *	the command fails or doesn't return an integer, infoPtr->result
+ *	is set and 0 is returned.
+ *
+ * Side effects:
+ *	Whatever the command does.
+ *
+ *----------------------------------------------------------------------
  */
 
 static int
-SortCompareProc(
-    const void *first, const void *second /* Elements to be compared. */)
+SortCommand(
+    SortInfo *infoPtr,		/* Command to run. */
+    SortItem *firstPtr,		/* Items to compare. */
+    SortItem *secondPtr)
+{
+    Hax_Interp *interp = infoPtr->interp;
+    int order;
+
+    if (infoPtr->result != HAX_OK) {
+	return 0;
+    }
+    infoPtr->cmdv[infoPtr->cmdc-2] = firstPtr->key.objPtr;
+    infoPtr->cmdv[infoPtr->cmdc-1] = secondPtr->key.objPtr;
+    infoPtr->result = Hax_EvalObjv(interp, infoPtr->cmdc, infoPtr->cmdv);
+    if (infoPtr->result != HAX_OK) {
+	if (infoPtr->result == HAX_ERROR) {
+	    Hax_AddErrorInfo(interp, "\n    (-compare command)");
+	}
+	return 0;
+    }
+    if (Hax_GetInt(interp, interp->result, &order) != HAX_OK) {
+	Hax_ResetResult(interp);
+	interp->result = (char *) "-compare command returned non-numeric result";
+	infoPtr->result = HAX_ERROR;
+	return 0;
+    }
+    return (order > 0) - (order < 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortPrefix --
+ *
+ *	Pack the first sizeof(unsigned long) characters of a string into
+ *	an unsigned long, first character in the high-order byte and
+ *	padded with zeroes, so that the prefixes of two strings compare
+ *	the same way strcmp would compare those characters.
+ *
+ * Results:
+ *	The packed prefix.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static unsigned long
+SortPrefix(
+    char *string)		/* String whose prefix is wanted. */
 {
-    return strcmp(*((char **) first), *((char **) second));
+    unsigned long prefix = 0;
+    int i;
+
+    for (i = 0; i < (int) sizeof(unsigned long); i++) {
+	prefix <<= 8;
+	if (*string != 0) {
+	    prefix |= (unsigned char) *string;
+	    string++;
+	}
+    }
+    return prefix;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_SetSortThreads --
+ *
+ *	Set the largest number of threads that "lsort" may use to sort
+ *	a large list in an interpreter.
+ *
+ * Results:
+ *	The previous limit.
+ *
+ * Side effects:
+ *	If threads is greater than zero it becomes the new limit (but
+ *	no more than MAX_SORT_THREADS);  otherwise the limit is
+ *	unchanged.  A limit of 1 makes every sort serial.  Builds
+ *	compiled without HAX_THREADS keep the limit but never use more
+ *	than one thread.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Hax_SetSortThreads(
+    Hax_Interp *interp,		/* Interpreter whose limit is to be
+				 * set. */
+    int threads)		/* New limit, or <= 0 to just query. */
+{
+    Interp *iPtr = (Interp *) interp;
+    int old = iPtr->sortThreads;
+
+    if (threads > 0) {
+	iPtr->sortThreads = (threads > MAX_SORT_THREADS)
+		? MAX_SORT_THREADS : threads;
+    }
+    return old;
+}
+
+#ifdef HAX_THREADS
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortParallel --
+ *
+ *	Sort an array of items for "lsort" using several threads.  The
+ *	order is the same as SortItems would produce.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The items are reordered.  Tmp is used as working space;  it must
+ *	have room for count items.  If a thread can't be started, its
+ *	part of the work is done in the calling thread instead.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SortParallel(
+    SortInfo *infoPtr,		/* How to compare items.  Must not be
+				 * SORT_COMMAND. */
+    SortItem *items,		/* Items to sort. */
+    SortItem *tmp,		/* Working space. */
+    int count,			/* Number of items. */
+    int threads)		/* Number of threads to use, between 2 and
+				 * MAX_SORT_THREADS. */
+{
+    SortTask tasks[MAX_SORT_THREADS];
+    pthread_t ids[MAX_SORT_THREADS];
+    int started[MAX_SORT_THREADS];
+    SortItem *src, *dst, *swap;
+    int width, i;
+
+    src = items;
+    dst = tmp;
+    for (width = 0; width < threads; width = (width == 0) ? 1 : 2*width) {
+	for (i = 0; i < threads; i++) {
+	    tasks[i].infoPtr = infoPtr;
+	    tasks[i].src = src;
+	    tasks[i].dst = dst;
+	    tasks[i].count = count;
+	    tasks[i].threads = threads;
+	    tasks[i].width = width;
+	    tasks[i].thread = i;
+	}
+	for (i = 1; i < threads; i++) {
+	    started[i] = (pthread_create(&ids[i], (pthread_attr_t *) NULL,
+		    SortThread, (void *) &tasks[i]) == 0);
+	}
+	SortThread((void *) &tasks[0]);
+	for (i = 1; i < threads; i++) {
+	    if (started[i]) {
+		pthread_join(ids[i], (void **) NULL);
+	    } else {
+		SortThread((void *) &tasks[i]);
+	    }
+	}
+
+	/*
+	 * Sorting leaves each share in place;  merging moves the items
+	 * to the other array.
+	 */
+
+	if (width > 0) {
+	    swap = src;
+	    src = dst;
+	    dst = swap;
+	}
+    }
+    if (src != items) {
+	memcpy((void *) items, (void *) src, count * sizeof(SortItem));
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortThread --
+ *
+ *	Do one thread's part of one step of SortParallel:  either sort
+ *	the thread's share of the list, or produce its share of the
+ *	output of a round of merges.
+ *
+ * Results:
+ *	Always NULL.
+ *
+ * Side effects:
+ *	Items are sorted in place or merged into taskPtr->dst.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void *
+SortThread(
+    void *clientData)		/* The SortTask to do. */
+{
+    SortTask *taskPtr = (SortTask *) clientData;
+    SortInfo *infoPtr = taskPtr->infoPtr;
+    SortItem *src = taskPtr->src;
+    int start, end, first, mid, last, share, from, to, split1, split2;
+
+    start = SortBound(taskPtr, taskPtr->thread);
+    end = SortBound(taskPtr, taskPtr->thread + 1);
+    if (taskPtr->width == 0) {
+	SortItems(infoPtr, src + start, taskPtr->dst + start, end - start);
+	return NULL;
+    }
+
+    /*
+     * Each pair of adjacent runs is merged into the same place in dst.
+     * Of each merge, do just the part that lands in [start, end).
+     * SortSplit finds how many items of the first run go before a given
+     * point in the output, so each thread can begin part-way through.
+     */
+
+    for (share = 0; share < taskPtr->threads; share += 2*taskPtr->width) {
+	first = SortBound(taskPtr, share);
+	mid = SortBound(taskPtr, share + taskPtr->width);
+	last = SortBound(taskPtr, share + 2*taskPtr->width);
+	if (first >= end) {
+	    break;
+	}
+	if (last <= start) {
+	    continue;
+	}
+	from = ((start > first) ? start : first) - first;
+	to = ((end < last) ? end : last) - first;
+	split1 = SortSplit(infoPtr, from, src + first, mid - first,
+		src + mid, last - mid);
+	split2 = SortSplit(infoPtr, to, src + first, mid - first,
+		src + mid, last - mid);
+	SortMerge(infoPtr, src + first + split1, split2 - split1,
+		src + mid + (from - split1), (to - split2) - (from - split1),
+		taskPtr->dst + first + from);
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortBound --
+ *
+ *	Find where a thread's share of the list starts.
+ *
+ * Results:
+ *	The index of the first item in the given share;  for shares past
+ *	the last one, the number of items.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SortBound(
+    SortTask *taskPtr,		/* Describes the list and the threads. */
+    int share)			/* Which share. */
+{
+    if (share >= taskPtr->threads) {
+	return taskPtr->count;
+    }
+    return (int) (((long) share * taskPtr->count) / taskPtr->threads);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortSplit --
+ *
+ *	Given two sorted runs of items, find how many items from the
+ *	first run are among the first count items of their stable merge.
+ *
+ * Results:
+ *	The number of items from the first run;  the rest of the count
+ *	come from the second.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SortSplit(
+    SortInfo *infoPtr,		/* How to compare items. */
+    int count,			/* Number of merged items wanted. */
+    SortItem *first,		/* First run and its length. */
+    int firstCount,
+    SortItem *second,		/* Second run and its length. */
+    int secondCount)
+{
+    int low, high, mid;
+
+    low = (count > secondCount) ? count - secondCount : 0;
+    high = (count < firstCount) ? count : firstCount;
+    while (low < high) {
+	/*
+	 * If first[mid] comes no later than second[count-mid-1] (ties go
+	 * to the first run), it's among the first count items.
+	 */
+
+	mid = (low + high)/2;
+	if (SortCompare(infoPtr, &first[mid], &second[count-mid-1]) <= 0) {
+	    low = mid + 1;
+	} else {
+	    high = mid;
+	}
+    }
+    return low;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SortMerge --
+ *
+ *	Merge two sorted runs of items, keeping items with equal keys in
+ *	order (those from the first run first).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The merged items are stored at dst, which must not overlap
+ *	either run.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SortMerge(
+    SortInfo *infoPtr,		/* How to compare items. */
+    SortItem *first,		/* First run and its length. */
+    int firstCount,
+    SortItem *second,		/* Second run and its length. */
+    int secondCount,
+    SortItem *dst)		/* Where to put the result. */
+{
+    SortItem *firstEnd = first + firstCount;
+    SortItem *secondEnd = second + secondCount;
+
+    while ((first < firstEnd) && (second < secondEnd)) {
+	if (SortCompare(infoPtr, second, first) < 0) {
+	    *dst++ = *second++;
+	} else {
+	    *dst++ = *first++;
+	}
+    }
+    while (first < firstEnd) {
+	*dst++ = *first++;
+    }
+    while (second < secondEnd) {
+	*dst++ = *second++;
+    }
 }
+#endif /* HAX_THREADS */
@@ -44,6 +44,8 @@ typedef struct {
 static char *		TraceVarProc (ClientData clientData,
 			    Hax_Interp *interp, char *name1, char *name2,
 			    int flags);
+static int		WhileNext (Hax_Interp *interp, ClientData data[],
+			    int result);
 
 /*
  *----------------------------------------------------------------------
@@ -473,6 +475,7 @@ Hax_RenameCmd(
 		"\":  command doesn't exist", (char *) NULL);
 	return HAX_ERROR;
     }
+    iPtr->cmdEpoch++;
     cmdPtr = (Command *) Hax_GetHashValue(hPtr);
     Hax_DeleteHashEntry(interp, hPtr);
     hPtr = Hax_CreateHashEntry(interp, &iPtr->commandTable, argv[2], &newPtr);
@@ -516,6 +519,44 @@ Hax_ReturnCmd(
     return HAX_RETURN;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_ReturnObjCmd --
+ *
+ *	This is the object-based form of Hax_ReturnCmd.  Compiled
+ *	scripts use it when the value is held by reference, so that it
+ *	can be returned without being copied.
+ *
+ * Results:
+ *	A standard Hax result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+	/* ARGSUSED */
+int
+Hax_ReturnObjCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
+{
+    if (objc > 2) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
+		" ?value?\"", (char *) NULL);
+	return HAX_ERROR;
+    }
+    if (objc == 2) {
+	Hax_SetObjResult(interp, objv[1]);
+    }
+    return HAX_RETURN;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1394,13 +1435,16 @@ TraceVarProc(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_WhileCmd --
+ * Hax_WhileCmd, Hax_WhileNRCmd --
  *
- *	This procedure is invoked to process the "while" Hax command.
+ *	These procedures are invoked to process the "while" Hax command.
  *	See the user documentation for details on what it does.
+ *	Hax_WhileNRCmd is used by compiled scripts:  it schedules each
+ *	execution of the body, followed by a call to WhileNext to check
+ *	the result and test the condition again.
  *
  * Results:
- *	A standard Hax result.
+ *	A standard Hax result, or HAX_NR_PENDING from Hax_WhileNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -1408,7 +1452,6 @@ TraceVarProc(
  *----------------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 int
 Hax_WhileCmd(
     ClientData dummy,			/* Not used. */
@@ -1416,7 +1459,20 @@ Hax_WhileCmd(
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
 {
-    int result, value;
+    return HaxNRCallCommand(interp, Hax_WhileNRCmd, dummy, argc, argv,
+	    (Hax_Obj **) NULL);
+}
+
+	/* ARGSUSED */
+int
+Hax_WhileNRCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv,			/* Argument strings. */
+    Hax_Obj **objv			/* Not used. */)
+{
+    ClientData data[4];
 
     if (argc != 3) {
 	Hax_AppendResult(interp, "wrong # args: should be \"",
@@ -1424,26 +1480,69 @@ Hax_WhileCmd(
 	return HAX_ERROR;
     }
 
-    while (1) {
-	result = Hax_ExprBoolean(interp, argv[1], &value);
-	if (result != HAX_OK) {
-	    return result;
-	}
-	if (!value) {
-	    break;
-	}
-	result = Hax_Eval(interp, NULL, argv[2], 0, (char **) NULL);
-	if (result == HAX_CONTINUE) {
-	    result = HAX_OK;
-	} else if (result != HAX_OK) {
-	    if (result == HAX_ERROR) {
-		char msg[60];
-		sprintf(msg, "\n    (\"while\" body line %d)",
-			interp->errorLine);
-		Hax_AddErrorInfo(interp, msg);
-	    }
-	    break;
+    data[0] = (ClientData) argv[1];
+    data[1] = (ClientData) argv[2];
+    data[2] = (ClientData) HaxGetCachedScript(interp, argv[2]);
+    data[3] = (ClientData) HaxGetCompiledExpr(interp, argv[1]);
+    return WhileNext(interp, data, HAX_OK);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * WhileNext --
+ *
+ *	Callback for "while":  handle the result of the body, then test
+ *	the condition and run the body again if it's still true.
+ *
+ * Results:
+ *	HAX_NR_PENDING if the body is to be run again, else the result
+ *	of the loop.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+WhileNext(
+    Hax_Interp *interp,			/* Current interpreter. */
+    ClientData data[],			/* Condition, body, compiled body
+					 * and compiled condition (either
+					 * may be NULL). */
+    int result)				/* Result of the body. */
+{
+    char *test = (char *) data[0];
+    char *body = (char *) data[1];
+    CompiledScript *bodyPtr = (CompiledScript *) data[2];
+    CompiledExpr *testPtr = (CompiledExpr *) data[3];
+    int value;
+
+    if (result == HAX_CONTINUE) {
+	result = HAX_OK;
+    } else if (result != HAX_OK) {
+	if (result == HAX_ERROR) {
+	    char msg[60];
+	    sprintf(msg, "\n    (\"while\" body line %d)",
+		    interp->errorLine);
+	    Hax_AddErrorInfo(interp, msg);
 	}
+	goto done;
+    }
+    result = HaxExprBooleanCompiled(interp, testPtr, test, &value);
+    if ((result == HAX_OK) && value) {
+	HaxNRAddCallback(interp, WhileNext, 0, (ClientData) test,
+		(ClientData) body, (ClientData) bodyPtr, (ClientData) testPtr);
+	return HaxNREvalScript(interp, bodyPtr, body);
+    }
+
+    done:
+    if (bodyPtr != NULL) {
+	HaxReleaseCompiled(interp, bodyPtr);
+    }
+    if (testPtr != NULL) {
+	HaxReleaseCompiledExpr(interp, testPtr);
     }
     if (result == HAX_BREAK) {
 	result = HAX_OK;
@@ -0,0 +1,2724 @@
+/*
+ * haxCompile.c --
+ *
+ *	This file contains a compiler that translates a Hax script
+ *	(normally the body of a procedure) into a compact instruction
+ *	stream, plus a small stack machine that executes it.  The
+ *	compiled form keeps the words of every command pre-parsed, so
+ *	executing it again only performs variable and command
+ *	substitution:  the source text is never re-scanned.  The
+ *	machine keeps its state in a stack of ExecLevels in the heap
+ *	rather than on the C stack, so scripts, nested commands and
+ *	procedure calls can be nested as deeply as the interpreter's
+ *	evaluation budget allows.
+ *
+ *	The compiler follows the rules of HaxParseWords, HaxParseQuotes
+ *	and Hax_ParseVar exactly, and the executor reproduces the
+ *	bookkeeping done by Hax_Eval (nesting levels, command traces,
+ *	errorInfo and errorLine), so a compiled script behaves just like
+ *	the same script passed to Hax_Eval.  Anything the compiler can't
+ *	handle (e.g. a syntax error somewhere in the script) makes
+ *	HaxCompileScript return NULL, and the caller must fall back to
+ *	Hax_Eval.
+ */
+
+#include "haxInt.h"
+
+/*
+ * Instructions.  Each instruction is an opcode followed by a fixed
+ * number of integer operands:
+ *
+ * INST_DONE			End of a script (or of a nested command).
+ * INST_CLEAR_ERR		Clear ERR_IN_PROGRESS and ERROR_CODE_SET, as
+ *				Hax_Eval does between commands.
+ * INST_CMD cmd			Start of command number "cmd";  the code
+ *				up to the next INST_INVOKE pushes its words.
+ * INST_INVOKE argc		Invoke the command whose argc words are on
+ *				top of the stack, then pop them.
+ * INST_PUSH offset length obj
+ *				Push a literal from the literal pool.  "obj"
+ *				is the literal's slot in the script's litObjs
+ *				array (see MakeObjv).
+ * INST_LOAD_SCALAR name end	Push the value of a scalar variable.  "end"
+ *				is the source offset just after the
+ *				variable reference (for error messages).
+ * INST_LOAD_SLOT name end slot
+ *				Like INST_LOAD_SCALAR, for a local variable
+ *				of the procedure the script was compiled
+ *				for, kept in slot "slot" of its frames.
+ * INST_LOAD_ARRAY name end length slot
+ *				Replace the top stack entry, an element name
+ *				computed by the preceding "length" words of
+ *				code, with the value of that array element.
+ *				"Slot" is the array's slot, or -1.
+ * INST_NESTED length		Execute the nested command that follows
+ *				(terminated by INST_DONE, "length" words
+ *				long) in a level of its own and push its
+ *				result.
+ * INST_CONCAT count		Concatenate the top "count" stack entries.
+ * INST_SCALAR_WORD name end	Like INST_LOAD_SCALAR, for a variable that
+ *				makes up a whole word.
+ * INST_SLOT_WORD name end slot	Like INST_LOAD_SLOT, for a variable that
+ *				makes up a whole word.
+ * INST_NESTED_WORD length	Like INST_NESTED, for a command that makes
+ *				up a whole word.
+ *
+ * The last three push the variable's value or the command's result by
+ * reference if it is a Hax_Obj, or (for a result) if its storage can
+ * be taken over by one (see HaxTakeResultObj), instead of copying its
+ * string.  They
+ * are only used for whole words, because a piece of a word has to be
+ * copied anyway to be concatenated with the rest.
+ *
+ * Slots are only used while the current variable frame is a call to
+ * the script's procedure (see ScriptSlots);  otherwise the name is
+ * looked up as usual.
+ */
+
+#define INST_DONE		0
+#define INST_CLEAR_ERR		1
+#define INST_CMD		2
+#define INST_INVOKE		3
+#define INST_PUSH		4
+#define INST_LOAD_SCALAR	5
+#define INST_LOAD_ARRAY		6
+#define INST_NESTED		7
+#define INST_CONCAT		8
+#define INST_SCALAR_WORD	9
+#define INST_NESTED_WORD	10
+#define INST_LOAD_SLOT		11
+#define INST_SLOT_WORD		12
+
+/*
+ * The macro below gives the slots of the current variable frame if
+ * they are the ones the slot operands in scriptPtr refer to, or NULL.
+ */
+
+#define ScriptSlots(iPtr, scriptPtr) \
+    ((((iPtr)->varFramePtr != NULL) \
+	    && ((iPtr)->varFramePtr->procPtr == (scriptPtr)->procPtr)) \
+	    ? (iPtr)->varFramePtr->slots : (Hax_HashEntry *) NULL)
+
+/*
+ * The structure below holds the growing output of the compiler.
+ */
+
+typedef struct CompileEnv {
+    Interp *iPtr;		/* Interpreter (for memory allocation). */
+    char *source;		/* First character of the script. */
+    Proc *procPtr;		/* Procedure whose locals get slots, or
+				 * NULL. */
+    int *code;			/* Instructions generated so far. */
+    int codeNext;		/* Index of next free slot in code. */
+    int codeAvl;		/* Total slots available in code. */
+    CompiledCmd *cmds;		/* Information about each command. */
+    int numCmds;		/* Number of entries used in cmds. */
+    int cmdsAvl;		/* Total entries available in cmds. */
+    char *literals;		/* Literal strings and variable names, each
+				 * followed by a null character. */
+    int litNext;		/* Offset of next free byte in literals. */
+    int litAvl;			/* Total bytes available in literals. */
+    int numLitObjs;		/* Number of litObjs slots assigned to
+				 * INST_PUSH instructions so far. */
+    int lastClear;		/* Non-zero means the last instruction
+				 * emitted was INST_CLEAR_ERR. */
+} CompileEnv;
+
+/*
+ * The structure below accumulates the literal text of one word while
+ * it is being compiled.  Adjacent literal characters are merged into a
+ * single INST_PUSH.
+ */
+
+#define WORD_SPACE 200
+
+typedef struct WordInfo {
+    ParseValue pv;		/* Literal characters not yet emitted. */
+    int numPieces;		/* Number of stack entries already emitted
+				 * for this word. */
+    char staticSpace[WORD_SPACE];
+				/* Initial space for pv. */
+} WordInfo;
+
+/*
+ * The structure below holds the operand stack used while executing a
+ * compiled script.  Stack entries are null-terminated strings stored
+ * back to back in chars, so the top entries of the stack can be
+ * concatenated in place.  An entry pushed by reference has an empty
+ * string in chars and its value in objs.
+ */
+
+#define NUM_CHARS 200
+#define NUM_WORDS 20
+
+typedef struct ExecEnv {
+    CompiledScript *scriptPtr;	/* Script being executed. */
+    char *chars;		/* Storage for stack entries. */
+    int charsUsed;		/* Number of bytes in use in chars. */
+    int charsAvl;		/* Total bytes available in chars. */
+    int *words;			/* Offset in chars of each stack entry. */
+    int *lits;			/* For each stack entry, its slot in the
+				 * script's litObjs if it was pushed by
+				 * INST_PUSH and not changed since, else -1. */
+    Hax_Obj **objs;		/* For each stack entry, the value it was
+				 * pushed by reference as (holding a
+				 * reference to it), else NULL. */
+    int numWords;		/* Number of entries on the stack. */
+    int wordsAvl;		/* Total entries available in words, lits
+				 * and objs. */
+    char **argv;		/* Space to build argv for command procs. */
+    int argvAvl;		/* Total entries available in argv. */
+    Hax_Obj **objv;		/* Space to build objv for object-based
+				 * command procs. */
+    int objvAvl;		/* Total entries available in objv. */
+    int errOffset;		/* When a substitution fails, the offset in
+				 * the source just after the last character
+				 * that was processed. */
+    char charStorage[NUM_CHARS];
+    int wordStorage[NUM_WORDS];
+    int litStorage[NUM_WORDS];
+    Hax_Obj *objStorage[NUM_WORDS];
+    char *argvStorage[NUM_WORDS];
+    Hax_Obj *objvStorage[NUM_WORDS];
+} ExecEnv;
+
+/*
+ * The structure below is one level of an interpreter's stack of
+ * executing scripts (Interp.execTopPtr).  There are three kinds of
+ * level:  a script, which has an ExecEnv of its own in the scratch
+ * space;  a nested command, which uses its parent's ExecEnv and leaves
+ * its result there;  and a callback, a HaxNRCallbackProc to be called
+ * with the return code of the levels above it once they're done.  The
+ * levels themselves are recycled through Interp.execFreePtr rather than
+ * taken from the scratch space, since a nested command may enlarge its
+ * parent's stacks.
+ */
+
+#define LEVEL_SCRIPT	0
+#define LEVEL_NESTED	1
+#define LEVEL_CALLBACK	2
+
+/*
+ * States of a script or nested command level:
+ *
+ * LEVEL_NEW			Not started yet.
+ * LEVEL_RUNNING		Executing, or waiting for the nested command
+ *				at pc.
+ * LEVEL_INVOKING		Waiting for the command invoked at pc.
+ */
+
+#define LEVEL_NEW	0
+#define LEVEL_RUNNING	1
+#define LEVEL_INVOKING	2
+
+/*
+ * Depth of Hax_Eval recursion at which HaxNREvalDynamic starts
+ * compiling scripts, so that deep recursion through "eval" and
+ * "uplevel" stops using the C stack well before MAX_NESTING_DEPTH.
+ */
+
+#define DYNAMIC_COMPILE_DEPTH	(MAX_NESTING_DEPTH/4)
+
+struct ExecLevel {
+    int type;			/* LEVEL_SCRIPT, LEVEL_NESTED or
+				 * LEVEL_CALLBACK. */
+    int state;			/* See above. */
+    long bytes;			/* Amount the level adds to the
+				 * interpreter's execBytes. */
+    ExecLevel *nextPtr;		/* Level that continues when this one is
+				 * done, or next free level. */
+    CompiledScript *scriptPtr;	/* Script being executed.  A script level
+				 * holds a reference to it. */
+    ExecEnv *envPtr;		/* Stacks for the script. */
+    int *pc;			/* Next instruction, or the one the level
+				 * is waiting for. */
+    CompiledCmd *infoPtr;	/* Command being executed, or NULL. */
+    int baseWords;		/* Number of stack entries and bytes in use */
+    int baseChars;		/* when the level started. */
+    int first;			/* While invoking:  index of the command's
+				 * first word on the stack. */
+    int numObjs;		/* While invoking:  number of entries in
+				 * envPtr->objv holding references. */
+    ScratchMark mark;		/* Script level:  top of the scratch space
+				 * before the ExecEnv was allocated. */
+    ScratchMark cmdMark;	/* While invoking:  top of the scratch space
+				 * before the command was called. */
+    HaxNRCallbackProc *proc;	/* Callback level:  procedure to call. */
+    ClientData data[4];		/* Callback level:  values for proc. */
+};
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static int	CompileCmds (CompileEnv *envPtr, char *script,
+		    int nested, char **termPtr);
+static int	CompileQuotes (CompileEnv *envPtr, WordInfo *wordPtr,
+		    char *string, int termChar, char **termPtr);
+static int	CompileVar (CompileEnv *envPtr, WordInfo *wordPtr,
+		    char *string, char **termPtr);
+static int	CompileWords (CompileEnv *envPtr, char *string,
+		    int nested, char **termPtr, int *argcPtr,
+		    int *literalPtr, int *slotPtr, int *exprWordPtr);
+static int	EmitInst (CompileEnv *envPtr, int op, int numOperands);
+static int	EmitLiteral (CompileEnv *envPtr, char *string,
+		    int length);
+static void	EndWord (CompileEnv *envPtr, WordInfo *wordPtr);
+static void	AddIndexInfo (Hax_Interp *interp,
+		    CompiledScript *scriptPtr, int *failPc);
+static int	EvalCallback (Hax_Interp *interp, ClientData data[],
+		    int result);
+static int	ExecCmds (Interp *iPtr, ExecLevel *stopPtr,
+		    int result);
+static void	FinishInvoke (Interp *iPtr, ExecLevel *levelPtr);
+static void	FlushLiteral (CompileEnv *envPtr, WordInfo *wordPtr);
+static void	FreeCompileEnv (CompileEnv *envPtr);
+static void	GrowArray (Interp *iPtr, char **arrayPtr, int *availPtr,
+		    int used, int elSize, int needed, char *staticSpace);
+static void	GrowScratchArray (Interp *iPtr, char **arrayPtr,
+		    int *availPtr, int used, int elSize, int needed);
+static void	InitCompileEnv (Interp *iPtr, CompileEnv *envPtr,
+		    char *source);
+static void	InitWord (WordInfo *wordPtr);
+static int	InstLength (int *pc);
+static int	LocalSlot (CompileEnv *envPtr, char *name);
+static Hax_Obj **	MakeObjv (Interp *iPtr, ExecEnv *envPtr,
+		    int first, int argc);
+static void	PopLevel (Interp *iPtr, ExecLevel *levelPtr);
+static void	PopWords (Interp *iPtr, ExecEnv *envPtr, int first);
+static ExecLevel *	PushLevel (Interp *iPtr, int type, int bytes);
+static void	Push (Interp *iPtr, ExecEnv *envPtr, char *string,
+		    int length);
+static void	PushObj (Interp *iPtr, ExecEnv *envPtr,
+			    Hax_Obj *objPtr);
+static int	RunLevels (Interp *iPtr, ExecLevel *stopPtr,
+		    int result);
+static void	WordChar (Hax_Interp *interp, WordInfo *wordPtr, int c);
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxCompileScript --
+ *
+ *	Translate a script into its compiled form.  If procPtr isn't
+ *	NULL, references to the procedure's local variables whose names
+ *	are known when compiling use its slots (see CompileVar), so the
+ *	script should be one that is evaluated in the procedure's frame.
+ *
+ * Results:
+ *	The return value is a pointer to a CompiledScript with a
+ *	reference count of 1, or NULL if the script couldn't be compiled
+ *	(in which case it must be evaluated with Hax_Eval, which will
+ *	report any error at the right time).
+ *
+ * Side effects:
+ *	Memory is allocated;  the caller must eventually pass the
+ *	result to HaxReleaseCompiled.  Interp->result may be modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+CompiledScript *
+HaxCompileScript(
+    Hax_Interp *interp,		/* Interpreter in which the script will
+				 * be executed. */
+    char *script,		/* Script to compile. */
+    Proc *procPtr)		/* Procedure in whose frame the script is
+				 * normally evaluated, or NULL. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    CompileEnv env;
+    CompiledScript *scriptPtr;
+    char *term, *p;
+    int sourceLength, result;
+
+    InitCompileEnv(iPtr, &env, script);
+    if ((procPtr != NULL) && (procPtr->numLocals > 0)) {
+	env.procPtr = procPtr;
+    }
+    result = CompileCmds(&env, script, 0, &term);
+    scriptPtr = NULL;
+    if (result == HAX_OK) {
+	/*
+	 * Pack everything into a single block:  the structure itself,
+	 * then the command table and literal values (which hold
+	 * pointers, so they go first to keep them aligned), the code,
+	 * literals and a private copy of the source (so the compiled
+	 * script stays valid even if the original text goes away while
+	 * the script is running).
+	 */
+
+	sourceLength = strlen(script);
+	scriptPtr = (CompiledScript *) ckalloc(memoryp, (unsigned)
+		(sizeof(CompiledScript) + env.numCmds * sizeof(CompiledCmd)
+		+ env.numLitObjs * sizeof(Hax_Obj *)
+		+ env.codeNext * sizeof(int) + env.litNext
+		+ sourceLength + 1));
+	scriptPtr->refCount = 1;
+	scriptPtr->codeLength = env.codeNext;
+	scriptPtr->numCmds = env.numCmds;
+	scriptPtr->numLitObjs = env.numLitObjs;
+	scriptPtr->procPtr = env.procPtr;
+	p = (char *) (scriptPtr + 1);
+	scriptPtr->cmds = (CompiledCmd *) p;
+	memcpy(p, env.cmds, env.numCmds * sizeof(CompiledCmd));
+	p += env.numCmds * sizeof(CompiledCmd);
+	scriptPtr->litObjs = (Hax_Obj **) p;
+	memset(p, 0, env.numLitObjs * sizeof(Hax_Obj *));
+	p += env.numLitObjs * sizeof(Hax_Obj *);
+	scriptPtr->code = (int *) p;
+	memcpy(p, env.code, env.codeNext * sizeof(int));
+	p += env.codeNext * sizeof(int);
+	scriptPtr->literals = p;
+	memcpy(p, env.literals, env.litNext);
+	p += env.litNext;
+	scriptPtr->source = p;
+	memcpy(p, script, sourceLength + 1);
+    }
+    FreeCompileEnv(&env);
+    return scriptPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxCheckSubst --
+ *
+ *	Check the syntax of a single substitution:  a variable
+ *	reference, a bracketed command or a double-quoted string.  This
+ *	is used by the expression compiler to find the end of operands
+ *	without evaluating anything.
+ *
+ * Results:
+ *	HAX_OK if the substitution is well-formed (i.e. Hax_ParseVar,
+ *	Hax_Eval or HaxParseQuotes won't find a syntax error in it), in
+ *	which case *termPtr points just after it.  HAX_ERROR otherwise.
+ *
+ * Side effects:
+ *	Interp->result may be modified.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxCheckSubst(
+    Hax_Interp *interp,		/* Interpreter (used for memory). */
+    char *string,		/* Points to the "$", "[" or '"'. */
+    char **termPtr)		/* Store address of character just after
+				 * the substitution here. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    CompileEnv env;
+    WordInfo word;
+    char *term;
+    int result;
+
+    InitCompileEnv(iPtr, &env, string);
+    InitWord(&word);
+    if (*string == '$') {
+	result = CompileVar(&env, &word, string, termPtr);
+    } else if (*string == '[') {
+	result = CompileCmds(&env, string+1, 1, &term);
+	*termPtr = term+1;
+    } else if (*string == '"') {
+	result = CompileQuotes(&env, &word, string+1, '"', termPtr);
+    } else {
+	result = HAX_ERROR;
+    }
+    if (word.pv.buffer != word.staticSpace) {
+	ckfree(memoryp, word.pv.buffer);
+    }
+    FreeCompileEnv(&env);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxPreserveCompiled, HaxReleaseCompiled --
+ *
+ *	Manage the reference count of a compiled script.  Anyone that
+ *	executes a compiled script must hold a reference for the
+ *	duration of the execution, since the script's owner (e.g. a
+ *	procedure) may be deleted by the commands being executed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The script is freed when its last reference is released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxPreserveCompiled(
+    CompiledScript *scriptPtr)
+{
+    scriptPtr->refCount++;
+}
+
+void
+HaxReleaseCompiled(
+    Hax_Interp *interp,
+    CompiledScript *scriptPtr)
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    int i;
+
+    scriptPtr->refCount--;
+    if (scriptPtr->refCount <= 0) {
+	for (i = 0; i < scriptPtr->numLitObjs; i++) {
+	    if (scriptPtr->litObjs[i] != NULL) {
+		Hax_DecrRefCount(interp, scriptPtr->litObjs[i]);
+	    }
+	}
+	for (i = 0; i < scriptPtr->numCmds; i++) {
+	    if (scriptPtr->cmds[i].exprPtr != NULL) {
+		HaxReleaseCompiledExpr(interp, scriptPtr->cmds[i].exprPtr);
+	    }
+	}
+	ckfree(memoryp, (char *) scriptPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxGetCachedScript --
+ *
+ *	Return the compiled form of a script from the interpreter's
+ *	script cache, compiling it and adding it to the cache if it
+ *	isn't there already.  The cache is keyed by the text of the
+ *	script rather than its address, since commands like "while"
+ *	get their arguments in buffers that are reused for other text.
+ *	Inside a procedure with local variable slots, the procedure's
+ *	own cache is used instead (up to MAX_PROC_SCRIPTS scripts), so
+ *	that the script can be compiled to use the slots.
+ *
+ * Results:
+ *	A pointer to the compiled script, with a reference held for the
+ *	caller, or NULL if the script can't be compiled (in which case
+ *	it should be passed to Hax_Eval instead).  The caller must pass
+ *	a non-NULL result to HaxReleaseCompiled when done with it.
+ *
+ * Side effects:
+ *	The cache is updated.  If it grows beyond MAX_CACHED_SCRIPTS
+ *	entries, the least recently used one is discarded.  A
+ *	procedure's cache is freed along with the procedure.
+ *
+ *----------------------------------------------------------------------
+ */
+
+CompiledScript *
+HaxGetCachedScript(
+    Hax_Interp *interp,		/* Interpreter in which the script will
+				 * be executed. */
+    char *script)		/* Text of the script. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_HashEntry *hPtr;
+    ScriptCacheEntry *entryPtr;
+    CompiledScript *scriptPtr;
+    Proc *procPtr;
+    int new;
+
+    if ((iPtr->varFramePtr != NULL)
+	    && (iPtr->varFramePtr->procPtr->numLocals > 0)) {
+	procPtr = iPtr->varFramePtr->procPtr;
+	if (procPtr->scriptTablePtr == NULL) {
+	    procPtr->scriptTablePtr = (Hax_HashTable *) ckalloc(memoryp,
+		    sizeof(Hax_HashTable));
+	    Hax_InitHashTable(procPtr->scriptTablePtr, HAX_STRING_KEYS);
+	}
+	hPtr = Hax_FindHashEntry(procPtr->scriptTablePtr, script);
+	if (hPtr != NULL) {
+	    iPtr->scriptCacheHits++;
+	    scriptPtr = (CompiledScript *) Hax_GetHashValue(hPtr);
+	    goto gotScript;
+	}
+	if (procPtr->scriptTablePtr->numEntries < MAX_PROC_SCRIPTS) {
+	    iPtr->scriptCacheMisses++;
+	    scriptPtr = HaxCompileScript(interp, script, procPtr);
+	    hPtr = Hax_CreateHashEntry(interp, procPtr->scriptTablePtr,
+		    script, &new);
+	    Hax_SetHashValue(hPtr, scriptPtr);
+	    goto gotScript;
+	}
+    }
+
+    hPtr = Hax_CreateHashEntry(interp, &iPtr->scriptCache, script, &new);
+    if (!new) {
+	iPtr->scriptCacheHits++;
+	entryPtr = (ScriptCacheEntry *) Hax_GetHashValue(hPtr);
+
+	/*
+	 * Move the entry to the front of the LRU list.
+	 */
+
+	if (entryPtr->prevPtr != NULL) {
+	    entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+	    if (entryPtr->nextPtr != NULL) {
+		entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+	    } else {
+		iPtr->cacheLastPtr = entryPtr->prevPtr;
+	    }
+	    entryPtr->prevPtr = NULL;
+	    entryPtr->nextPtr = iPtr->cacheFirstPtr;
+	    iPtr->cacheFirstPtr->prevPtr = entryPtr;
+	    iPtr->cacheFirstPtr = entryPtr;
+	}
+    } else {
+	iPtr->scriptCacheMisses++;
+	entryPtr = (ScriptCacheEntry *) ckalloc(memoryp,
+		sizeof(ScriptCacheEntry));
+	entryPtr->scriptPtr = HaxCompileScript(interp, script,
+		(Proc *) NULL);
+	entryPtr->hPtr = hPtr;
+	entryPtr->prevPtr = NULL;
+	entryPtr->nextPtr = iPtr->cacheFirstPtr;
+	if (iPtr->cacheFirstPtr != NULL) {
+	    iPtr->cacheFirstPtr->prevPtr = entryPtr;
+	} else {
+	    iPtr->cacheLastPtr = entryPtr;
+	}
+	iPtr->cacheFirstPtr = entryPtr;
+	Hax_SetHashValue(hPtr, entryPtr);
+
+	/*
+	 * Discard the least recently used entry if the cache is full.
+	 * Anyone still executing its script holds a reference, so the
+	 * script itself lives on until they're done.
+	 */
+
+	if (iPtr->scriptCache.numEntries > MAX_CACHED_SCRIPTS) {
+	    ScriptCacheEntry *lastPtr = iPtr->cacheLastPtr;
+
+	    iPtr->cacheLastPtr = lastPtr->prevPtr;
+	    iPtr->cacheLastPtr->nextPtr = NULL;
+	    Hax_DeleteHashEntry(interp, lastPtr->hPtr);
+	    if (lastPtr->scriptPtr != NULL) {
+		HaxReleaseCompiled(interp, lastPtr->scriptPtr);
+	    }
+	    ckfree(memoryp, (char *) lastPtr);
+	}
+    }
+    scriptPtr = entryPtr->scriptPtr;
+
+    gotScript:
+    if (scriptPtr != NULL) {
+	HaxPreserveCompiled(scriptPtr);
+    }
+    return scriptPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxNREvalScript, HaxNREvalCached, HaxNREvalDynamic --
+ *
+ *	Schedule a script that may have been compiled for execution
+ *	without recursing, as the last thing a HaxNRCmdProc or
+ *	HaxNRCallbackProc does.  HaxNREvalScript takes the result of an
+ *	earlier call to HaxGetCachedScript (so loops can look up their
+ *	body once and run it many times);  HaxNREvalCached does the
+ *	lookup itself.  HaxNREvalDynamic is for scripts that are often
+ *	built on the fly and executed just once, like those of "eval"
+ *	and "uplevel":  compiling such a script costs more than letting
+ *	Hax_Eval parse and execute it in one pass, so it's only compiled
+ *	if it's already in the cache or Hax_Eval has recursed deeply.
+ *
+ * Results:
+ *	Always HAX_NR_PENDING, which the caller should return.  The
+ *	script's return code and result are passed on to whatever is
+ *	below it on the stack:  a callback registered beforehand with
+ *	HaxNRAddCallback, or else the command's caller.
+ *
+ * Side effects:
+ *	A level is pushed on the interpreter's stack.  Scripts that
+ *	can't be compiled are evaluated by Hax_Eval from a callback.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxNREvalScript(
+    Hax_Interp *interp,		/* Interpreter in which to execute. */
+    CompiledScript *scriptPtr,	/* Compiled form of script, or NULL.  The
+				 * level holds its own reference to it. */
+    char *script)		/* Text of the script, evaluated with
+				 * Hax_Eval if scriptPtr is NULL.  Must
+				 * stay valid until the script runs. */
+{
+    Interp *iPtr = (Interp *) interp;
+    ExecLevel *levelPtr;
+
+    /*
+     * If we're only parsing (e.g. in the unevaluated half of an
+     * expression) let Hax_Eval handle it.
+     */
+
+    if ((scriptPtr == NULL) || iPtr->noEval) {
+	HaxNRAddCallback(interp, EvalCallback, 0, (ClientData) script,
+		(ClientData) NULL, (ClientData) NULL, (ClientData) NULL);
+	return HAX_NR_PENDING;
+    }
+    levelPtr = PushLevel(iPtr, LEVEL_SCRIPT, sizeof(ExecEnv));
+    levelPtr->scriptPtr = scriptPtr;
+    levelPtr->pc = scriptPtr->code;
+    levelPtr->infoPtr = NULL;
+    HaxPreserveCompiled(scriptPtr);
+    return HAX_NR_PENDING;
+}
+
+int
+HaxNREvalCached(
+    Hax_Interp *interp,		/* Interpreter in which to execute. */
+    char *script)		/* Script to execute.  Must stay valid
+				 * until it runs. */
+{
+    CompiledScript *scriptPtr;
+
+    scriptPtr = HaxGetCachedScript(interp, script);
+    HaxNREvalScript(interp, scriptPtr, script);
+    if (scriptPtr != NULL) {
+	HaxReleaseCompiled(interp, scriptPtr);
+    }
+    return HAX_NR_PENDING;
+}
+
+int
+HaxNREvalDynamic(
+    Hax_Interp *interp,		/* Interpreter in which to execute. */
+    char *script)		/* Script to execute.  Must stay valid
+				 * until it runs. */
+{
+    Interp *iPtr = (Interp *) interp;
+
+    if ((iPtr->evalDepth < DYNAMIC_COMPILE_DEPTH)
+	    && (Hax_FindHashEntry(&iPtr->scriptCache, script) == NULL)) {
+	return HaxNREvalScript(interp, (CompiledScript *) NULL, script);
+    }
+    return HaxNREvalCached(interp, script);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EvalCallback --
+ *
+ *	Callback used by HaxNREvalScript for scripts that aren't
+ *	compiled, or that are only being parsed.
+ *
+ * Results:
+ *	Same as Hax_Eval.
+ *
+ * Side effects:
+ *	Depends on the commands in the script.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EvalCallback(
+    Hax_Interp *interp,
+    ClientData data[],		/* data[0] is the script. */
+    int result)			/* Not used. */
+{
+    return Hax_Eval(interp, NULL, (char *) data[0], 0, (char **) NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxNRAddCallback --
+ *
+ *	Arrange for a procedure to be called once the levels pushed
+ *	after it (normally a script scheduled with HaxNREvalScript)
+ *	have finished.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A level is pushed on the interpreter's stack.  When it's
+ *	reached, proc is called with the four data values and the
+ *	return code of the levels above it, and whatever it returns is
+ *	passed on in turn;  it may also return HAX_NR_PENDING after
+ *	scheduling more work.  Bytes is added to the interpreter's
+ *	execBytes until then, to account for scratch space that the
+ *	callback needs (e.g. a procedure's call frame).
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxNRAddCallback(
+    Hax_Interp *interp,		/* Interpreter whose stack is used. */
+    HaxNRCallbackProc *proc,	/* Procedure to call. */
+    int bytes,			/* Memory held until proc is called. */
+    ClientData data0,		/* Values to pass to proc. */
+    ClientData data1,
+    ClientData data2,
+    ClientData data3)
+{
+    ExecLevel *levelPtr;
+
+    levelPtr = PushLevel((Interp *) interp, LEVEL_CALLBACK, bytes);
+    levelPtr->proc = proc;
+    levelPtr->data[0] = data0;
+    levelPtr->data[1] = data1;
+    levelPtr->data[2] = data2;
+    levelPtr->data[3] = data3;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxNRCallCommand --
+ *
+ *	Call a HaxNRCmdProc and run whatever it schedules to completion.
+ *	Commands with a HaxNRCmdProc use this in their ordinary command
+ *	procedures, which are called by Hax_Eval and from C.
+ *
+ * Results:
+ *	A standard Hax result.
+ *
+ * Side effects:
+ *	Depends on the command.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxNRCallCommand(
+    Hax_Interp *interp,		/* Current interpreter. */
+    HaxNRCmdProc *nrProc,	/* Procedure to call. */
+    ClientData clientData,	/* Arguments for nrProc. */
+    int argc,
+    char **argv,
+    Hax_Obj **objv)
+{
+    Interp *iPtr = (Interp *) interp;
+    ExecLevel *stopPtr = iPtr->execTopPtr;
+    ScratchMark mark;
+    int result;
+
+    HaxScratchMark(iPtr, &mark);
+    result = (*nrProc)(clientData, interp, argc, argv, objv);
+    if (result == HAX_NR_PENDING) {
+	result = RunLevels(iPtr, stopPtr, HAX_OK);
+    }
+    HaxScratchRelease(iPtr, &mark);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxDeleteScriptCache --
+ *
+ *	Discard all of the scripts in an interpreter's script cache.
+ *	Called when the interpreter is deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxDeleteScriptCache(
+    Interp *iPtr)		/* Interpreter whose cache is to be
+				 * freed. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ScriptCacheEntry *entryPtr, *nextPtr;
+
+    for (entryPtr = iPtr->cacheFirstPtr; entryPtr != NULL;
+	    entryPtr = nextPtr) {
+	nextPtr = entryPtr->nextPtr;
+	if (entryPtr->scriptPtr != NULL) {
+	    HaxReleaseCompiled((Hax_Interp *) iPtr, entryPtr->scriptPtr);
+	}
+	ckfree(memoryp, (char *) entryPtr);
+    }
+    iPtr->cacheFirstPtr = iPtr->cacheLastPtr = NULL;
+    Hax_DeleteHashTable((Hax_Interp *) iPtr, &iPtr->scriptCache);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxScriptForgetProc --
+ *
+ *	Called when the procedure a script was compiled for is freed,
+ *	so that the script and the expressions compiled for its
+ *	commands stop using the procedure's slots.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Local variables are looked up by name from now on.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxScriptForgetProc(
+    CompiledScript *scriptPtr)
+{
+    int i;
+
+    scriptPtr->procPtr = NULL;
+    for (i = 0; i < scriptPtr->numCmds; i++) {
+	if (scriptPtr->cmds[i].exprPtr != NULL) {
+	    HaxExprForgetProc(scriptPtr->cmds[i].exprPtr);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxDeleteProcScripts --
+ *
+ *	Discard all of the scripts in a procedure's script cache.
+ *	Called when the procedure is freed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.  Scripts that are still being executed live on
+ *	until they're done, but no longer use the procedure's slots.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxDeleteProcScripts(
+    Interp *iPtr,		/* Interpreter that owns the procedure. */
+    Proc *procPtr)		/* Procedure whose cache is to be freed. */
+{
+    Hax_HashEntry *hPtr;
+    Hax_HashSearch search;
+    CompiledScript *scriptPtr;
+
+    if (procPtr->scriptTablePtr == NULL) {
+	return;
+    }
+    for (hPtr = Hax_FirstHashEntry(procPtr->scriptTablePtr, &search);
+	    hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
+	scriptPtr = (CompiledScript *) Hax_GetHashValue(hPtr);
+	if (scriptPtr != NULL) {
+	    HaxScriptForgetProc(scriptPtr);
+	    HaxReleaseCompiled((Hax_Interp *) iPtr, scriptPtr);
+	}
+    }
+    Hax_DeleteHashTable((Hax_Interp *) iPtr, procPtr->scriptTablePtr);
+    ckfree(iPtr->memoryp, (char *) procPtr->scriptTablePtr);
+    procPtr->scriptTablePtr = NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileCmds --
+ *
+ *	Compile a sequence of commands, stopping at the end of the
+ *	string or, for nested commands, at the matching close-bracket.
+ *	This mirrors the command loop in Hax_Eval.
+ *
+ * Results:
+ *	HAX_OK, or HAX_ERROR if the script couldn't be compiled.  On
+ *	success *termPtr points to the terminating character.
+ *
+ * Side effects:
+ *	Instructions are appended to envPtr, ending with INST_DONE.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompileCmds(
+    CompileEnv *envPtr,		/* Where to store compiled code. */
+    char *script,		/* First character of script. */
+    int nested,			/* Non-zero means script is a nested
+				 * command terminated by close-bracket. */
+    char **termPtr)		/* Store address of terminating character
+				 * here. */
+{
+    Interp *iPtr = envPtr->iPtr;
+    char *src, *cmdStart, *lineScan;
+    char termChar = nested ? ']' : 0;
+    int line, cmdIndex, codeStart, argc, literal, slot, exprWord, pc;
+
+    src = script;
+    lineScan = script;
+    line = 1;
+    envPtr->lastClear = 0;
+    while (*src != termChar) {
+
+	/*
+	 * Skim off leading white space and semi-colons, and skip
+	 * comments.
+	 */
+
+	while (1) {
+	    char c = *src;
+
+	    if ((CHAR_TYPE(c) != HAX_SPACE) && (c != ';') && (c != '\n')) {
+		break;
+	    }
+	    src += 1;
+	}
+	if (*src == '#') {
+	    for (src++; *src != 0; src++) {
+		if ((*src == '\n') && (src[-1] != '\\')) {
+		    src++;
+		    break;
+		}
+	    }
+	    if (!envPtr->lastClear) {
+		EmitInst(envPtr, INST_CLEAR_ERR, 0);
+		envPtr->lastClear = 1;
+	    }
+	    continue;
+	}
+	cmdStart = src;
+	for ( ; lineScan != cmdStart; lineScan++) {
+	    if (*lineScan == '\n') {
+		line++;
+	    }
+	}
+
+	/*
+	 * Reserve a command slot and an INST_CMD instruction, then
+	 * compile the words.  A command with no words is dropped.
+	 */
+
+	if (envPtr->numCmds >= envPtr->cmdsAvl) {
+	    GrowArray(iPtr, (char **) &envPtr->cmds, &envPtr->cmdsAvl,
+		    envPtr->numCmds, sizeof(CompiledCmd), 1, (char *) NULL);
+	}
+	cmdIndex = envPtr->numCmds;
+	envPtr->numCmds++;
+	codeStart = EmitInst(envPtr, INST_CMD, 1);
+	envPtr->code[codeStart+1] = cmdIndex;
+	envPtr->lastClear = 0;
+	if (CompileWords(envPtr, src, nested, &src, &argc, &literal, &slot,
+		&exprWord) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+	if (argc == 0) {
+	    envPtr->numCmds--;
+	    envPtr->codeNext = codeStart;
+	    if (!envPtr->lastClear) {
+		EmitInst(envPtr, INST_CLEAR_ERR, 0);
+	    }
+	    envPtr->lastClear = 1;
+	    continue;
+	}
+	pc = EmitInst(envPtr, INST_INVOKE, 1);
+	envPtr->code[pc+1] = argc;
+	envPtr->cmds[cmdIndex].srcOffset = cmdStart - envPtr->source;
+	envPtr->cmds[cmdIndex].srcEnd = src - envPtr->source;
+	envPtr->cmds[cmdIndex].line = line;
+	envPtr->cmds[cmdIndex].literalName = literal;
+	envPtr->cmds[cmdIndex].cmdPtr = NULL;
+	envPtr->cmds[cmdIndex].cmdEpoch = 0;
+	envPtr->cmds[cmdIndex].slot = ((argc == 2) || (argc == 3)) ? slot : -1;
+	envPtr->cmds[cmdIndex].exprWord = exprWord;
+	envPtr->cmds[cmdIndex].exprPtr = NULL;
+	envPtr->cmds[cmdIndex].exprCompiled = 0;
+	envPtr->lastClear = 0;
+    }
+    EmitInst(envPtr, INST_DONE, 0);
+    envPtr->lastClear = 0;
+    *termPtr = src;
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileWords --
+ *
+ *	Compile the words of a single command.  This mirrors
+ *	HaxParseWords, except that substitutions are compiled into
+ *	instructions instead of being performed.
+ *
+ * Results:
+ *	HAX_OK, or HAX_ERROR if the command couldn't be compiled.
+ *	*ArgcPtr is filled in with the number of words, *termPtr
+ *	with the address of the command terminator, and *literalPtr
+ *	with 1 if the first word involves no substitutions (0
+ *	otherwise).  If the command is "set" or "incr" and its second
+ *	word is the literal name of a scalar with a slot, *slotPtr is
+ *	set to the slot;  otherwise it is set to -1.  If the command is
+ *	"if", "while", "for" or "expr" and the word holding its (first)
+ *	expression is a literal, *exprWordPtr is set to the index of
+ *	that word;  otherwise it is set to -1.
+ *
+ * Side effects:
+ *	Instructions pushing each word are appended to envPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompileWords(
+    CompileEnv *envPtr,		/* Where to store compiled code. */
+    char *string,		/* First character of command. */
+    int nested,			/* Non-zero means close-bracket terminates
+				 * the command. */
+    char **termPtr,		/* Store address of terminating character
+				 * here. */
+    int *argcPtr,		/* Store number of words here. */
+    int *literalPtr,		/* Store here whether the first word is
+				 * a literal. */
+    int *slotPtr,		/* Store the slot of the second word
+				 * here (see above). */
+    int *exprWordPtr)		/* Store the index of the expression word
+				 * here (see above). */
+{
+    Hax_Interp *interp = (Hax_Interp *) envPtr->iPtr;
+    char *src, *term;
+    char c;
+    int type, result, argc, wordStart;
+    int firstWord = envPtr->codeNext;
+    WordInfo word;
+
+    src = string;
+    *literalPtr = 0;
+    *slotPtr = -1;
+    *exprWordPtr = -1;
+    InitWord(&word);
+    for (argc = 0; ; argc++) {
+	skipSpace:
+	c = *src;
+	type = CHAR_TYPE(c);
+	while (type == HAX_SPACE) {
+	    src++;
+	    c = *src;
+	    type = CHAR_TYPE(c);
+	}
+	wordStart = envPtr->codeNext;
+
+	if (type == HAX_NORMAL) {
+	    normalArg:
+	    while (1) {
+		if (type == HAX_NORMAL) {
+		    copy:
+		    WordChar(interp, &word, c);
+		    src++;
+		} else if (type == HAX_SPACE) {
+		    goto wordEnd;
+		} else if (type == HAX_DOLLAR) {
+		    if (CompileVar(envPtr, &word, src, &src) != HAX_OK) {
+			goto error;
+		    }
+		} else if (type == HAX_COMMAND_END) {
+		    if ((c == ']') && !nested) {
+			goto copy;
+		    }
+		    goto wordEnd;
+		} else if (type == HAX_OPEN_BRACKET) {
+		    int pc;
+
+		    FlushLiteral(envPtr, &word);
+		    pc = EmitInst(envPtr, INST_NESTED, 1);
+		    if (CompileCmds(envPtr, src+1, 1, &src) != HAX_OK) {
+			goto error;
+		    }
+		    envPtr->code[pc+1] = envPtr->codeNext - (pc+2);
+		    word.numPieces++;
+		    src++;
+		} else if (type == HAX_BACKSLASH) {
+		    int numRead;
+
+		    c = Hax_Backslash(src, &numRead);
+		    if (c != 0) {
+			WordChar(interp, &word, c);
+		    }
+		    src += numRead;
+		} else {
+		    goto copy;
+		}
+		c = *src;
+		type = CHAR_TYPE(c);
+	    }
+	} else {
+
+	    /*
+	     * Check for the end of the command.
+	     */
+
+	    if (type == HAX_COMMAND_END) {
+		if (nested) {
+		    if (c == '\0') {
+			goto error;
+		    }
+		} else {
+		    if (c == ']') {
+			goto normalArg;
+		    }
+		}
+		goto done;
+	    }
+
+	    /*
+	     * Now handle the special cases: open braces, double-quotes,
+	     * and backslash-newline.
+	     */
+
+	    if (type == HAX_QUOTE) {
+		result = CompileQuotes(envPtr, &word, src+1, '"', &term);
+	    } else if (type == HAX_OPEN_BRACE) {
+		result = HaxParseBraces(interp, src+1, &term, &word.pv);
+	    } else if ((type == HAX_BACKSLASH) && (src[1] == '\n')) {
+		src += 2;
+		goto skipSpace;
+	    } else {
+		goto normalArg;
+	    }
+	    if (result != HAX_OK) {
+		goto error;
+	    }
+
+	    /*
+	     * Make sure that the terminating character was the end of
+	     * the word.
+	     */
+
+	    c = *term;
+	    if ((c == '\\') && (term[1] == '\n')) {
+		c = term[2];
+	    }
+	    type = CHAR_TYPE(c);
+	    if ((type != HAX_SPACE) && (type != HAX_COMMAND_END)) {
+		goto error;
+	    }
+	    src = term;
+	}
+
+	wordEnd:
+	EndWord(envPtr, &word);
+
+	/*
+	 * A word without substitutions compiles to a single INST_PUSH.
+	 */
+
+	if ((argc == 0) && (envPtr->codeNext == firstWord + 4)
+		&& (envPtr->code[firstWord] == INST_PUSH)) {
+	    *literalPtr = 1;
+	}
+	if (((argc == 1) || (argc == 2)) && *literalPtr
+		&& (envPtr->codeNext == wordStart + 4)
+		&& (envPtr->code[wordStart] == INST_PUSH)) {
+	    char *name = envPtr->literals + envPtr->code[firstWord+1];
+
+	    if (argc == 2) {
+		if (strcmp(name, "for") == 0) {
+		    *exprWordPtr = 2;
+		}
+	    } else if ((strcmp(name, "if") == 0)
+		    || (strcmp(name, "while") == 0)
+		    || (strcmp(name, "expr") == 0)) {
+		*exprWordPtr = 1;
+	    } else if ((envPtr->procPtr != NULL)
+		    && ((strcmp(name, "set") == 0)
+			|| (strcmp(name, "incr") == 0))) {
+		name = envPtr->literals + envPtr->code[wordStart+1];
+		if (strchr(name, '(') == NULL) {
+		    *slotPtr = LocalSlot(envPtr, name);
+		}
+	    }
+	}
+
+	/*
+	 * A word that is nothing but one variable or one nested command
+	 * can be pushed by reference.
+	 */
+
+	if ((envPtr->code[wordStart] == INST_LOAD_SCALAR)
+		&& (envPtr->codeNext == wordStart + 3)) {
+	    envPtr->code[wordStart] = INST_SCALAR_WORD;
+	} else if ((envPtr->code[wordStart] == INST_LOAD_SLOT)
+		&& (envPtr->codeNext == wordStart + 4)) {
+	    envPtr->code[wordStart] = INST_SLOT_WORD;
+	} else if ((envPtr->code[wordStart] == INST_NESTED)
+		&& (envPtr->codeNext
+		    == wordStart + 2 + envPtr->code[wordStart+1])) {
+	    envPtr->code[wordStart] = INST_NESTED_WORD;
+	}
+    }
+
+    done:
+    if (word.pv.buffer != word.staticSpace) {
+	ckfree(envPtr->iPtr->memoryp, word.pv.buffer);
+    }
+    *termPtr = src;
+    *argcPtr = argc;
+    return HAX_OK;
+
+    error:
+    if (word.pv.buffer != word.staticSpace) {
+	ckfree(envPtr->iPtr->memoryp, word.pv.buffer);
+    }
+    return HAX_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileQuotes --
+ *
+ *	Compile the contents of a double-quoted word or of an array
+ *	element name in parentheses.  This mirrors HaxParseQuotes.
+ *
+ * Results:
+ *	HAX_OK, or HAX_ERROR if the terminating character is missing
+ *	or something inside couldn't be compiled.  On success *termPtr
+ *	points just after the terminating character.
+ *
+ * Side effects:
+ *	Literal characters are added to *wordPtr and instructions for
+ *	substitutions are appended to envPtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompileQuotes(
+    CompileEnv *envPtr,		/* Where to store compiled code. */
+    WordInfo *wordPtr,		/* Word being compiled. */
+    char *string,		/* Character just after opening quote. */
+    int termChar,		/* Character that terminates the string. */
+    char **termPtr)		/* Store address just after terminating
+				 * character here. */
+{
+    Hax_Interp *interp = (Hax_Interp *) envPtr->iPtr;
+    char *src, c;
+
+    src = string;
+    while (1) {
+	c = *src;
+	src++;
+	if (c == termChar) {
+	    *termPtr = src;
+	    return HAX_OK;
+	} else if (CHAR_TYPE(c) == HAX_NORMAL) {
+	    copy:
+	    WordChar(interp, wordPtr, c);
+	} else if (c == '$') {
+	    if (CompileVar(envPtr, wordPtr, src-1, &src) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	} else if (c == '[') {
+	    int pc;
+
+	    FlushLiteral(envPtr, wordPtr);
+	    pc = EmitInst(envPtr, INST_NESTED, 1);
+	    if (CompileCmds(envPtr, src, 1, &src) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    envPtr->code[pc+1] = envPtr->codeNext - (pc+2);
+	    wordPtr->numPieces++;
+	    src++;
+	} else if (c == '\\') {
+	    int numRead;
+
+	    src--;
+	    c = Hax_Backslash(src, &numRead);
+	    if (c != 0) {
+		WordChar(interp, wordPtr, c);
+	    }
+	    src += numRead;
+	} else if (c == '\0') {
+	    return HAX_ERROR;
+	} else {
+	    goto copy;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileVar --
+ *
+ *	Compile a variable reference starting with "$".  This mirrors
+ *	Hax_ParseVar.  A reference to a local variable that has a slot
+ *	in the procedure being compiled for uses the slot.
+ *
+ * Results:
+ *	HAX_OK, or HAX_ERROR if the reference couldn't be compiled.
+ *	*TermPtr is filled in with the address of the character just
+ *	after the variable reference.
+ *
+ * Side effects:
+ *	Instructions are appended to envPtr (or a literal "$" is added
+ *	to the word, if there is no variable name).
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CompileVar(
+    CompileEnv *envPtr,		/* Where to store compiled code. */
+    WordInfo *wordPtr,		/* Word being compiled. */
+    char *string,		/* Points to the "$". */
+    char **termPtr)		/* Store address of character just after
+				 * the reference here. */
+{
+    char *name1, *name1End, *end;
+    int pc, nameOffset, indexStart, slot;
+
+    string++;
+    if (*string == '{') {
+	string++;
+	name1 = string;
+	while (*string != '}') {
+	    if (*string == 0) {
+		return HAX_ERROR;
+	    }
+	    string++;
+	}
+	name1End = string;
+	string++;
+    } else {
+	name1 = string;
+	while (isalnum(*string) || (*string == '_')) {
+	    string++;
+	}
+	if (string == name1) {
+	    WordChar((Hax_Interp *) envPtr->iPtr, wordPtr, '$');
+	    *termPtr = string;
+	    return HAX_OK;
+	}
+	name1End = string;
+	if (*string == '(') {
+	    WordInfo index;
+
+	    /*
+	     * The element name is compiled into a block of code that
+	     * precedes the INST_LOAD_ARRAY instruction.
+	     */
+
+	    FlushLiteral(envPtr, wordPtr);
+	    nameOffset = EmitLiteral(envPtr, name1, name1End - name1);
+	    indexStart = envPtr->codeNext;
+	    InitWord(&index);
+	    if (CompileQuotes(envPtr, &index, string+1, ')', &end)
+		    != HAX_OK) {
+		if (index.pv.buffer != index.staticSpace) {
+		    ckfree(envPtr->iPtr->memoryp, index.pv.buffer);
+		}
+		return HAX_ERROR;
+	    }
+	    EndWord(envPtr, &index);
+	    if (index.pv.buffer != index.staticSpace) {
+		ckfree(envPtr->iPtr->memoryp, index.pv.buffer);
+	    }
+	    pc = EmitInst(envPtr, INST_LOAD_ARRAY, 4);
+	    envPtr->code[pc+1] = nameOffset;
+	    envPtr->code[pc+2] = end - envPtr->source;
+	    envPtr->code[pc+3] = pc - indexStart;
+	    envPtr->code[pc+4] = LocalSlot(envPtr,
+		    envPtr->literals + nameOffset);
+	    wordPtr->numPieces++;
+	    *termPtr = end;
+	    return HAX_OK;
+	}
+    }
+
+    FlushLiteral(envPtr, wordPtr);
+    nameOffset = EmitLiteral(envPtr, name1, name1End - name1);
+    slot = LocalSlot(envPtr, envPtr->literals + nameOffset);
+    if (slot >= 0) {
+	pc = EmitInst(envPtr, INST_LOAD_SLOT, 3);
+	envPtr->code[pc+3] = slot;
+    } else {
+	pc = EmitInst(envPtr, INST_LOAD_SCALAR, 2);
+    }
+    envPtr->code[pc+1] = nameOffset;
+    envPtr->code[pc+2] = string - envPtr->source;
+    wordPtr->numPieces++;
+    *termPtr = string;
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LocalSlot --
+ *
+ *	Find the slot of a local variable of the procedure being
+ *	compiled for.
+ *
+ * Results:
+ *	The index of the variable's slot in the procedure's call frames,
+ *	or -1 if there is no procedure or the variable has no slot.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LocalSlot(
+    CompileEnv *envPtr,		/* Compiler state. */
+    char *name)			/* Name of the variable. */
+{
+    Hax_HashEntry *hPtr;
+
+    if (envPtr->procPtr == NULL) {
+	return -1;
+    }
+    hPtr = Hax_FindHashEntry(&envPtr->procPtr->localTable, name);
+    if (hPtr == NULL) {
+	return -1;
+    }
+    return (int) (long) Hax_GetHashValue(hPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitCompileEnv, FreeCompileEnv --
+ *
+ *	Set up the output arrays of the compiler, and free them when
+ *	done.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated or freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitCompileEnv(
+    Interp *iPtr,		/* Interpreter (used for memory). */
+    CompileEnv *envPtr,		/* Structure to initialize. */
+    char *source)		/* Text being compiled;  source offsets are
+				 * relative to this. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+
+    envPtr->iPtr = iPtr;
+    envPtr->source = source;
+    envPtr->procPtr = NULL;
+    envPtr->codeAvl = 64;
+    envPtr->code = (int *) ckalloc(memoryp, envPtr->codeAvl * sizeof(int));
+    envPtr->codeNext = 0;
+    envPtr->cmdsAvl = 8;
+    envPtr->cmds = (CompiledCmd *) ckalloc(memoryp,
+	    envPtr->cmdsAvl * sizeof(CompiledCmd));
+    envPtr->numCmds = 0;
+    envPtr->litAvl = 128;
+    envPtr->literals = (char *) ckalloc(memoryp, (unsigned) envPtr->litAvl);
+    envPtr->litNext = 0;
+    envPtr->numLitObjs = 0;
+    envPtr->lastClear = 0;
+}
+
+static void
+FreeCompileEnv(
+    CompileEnv *envPtr)
+{
+    Hax_Memoryp *memoryp = envPtr->iPtr->memoryp;
+
+    ckfree(memoryp, (char *) envPtr->code);
+    ckfree(memoryp, (char *) envPtr->cmds);
+    ckfree(memoryp, envPtr->literals);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitWord, WordChar, FlushLiteral, EndWord --
+ *
+ *	Utility procedures used to assemble the instructions for a
+ *	single word:  literal characters are collected with WordChar
+ *	and emitted as one INST_PUSH by FlushLiteral just before any
+ *	substitution;  EndWord emits whatever is needed to leave
+ *	exactly one stack entry for the word.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	See above.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitWord(
+    WordInfo *wordPtr)
+{
+    wordPtr->pv.buffer = wordPtr->pv.next = wordPtr->staticSpace;
+    wordPtr->pv.end = wordPtr->staticSpace + WORD_SPACE - 1;
+    wordPtr->pv.expandProc = HaxExpandParseValue;
+    wordPtr->pv.clientData = (ClientData) NULL;
+    wordPtr->numPieces = 0;
+}
+
+static void
+WordChar(
+    Hax_Interp *interp,
+    WordInfo *wordPtr,
+    int c)
+{
+    if (wordPtr->pv.next == wordPtr->pv.end) {
+	(*wordPtr->pv.expandProc)(interp, &wordPtr->pv, 1);
+    }
+    *wordPtr->pv.next = c;
+    wordPtr->pv.next++;
+}
+
+static void
+FlushLiteral(
+    CompileEnv *envPtr,
+    WordInfo *wordPtr)
+{
+    int length, offset, pc;
+
+    length = wordPtr->pv.next - wordPtr->pv.buffer;
+    if (length == 0) {
+	return;
+    }
+    offset = EmitLiteral(envPtr, wordPtr->pv.buffer, length);
+    pc = EmitInst(envPtr, INST_PUSH, 3);
+    envPtr->code[pc+1] = offset;
+    envPtr->code[pc+2] = length;
+    envPtr->code[pc+3] = envPtr->numLitObjs++;
+    wordPtr->numPieces++;
+    wordPtr->pv.next = wordPtr->pv.buffer;
+}
+
+static void
+EndWord(
+    CompileEnv *envPtr,
+    WordInfo *wordPtr)
+{
+    int pc;
+
+    FlushLiteral(envPtr, wordPtr);
+    if (wordPtr->numPieces == 0) {
+	pc = EmitInst(envPtr, INST_PUSH, 3);
+	envPtr->code[pc+1] = EmitLiteral(envPtr, "", 0);
+	envPtr->code[pc+2] = 0;
+	envPtr->code[pc+3] = envPtr->numLitObjs++;
+    } else if (wordPtr->numPieces > 1) {
+	pc = EmitInst(envPtr, INST_CONCAT, 1);
+	envPtr->code[pc+1] = wordPtr->numPieces;
+    }
+    wordPtr->numPieces = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EmitInst, EmitLiteral --
+ *
+ *	Append an instruction (with room for its operands) or a
+ *	null-terminated literal to the output of the compiler.
+ *
+ * Results:
+ *	The index of the instruction in the code array, or the offset
+ *	of the literal in the literal pool.
+ *
+ * Side effects:
+ *	The arrays in envPtr may be enlarged.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+EmitInst(
+    CompileEnv *envPtr,
+    int op,
+    int numOperands)
+{
+    int pc;
+
+    if (envPtr->codeNext + numOperands + 1 > envPtr->codeAvl) {
+	GrowArray(envPtr->iPtr, (char **) &envPtr->code, &envPtr->codeAvl,
+		envPtr->codeNext, sizeof(int), numOperands + 1,
+		(char *) NULL);
+    }
+    pc = envPtr->codeNext;
+    envPtr->code[pc] = op;
+    envPtr->codeNext += numOperands + 1;
+    return pc;
+}
+
+static int
+EmitLiteral(
+    CompileEnv *envPtr,
+    char *string,
+    int length)
+{
+    int offset;
+
+    if (envPtr->litNext + length + 1 > envPtr->litAvl) {
+	GrowArray(envPtr->iPtr, &envPtr->literals, &envPtr->litAvl,
+		envPtr->litNext, 1, length + 1, (char *) NULL);
+    }
+    offset = envPtr->litNext;
+    memcpy(envPtr->literals + offset, string, length);
+    envPtr->literals[offset + length] = 0;
+    envPtr->litNext += length + 1;
+    return offset;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GrowArray --
+ *
+ *	Enlarge a dynamically-allocated array, at least doubling it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*ArrayPtr and *availPtr are updated.  The old array is freed
+ *	unless it is staticSpace.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GrowArray(
+    Interp *iPtr,
+    char **arrayPtr,		/* Array to enlarge. */
+    int *availPtr,		/* Number of elements it holds. */
+    int used,			/* Number of elements in use. */
+    int elSize,			/* Size of each element. */
+    int needed,			/* Minimum number of elements to add. */
+    char *staticSpace)		/* If the array is here, don't free it. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    int newAvail;
+    char *newArray;
+
+    newAvail = 2 * *availPtr;
+    if (newAvail < used + needed) {
+	newAvail = used + needed;
+    }
+    newArray = (char *) ckalloc(memoryp, (unsigned) (newAvail * elSize));
+    memcpy(newArray, *arrayPtr, used * elSize);
+    if (*arrayPtr != staticSpace) {
+	ckfree(memoryp, *arrayPtr);
+    }
+    *arrayPtr = newArray;
+    *availPtr = newAvail;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GrowScratchArray --
+ *
+ *	Same as GrowArray, except that the new array comes from the
+ *	interpreter's scratch space and the old one is never freed.
+ *	This is used for the stacks in an ExecEnv, which go away when
+ *	the script finishes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*ArrayPtr and *availPtr are updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+GrowScratchArray(
+    Interp *iPtr,
+    char **arrayPtr,		/* Array to enlarge. */
+    int *availPtr,		/* Number of elements it holds. */
+    int used,			/* Number of elements in use. */
+    int elSize,			/* Size of each element. */
+    int needed)			/* Minimum number of elements to add. */
+{
+    int newAvail;
+    char *newArray;
+
+    newAvail = 2 * *availPtr;
+    if (newAvail < used + needed) {
+	newAvail = used + needed;
+    }
+    newArray = HaxScratchAlloc(iPtr, newAvail * elSize);
+    memcpy(newArray, *arrayPtr, used * elSize);
+    *arrayPtr = newArray;
+    *availPtr = newAvail;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PushLevel, PopLevel --
+ *
+ *	Add a level to the top of an interpreter's stack, or take the
+ *	top one off again.
+ *
+ * Results:
+ *	PushLevel returns the new level, in state LEVEL_NEW.
+ *
+ * Side effects:
+ *	The interpreter's execBytes is updated.  Levels are recycled
+ *	through execFreePtr.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static ExecLevel *
+PushLevel(
+    Interp *iPtr,
+    int type,			/* LEVEL_SCRIPT, LEVEL_NESTED or
+				 * LEVEL_CALLBACK. */
+    int bytes)			/* Memory the level uses besides the
+				 * ExecLevel itself. */
+{
+    ExecLevel *levelPtr;
+
+    levelPtr = iPtr->execFreePtr;
+    if (levelPtr != NULL) {
+	iPtr->execFreePtr = levelPtr->nextPtr;
+    } else {
+	levelPtr = (ExecLevel *) ckalloc(iPtr->memoryp, sizeof(ExecLevel));
+    }
+    levelPtr->type = type;
+    levelPtr->state = LEVEL_NEW;
+    levelPtr->bytes = sizeof(ExecLevel) + bytes;
+    iPtr->execBytes += levelPtr->bytes;
+    levelPtr->nextPtr = iPtr->execTopPtr;
+    iPtr->execTopPtr = levelPtr;
+    return levelPtr;
+}
+
+static void
+PopLevel(
+    Interp *iPtr,
+    ExecLevel *levelPtr)	/* Level to pop;  must be on top. */
+{
+    iPtr->execTopPtr = levelPtr->nextPtr;
+    iPtr->execBytes -= levelPtr->bytes;
+    levelPtr->nextPtr = iPtr->execFreePtr;
+    iPtr->execFreePtr = levelPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxDeleteExecLevels --
+ *
+ *	Free the levels kept for reuse by an interpreter that is being
+ *	deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxDeleteExecLevels(
+    Interp *iPtr)
+{
+    ExecLevel *levelPtr;
+
+    while (iPtr->execFreePtr != NULL) {
+	levelPtr = iPtr->execFreePtr;
+	iPtr->execFreePtr = levelPtr->nextPtr;
+	ckfree(iPtr->memoryp, (char *) levelPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RunLevels --
+ *
+ *	Execute the levels on top of an interpreter's stack until
+ *	stopPtr is on top again.  This is the only loop that drives the
+ *	execution of compiled scripts:  a script that invokes a
+ *	procedure, a nested command or a command with a HaxNRCmdProc
+ *	pushes a new level and returns here instead of calling itself,
+ *	so the depth of nesting doesn't use any C stack.
+ *
+ * Results:
+ *	The return code of the last level to finish, with its result
+ *	in interp->result.
+ *
+ * Side effects:
+ *	Depends on the commands executed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RunLevels(
+    Interp *iPtr,
+    ExecLevel *stopPtr,		/* Level at which to stop. */
+    int result)			/* Return code to pass to the first level
+				 * if it is resuming. */
+{
+    ExecLevel *levelPtr;
+    HaxNRCallbackProc *proc;
+    ClientData data[4];
+
+    while ((levelPtr = iPtr->execTopPtr) != stopPtr) {
+	if (levelPtr->type == LEVEL_CALLBACK) {
+	    proc = levelPtr->proc;
+	    memcpy(data, levelPtr->data, sizeof(data));
+	    PopLevel(iPtr, levelPtr);
+	    result = (*proc)((Hax_Interp *) iPtr, data, result);
+	    if (result == HAX_NR_PENDING) {
+		result = HAX_OK;
+	    }
+	} else {
+	    result = ExecCmds(iPtr, stopPtr, result);
+	}
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ExecCmds --
+ *
+ *	Start or resume execution of the script or nested command on
+ *	top of an interpreter's stack.  This is the compiled counterpart
+ *	of Hax_Eval.  When it needs the result of something that has its
+ *	own level (a nested command, or a command with a HaxNRCmdProc
+ *	that returns HAX_NR_PENDING) it goes on to execute that level
+ *	itself, and likewise resumes the level below when one finishes;
+ *	it only returns to RunLevels when it reaches a callback or
+ *	stopPtr.
+ *
+ * Results:
+ *	A standard Hax return code for the callback or stopPtr that is
+ *	now on top of the stack, with interp->result set as by Hax_Eval
+ *	(HAX_OK if a command has just pushed the callback).  If a
+ *	substitution failed, envPtr->errOffset is left pointing just
+ *	after the offending text.
+ *
+ * Side effects:
+ *	Depends on the commands.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ExecCmds(
+    Interp *iPtr,		/* Interpreter in which to execute. */
+    ExecLevel *stopPtr,		/* Level at which to stop. */
+    int result)			/* If the top level is resuming, return
+				 * code of the level it was waiting for. */
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+    ExecLevel *levelPtr;
+    CompiledScript *scriptPtr;
+    ExecEnv *envPtr;
+    CompiledCmd *infoPtr;
+    int *pc;
+    int argc, first, i, length, next, numChars, end, haveRefs, useObjv;
+    char **argv;
+    char *value, *dst;
+    Hax_Obj *objPtr;
+    Hax_Obj **objv;
+    Hax_HashEntry *hPtr, *slotPtr;
+    Command *cmdPtr;
+    Trace *tracePtr;
+    ExecLevel *nestedPtr;
+    const char *ellipsis;
+
+    nextLevel:
+    levelPtr = iPtr->execTopPtr;
+    scriptPtr = levelPtr->scriptPtr;
+    envPtr = levelPtr->envPtr;
+    infoPtr = levelPtr->infoPtr;
+    pc = levelPtr->pc;
+    ellipsis = "";
+    end = 0;
+    if (levelPtr->state == LEVEL_INVOKING) {
+	end = infoPtr->srcEnd;
+	levelPtr->state = LEVEL_RUNNING;
+	FinishInvoke(iPtr, levelPtr);
+	if (result != HAX_OK) {
+	    goto done;
+	}
+	pc += 2;
+	goto run;
+    } else if (levelPtr->state == LEVEL_RUNNING) {
+
+	/*
+	 * The nested command at pc has finished.
+	 */
+
+	if (result != HAX_OK) {
+	    /*
+	     * Same adjustment as in HaxParseNestedCmd, so that the
+	     * close-bracket appears in errorInfo.
+	     */
+
+	    if (scriptPtr->source[envPtr->errOffset] == ']') {
+		envPtr->errOffset++;
+	    }
+	    goto substError;
+	}
+	if ((*pc == INST_NESTED_WORD)
+		&& ((objPtr = HaxTakeResultObj(iPtr)) != NULL)) {
+	    PushObj(iPtr, envPtr, objPtr);
+	    Hax_DecrRefCount(interp, objPtr);
+	} else {
+	    Push(iPtr, envPtr, iPtr->result, strlen(iPtr->result));
+	}
+	Hax_FreeResult(interp);
+	HaxReleaseObjResult(iPtr);
+	iPtr->result = iPtr->resultSpace;
+	iPtr->resultSpace[0] = '\0';
+	pc += 2 + pc[1];
+	goto run;
+    }
+
+    /*
+     * Starting a new level.  This is where the depth of nesting is
+     * checked:  if the stack has grown beyond the budget it's
+     * probably because of an infinite loop somewhere.
+     */
+
+    Hax_FreeResult(interp);
+    iPtr->result = iPtr->resultSpace;
+    iPtr->resultSpace[0] = 0;
+    if (iPtr->execBytes > iPtr->evalBudget) {
+	iPtr->result =
+	    (char *) "too many nested calls to Hax_Eval (infinite loop?)";
+	if (levelPtr->type == LEVEL_SCRIPT) {
+	    HaxReleaseCompiled(interp, scriptPtr);
+	}
+	PopLevel(iPtr, levelPtr);
+	result = HAX_ERROR;
+	goto popped;
+    }
+    if (levelPtr->type == LEVEL_SCRIPT) {
+
+	/*
+	 * The stacks start out in the ExecEnv and move elsewhere in the
+	 * scratch space if they outgrow it.
+	 */
+
+	HaxScratchMark(iPtr, &levelPtr->mark);
+	envPtr = (ExecEnv *) HaxScratchAlloc(iPtr, sizeof(ExecEnv));
+	envPtr->scriptPtr = scriptPtr;
+	envPtr->chars = envPtr->charStorage;
+	envPtr->charsUsed = 0;
+	envPtr->charsAvl = NUM_CHARS;
+	envPtr->words = envPtr->wordStorage;
+	envPtr->lits = envPtr->litStorage;
+	envPtr->objs = envPtr->objStorage;
+	envPtr->numWords = 0;
+	envPtr->wordsAvl = NUM_WORDS;
+	envPtr->argv = envPtr->argvStorage;
+	envPtr->argvAvl = NUM_WORDS;
+	envPtr->objv = envPtr->objvStorage;
+	envPtr->objvAvl = NUM_WORDS;
+	envPtr->errOffset = 0;
+	levelPtr->envPtr = envPtr;
+    }
+    levelPtr->baseWords = envPtr->numWords;
+    levelPtr->baseChars = envPtr->charsUsed;
+    levelPtr->state = LEVEL_RUNNING;
+    iPtr->numLevels++;
+    result = HAX_OK;
+
+    run:
+    while (1) {
+	switch (*pc) {
+	    case INST_DONE:
+		goto done;
+
+	    case INST_CLEAR_ERR:
+		iPtr->flags &= ~(ERR_IN_PROGRESS | ERROR_CODE_SET);
+		pc += 1;
+		break;
+
+	    case INST_CMD:
+		iPtr->flags &= ~(ERR_IN_PROGRESS | ERROR_CODE_SET);
+		infoPtr = &scriptPtr->cmds[pc[1]];
+		pc += 2;
+		break;
+
+	    case INST_PUSH:
+		Push(iPtr, envPtr, scriptPtr->literals + pc[1], pc[2]);
+		envPtr->lits[envPtr->numWords - 1] = pc[3];
+		pc += 4;
+		break;
+
+	    case INST_LOAD_SCALAR:
+		value = Hax_GetVar2(interp, scriptPtr->literals + pc[1],
+			(char *) NULL, HAX_LEAVE_ERR_MSG);
+		if (value == NULL) {
+		    envPtr->errOffset = pc[2];
+		    result = HAX_ERROR;
+		    goto substError;
+		}
+		Push(iPtr, envPtr, value, strlen(value));
+		pc += 3;
+		break;
+
+	    case INST_SCALAR_WORD:
+	    case INST_SLOT_WORD:
+		slotPtr = NULL;
+		if ((*pc == INST_SLOT_WORD)
+			&& ((slotPtr = ScriptSlots(iPtr, scriptPtr)) != NULL)) {
+		    slotPtr += pc[3];
+		}
+		value = HaxGetVarSlot(interp, slotPtr,
+			scriptPtr->literals + pc[1], (char *) NULL,
+			HAX_LEAVE_ERR_MSG, &objPtr, (VarNumber **) NULL);
+		if (value == NULL) {
+		    envPtr->errOffset = pc[2];
+		    result = HAX_ERROR;
+		    goto substError;
+		}
+		if (objPtr != NULL) {
+		    PushObj(iPtr, envPtr, objPtr);
+		} else {
+		    Push(iPtr, envPtr, value, strlen(value));
+		}
+		pc += (*pc == INST_SLOT_WORD) ? 4 : 3;
+		break;
+
+	    case INST_LOAD_SLOT:
+		slotPtr = ScriptSlots(iPtr, scriptPtr);
+		if (slotPtr != NULL) {
+		    slotPtr += pc[3];
+		}
+		value = HaxGetVarSlot(interp, slotPtr,
+			scriptPtr->literals + pc[1], (char *) NULL,
+			HAX_LEAVE_ERR_MSG, (Hax_Obj **) NULL,
+			(VarNumber **) NULL);
+		if (value == NULL) {
+		    envPtr->errOffset = pc[2];
+		    result = HAX_ERROR;
+		    goto substError;
+		}
+		Push(iPtr, envPtr, value, strlen(value));
+		pc += 4;
+		break;
+
+	    case INST_LOAD_ARRAY:
+		first = envPtr->numWords - 1;
+		slotPtr = NULL;
+		if ((pc[4] >= 0)
+			&& ((slotPtr = ScriptSlots(iPtr, scriptPtr)) != NULL)) {
+		    slotPtr += pc[4];
+		}
+		value = HaxGetVarSlot(interp, slotPtr,
+			scriptPtr->literals + pc[1],
+			envPtr->chars + envPtr->words[first],
+			HAX_LEAVE_ERR_MSG, (Hax_Obj **) NULL,
+			(VarNumber **) NULL);
+		envPtr->charsUsed = envPtr->words[first];
+		envPtr->numWords = first;
+		if (value == NULL) {
+		    envPtr->errOffset = pc[2];
+		    result = HAX_ERROR;
+		    goto substError;
+		}
+		Push(iPtr, envPtr, value, strlen(value));
+		pc += 5;
+		break;
+
+	    case INST_NESTED:
+	    case INST_NESTED_WORD:
+		levelPtr->pc = pc;
+		levelPtr->infoPtr = infoPtr;
+		nestedPtr = PushLevel(iPtr, LEVEL_NESTED, 0);
+		nestedPtr->scriptPtr = scriptPtr;
+		nestedPtr->envPtr = envPtr;
+		nestedPtr->pc = pc + 2;
+		nestedPtr->infoPtr = NULL;
+		goto nextLevel;
+
+	    case INST_CONCAT:
+
+		/*
+		 * The entries are stored back to back, so just squeeze
+		 * out the null characters between them.
+		 */
+
+		first = envPtr->numWords - pc[1];
+		dst = envPtr->chars + envPtr->words[first+1] - 1;
+		for (i = first+1; i < envPtr->numWords; i++) {
+		    next = (i+1 < envPtr->numWords) ? envPtr->words[i+1]
+			    : envPtr->charsUsed;
+		    length = next - envPtr->words[i] - 1;
+		    memmove(dst, envPtr->chars + envPtr->words[i], length);
+		    dst += length;
+		}
+		*dst = 0;
+		envPtr->charsUsed = dst + 1 - envPtr->chars;
+		envPtr->numWords = first + 1;
+		envPtr->lits[first] = -1;
+		pc += 2;
+		break;
+
+	    case INST_INVOKE:
+
+		/*
+		 * Build an argv array for the command from the top of the
+		 * stack, leaving room for "unknown" and a NULL.
+		 */
+
+		argc = pc[1];
+		first = envPtr->numWords - argc;
+		if (argc + 2 > envPtr->argvAvl) {
+		    GrowScratchArray(iPtr, (char **) &envPtr->argv,
+			    &envPtr->argvAvl, 0, sizeof(char *), argc + 2);
+		}
+		argv = envPtr->argv;
+		haveRefs = 0;
+		for (i = 0; i < argc; i++) {
+		    objPtr = envPtr->objs[first + i];
+		    if (objPtr != NULL) {
+			argv[i] = objPtr->bytes;
+			haveRefs = 1;
+		    } else {
+			argv[i] = envPtr->chars + envPtr->words[first + i];
+		    }
+		}
+		argv[argc] = NULL;
+		end = infoPtr->srcEnd;
+
+		/*
+		 * If the command's name is a literal, the command it
+		 * resolved to last time is still right unless some
+		 * command has since been created, deleted or renamed.
+		 */
+
+		if (infoPtr->literalName
+			&& (infoPtr->cmdEpoch == iPtr->cmdEpoch)) {
+		    cmdPtr = infoPtr->cmdPtr;
+		    goto haveCmd;
+		}
+		hPtr = Hax_FindHashEntry(&iPtr->commandTable, argv[0]);
+		if (hPtr == NULL) {
+		    hPtr = Hax_FindHashEntry(&iPtr->commandTable,
+			    (char *) "unknown");
+		    if (hPtr == NULL) {
+			Hax_ResetResult(interp);
+			Hax_AppendResult(interp, "invalid command name: \"",
+				argv[0], "\"", (char *) NULL);
+			result = HAX_ERROR;
+			goto done;
+		    }
+		    for (i = argc; i >= 0; i--) {
+			argv[i+1] = argv[i];
+		    }
+		    argv[0] = (char *) "unknown";
+		    argc++;
+		    cmdPtr = (Command *) Hax_GetHashValue(hPtr);
+		} else {
+		    cmdPtr = (Command *) Hax_GetHashValue(hPtr);
+		    infoPtr->cmdPtr = cmdPtr;
+		    infoPtr->cmdEpoch = iPtr->cmdEpoch;
+		}
+
+		haveCmd:
+
+		/*
+		 * A string-based command procedure gets pointers to the
+		 * strings of any words that were pushed by reference;
+		 * they stay valid until the words are popped.  The objv
+		 * array is built before the scratch mark is taken, since
+		 * it may have to be enlarged.
+		 */
+
+		slotPtr = NULL;
+		if ((infoPtr->slot >= 0) && (argc == pc[1])
+			&& ((cmdPtr->objProc == Hax_SetObjCmd)
+			    || (cmdPtr->objProc == Hax_IncrObjCmd))
+			&& ((slotPtr = ScriptSlots(iPtr, scriptPtr)) != NULL)) {
+		    slotPtr += infoPtr->slot;
+		}
+		useObjv = (cmdPtr->objProc != NULL) && (argc == pc[1])
+			&& (slotPtr == NULL)
+			&& (haveRefs || (cmdPtr->proc == HaxInvokeObjCommand));
+		objv = NULL;
+		levelPtr->numObjs = 0;
+		if (useObjv) {
+		    objv = MakeObjv(iPtr, envPtr, first, argc);
+		    levelPtr->numObjs = argc;
+		}
+		levelPtr->first = first;
+		HaxScratchMark(iPtr, &levelPtr->cmdMark);
+
+		for (tracePtr = iPtr->tracePtr; tracePtr != NULL;
+			tracePtr = tracePtr->nextPtr) {
+		    char *src = scriptPtr->source + infoPtr->srcEnd;
+		    char saved;
+
+		    if (tracePtr->level < iPtr->numLevels) {
+			continue;
+		    }
+		    saved = *src;
+		    *src = 0;
+		    (*tracePtr->proc)(tracePtr->clientData, interp,
+			    iPtr->numLevels,
+			    scriptPtr->source + infoPtr->srcOffset,
+			    cmdPtr->proc, cmdPtr->clientData, argc, argv);
+		    *src = saved;
+		}
+
+		iPtr->cmdCount++;
+		Hax_FreeResult(interp);
+		HaxReleaseObjResult(iPtr);
+		iPtr->result = iPtr->resultSpace;
+		iPtr->resultSpace[0] = 0;
+
+		/*
+		 * Let the command find the compiled form of its literal
+		 * expression in infoPtr, rather than looking the text up
+		 * in the expression cache (see ExprGetCached).
+		 */
+
+		if ((infoPtr->exprWord >= 0) && (argc == pc[1])
+			&& (infoPtr->exprWord < argc)) {
+		    iPtr->exprCmdPtr = infoPtr;
+		    iPtr->exprCmdString = argv[infoPtr->exprWord];
+		    iPtr->exprProcPtr = scriptPtr->procPtr;
+		}
+		if ((cmdPtr->nrProc != NULL)
+			&& (useObjv || (cmdPtr->proc != HaxInvokeObjCommand))) {
+		    levelPtr->pc = pc;
+		    levelPtr->infoPtr = infoPtr;
+		    levelPtr->state = LEVEL_INVOKING;
+		    result = (*cmdPtr->nrProc)(cmdPtr->objClientData, interp,
+			    argc, argv, objv);
+		    iPtr->exprCmdPtr = NULL;
+		    if (result == HAX_NR_PENDING) {
+			if (iPtr->execTopPtr->type == LEVEL_CALLBACK) {
+			    return HAX_OK;
+			}
+			goto nextLevel;
+		    }
+		    levelPtr->state = LEVEL_RUNNING;
+		} else if (useObjv) {
+		    result = (*cmdPtr->objProc)(cmdPtr->objClientData, interp,
+			    argc, objv);
+		} else if (slotPtr != NULL) {
+		    if (cmdPtr->objProc == Hax_SetObjCmd) {
+			result = HaxSetSlotCmd(interp, slotPtr, argv[1],
+				argv[2], (argc == 3) ? envPtr->objs[first + 2]
+				: (Hax_Obj *) NULL);
+		    } else {
+			result = HaxIncrSlotCmd(interp, slotPtr, argv[1],
+				argv[2]);
+		    }
+		} else {
+		    result = (*cmdPtr->proc)(cmdPtr->clientData, interp, argc,
+			    argv);
+		}
+		iPtr->exprCmdPtr = NULL;
+		FinishInvoke(iPtr, levelPtr);
+		if (result != HAX_OK) {
+		    goto done;
+		}
+		pc += 2;
+		break;
+
+	    default:
+		Hax_Panic((char *) "bad instruction %d in compiled script", *pc);
+	}
+    }
+
+    /*
+     * A substitution failed at pc:  note any array references whose
+     * index it was part of, then treat it like a failed command.
+     */
+
+    substError:
+    AddIndexInfo(interp, scriptPtr, pc);
+    end = envPtr->errOffset;
+    ellipsis = "...";
+
+    done:
+    PopWords(iPtr, envPtr, levelPtr->baseWords);
+    envPtr->charsUsed = levelPtr->baseChars;
+    iPtr->numLevels--;
+    if (iPtr->numLevels == 0) {
+	if (result == HAX_RETURN) {
+	    result = HAX_OK;
+	}
+	if ((result != HAX_OK) && (result != HAX_ERROR)) {
+	    Hax_ResetResult(interp);
+	    if (result == HAX_BREAK) {
+		iPtr->result = (char *) "invoked \"break\" outside of a loop";
+	    } else if (result == HAX_CONTINUE) {
+		iPtr->result =
+		    (char *) "invoked \"continue\" outside of a loop";
+	    } else {
+		iPtr->result = iPtr->resultSpace;
+		sprintf(iPtr->resultSpace,
+		    (char *) "command returned bad code: %d", result);
+	    }
+	    result = HAX_ERROR;
+	}
+    }
+
+    /*
+     * If an error occurred, record information about what was being
+     * executed when the error occurred.
+     */
+
+    if ((result == HAX_ERROR) && !(iPtr->flags & ERR_ALREADY_LOGGED)) {
+	iPtr->errorLine = infoPtr->line;
+	numChars = end - infoPtr->srcOffset;
+	if (numChars < 0) {
+	    numChars = 0;
+	}
+	if (numChars > (NUM_CHARS-50)) {
+	    numChars = NUM_CHARS-50;
+	    ellipsis = " ...";
+	}
+	HaxLogErrorCommand(iPtr, scriptPtr->source + infoPtr->srcOffset,
+		numChars, ellipsis);
+	iPtr->flags &= ~ERR_ALREADY_LOGGED;
+    } else {
+	iPtr->flags &= ~ERR_ALREADY_LOGGED;
+    }
+    envPtr->errOffset = end;
+    if (iPtr->numLevels == 0) {
+	HaxFlushPendingError(iPtr);
+    }
+    if (levelPtr->type == LEVEL_SCRIPT) {
+	HaxScratchRelease(iPtr, &levelPtr->mark);
+	HaxReleaseCompiled(interp, scriptPtr);
+    }
+    PopLevel(iPtr, levelPtr);
+
+    popped:
+    if ((iPtr->execTopPtr == stopPtr)
+	    || (iPtr->execTopPtr->type == LEVEL_CALLBACK)) {
+	return result;
+    }
+    goto nextLevel;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddIndexInfo --
+ *
+ *	Called when a substitution fails, to add a line to errorInfo
+ *	for each array reference whose index contained the failure,
+ *	innermost first.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Information is added to errorInfo.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddIndexInfo(
+    Hax_Interp *interp,
+    CompiledScript *scriptPtr,	/* Script being executed. */
+    int *failPc)		/* Instruction that failed. */
+{
+    int *pc;
+    char msg[150];
+    char *name;
+    const char *ellipsis;
+    int n;
+
+    /*
+     * An INST_LOAD_ARRAY follows the code for its index, so the
+     * references in question are the ones between the failure and the
+     * end of the command whose index code starts at or before it.
+     */
+
+    for (pc = failPc + InstLength(failPc); *pc != INST_INVOKE;
+	    pc += InstLength(pc)) {
+	if ((*pc != INST_LOAD_ARRAY) || (pc - pc[3] > failPc)) {
+	    continue;
+	}
+	name = scriptPtr->literals + pc[1];
+	ellipsis = "";
+	n = strlen(name);
+	if (n > 100) {
+	    n = 100;
+	    ellipsis = " ...";
+	}
+	sprintf(msg, "\n    (parsing index for array \"%.*s%s\")",
+		n, name, ellipsis);
+	Hax_AddErrorInfo(interp, msg);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InstLength --
+ *
+ *	Find the length of a word-building instruction.
+ *
+ * Results:
+ *	The number of words of code taken by the instruction at pc,
+ *	including the nested command that follows an INST_NESTED.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+InstLength(
+    int *pc)			/* Instruction to measure. */
+{
+    switch (*pc) {
+	case INST_LOAD_ARRAY:
+	    return 5;
+	case INST_PUSH:
+	case INST_LOAD_SLOT:
+	case INST_SLOT_WORD:
+	    return 4;
+	case INST_LOAD_SCALAR:
+	case INST_SCALAR_WORD:
+	    return 3;
+	case INST_NESTED:
+	case INST_NESTED_WORD:
+	    return 2 + pc[1];
+	case INST_CONCAT:
+	    return 2;
+	default:
+	    Hax_Panic((char *) "bad instruction %d in compiled script", *pc);
+	    return 1;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MakeObjv, FinishInvoke --
+ *
+ *	MakeObjv passes the top argc stack entries to an object-based
+ *	command procedure as values.  An entry that is still a literal
+ *	from the script is passed as the script's own value for that
+ *	literal, so any internal form a command gives it (e.g. a list
+ *	or an integer) is still there the next time the command is
+ *	executed.  FinishInvoke cleans up after a command invoked by
+ *	ExecCmds, whether it finished at once or later.
+ *
+ * Results:
+ *	MakeObjv returns envPtr->objv, filled in.
+ *
+ * Side effects:
+ *	MakeObjv creates values for the non-literal words and holds a
+ *	reference to each entry;  a literal's value is created the
+ *	first time it is needed and kept until the script is freed.
+ *	FinishInvoke releases them, gives back the scratch space used
+ *	by the command and pops its words.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Hax_Obj **
+MakeObjv(
+    Interp *iPtr,		/* Interpreter in which to execute. */
+    ExecEnv *envPtr,		/* Stack and script information. */
+    int first,			/* Index of first stack entry to pass. */
+    int argc)			/* Number of stack entries to pass. */
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+    CompiledScript *scriptPtr = envPtr->scriptPtr;
+    Hax_Obj **objv;
+    Hax_Obj *objPtr;
+    int i, lit, next;
+
+    if (argc > envPtr->objvAvl) {
+	GrowScratchArray(iPtr, (char **) &envPtr->objv, &envPtr->objvAvl,
+		0, sizeof(Hax_Obj *), argc);
+    }
+    objv = envPtr->objv;
+    for (i = 0; i < argc; i++) {
+	lit = envPtr->lits[first + i];
+	objPtr = (lit >= 0) ? scriptPtr->litObjs[lit] : envPtr->objs[first + i];
+	if (objPtr == NULL) {
+	    next = (first+i+1 < envPtr->numWords) ? envPtr->words[first+i+1]
+		    : envPtr->charsUsed;
+	    objPtr = Hax_NewStringObj(interp,
+		    envPtr->chars + envPtr->words[first+i],
+		    next - envPtr->words[first+i] - 1);
+	    if (lit >= 0) {
+		scriptPtr->litObjs[lit] = objPtr;
+		Hax_IncrRefCount(objPtr);
+	    }
+	}
+	objv[i] = objPtr;
+	Hax_IncrRefCount(objPtr);
+    }
+    return objv;
+}
+
+static void
+FinishInvoke(
+    Interp *iPtr,
+    ExecLevel *levelPtr)	/* Level whose command has finished. */
+{
+    ExecEnv *envPtr = levelPtr->envPtr;
+    int i;
+
+    for (i = 0; i < levelPtr->numObjs; i++) {
+	Hax_DecrRefCount((Hax_Interp *) iPtr, envPtr->objv[i]);
+    }
+    HaxScratchRelease(iPtr, &levelPtr->cmdMark);
+    PopWords(iPtr, envPtr, levelPtr->first);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Push --
+ *
+ *	Push a copy of a string on the stack of an executing script.
+ *	The string may lie in the part of the stack that was just
+ *	popped (e.g. a nested command's result that points into one of
+ *	its arguments).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The stack storage may be enlarged.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+Push(
+    Interp *iPtr,
+    ExecEnv *envPtr,
+    char *string,		/* String to push. */
+    int length)			/* Number of bytes in string. */
+{
+    if (envPtr->charsUsed + length + 1 > envPtr->charsAvl) {
+	GrowScratchArray(iPtr, &envPtr->chars, &envPtr->charsAvl,
+		envPtr->charsUsed, 1, length + 1);
+    }
+    if (envPtr->numWords >= envPtr->wordsAvl) {
+	int litsAvl = envPtr->wordsAvl;
+
+	int objsAvl = envPtr->wordsAvl;
+
+	GrowScratchArray(iPtr, (char **) &envPtr->lits, &litsAvl,
+		envPtr->numWords, sizeof(int), 1);
+	GrowScratchArray(iPtr, (char **) &envPtr->objs, &objsAvl,
+		envPtr->numWords, sizeof(Hax_Obj *), 1);
+	GrowScratchArray(iPtr, (char **) &envPtr->words, &envPtr->wordsAvl,
+		envPtr->numWords, sizeof(int), 1);
+    }
+    envPtr->words[envPtr->numWords] = envPtr->charsUsed;
+    envPtr->lits[envPtr->numWords] = -1;
+    envPtr->objs[envPtr->numWords] = NULL;
+    envPtr->numWords++;
+    memmove(envPtr->chars + envPtr->charsUsed, string, length);
+    envPtr->charsUsed += length;
+    envPtr->chars[envPtr->charsUsed] = 0;
+    envPtr->charsUsed++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PushObj --
+ *
+ *	Push a value on the stack of an executing script by reference.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The stack holds a reference to objPtr until the entry is popped
+ *	by PopWords.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PushObj(
+    Interp *iPtr,
+    ExecEnv *envPtr,
+    Hax_Obj *objPtr)		/* Value to push;  its string form must
+				 * be valid. */
+{
+    Push(iPtr, envPtr, (char *) "", 0);
+    envPtr->objs[envPtr->numWords - 1] = objPtr;
+    Hax_IncrRefCount(objPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * PopWords --
+ *
+ *	Pop entries off the stack of an executing script.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Entries from first up are removed, releasing the values of any
+ *	that were pushed by reference.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+PopWords(
+    Interp *iPtr,
+    ExecEnv *envPtr,
+    int first)			/* Index of the first entry to pop. */
+{
+    int i;
+
+    if (first >= envPtr->numWords) {
+	return;
+    }
+    for (i = first; i < envPtr->numWords; i++) {
+	if (envPtr->objs[i] != NULL) {
+	    Hax_DecrRefCount((Hax_Interp *) iPtr, envPtr->objs[i]);
+	}
+    }
+    envPtr->charsUsed = envPtr->words[first];
+    envPtr->numWords = first;
+}
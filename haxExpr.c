@@ -68,6 +68,150 @@ typedef struct {
 				 * before expr. */
 } ExprInfo;
 
+/*
+ * Expressions that are evaluated over and over (loop conditions and
+ * the like) are compiled into a postfix instruction stream, which is
+ * kept in a per-interpreter cache keyed by the text of the expression.
+ * Each instruction is an opcode followed by a fixed number of integer
+ * operands:
+ *
+ * EXPR_DONE			End of the expression;  its value is the
+ *				only entry left on the stack.
+ * EXPR_PUSH const		Push an entry from the constant table.
+ * EXPR_LOAD_SCALAR name	Push the value of the scalar variable whose
+ *				name is in the string pool.
+ * EXPR_LOAD_SLOT name slot	Like EXPR_LOAD_SCALAR, for a local variable
+ *				of the procedure the expression was compiled
+ *				for, kept in slot "slot" of its frames.  The
+ *				slot is only used while a call to that
+ *				procedure is the current variable frame.
+ * EXPR_SUBST text		Push the value of a substitution other than
+ *				a simple variable reference:  an array
+ *				element, a command, or a quoted string
+ *				containing substitutions.  The text of the
+ *				substitution is in the string pool, and is
+ *				processed with ExprLex each time.
+ * EXPR_UNARY op		Apply a unary operator to the top entry.
+ * EXPR_BINARY op		Replace the top two entries with the result
+ *				of applying a binary operator to them.
+ * EXPR_AND_OR op skip target	The top entry is the left operand of "&&"
+ *				or "||".  If it determines the result,
+ *				replace it with 0 or 1 and jump to target;
+ *				otherwise go on to the right operand.
+ * EXPR_IF_FALSE skip target	Pop the condition of a "?:" operator and
+ *				jump to target (the "else" value) if it's
+ *				false.
+ * EXPR_JUMP skip target	Jump to target (past the "else" value).
+ *
+ * The interpreter parses an operand that's skipped by "&&", "||" or "?:"
+ * with noEval set, which still applies the operators in it (variables
+ * and commands count as 0):  so "0 && {abc}" is an error, and a command
+ * in the skipped operand resets interp->result.  None of this depends
+ * on run-time values, so the compiler works out the outcome in advance
+ * and stores it in the ExprSkip given by "skip", which is applied when
+ * the jump is taken.
+ */
+
+#define EXPR_DONE		0
+#define EXPR_PUSH		1
+#define EXPR_LOAD_SCALAR	2
+#define EXPR_SUBST		3
+#define EXPR_UNARY		4
+#define EXPR_BINARY		5
+#define EXPR_AND_OR		6
+#define EXPR_IF_FALSE		7
+#define EXPR_JUMP		8
+#define EXPR_LOAD_SLOT		9
+
+typedef struct {
+    int type;			/* TYPE_LLONG, TYPE_DOUBLE or TYPE_STRING. */
+    long long int llongValue;	/* Integer value, if any. */
+    double doubleValue;		/* Floating-point value, if any. */
+    int string;			/* Offset of string value in string pool,
+				 * if any. */
+} ExprConst;
+
+typedef struct {
+    int resetResult;		/* Non-zero means that parsing the skipped
+				 * operand resets interp->result. */
+    int error;			/* EXPR_OK, or the error that parsing the
+				 * skipped operand produces. */
+    int op;			/* Operator and operand type to pass to */
+    int badType;		/* ExprError along with error. */
+} ExprSkip;
+
+struct CompiledExpr {
+    int refCount;		/* Number of references to this structure;
+				 * the cache holds one, and so does anyone
+				 * executing it. */
+    int *code;			/* Instructions. */
+    ExprConst *consts;		/* Constant table. */
+    ExprSkip *skips;		/* Outcomes of skipped operands. */
+    char *strings;		/* String pool:  null-terminated strings,
+				 * back to back. */
+    int maxDepth;		/* Most stack entries ever needed. */
+    Proc *procPtr;		/* Procedure whose slots EXPR_LOAD_SLOT
+				 * refers to, or NULL.  Set to NULL when
+				 * the procedure is freed. */
+};
+
+/*
+ * While an expression is being compiled it is first parsed into a tree
+ * of the structures below, so that the outcome of skipped operands can
+ * be worked out and constant sub-expressions folded before any code is
+ * emitted.
+ */
+
+#define NODE_LEAF	0
+#define NODE_UNARY	1
+#define NODE_BINARY	2
+#define NODE_AND_OR	3
+#define NODE_COND	4
+
+typedef struct {
+    int type;			/* NODE_LEAF etc. */
+    int op;			/* Operator, or for leaves the instruction
+				 * that pushes the value. */
+    int operand;		/* Operand of a leaf's instruction. */
+    int child[3];		/* Node indexes of operands. */
+    int noEvalConst;		/* For leaves, index of a constant holding
+				 * the value of the leaf when it is parsed
+				 * with noEval set. */
+    int resetResult;		/* For leaves, non-zero means that parsing
+				 * the leaf with noEval set resets
+				 * interp->result. */
+    int pure;			/* Non-zero means the value doesn't depend on
+				 * anything that happens at run time. */
+} ExprNode;
+
+typedef struct {
+    Interp *iPtr;		/* Interpreter (used for memory). */
+    Proc *procPtr;		/* Procedure whose locals get slots, or
+				 * NULL. */
+    ExprInfo info;		/* Describes the state of the parse. */
+    Value value;		/* Holds values lexed from the expression. */
+    int leaf;			/* Node for the last VALUE token lexed. */
+    ExprNode *nodes;		/* Parse tree. */
+    int numNodes, nodesAvl;
+    ExprConst *consts;		/* Constant table. */
+    int numConsts, constsAvl;
+    ExprSkip *skips;		/* Outcomes of skipped operands. */
+    int numSkips, skipsAvl;
+    char *strings;		/* String pool. */
+    int stringsUsed, stringsAvl;
+    int *code;			/* Instructions. */
+    int codeNext, codeAvl;
+    int depth;			/* Stack depth at codeNext. */
+    int maxDepth;		/* Most stack entries ever needed. */
+} ExprCompileEnv;
+
+/*
+ * Number of stack entries that ExprExecute keeps on the C stack;  if
+ * an expression needs more they are allocated.
+ */
+
+#define NUM_EXPR_VALUES	8
+
 /*
  * The token types are defined below.  In addition, there is a table
  * associating a precedence with each operator.  The order of types
@@ -113,6 +257,17 @@ typedef struct {
 #define NOT		29
 #define BIT_NOT		30
 
+/*
+ * Error codes returned by ExprUnaryOp and ExprBinaryOp;  ExprError
+ * turns them into messages.
+ */
+
+#define EXPR_OK			0
+#define EXPR_ILLEGAL_TYPE	1
+#define EXPR_DIVIDE_BY_ZERO	2
+#define EXPR_UNKNOWN_OP		3
+#define EXPR_BAD_COLON		4
+
 /*
  * Precedence table.  The values for non-operator token types are ignored.
  */
@@ -148,15 +303,51 @@ const char *operatorStrings[] = {
  * Declarations for local procedures to this file:
  */
 
+static int		ExprAddConst (ExprCompileEnv *envPtr,
+			    Value *valuePtr);
+static int		ExprAddSkip (ExprCompileEnv *envPtr, int node,
+			    int op);
+static int		ExprAddString (ExprCompileEnv *envPtr,
+			    char *string, int length);
+static int		ExprBinaryOp (Hax_Interp *interp, int op,
+			    Value *valuePtr, Value *value2Ptr,
+			    int *badTypePtr);
+static CompiledExpr *	ExprCompile (Hax_Interp *interp, char *string,
+			    Proc *procPtr);
+static int		ExprCompileLex (ExprCompileEnv *envPtr);
+static int		ExprCompileValue (ExprCompileEnv *envPtr,
+			    int prec, int *nodePtr);
+static void		ExprEmit (ExprCompileEnv *envPtr, int node);
+static int		ExprEmitInst (ExprCompileEnv *envPtr, int op,
+			    int numOperands);
+static void		ExprError (Hax_Interp *interp, int code, int op,
+			    int badType);
+static int		ExprExecute (Hax_Interp *interp,
+			    CompiledExpr *exprPtr, Value *valuePtr);
+static CompiledExpr *	ExprGetCached (Hax_Interp *interp, char *string,
+			    int compileNow);
 static int		ExprGetValue (Hax_Interp *interp,
 			    ExprInfo *infoPtr, int prec, Value *valuePtr);
+static void		ExprGrow (Interp *iPtr, char **arrayPtr,
+			    int *availPtr, int used, int elSize);
+static void		ExprInitValue (Value *valuePtr);
 static int		ExprLex (Hax_Interp *interp,
 			    ExprInfo *infoPtr, Value *valuePtr);
+static void		ExprLoadConst (Hax_Interp *interp, char *strings,
+			    ExprConst *constPtr, Value *valuePtr);
 static void		ExprMakeString (Hax_Interp *interp, Value *valuePtr);
+static int		ExprNewNode (ExprCompileEnv *envPtr, int type,
+			    int op, int child0, int child1, int child2);
 static int		ExprParseString (Hax_Interp *interp,
 			    char *string, Value *valuePtr);
+static int		ExprStaticEval (ExprCompileEnv *envPtr, int node,
+			    Value *valuePtr, ExprSkip *skipPtr);
+static int		ExprTestOp (Value *valuePtr, int *badTypePtr);
 static int		ExprTopLevel (Hax_Interp *interp,
-			    char *string, Value *valuePtr);
+			    CompiledExpr *exprPtr, char *string,
+			    Value *valuePtr);
+static int		ExprUnaryOp (int op, Value *valuePtr,
+			    int *badTypePtr);
 
 /*
  *--------------------------------------------------------------
@@ -581,6 +772,8 @@ ExprGetValue(
 					 * operator (while picking up value
 					 * for unary operator).  Don't lex
 					 * again. */
+    int code;				/* EXPR_OK or an error code from
+					 * ExprUnaryOp or ExprBinaryOp. */
     int result;
 
     /*
@@ -631,45 +824,9 @@ ExprGetValue(
 	    if (result != HAX_OK) {
 		goto done;
 	    }
-	    switch (op) {
-		case UNARY_MINUS:
-		    if (valuePtr->type == TYPE_LLONG) {
-			valuePtr->llongValue = -valuePtr->llongValue;
-		    } else if (valuePtr->type == TYPE_DOUBLE){
-			valuePtr->doubleValue = -valuePtr->doubleValue;
-		    } else {
-			badType = valuePtr->type;
-			goto illegalType;
-		    }
-		    break;
-		case NOT:
-		    if (valuePtr->type == TYPE_LLONG) {
-			valuePtr->llongValue = !valuePtr->llongValue;
-		    } else if (valuePtr->type == TYPE_DOUBLE) {
-			/*
-			 * Theoretically, should be able to use
-			 * "!valuePtr->llongValue", but apparently some
-			 * compilers can't handle it.
-			 */
-			if (valuePtr->doubleValue == 0.0) {
-			    valuePtr->llongValue = 1;
-			} else {
-			    valuePtr->llongValue = 0;
-			}
-			valuePtr->type = TYPE_LLONG;
-		    } else {
-			badType = valuePtr->type;
-			goto illegalType;
-		    }
-		    break;
-		case BIT_NOT:
-		    if (valuePtr->type == TYPE_LLONG) {
-			valuePtr->llongValue = ~valuePtr->llongValue;
-		    } else {
-			badType  = valuePtr->type;
-			goto illegalType;
-		    }
-		    break;
+	    code = ExprUnaryOp(op, valuePtr, &badType);
+	    if (code != EXPR_OK) {
+		goto opError;
 	    }
 	    gotOp = 1;
 	} else if (infoPtr->token != VALUE) {
@@ -710,12 +867,9 @@ ExprGetValue(
 	 */
 
 	if ((op == AND) || (op == OR) || (op == QUESTY)) {
-	    if (valuePtr->type == TYPE_DOUBLE) {
-		valuePtr->llongValue = valuePtr->doubleValue != 0;
-		valuePtr->type = TYPE_LLONG;
-	    } else if (valuePtr->type == TYPE_STRING) {
-		badType = TYPE_STRING;
-		goto illegalType;
+	    code = ExprTestOp(valuePtr, &badType);
+	    if (code != EXPR_OK) {
+		goto opError;
 	    }
 	    if (((op == AND) && !valuePtr->llongValue)
 		    || ((op == OR) && valuePtr->llongValue)) {
@@ -772,298 +926,12 @@ ExprGetValue(
 	}
 
 	/*
-	 * At this point we've got two values and an operator.  Check
-	 * to make sure that the particular data types are appropriate
-	 * for the particular operator, and perform type conversion
-	 * if necessary.
-	 */
-
-	switch (op) {
-
-	    /*
-	     * For the operators below, no strings are allowed and
-	     * ints get converted to floats if necessary.
-	     */
-
-	    case MULT: case DIVIDE: case PLUS: case MINUS:
-		if ((valuePtr->type == TYPE_STRING)
-			|| (value2.type == TYPE_STRING)) {
-		    badType = TYPE_STRING;
-		    goto illegalType;
-		}
-		if (valuePtr->type == TYPE_DOUBLE) {
-		    if (value2.type == TYPE_LLONG) {
-			value2.doubleValue = value2.llongValue;
-			value2.type = TYPE_DOUBLE;
-		    }
-		} else if (value2.type == TYPE_DOUBLE) {
-		    if (valuePtr->type == TYPE_LLONG) {
-			valuePtr->doubleValue = valuePtr->llongValue;
-			valuePtr->type = TYPE_DOUBLE;
-		    }
-		}
-		break;
-
-	    /*
-	     * For the operators below, only integers are allowed.
-	     */
-
-	    case MOD: case LEFT_SHIFT: case RIGHT_SHIFT:
-	    case BIT_AND: case BIT_XOR: case BIT_OR:
-		 if (valuePtr->type != TYPE_LLONG) {
-		     badType = valuePtr->type;
-		     goto illegalType;
-		 } else if (value2.type != TYPE_LLONG) {
-		     badType = value2.type;
-		     goto illegalType;
-		 }
-		 break;
-
-	    /*
-	     * For the operators below, any type is allowed but the
-	     * two operands must have the same type.  Convert integers
-	     * to floats and either to strings, if necessary.
-	     */
-
-	    case LESS: case GREATER: case LEQ: case GEQ:
-	    case EQUAL: case NEQ:
-		if (valuePtr->type == TYPE_STRING) {
-		    if (value2.type != TYPE_STRING) {
-			ExprMakeString(interp, &value2);
-		    }
-		} else if (value2.type == TYPE_STRING) {
-		    if (valuePtr->type != TYPE_STRING) {
-			ExprMakeString(interp, valuePtr);
-		    }
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    if (value2.type == TYPE_LLONG) {
-			value2.doubleValue = value2.llongValue;
-			value2.type = TYPE_DOUBLE;
-		    }
-		} else if (value2.type == TYPE_DOUBLE) {
-		     if (valuePtr->type == TYPE_LLONG) {
-			valuePtr->doubleValue = valuePtr->llongValue;
-			valuePtr->type = TYPE_DOUBLE;
-		    }
-		}
-		break;
-
-	    /*
-	     * For the operators below, no strings are allowed, but
-	     * no int->double conversions are performed.
-	     */
-
-	    case AND: case OR:
-		if (valuePtr->type == TYPE_STRING) {
-		    badType = valuePtr->type;
-		    goto illegalType;
-		}
-		if (value2.type == TYPE_STRING) {
-		    badType = value2.type;
-		    goto illegalType;
-		}
-		break;
-
-	    /*
-	     * For the operators below, type and conversions are
-	     * irrelevant:  they're handled elsewhere.
-	     */
-
-	    case QUESTY: case COLON:
-		break;
-
-	    /*
-	     * Any other operator is an error.
-	     */
-
-	    default:
-		interp->result = (char *) "unknown operator in expression";
-		result = HAX_ERROR;
-		goto done;
-	}
-
-	/*
-	 * If necessary, convert one of the operands to the type
-	 * of the other.  If the operands are incompatible with
-	 * the operator (e.g. "+" on strings) then return an
-	 * error.
+	 * At this point we've got two values and an operator.
 	 */
 
-	switch (op) {
-	    case MULT:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue *= value2.llongValue;
-		} else {
-		    valuePtr->doubleValue *= value2.doubleValue;
-		}
-		break;
-	    case DIVIDE:
-		if (valuePtr->type == TYPE_LLONG) {
-		    if (value2.llongValue == 0) {
-			divideByZero:
-			interp->result = (char *) "divide by zero";
-			result = HAX_ERROR;
-			goto done;
-		    }
-		    valuePtr->llongValue /= value2.llongValue;
-		} else {
-		    if (value2.doubleValue == 0.0) {
-			goto divideByZero;
-		    }
-		    valuePtr->doubleValue /= value2.doubleValue;
-		}
-		break;
-	    case MOD:
-		if (value2.llongValue == 0) {
-		    goto divideByZero;
-		}
-		valuePtr->llongValue %= value2.llongValue;
-		break;
-	    case PLUS:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue += value2.llongValue;
-		} else {
-		    valuePtr->doubleValue += value2.doubleValue;
-		}
-		break;
-	    case MINUS:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue -= value2.llongValue;
-		} else {
-		    valuePtr->doubleValue -= value2.doubleValue;
-		}
-		break;
-	    case LEFT_SHIFT:
-		valuePtr->llongValue <<= value2.llongValue;
-		break;
-	    case RIGHT_SHIFT:
-		/*
-		 * The following code is a bit tricky:  it ensures that
-		 * right shifts propagate the sign bit even on machines
-		 * where ">>" won't do it by default.
-		 */
-
-		if (valuePtr->llongValue < 0) {
-		    valuePtr->llongValue =
-			    ~((~valuePtr->llongValue) >> value2.llongValue);
-		} else {
-		    valuePtr->llongValue >>= value2.llongValue;
-		}
-		break;
-	    case LESS:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue =
-			valuePtr->llongValue < value2.llongValue;
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    valuePtr->llongValue =
-			valuePtr->doubleValue < value2.doubleValue;
-		} else {
-		    valuePtr->llongValue =
-			    strcmp(valuePtr->pv.buffer, value2.pv.buffer) < 0;
-		}
-		valuePtr->type = TYPE_LLONG;
-		break;
-	    case GREATER:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue =
-			valuePtr->llongValue > value2.llongValue;
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    valuePtr->llongValue =
-			valuePtr->doubleValue > value2.doubleValue;
-		} else {
-		    valuePtr->llongValue =
-			    strcmp(valuePtr->pv.buffer, value2.pv.buffer) > 0;
-		}
-		valuePtr->type = TYPE_LLONG;
-		break;
-	    case LEQ:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue =
-			valuePtr->llongValue <= value2.llongValue;
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    valuePtr->llongValue =
-			valuePtr->doubleValue <= value2.doubleValue;
-		} else {
-		    valuePtr->llongValue =
-			    strcmp(valuePtr->pv.buffer, value2.pv.buffer) <= 0;
-		}
-		valuePtr->type = TYPE_LLONG;
-		break;
-	    case GEQ:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue =
-			valuePtr->llongValue >= value2.llongValue;
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    valuePtr->llongValue =
-			valuePtr->doubleValue >= value2.doubleValue;
-		} else {
-		    valuePtr->llongValue =
-			    strcmp(valuePtr->pv.buffer, value2.pv.buffer) >= 0;
-		}
-		valuePtr->type = TYPE_LLONG;
-		break;
-	    case EQUAL:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue =
-			valuePtr->llongValue == value2.llongValue;
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    valuePtr->llongValue =
-			valuePtr->doubleValue == value2.doubleValue;
-		} else {
-		    valuePtr->llongValue =
-			    strcmp(valuePtr->pv.buffer, value2.pv.buffer) == 0;
-		}
-		valuePtr->type = TYPE_LLONG;
-		break;
-	    case NEQ:
-		if (valuePtr->type == TYPE_LLONG) {
-		    valuePtr->llongValue =
-			valuePtr->llongValue != value2.llongValue;
-		} else if (valuePtr->type == TYPE_DOUBLE) {
-		    valuePtr->llongValue =
-			valuePtr->doubleValue != value2.doubleValue;
-		} else {
-		    valuePtr->llongValue =
-			    strcmp(valuePtr->pv.buffer, value2.pv.buffer) != 0;
-		}
-		valuePtr->type = TYPE_LLONG;
-		break;
-	    case BIT_AND:
-		valuePtr->llongValue &= value2.llongValue;
-		break;
-	    case BIT_XOR:
-		valuePtr->llongValue ^= value2.llongValue;
-		break;
-	    case BIT_OR:
-		valuePtr->llongValue |= value2.llongValue;
-		break;
-
-	    /*
-	     * For AND and OR, we know that the first value has already
-	     * been converted to an integer.  Thus we need only consider
-	     * the possibility of int vs. double for the second value.
-	     */
-
-	    case AND:
-		if (value2.type == TYPE_DOUBLE) {
-		    value2.llongValue = value2.doubleValue != 0;
-		    value2.type = TYPE_LLONG;
-		}
-		valuePtr->llongValue = valuePtr->llongValue && value2.llongValue;
-		break;
-	    case OR:
-		if (value2.type == TYPE_DOUBLE) {
-		    value2.llongValue = value2.doubleValue != 0;
-		    value2.type = TYPE_LLONG;
-		}
-		valuePtr->llongValue = valuePtr->llongValue || value2.llongValue;
-		break;
-
-	    case COLON:
-		interp->result =
-		    (char *) "can't have : operator without ? first";
-		result = HAX_ERROR;
-		goto done;
+	code = ExprBinaryOp(interp, op, valuePtr, &value2, &badType);
+	if (code != EXPR_OK) {
+	    goto opError;
 	}
     }
 
@@ -1080,11 +948,8 @@ ExprGetValue(
     result = HAX_ERROR;
     goto done;
 
-    illegalType:
-    Hax_AppendResult(interp, "can't use ", (badType == TYPE_DOUBLE) ?
-	    "floating-point value" : "non-numeric string",
-	    " as operand of \"", operatorStrings[op], "\"",
-	    (char *) NULL);
+    opError:
+    ExprError(interp, code, op, badType);
     result = HAX_ERROR;
     goto done;
 }
@@ -1092,108 +957,1911 @@ ExprGetValue(
 /*
  *--------------------------------------------------------------
  *
- * ExprMakeString --
+ * ExprUnaryOp, ExprBinaryOp --
  *
- *	Convert a value from int or long long int or double
- *	representation to a string.
+ *	Apply a unary or binary operator to values that have already
+ *	been computed.  These are shared by the expression parser and
+ *	by the executor for compiled expressions.
  *
  * Results:
- *	The information at *valuePtr gets converted to string
- *	format, if it wasn't that way already.
+ *	EXPR_OK if all went well, in which case the result replaces
+ *	the value at *valuePtr.  Otherwise an error code for ExprError
+ *	is returned, and *badTypePtr may be filled in with the type of
+ *	the offending operand.
  *
  * Side effects:
- *	None.
+ *	The operands may be converted to other types.
  *
  *--------------------------------------------------------------
  */
 
-static void
-ExprMakeString(
-    Hax_Interp *interp,
-    Value *valuePtr		/* Value to be converted. */)
+static int
+ExprUnaryOp(
+    int op,			/* UNARY_MINUS, NOT or BIT_NOT. */
+    Value *valuePtr,		/* Operand;  also receives result. */
+    int *badTypePtr)		/* Type of offending operand, if any. */
 {
-    int shortfall;
-
-    shortfall = 150 - (valuePtr->pv.end - valuePtr->pv.buffer);
-    if (shortfall > 0) {
-	(*valuePtr->pv.expandProc)(interp, &valuePtr->pv, shortfall);
-    }
-    if (valuePtr->type == TYPE_LLONG) {
-	sprintf(valuePtr->pv.buffer, "%lld", valuePtr->llongValue);
-    } else if (valuePtr->type == TYPE_DOUBLE) {
-	sprintf(valuePtr->pv.buffer, "%g", valuePtr->doubleValue);
+    switch (op) {
+	case UNARY_MINUS:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue = -valuePtr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE){
+		valuePtr->doubleValue = -valuePtr->doubleValue;
+	    } else {
+		*badTypePtr = valuePtr->type;
+		return EXPR_ILLEGAL_TYPE;
+	    }
+	    break;
+	case NOT:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue = !valuePtr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		/*
+		 * Theoretically, should be able to use
+		 * "!valuePtr->llongValue", but apparently some
+		 * compilers can't handle it.
+		 */
+		if (valuePtr->doubleValue == 0.0) {
+		    valuePtr->llongValue = 1;
+		} else {
+		    valuePtr->llongValue = 0;
+		}
+		valuePtr->type = TYPE_LLONG;
+	    } else {
+		*badTypePtr = valuePtr->type;
+		return EXPR_ILLEGAL_TYPE;
+	    }
+	    break;
+	case BIT_NOT:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue = ~valuePtr->llongValue;
+	    } else {
+		*badTypePtr = valuePtr->type;
+		return EXPR_ILLEGAL_TYPE;
+	    }
+	    break;
     }
-    valuePtr->type = TYPE_STRING;
+    return EXPR_OK;
 }
-
-/*
- *--------------------------------------------------------------
- *
- * ExprTopLevel --
- *
- *	This procedure provides top-level functionality shared by
- *	procedures like Hax_ExprInt, Hax_ExprDouble, etc.
- *
- * Results:
- *	The result is a standard Hax return value.  If an error
- *	occurs then an error message is left in interp->result.
- *	The value of the expression is returned in *valuePtr, in
- *	whatever form it ends up in (could be string or integer
- *	or double).  Caller may need to convert result.  Caller
- *	is also responsible for freeing string memory in *valuePtr,
- *	if any was allocated.
- *
- * Side effects:
- *	None.
- *
- *--------------------------------------------------------------
- */
 
 static int
-ExprTopLevel(
-    Hax_Interp *interp,			/* Context in which to evaluate the
-					 * expression. */
-    char *string,			/* Expression to evaluate. */
-    Value *valuePtr			/* Where to store result.  Should
-					 * not be initialized by caller. */)
+ExprBinaryOp(
+    Hax_Interp *interp,		/* Used to expand string values. */
+    int op,			/* Binary operator. */
+    Value *valuePtr,		/* First operand;  also receives result. */
+    Value *value2Ptr,		/* Second operand. */
+    int *badTypePtr)		/* Type of offending operand, if any. */
 {
-    ExprInfo info;
-    int result;
+    /*
+     * Check to make sure that the particular data types are
+     * appropriate for the particular operator, and perform type
+     * conversion if necessary.
+     */
 
-    info.originalExpr = string;
-    info.expr = string;
-    valuePtr->pv.buffer = valuePtr->pv.next = valuePtr->staticSpace;
-    valuePtr->pv.end = valuePtr->pv.buffer + STATIC_STRING_SPACE - 1;
-    valuePtr->pv.expandProc = HaxExpandParseValue;
-    valuePtr->pv.clientData = (ClientData) NULL;
+    switch (op) {
 
-    result = ExprGetValue(interp, &info, -1, valuePtr);
-    if (result != HAX_OK) {
-	return result;
-    }
-    if (info.token != END) {
-	Hax_AppendResult(interp, "syntax error in expression \"",
-		string, "\"", (char *) NULL);
-	return HAX_ERROR;
-    }
-    return HAX_OK;
-}
-
-/*
- *--------------------------------------------------------------
- *
- * Hax_ExprLong, Hax_ExprLongLong, Hax_ExprDouble,
- * Hax_ExprBoolean --
- *
- *	Procedures to evaluate an expression and return its value
- *	in a particular form.
- *
- * Results:
- *	Each of the procedures below returns a standard Hax result.
- *	If an error occurs then an error message is left in
- *	interp->result.  Otherwise the value of the expression,
- *	in the appropriate form, is stored at *resultPtr.  If
- *	the expression had a result that was incompatible with the
+	/*
+	 * For the operators below, no strings are allowed and
+	 * ints get converted to floats if necessary.
+	 */
+
+	case MULT: case DIVIDE: case PLUS: case MINUS:
+	    if ((valuePtr->type == TYPE_STRING)
+		    || (value2Ptr->type == TYPE_STRING)) {
+		*badTypePtr = TYPE_STRING;
+		return EXPR_ILLEGAL_TYPE;
+	    }
+	    if (valuePtr->type == TYPE_DOUBLE) {
+		if (value2Ptr->type == TYPE_LLONG) {
+		    value2Ptr->doubleValue = value2Ptr->llongValue;
+		    value2Ptr->type = TYPE_DOUBLE;
+		}
+	    } else if (value2Ptr->type == TYPE_DOUBLE) {
+		if (valuePtr->type == TYPE_LLONG) {
+		    valuePtr->doubleValue = valuePtr->llongValue;
+		    valuePtr->type = TYPE_DOUBLE;
+		}
+	    }
+	    break;
+
+	/*
+	 * For the operators below, only integers are allowed.
+	 */
+
+	case MOD: case LEFT_SHIFT: case RIGHT_SHIFT:
+	case BIT_AND: case BIT_XOR: case BIT_OR:
+	     if (valuePtr->type != TYPE_LLONG) {
+		 *badTypePtr = valuePtr->type;
+		 return EXPR_ILLEGAL_TYPE;
+	     } else if (value2Ptr->type != TYPE_LLONG) {
+		 *badTypePtr = value2Ptr->type;
+		 return EXPR_ILLEGAL_TYPE;
+	     }
+	     break;
+
+	/*
+	 * For the operators below, any type is allowed but the
+	 * two operands must have the same type.  Convert integers
+	 * to floats and either to strings, if necessary.
+	 */
+
+	case LESS: case GREATER: case LEQ: case GEQ:
+	case EQUAL: case NEQ:
+	    if (valuePtr->type == TYPE_STRING) {
+		if (value2Ptr->type != TYPE_STRING) {
+		    ExprMakeString(interp, value2Ptr);
+		}
+	    } else if (value2Ptr->type == TYPE_STRING) {
+		if (valuePtr->type != TYPE_STRING) {
+		    ExprMakeString(interp, valuePtr);
+		}
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		if (value2Ptr->type == TYPE_LLONG) {
+		    value2Ptr->doubleValue = value2Ptr->llongValue;
+		    value2Ptr->type = TYPE_DOUBLE;
+		}
+	    } else if (value2Ptr->type == TYPE_DOUBLE) {
+		 if (valuePtr->type == TYPE_LLONG) {
+		    valuePtr->doubleValue = valuePtr->llongValue;
+		    valuePtr->type = TYPE_DOUBLE;
+		}
+	    }
+	    break;
+
+	/*
+	 * For the operators below, no strings are allowed, but
+	 * no int->double conversions are performed.
+	 */
+
+	case AND: case OR:
+	    if (valuePtr->type == TYPE_STRING) {
+		*badTypePtr = valuePtr->type;
+		return EXPR_ILLEGAL_TYPE;
+	    }
+	    if (value2Ptr->type == TYPE_STRING) {
+		*badTypePtr = value2Ptr->type;
+		return EXPR_ILLEGAL_TYPE;
+	    }
+	    break;
+
+	/*
+	 * For the operators below, type and conversions are
+	 * irrelevant:  they're handled elsewhere.
+	 */
+
+	case QUESTY: case COLON:
+	    break;
+
+	/*
+	 * Any other operator is an error.
+	 */
+
+	default:
+	    return EXPR_UNKNOWN_OP;
+    }
+
+    /*
+     * If necessary, convert one of the operands to the type
+     * of the other.  If the operands are incompatible with
+     * the operator (e.g. "+" on strings) then return an
+     * error.
+     */
+
+    switch (op) {
+	case MULT:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue *= value2Ptr->llongValue;
+	    } else {
+		valuePtr->doubleValue *= value2Ptr->doubleValue;
+	    }
+	    break;
+	case DIVIDE:
+	    if (valuePtr->type == TYPE_LLONG) {
+		if (value2Ptr->llongValue == 0) {
+		    return EXPR_DIVIDE_BY_ZERO;
+		}
+		valuePtr->llongValue /= value2Ptr->llongValue;
+	    } else {
+		if (value2Ptr->doubleValue == 0.0) {
+		    return EXPR_DIVIDE_BY_ZERO;
+		}
+		valuePtr->doubleValue /= value2Ptr->doubleValue;
+	    }
+	    break;
+	case MOD:
+	    if (value2Ptr->llongValue == 0) {
+		return EXPR_DIVIDE_BY_ZERO;
+	    }
+	    valuePtr->llongValue %= value2Ptr->llongValue;
+	    break;
+	case PLUS:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue += value2Ptr->llongValue;
+	    } else {
+		valuePtr->doubleValue += value2Ptr->doubleValue;
+	    }
+	    break;
+	case MINUS:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue -= value2Ptr->llongValue;
+	    } else {
+		valuePtr->doubleValue -= value2Ptr->doubleValue;
+	    }
+	    break;
+	case LEFT_SHIFT:
+	    valuePtr->llongValue <<= value2Ptr->llongValue;
+	    break;
+	case RIGHT_SHIFT:
+	    /*
+	     * The following code is a bit tricky:  it ensures that
+	     * right shifts propagate the sign bit even on machines
+	     * where ">>" won't do it by default.
+	     */
+
+	    if (valuePtr->llongValue < 0) {
+		valuePtr->llongValue =
+			~((~valuePtr->llongValue) >> value2Ptr->llongValue);
+	    } else {
+		valuePtr->llongValue >>= value2Ptr->llongValue;
+	    }
+	    break;
+	case LESS:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue =
+		    valuePtr->llongValue < value2Ptr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		valuePtr->llongValue =
+		    valuePtr->doubleValue < value2Ptr->doubleValue;
+	    } else {
+		valuePtr->llongValue =
+			strcmp(valuePtr->pv.buffer, value2Ptr->pv.buffer) < 0;
+	    }
+	    valuePtr->type = TYPE_LLONG;
+	    break;
+	case GREATER:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue =
+		    valuePtr->llongValue > value2Ptr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		valuePtr->llongValue =
+		    valuePtr->doubleValue > value2Ptr->doubleValue;
+	    } else {
+		valuePtr->llongValue =
+			strcmp(valuePtr->pv.buffer, value2Ptr->pv.buffer) > 0;
+	    }
+	    valuePtr->type = TYPE_LLONG;
+	    break;
+	case LEQ:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue =
+		    valuePtr->llongValue <= value2Ptr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		valuePtr->llongValue =
+		    valuePtr->doubleValue <= value2Ptr->doubleValue;
+	    } else {
+		valuePtr->llongValue =
+			strcmp(valuePtr->pv.buffer, value2Ptr->pv.buffer) <= 0;
+	    }
+	    valuePtr->type = TYPE_LLONG;
+	    break;
+	case GEQ:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue =
+		    valuePtr->llongValue >= value2Ptr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		valuePtr->llongValue =
+		    valuePtr->doubleValue >= value2Ptr->doubleValue;
+	    } else {
+		valuePtr->llongValue =
+			strcmp(valuePtr->pv.buffer, value2Ptr->pv.buffer) >= 0;
+	    }
+	    valuePtr->type = TYPE_LLONG;
+	    break;
+	case EQUAL:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue =
+		    valuePtr->llongValue == value2Ptr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		valuePtr->llongValue =
+		    valuePtr->doubleValue == value2Ptr->doubleValue;
+	    } else {
+		valuePtr->llongValue =
+			strcmp(valuePtr->pv.buffer, value2Ptr->pv.buffer) == 0;
+	    }
+	    valuePtr->type = TYPE_LLONG;
+	    break;
+	case NEQ:
+	    if (valuePtr->type == TYPE_LLONG) {
+		valuePtr->llongValue =
+		    valuePtr->llongValue != value2Ptr->llongValue;
+	    } else if (valuePtr->type == TYPE_DOUBLE) {
+		valuePtr->llongValue =
+		    valuePtr->doubleValue != value2Ptr->doubleValue;
+	    } else {
+		valuePtr->llongValue =
+			strcmp(valuePtr->pv.buffer, value2Ptr->pv.buffer) != 0;
+	    }
+	    valuePtr->type = TYPE_LLONG;
+	    break;
+	case BIT_AND:
+	    valuePtr->llongValue &= value2Ptr->llongValue;
+	    break;
+	case BIT_XOR:
+	    valuePtr->llongValue ^= value2Ptr->llongValue;
+	    break;
+	case BIT_OR:
+	    valuePtr->llongValue |= value2Ptr->llongValue;
+	    break;
+
+	/*
+	 * For AND and OR, we know that the first value has already
+	 * been converted to an integer.  Thus we need only consider
+	 * the possibility of int vs. double for the second value.
+	 */
+
+	case AND:
+	    if (value2Ptr->type == TYPE_DOUBLE) {
+		value2Ptr->llongValue = value2Ptr->doubleValue != 0;
+		value2Ptr->type = TYPE_LLONG;
+	    }
+	    valuePtr->llongValue = valuePtr->llongValue && value2Ptr->llongValue;
+	    break;
+	case OR:
+	    if (value2Ptr->type == TYPE_DOUBLE) {
+		value2Ptr->llongValue = value2Ptr->doubleValue != 0;
+		value2Ptr->type = TYPE_LLONG;
+	    }
+	    valuePtr->llongValue = valuePtr->llongValue || value2Ptr->llongValue;
+	    break;
+
+	case COLON:
+	    return EXPR_BAD_COLON;
+    }
+    return EXPR_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprError --
+ *
+ *	Leave an error message in interp->result for an error code
+ *	returned by ExprUnaryOp or ExprBinaryOp.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Interp->result is modified.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprError(
+    Hax_Interp *interp,		/* Where to leave error message. */
+    int code,			/* EXPR_ILLEGAL_TYPE etc. */
+    int op,			/* Operator that failed. */
+    int badType)		/* Type of offending operand, for
+				 * EXPR_ILLEGAL_TYPE. */
+{
+    switch (code) {
+	case EXPR_ILLEGAL_TYPE:
+	    Hax_AppendResult(interp, "can't use ",
+		    (badType == TYPE_DOUBLE) ?
+		    "floating-point value" : "non-numeric string",
+		    " as operand of \"", operatorStrings[op], "\"",
+		    (char *) NULL);
+	    break;
+	case EXPR_DIVIDE_BY_ZERO:
+	    interp->result = (char *) "divide by zero";
+	    break;
+	case EXPR_UNKNOWN_OP:
+	    interp->result = (char *) "unknown operator in expression";
+	    break;
+	case EXPR_BAD_COLON:
+	    interp->result =
+		(char *) "can't have : operator without ? first";
+	    break;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprTestOp --
+ *
+ *	Convert the first operand of "&&", "||" or "?" to an integer
+ *	truth value.
+ *
+ * Results:
+ *	EXPR_OK, or EXPR_ILLEGAL_TYPE if the operand is a string.
+ *
+ * Side effects:
+ *	*ValuePtr is converted to TYPE_LLONG.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprTestOp(
+    Value *valuePtr,		/* Operand to test. */
+    int *badTypePtr)		/* Type of offending operand, if any. */
+{
+    if (valuePtr->type == TYPE_DOUBLE) {
+	valuePtr->llongValue = valuePtr->doubleValue != 0;
+	valuePtr->type = TYPE_LLONG;
+    } else if (valuePtr->type == TYPE_STRING) {
+	*badTypePtr = TYPE_STRING;
+	return EXPR_ILLEGAL_TYPE;
+    }
+    return EXPR_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprMakeString --
+ *
+ *	Convert a value from int or long long int or double
+ *	representation to a string.
+ *
+ * Results:
+ *	The information at *valuePtr gets converted to string
+ *	format, if it wasn't that way already.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprMakeString(
+    Hax_Interp *interp,
+    Value *valuePtr		/* Value to be converted. */)
+{
+    int shortfall;
+
+    shortfall = 150 - (valuePtr->pv.end - valuePtr->pv.buffer);
+    if (shortfall > 0) {
+	(*valuePtr->pv.expandProc)(interp, &valuePtr->pv, shortfall);
+    }
+    if (valuePtr->type == TYPE_LLONG) {
+	sprintf(valuePtr->pv.buffer, "%lld", valuePtr->llongValue);
+    } else if (valuePtr->type == TYPE_DOUBLE) {
+	sprintf(valuePtr->pv.buffer, "%g", valuePtr->doubleValue);
+    }
+    valuePtr->type = TYPE_STRING;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprTopLevel --
+ *
+ *	This procedure provides top-level functionality shared by
+ *	procedures like Hax_ExprInt, Hax_ExprDouble, etc.  The caller
+ *	may pass the compiled form of the expression, if it has one
+ *	(see HaxGetCompiledExpr);  otherwise it is looked up.
+ *
+ * Results:
+ *	The result is a standard Hax return value.  If an error
+ *	occurs then an error message is left in interp->result.
+ *	The value of the expression is returned in *valuePtr, in
+ *	whatever form it ends up in (could be string or integer
+ *	or double).  Caller may need to convert result.  Caller
+ *	is also responsible for freeing string memory in *valuePtr,
+ *	if any was allocated.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprTopLevel(
+    Hax_Interp *interp,			/* Context in which to evaluate the
+					 * expression. */
+    CompiledExpr *exprPtr,		/* Compiled form of string, or NULL
+					 * to look it up. */
+    char *string,			/* Expression to evaluate. */
+    Value *valuePtr			/* Where to store result.  Should
+					 * not be initialized by caller. */)
+{
+    ExprInfo info;
+    int result;
+
+    info.originalExpr = string;
+    info.expr = string;
+    ExprInitValue(valuePtr);
+
+    if (!((Interp *) interp)->noEval) {
+	if (exprPtr != NULL) {
+	    return ExprExecute(interp, exprPtr, valuePtr);
+	}
+	exprPtr = ExprGetCached(interp, string, 0);
+	if (exprPtr != NULL) {
+	    result = ExprExecute(interp, exprPtr, valuePtr);
+	    HaxReleaseCompiledExpr(interp, exprPtr);
+	    return result;
+	}
+    }
+
+    result = ExprGetValue(interp, &info, -1, valuePtr);
+    if (result != HAX_OK) {
+	return result;
+    }
+    if (info.token != END) {
+	Hax_AppendResult(interp, "syntax error in expression \"",
+		string, "\"", (char *) NULL);
+	return HAX_ERROR;
+    }
+    return HAX_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprGetCached --
+ *
+ *	Return the compiled form of an expression from the
+ *	interpreter's expression cache.  Unless compileNow is set, an
+ *	expression is compiled the second time it is looked up, so that
+ *	expressions that are only evaluated once (e.g. because they
+ *	were substituted into before being passed to "expr") don't pay
+ *	for compilation.  The literal expression of a command in a
+ *	compiled script (see Interp.exprCmdPtr) is kept in the command
+ *	instead, and compiled the first time.
+ *
+ * Results:
+ *	A pointer to the compiled expression, with a reference held for
+ *	the caller (who must pass it to HaxReleaseCompiledExpr when done),
+ *	or NULL if the expression should be evaluated by ExprGetValue.
+ *
+ * Side effects:
+ *	The cache is updated.  If it grows beyond MAX_CACHED_EXPRS
+ *	entries, the least recently used one is discarded.
+ *
+ *--------------------------------------------------------------
+ */
+
+static CompiledExpr *
+ExprGetCached(
+    Hax_Interp *interp,		/* Interpreter in which to evaluate. */
+    char *string,		/* Text of the expression. */
+    int compileNow)		/* Non-zero means compile the expression
+				 * the first time it is looked up. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_HashEntry *hPtr;
+    ExprCacheEntry *entryPtr;
+    CompiledCmd *cmdPtr;
+    int new;
+
+    if ((iPtr->exprCmdPtr != NULL) && (string == iPtr->exprCmdString)) {
+	cmdPtr = iPtr->exprCmdPtr;
+	if (!cmdPtr->exprCompiled) {
+	    iPtr->exprCacheMisses++;
+	    cmdPtr->exprPtr = ExprCompile(interp, string, iPtr->exprProcPtr);
+	    cmdPtr->exprCompiled = 1;
+	} else {
+	    iPtr->exprCacheHits++;
+	}
+	if (cmdPtr->exprPtr != NULL) {
+	    cmdPtr->exprPtr->refCount++;
+	}
+	return cmdPtr->exprPtr;
+    }
+
+    hPtr = Hax_CreateHashEntry(interp, &iPtr->exprCache, string, &new);
+    if (!new) {
+	iPtr->exprCacheHits++;
+	entryPtr = (ExprCacheEntry *) Hax_GetHashValue(hPtr);
+	if (entryPtr->prevPtr != NULL) {
+	    entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+	    if (entryPtr->nextPtr != NULL) {
+		entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+	    } else {
+		iPtr->exprLastPtr = entryPtr->prevPtr;
+	    }
+	    entryPtr->prevPtr = NULL;
+	    entryPtr->nextPtr = iPtr->exprFirstPtr;
+	    iPtr->exprFirstPtr->prevPtr = entryPtr;
+	    iPtr->exprFirstPtr = entryPtr;
+	}
+	if (!entryPtr->compiled) {
+	    entryPtr->exprPtr = ExprCompile(interp, string, (Proc *) NULL);
+	    entryPtr->compiled = 1;
+	}
+    } else {
+	iPtr->exprCacheMisses++;
+	entryPtr = (ExprCacheEntry *) ckalloc(memoryp,
+		sizeof(ExprCacheEntry));
+	entryPtr->exprPtr = NULL;
+	entryPtr->compiled = 0;
+	if (compileNow) {
+	    entryPtr->exprPtr = ExprCompile(interp, string, (Proc *) NULL);
+	    entryPtr->compiled = 1;
+	}
+	entryPtr->hPtr = hPtr;
+	entryPtr->prevPtr = NULL;
+	entryPtr->nextPtr = iPtr->exprFirstPtr;
+	if (iPtr->exprFirstPtr != NULL) {
+	    iPtr->exprFirstPtr->prevPtr = entryPtr;
+	} else {
+	    iPtr->exprLastPtr = entryPtr;
+	}
+	iPtr->exprFirstPtr = entryPtr;
+	Hax_SetHashValue(hPtr, entryPtr);
+
+	if (iPtr->exprCache.numEntries > MAX_CACHED_EXPRS) {
+	    ExprCacheEntry *lastPtr = iPtr->exprLastPtr;
+
+	    iPtr->exprLastPtr = lastPtr->prevPtr;
+	    iPtr->exprLastPtr->nextPtr = NULL;
+	    Hax_DeleteHashEntry(interp, lastPtr->hPtr);
+	    if (lastPtr->exprPtr != NULL) {
+		HaxReleaseCompiledExpr(interp, lastPtr->exprPtr);
+	    }
+	    ckfree(memoryp, (char *) lastPtr);
+	}
+    }
+    if (entryPtr->exprPtr != NULL) {
+	entryPtr->exprPtr->refCount++;
+    }
+    return entryPtr->exprPtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HaxGetCompiledExpr --
+ *
+ *	Return the compiled form of an expression, for a command that
+ *	evaluates the expression repeatedly (see
+ *	HaxExprBooleanCompiled).  Unlike the procedures that look an
+ *	expression up each time it is evaluated, this compiles the
+ *	expression right away.
+ *
+ * Results:
+ *	A pointer to a CompiledExpr, which the caller must release with
+ *	HaxReleaseCompiledExpr, or NULL if the expression can't be
+ *	compiled.
+ *
+ * Side effects:
+ *	The expression may be compiled and entered in the cache.
+ *
+ *--------------------------------------------------------------
+ */
+
+CompiledExpr *
+HaxGetCompiledExpr(
+    Hax_Interp *interp,		/* Interpreter in which to evaluate. */
+    char *string)		/* Text of the expression. */
+{
+    if (((Interp *) interp)->noEval) {
+	return NULL;
+    }
+    return ExprGetCached(interp, string, 1);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HaxExprForgetProc --
+ *
+ *	Called when the procedure an expression was compiled for is
+ *	freed, so that the expression stops using the procedure's
+ *	slots.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Local variables in the expression are looked up by name from
+ *	now on.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+HaxExprForgetProc(
+    CompiledExpr *exprPtr)
+{
+    exprPtr->procPtr = NULL;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HaxReleaseCompiledExpr --
+ *
+ *	Release a reference to a compiled expression.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The expression is freed when its last reference goes away.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+HaxReleaseCompiledExpr(
+    Hax_Interp *interp,
+    CompiledExpr *exprPtr)
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+
+    exprPtr->refCount--;
+    if (exprPtr->refCount <= 0) {
+	ckfree(memoryp, (char *) exprPtr);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HaxDeleteExprCache --
+ *
+ *	Discard all of the expressions in an interpreter's expression
+ *	cache.  Called when the interpreter is deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+HaxDeleteExprCache(
+    Interp *iPtr)		/* Interpreter whose cache is to be
+				 * freed. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ExprCacheEntry *entryPtr, *nextPtr;
+
+    for (entryPtr = iPtr->exprFirstPtr; entryPtr != NULL;
+	    entryPtr = nextPtr) {
+	nextPtr = entryPtr->nextPtr;
+	if (entryPtr->exprPtr != NULL) {
+	    HaxReleaseCompiledExpr((Hax_Interp *) iPtr, entryPtr->exprPtr);
+	}
+	ckfree(memoryp, (char *) entryPtr);
+    }
+    iPtr->exprFirstPtr = iPtr->exprLastPtr = NULL;
+    Hax_DeleteHashTable((Hax_Interp *) iPtr, &iPtr->exprCache);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprCompile --
+ *
+ *	Translate an expression into its compiled form.  Only
+ *	expressions that are syntactically correct are compiled;  for
+ *	the others, ExprGetValue reports the error at the right time
+ *	(i.e. after evaluating whatever comes before it).  If procPtr
+ *	isn't NULL, references to the procedure's local variables use
+ *	its slots (see EXPR_LOAD_SLOT).
+ *
+ * Results:
+ *	A pointer to a CompiledExpr with a reference count of 1, or
+ *	NULL if the expression couldn't be compiled.
+ *
+ * Side effects:
+ *	Memory is allocated.  Interp->result is preserved.
+ *
+ *--------------------------------------------------------------
+ */
+
+static CompiledExpr *
+ExprCompile(
+    Hax_Interp *interp,		/* Interpreter in which the expression
+				 * will be evaluated. */
+    char *string,		/* Expression to compile. */
+    Proc *procPtr)		/* Procedure in whose frame the expression
+				 * will be evaluated, or NULL. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ExprCompileEnv env;
+    CompiledExpr *exprPtr;
+    char *savedResult, *oldResult, *p;
+    int root, size;
+
+    /*
+     * Parsing substitutions with noEval set may reset interp->result,
+     * so save a copy of it to restore afterwards.
+     */
+
+    oldResult = interp->result;
+    savedResult = NULL;
+    if (*oldResult != 0) {
+	savedResult = (char *) ckalloc(memoryp, (unsigned) strlen(oldResult) + 1);
+	strcpy(savedResult, oldResult);
+    }
+
+    env.iPtr = iPtr;
+    env.procPtr = NULL;
+    if ((procPtr != NULL) && (procPtr->numLocals > 0)) {
+	env.procPtr = procPtr;
+    }
+    env.info.originalExpr = string;
+    env.info.expr = string;
+    ExprInitValue(&env.value);
+    env.leaf = -1;
+    env.nodesAvl = 16;
+    env.nodes = (ExprNode *) ckalloc(memoryp, env.nodesAvl * sizeof(ExprNode));
+    env.numNodes = 0;
+    env.constsAvl = 8;
+    env.consts = (ExprConst *) ckalloc(memoryp,
+	    env.constsAvl * sizeof(ExprConst));
+    env.numConsts = 0;
+    env.skipsAvl = 4;
+    env.skips = (ExprSkip *) ckalloc(memoryp, env.skipsAvl * sizeof(ExprSkip));
+    env.numSkips = 0;
+    env.stringsAvl = 64;
+    env.strings = (char *) ckalloc(memoryp, (unsigned) env.stringsAvl);
+    env.stringsUsed = 0;
+    env.codeAvl = 32;
+    env.code = (int *) ckalloc(memoryp, env.codeAvl * sizeof(int));
+    env.codeNext = 0;
+    env.depth = 0;
+    env.maxDepth = 1;
+
+    exprPtr = NULL;
+    if ((ExprCompileValue(&env, -1, &root) == HAX_OK)
+	    && (env.info.token == END)) {
+	ExprEmit(&env, root);
+	ExprEmitInst(&env, EXPR_DONE, 0);
+
+	/*
+	 * Pack everything into a single block.  The constant table
+	 * comes first after the structure, since it needs the
+	 * strictest alignment.
+	 */
+
+	size = sizeof(CompiledExpr) + env.numConsts * sizeof(ExprConst)
+		+ env.numSkips * sizeof(ExprSkip)
+		+ env.codeNext * sizeof(int) + env.stringsUsed;
+	exprPtr = (CompiledExpr *) ckalloc(memoryp, (unsigned) size);
+	exprPtr->refCount = 1;
+	exprPtr->maxDepth = env.maxDepth;
+	exprPtr->procPtr = env.procPtr;
+	p = (char *) (exprPtr + 1);
+	exprPtr->consts = (ExprConst *) p;
+	memcpy(p, env.consts, env.numConsts * sizeof(ExprConst));
+	p += env.numConsts * sizeof(ExprConst);
+	exprPtr->skips = (ExprSkip *) p;
+	memcpy(p, env.skips, env.numSkips * sizeof(ExprSkip));
+	p += env.numSkips * sizeof(ExprSkip);
+	exprPtr->code = (int *) p;
+	memcpy(p, env.code, env.codeNext * sizeof(int));
+	p += env.codeNext * sizeof(int);
+	exprPtr->strings = p;
+	memcpy(p, env.strings, env.stringsUsed);
+    }
+
+    if (env.value.pv.buffer != env.value.staticSpace) {
+	ckfree(memoryp, env.value.pv.buffer);
+    }
+    ckfree(memoryp, (char *) env.nodes);
+    ckfree(memoryp, (char *) env.consts);
+    ckfree(memoryp, (char *) env.skips);
+    ckfree(memoryp, env.strings);
+    ckfree(memoryp, (char *) env.code);
+
+    if (savedResult != NULL) {
+	if ((interp->result != oldResult)
+		|| (strcmp(interp->result, savedResult) != 0)) {
+	    Hax_SetResult(interp, savedResult, HAX_VOLATILE);
+	}
+	ckfree(memoryp, savedResult);
+    } else if (*interp->result != 0) {
+	Hax_ResetResult(interp);
+    }
+    return exprPtr;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprCompileValue --
+ *
+ *	Parse a value from the remainder of the expression being
+ *	compiled.  This mirrors ExprGetValue step for step, except
+ *	that it builds a parse tree instead of computing the value.
+ *
+ * Results:
+ *	HAX_OK, with the index of the value's node stored at *nodePtr,
+ *	or HAX_ERROR if the expression has a syntax error (in which
+ *	case it isn't compiled at all).  The parse state is left as
+ *	by ExprGetValue.
+ *
+ * Side effects:
+ *	Nodes are added to envPtr.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprCompileValue(
+    ExprCompileEnv *envPtr,	/* Describes the compilation. */
+    int prec,			/* Treat any un-parenthesized operator
+				 * with precedence <= this as the end
+				 * of the expression. */
+    int *nodePtr)		/* Store index of value's node here. */
+{
+    ExprInfo *infoPtr = &envPtr->info;
+    int node, operand, op, gotOp, node2, node3;
+
+    gotOp = 0;
+    if (ExprCompileLex(envPtr) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    if (infoPtr->token == OPEN_PAREN) {
+	if (ExprCompileValue(envPtr, -1, &node) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+	if (infoPtr->token != CLOSE_PAREN) {
+	    return HAX_ERROR;
+	}
+    } else {
+	if (infoPtr->token == MINUS) {
+	    infoPtr->token = UNARY_MINUS;
+	}
+	if (infoPtr->token >= UNARY_MINUS) {
+	    op = infoPtr->token;
+	    if (ExprCompileValue(envPtr, precTable[op], &operand)
+		    != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    node = ExprNewNode(envPtr, NODE_UNARY, op, operand, -1, -1);
+	    gotOp = 1;
+	} else if (infoPtr->token != VALUE) {
+	    return HAX_ERROR;
+	} else {
+	    node = envPtr->leaf;
+	}
+    }
+
+    if (!gotOp) {
+	if (ExprCompileLex(envPtr) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+    }
+    while (1) {
+	op = infoPtr->token;
+	if ((op < MULT) || (op >= UNARY_MINUS)) {
+	    if ((op == END) || (op == CLOSE_PAREN)) {
+		break;
+	    }
+	    return HAX_ERROR;
+	}
+	if (precTable[op] <= prec) {
+	    break;
+	}
+
+	/*
+	 * A ":" without a "?" is always an error, though ExprGetValue
+	 * only reports it after evaluating both operands.
+	 */
+
+	if (op == COLON) {
+	    return HAX_ERROR;
+	}
+	if (op == QUESTY) {
+	    if (ExprCompileValue(envPtr, precTable[op], &node2) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    if (infoPtr->token != COLON) {
+		return HAX_ERROR;
+	    }
+	    if (ExprCompileValue(envPtr, precTable[op], &node3) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    node = ExprNewNode(envPtr, NODE_COND, op, node, node2, node3);
+	} else {
+	    if (ExprCompileValue(envPtr, precTable[op], &node2) != HAX_OK) {
+		return HAX_ERROR;
+	    }
+	    node = ExprNewNode(envPtr,
+		    ((op == AND) || (op == OR)) ? NODE_AND_OR : NODE_BINARY,
+		    op, node, node2, -1);
+	}
+	if ((infoPtr->token < MULT) && (infoPtr->token != VALUE)
+		&& (infoPtr->token != END)
+		&& (infoPtr->token != CLOSE_PAREN)) {
+	    return HAX_ERROR;
+	}
+    }
+    *nodePtr = node;
+    return HAX_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprCompileLex --
+ *
+ *	Lexical analyzer for the expression compiler.  Operators and
+ *	constants are handled by ExprLex;  substitutions are checked
+ *	for syntax errors and then parsed with noEval set, to find
+ *	out how they behave when they're skipped.
+ *
+ * Results:
+ *	HAX_OK, or HAX_ERROR if the expression can't be compiled.  The
+ *	parse state is updated as by ExprLex, and if the token is a
+ *	value, a leaf node for it is stored in envPtr->leaf.
+ *
+ * Side effects:
+ *	Interp->result may be modified.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprCompileLex(
+    ExprCompileEnv *envPtr)	/* Describes the compilation. */
+{
+    Hax_Interp *interp = (Hax_Interp *) envPtr->iPtr;
+    ExprInfo *infoPtr = &envPtr->info;
+    Value *valuePtr = &envPtr->value;
+    char *p, *end, *name, *nameEnd;
+    int index, reset, result, numRead;
+
+    p = infoPtr->expr;
+    while (isspace(*p)) {
+	p++;
+    }
+    end = p;
+    valuePtr->pv.next = valuePtr->pv.buffer;
+
+    /*
+     * A quoted string without substitutions is a constant.
+     */
+
+    if (*p == '"') {
+	for (end = p+1; *end != '"'; end++) {
+	    if ((*end == '$') || (*end == '[') || (*end == 0)) {
+		break;
+	    }
+	    if (*end == '\\') {
+		Hax_Backslash(end, &numRead);
+		end += numRead - 1;
+	    }
+	}
+    }
+    if (((*p != '$') && (*p != '[') && (*p != '"')) || (*end == '"')) {
+	if (ExprLex(interp, infoPtr, valuePtr) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+	if (infoPtr->token == VALUE) {
+	    index = ExprAddConst(envPtr, valuePtr);
+	    envPtr->leaf = ExprNewNode(envPtr, NODE_LEAF, EXPR_PUSH,
+		    -1, -1, -1);
+	    envPtr->nodes[envPtr->leaf].operand = index;
+	    envPtr->nodes[envPtr->leaf].noEvalConst = index;
+	    envPtr->nodes[envPtr->leaf].pure = 1;
+	}
+	return HAX_OK;
+    }
+
+    if (HaxCheckSubst(interp, p, &end) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    infoPtr->token = VALUE;
+    envPtr->leaf = ExprNewNode(envPtr, NODE_LEAF, EXPR_SUBST, -1, -1, -1);
+
+    /*
+     * Simple variable references get their own instruction.  When
+     * skipped, they count as 0.
+     */
+
+    nameEnd = NULL;
+    if (*p == '$') {
+	name = p+1;
+	if (*name == '{') {
+	    name++;
+	    nameEnd = end-1;
+	} else {
+	    for (nameEnd = name; isalnum(*nameEnd) || (*nameEnd == '_');
+		    nameEnd++) {
+		/* Empty loop body. */
+	    }
+	    if ((nameEnd == name) || (*nameEnd == '(')) {
+		nameEnd = NULL;
+	    }
+	}
+    }
+    if (nameEnd != NULL) {
+	envPtr->nodes[envPtr->leaf].op = EXPR_LOAD_SCALAR;
+	envPtr->nodes[envPtr->leaf].operand =
+		ExprAddString(envPtr, name, nameEnd - name);
+	valuePtr->type = TYPE_LLONG;
+	valuePtr->llongValue = 0;
+	envPtr->nodes[envPtr->leaf].noEvalConst =
+		ExprAddConst(envPtr, valuePtr);
+	infoPtr->expr = end;
+	return HAX_OK;
+    }
+
+    /*
+     * Anything else is redone by ExprLex at run time.  Parse it now
+     * with noEval set to find its value when skipped, using a dummy
+     * result to see whether parsing it resets interp->result.
+     */
+
+    envPtr->nodes[envPtr->leaf].operand = ExprAddString(envPtr, p, end - p);
+    Hax_SetResult(interp, (char *) "-", HAX_STATIC);
+    envPtr->iPtr->noEval++;
+    result = ExprLex(interp, infoPtr, valuePtr);
+    envPtr->iPtr->noEval--;
+    if ((result != HAX_OK) || (infoPtr->expr != end)) {
+	return HAX_ERROR;
+    }
+    reset = (*interp->result == 0);
+    envPtr->nodes[envPtr->leaf].resetResult = reset;
+    envPtr->nodes[envPtr->leaf].noEvalConst = ExprAddConst(envPtr, valuePtr);
+    return HAX_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprNewNode, ExprAddConst, ExprAddString, ExprAddSkip --
+ *
+ *	Add an entry to one of the tables built by the compiler.
+ *	ExprAddSkip works out the outcome of skipping an operand of
+ *	the given operator.
+ *
+ * Results:
+ *	The index (or for strings, the offset) of the new entry.
+ *
+ * Side effects:
+ *	The tables in envPtr may be enlarged.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprNewNode(
+    ExprCompileEnv *envPtr,
+    int type,			/* NODE_LEAF etc. */
+    int op,			/* Operator, or instruction for a leaf. */
+    int child0, int child1, int child2)
+				/* Operands, or -1. */
+{
+    ExprNode *nodePtr;
+    int i;
+
+    if (envPtr->numNodes >= envPtr->nodesAvl) {
+	ExprGrow(envPtr->iPtr, (char **) &envPtr->nodes, &envPtr->nodesAvl,
+		envPtr->numNodes, sizeof(ExprNode));
+    }
+    nodePtr = &envPtr->nodes[envPtr->numNodes];
+    nodePtr->type = type;
+    nodePtr->op = op;
+    nodePtr->operand = -1;
+    nodePtr->child[0] = child0;
+    nodePtr->child[1] = child1;
+    nodePtr->child[2] = child2;
+    nodePtr->noEvalConst = -1;
+    nodePtr->resetResult = 0;
+    nodePtr->pure = (type != NODE_LEAF);
+    for (i = 0; i < 3; i++) {
+	if ((nodePtr->child[i] >= 0)
+		&& !envPtr->nodes[nodePtr->child[i]].pure) {
+	    nodePtr->pure = 0;
+	}
+    }
+    return envPtr->numNodes++;
+}
+
+static int
+ExprAddConst(
+    ExprCompileEnv *envPtr,
+    Value *valuePtr)		/* Value to add. */
+{
+    ExprConst *constPtr;
+    int string;
+
+    string = -1;
+    if (valuePtr->type == TYPE_STRING) {
+	string = ExprAddString(envPtr, valuePtr->pv.buffer,
+		strlen(valuePtr->pv.buffer));
+    }
+    if (envPtr->numConsts >= envPtr->constsAvl) {
+	ExprGrow(envPtr->iPtr, (char **) &envPtr->consts, &envPtr->constsAvl,
+		envPtr->numConsts, sizeof(ExprConst));
+    }
+    constPtr = &envPtr->consts[envPtr->numConsts];
+    constPtr->type = valuePtr->type;
+    constPtr->llongValue = valuePtr->llongValue;
+    constPtr->doubleValue = valuePtr->doubleValue;
+    constPtr->string = string;
+    return envPtr->numConsts++;
+}
+
+static int
+ExprAddString(
+    ExprCompileEnv *envPtr,
+    char *string,		/* Characters to add. */
+    int length)			/* Number of characters. */
+{
+    int offset;
+
+    while (envPtr->stringsUsed + length + 1 > envPtr->stringsAvl) {
+	ExprGrow(envPtr->iPtr, &envPtr->strings, &envPtr->stringsAvl,
+		envPtr->stringsUsed, 1);
+    }
+    offset = envPtr->stringsUsed;
+    memcpy(envPtr->strings + offset, string, length);
+    envPtr->strings[offset + length] = 0;
+    envPtr->stringsUsed += length + 1;
+    return offset;
+}
+
+static int
+ExprAddSkip(
+    ExprCompileEnv *envPtr,
+    int node,			/* Operand that is skipped. */
+    int op)			/* AND, OR or QUESTY. */
+{
+    Interp *iPtr = envPtr->iPtr;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ExprSkip skip;
+    Value value;
+
+    skip.resetResult = 0;
+    skip.error = EXPR_OK;
+    skip.op = op;
+    skip.badType = TYPE_LLONG;
+    ExprInitValue(&value);
+    if ((ExprStaticEval(envPtr, node, &value, &skip) == EXPR_OK)
+	    && (op != QUESTY)) {
+	Value value1;
+
+	/*
+	 * The operator of "&&" and "||" is still applied to a skipped
+	 * right operand (e.g. it must not be a string).
+	 */
+
+	value1.type = TYPE_LLONG;
+	value1.llongValue = (op == OR);
+	skip.error = ExprBinaryOp((Hax_Interp *) iPtr, op, &value1, &value,
+		&skip.badType);
+    }
+    if (value.pv.buffer != value.staticSpace) {
+	ckfree(memoryp, value.pv.buffer);
+    }
+    if (envPtr->numSkips >= envPtr->skipsAvl) {
+	ExprGrow(iPtr, (char **) &envPtr->skips, &envPtr->skipsAvl,
+		envPtr->numSkips, sizeof(ExprSkip));
+    }
+    envPtr->skips[envPtr->numSkips] = skip;
+    return envPtr->numSkips++;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprGrow --
+ *
+ *	Double the size of one of the compiler's tables.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*ArrayPtr and *availPtr are updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprGrow(
+    Interp *iPtr,
+    char **arrayPtr,		/* Table to enlarge. */
+    int *availPtr,		/* Number of elements it holds. */
+    int used,			/* Number of elements in use. */
+    int elSize)			/* Size of each element. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    char *newArray;
+
+    newArray = (char *) ckalloc(memoryp, (unsigned) (2 * *availPtr * elSize));
+    memcpy(newArray, *arrayPtr, used * elSize);
+    ckfree(memoryp, *arrayPtr);
+    *arrayPtr = newArray;
+    *availPtr *= 2;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprStaticEval --
+ *
+ *	Compute the value of part of an expression as ExprGetValue
+ *	would with noEval set:  variables and commands count as 0,
+ *	but operators are still applied.  For a sub-expression whose
+ *	leaves are all constants, this is its actual value.
+ *
+ * Results:
+ *	EXPR_OK, with the value stored at *valuePtr, or an error code.
+ *	In the latter case the error is recorded in *skipPtr.
+ *	SkipPtr->resetResult is set if any leaf evaluated before the
+ *	error (if any) resets interp->result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprStaticEval(
+    ExprCompileEnv *envPtr,	/* Describes the compilation. */
+    int node,			/* Index of node to evaluate. */
+    Value *valuePtr,		/* Where to store value.  Caller must
+				 * have initialized pv field. */
+    ExprSkip *skipPtr)		/* Outcome of evaluation. */
+{
+    Hax_Interp *interp = (Hax_Interp *) envPtr->iPtr;
+    Hax_Memoryp *memoryp = envPtr->iPtr->memoryp;
+    ExprNode *nodePtr = &envPtr->nodes[node];
+    Value value2;
+    int code;
+
+    switch (nodePtr->type) {
+	case NODE_LEAF:
+	    ExprLoadConst(interp, envPtr->strings,
+		    &envPtr->consts[nodePtr->noEvalConst], valuePtr);
+	    if (nodePtr->resetResult) {
+		skipPtr->resetResult = 1;
+	    }
+	    return EXPR_OK;
+
+	case NODE_UNARY:
+	    code = ExprStaticEval(envPtr, nodePtr->child[0], valuePtr,
+		    skipPtr);
+	    if (code != EXPR_OK) {
+		return code;
+	    }
+	    code = ExprUnaryOp(nodePtr->op, valuePtr, &skipPtr->badType);
+	    break;
+
+	case NODE_BINARY:
+	case NODE_AND_OR:
+	    code = ExprStaticEval(envPtr, nodePtr->child[0], valuePtr,
+		    skipPtr);
+	    if (code != EXPR_OK) {
+		return code;
+	    }
+	    if (nodePtr->type == NODE_AND_OR) {
+		code = ExprTestOp(valuePtr, &skipPtr->badType);
+		if (code != EXPR_OK) {
+		    break;
+		}
+	    }
+	    ExprInitValue(&value2);
+	    code = ExprStaticEval(envPtr, nodePtr->child[1], &value2,
+		    skipPtr);
+	    if (code == EXPR_OK) {
+		code = ExprBinaryOp(interp, nodePtr->op, valuePtr, &value2,
+			&skipPtr->badType);
+		if (code != EXPR_OK) {
+		    skipPtr->error = code;
+		    skipPtr->op = nodePtr->op;
+		}
+	    }
+	    if (value2.pv.buffer != value2.staticSpace) {
+		ckfree(memoryp, value2.pv.buffer);
+	    }
+	    return code;
+
+	case NODE_COND:
+	    code = ExprStaticEval(envPtr, nodePtr->child[0], valuePtr,
+		    skipPtr);
+	    if (code != EXPR_OK) {
+		return code;
+	    }
+	    code = ExprTestOp(valuePtr, &skipPtr->badType);
+	    if (code != EXPR_OK) {
+		break;
+	    }
+
+	    /*
+	     * Both alternatives are parsed, in order, whichever is
+	     * chosen.
+	     */
+
+	    ExprInitValue(&value2);
+	    if (valuePtr->llongValue != 0) {
+		code = ExprStaticEval(envPtr, nodePtr->child[1], valuePtr,
+			skipPtr);
+		if (code == EXPR_OK) {
+		    code = ExprStaticEval(envPtr, nodePtr->child[2], &value2,
+			    skipPtr);
+		}
+	    } else {
+		code = ExprStaticEval(envPtr, nodePtr->child[1], &value2,
+			skipPtr);
+		if (code == EXPR_OK) {
+		    code = ExprStaticEval(envPtr, nodePtr->child[2],
+			    valuePtr, skipPtr);
+		}
+	    }
+	    if (value2.pv.buffer != value2.staticSpace) {
+		ckfree(memoryp, value2.pv.buffer);
+	    }
+	    return code;
+
+	default:
+	    code = EXPR_UNKNOWN_OP;
+	    break;
+    }
+    if (code != EXPR_OK) {
+	skipPtr->error = code;
+	skipPtr->op = nodePtr->op;
+    }
+    return code;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprEmit, ExprEmitInst --
+ *
+ *	Generate the instructions for the tree rooted at a node, or
+ *	for a single instruction.  Sub-trees that are constant are
+ *	folded into a single EXPR_PUSH, unless evaluating them
+ *	produces an error (which must then happen at run time).
+ *
+ * Results:
+ *	ExprEmitInst returns the index of the new instruction.
+ *
+ * Side effects:
+ *	Instructions are added to envPtr, and its stack depth updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprEmit(
+    ExprCompileEnv *envPtr,	/* Describes the compilation. */
+    int node)			/* Index of node. */
+{
+    Hax_Memoryp *memoryp = envPtr->iPtr->memoryp;
+    ExprNode *nodePtr = &envPtr->nodes[node];
+    int pc, pc2;
+
+    if (nodePtr->pure && (nodePtr->type != NODE_LEAF)) {
+	ExprSkip skip;
+	Value value;
+	int code;
+
+	skip.resetResult = 0;
+	skip.error = EXPR_OK;
+	ExprInitValue(&value);
+	code = ExprStaticEval(envPtr, node, &value, &skip);
+	if (code == EXPR_OK) {
+	    pc = ExprEmitInst(envPtr, EXPR_PUSH, 1);
+	    envPtr->code[pc+1] = ExprAddConst(envPtr, &value);
+	}
+	if (value.pv.buffer != value.staticSpace) {
+	    ckfree(memoryp, value.pv.buffer);
+	}
+	if (code == EXPR_OK) {
+	    goto pushed;
+	}
+    }
+
+    switch (nodePtr->type) {
+	case NODE_LEAF:
+	    if ((nodePtr->op == EXPR_LOAD_SCALAR)
+		    && (envPtr->procPtr != NULL)) {
+		Hax_HashEntry *hPtr;
+
+		hPtr = Hax_FindHashEntry(&envPtr->procPtr->localTable,
+			envPtr->strings + nodePtr->operand);
+		if (hPtr != NULL) {
+		    pc = ExprEmitInst(envPtr, EXPR_LOAD_SLOT, 2);
+		    envPtr->code[pc+1] = nodePtr->operand;
+		    envPtr->code[pc+2] = (int) (long) Hax_GetHashValue(hPtr);
+		    goto pushed;
+		}
+	    }
+	    pc = ExprEmitInst(envPtr, nodePtr->op, 1);
+	    envPtr->code[pc+1] = nodePtr->operand;
+	    goto pushed;
+
+	case NODE_UNARY:
+	    ExprEmit(envPtr, nodePtr->child[0]);
+	    pc = ExprEmitInst(envPtr, EXPR_UNARY, 1);
+	    envPtr->code[pc+1] = nodePtr->op;
+	    break;
+
+	case NODE_BINARY:
+	    ExprEmit(envPtr, nodePtr->child[0]);
+	    ExprEmit(envPtr, nodePtr->child[1]);
+	    pc = ExprEmitInst(envPtr, EXPR_BINARY, 1);
+	    envPtr->code[pc+1] = nodePtr->op;
+	    envPtr->depth--;
+	    break;
+
+	case NODE_AND_OR:
+	    ExprEmit(envPtr, nodePtr->child[0]);
+	    pc = ExprEmitInst(envPtr, EXPR_AND_OR, 3);
+	    envPtr->code[pc+1] = nodePtr->op;
+	    envPtr->code[pc+2] = ExprAddSkip(envPtr, nodePtr->child[1],
+		    nodePtr->op);
+	    ExprEmit(envPtr, nodePtr->child[1]);
+	    pc2 = ExprEmitInst(envPtr, EXPR_BINARY, 1);
+	    envPtr->code[pc2+1] = nodePtr->op;
+	    envPtr->depth--;
+	    envPtr->code[pc+3] = envPtr->codeNext;
+	    break;
+
+	case NODE_COND:
+	    ExprEmit(envPtr, nodePtr->child[0]);
+	    pc = ExprEmitInst(envPtr, EXPR_IF_FALSE, 2);
+	    envPtr->code[pc+1] = ExprAddSkip(envPtr, nodePtr->child[1],
+		    QUESTY);
+	    envPtr->depth--;
+	    ExprEmit(envPtr, nodePtr->child[1]);
+	    pc2 = ExprEmitInst(envPtr, EXPR_JUMP, 2);
+	    envPtr->code[pc2+1] = ExprAddSkip(envPtr, nodePtr->child[2],
+		    QUESTY);
+	    envPtr->code[pc+2] = envPtr->codeNext;
+	    envPtr->depth--;
+	    ExprEmit(envPtr, nodePtr->child[2]);
+	    envPtr->code[pc2+2] = envPtr->codeNext;
+	    break;
+    }
+    return;
+
+    pushed:
+    envPtr->depth++;
+    if (envPtr->depth > envPtr->maxDepth) {
+	envPtr->maxDepth = envPtr->depth;
+    }
+}
+
+static int
+ExprEmitInst(
+    ExprCompileEnv *envPtr,
+    int op,			/* Opcode. */
+    int numOperands)		/* Number of operands that will follow. */
+{
+    int pc;
+
+    while (envPtr->codeNext + numOperands + 1 > envPtr->codeAvl) {
+	ExprGrow(envPtr->iPtr, (char **) &envPtr->code, &envPtr->codeAvl,
+		envPtr->codeNext, sizeof(int));
+    }
+    pc = envPtr->codeNext;
+    envPtr->code[pc] = op;
+    envPtr->codeNext += numOperands + 1;
+    return pc;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprExecute --
+ *
+ *	Evaluate a compiled expression.
+ *
+ * Results:
+ *	Same as ExprGetValue:  a standard Hax result, with the value
+ *	of the expression stored at *valuePtr.
+ *
+ * Side effects:
+ *	Depends on the commands in the expression.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+ExprExecute(
+    Hax_Interp *interp,		/* Context in which to evaluate. */
+    CompiledExpr *exprPtr,	/* Expression to evaluate.  The caller must
+				 * hold a reference to it. */
+    Value *valuePtr)		/* Where to store result.  Caller must
+				 * have initialized pv field. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Value valueSpace[NUM_EXPR_VALUES];
+    Value *stackSpace[NUM_EXPR_VALUES+1];
+    Value *values = valueSpace;
+    Value **stack = stackSpace;
+    Value *topPtr;
+    ExprSkip *skipPtr;
+    VarNumber *numberPtr;
+    char *value;
+    int *pc;
+    int i, sp, op, code, badType, result;
+
+    if (exprPtr->maxDepth > NUM_EXPR_VALUES+1) {
+	values = (Value *) ckalloc(memoryp,
+		(exprPtr->maxDepth - 1) * sizeof(Value));
+	stack = (Value **) ckalloc(memoryp,
+		exprPtr->maxDepth * sizeof(Value *));
+    }
+    stack[0] = valuePtr;
+    for (i = 1; i < exprPtr->maxDepth; i++) {
+	stack[i] = &values[i-1];
+	ExprInitValue(stack[i]);
+    }
+
+    sp = 0;
+    pc = exprPtr->code;
+    while (1) {
+	switch (*pc) {
+	    case EXPR_DONE:
+		result = HAX_OK;
+		goto done;
+
+	    case EXPR_PUSH:
+		ExprLoadConst(interp, exprPtr->strings,
+			&exprPtr->consts[pc[1]], stack[sp]);
+		sp++;
+		pc += 2;
+		break;
+
+	    case EXPR_LOAD_SCALAR:
+	    case EXPR_LOAD_SLOT:
+		if ((*pc == EXPR_LOAD_SLOT) && (exprPtr->procPtr != NULL)
+			&& (iPtr->varFramePtr != NULL)
+			&& (iPtr->varFramePtr->procPtr == exprPtr->procPtr)) {
+		    value = HaxGetVarSlot(interp,
+			    &iPtr->varFramePtr->slots[pc[2]],
+			    exprPtr->strings + pc[1], (char *) NULL,
+			    HAX_LEAVE_ERR_MSG, (Hax_Obj **) NULL, &numberPtr);
+		} else {
+		    value = HaxGetVarNumber(interp, exprPtr->strings + pc[1],
+			    (char *) NULL, HAX_LEAVE_ERR_MSG, &numberPtr);
+		}
+		if (value == NULL) {
+		    result = HAX_ERROR;
+		    goto done;
+		}
+
+		/*
+		 * Use the variable's number if it's known;  otherwise
+		 * parse the value and remember the number for next time.
+		 */
+
+		if (numberPtr->type == VAR_NUM_LLONG) {
+		    stack[sp]->type = TYPE_LLONG;
+		    stack[sp]->llongValue = numberPtr->u.llongValue;
+		} else if (numberPtr->type == VAR_NUM_DOUBLE) {
+		    stack[sp]->type = TYPE_DOUBLE;
+		    stack[sp]->doubleValue = numberPtr->u.doubleValue;
+		} else {
+		    result = ExprParseString(interp, value, stack[sp]);
+		    if (result != HAX_OK) {
+			goto done;
+		    }
+		    if (stack[sp]->type == TYPE_LLONG) {
+			numberPtr->type = VAR_NUM_LLONG;
+			numberPtr->u.llongValue = stack[sp]->llongValue;
+		    } else if (stack[sp]->type == TYPE_DOUBLE) {
+			numberPtr->type = VAR_NUM_DOUBLE;
+			numberPtr->u.doubleValue = stack[sp]->doubleValue;
+		    }
+		}
+		sp++;
+		pc += (*pc == EXPR_LOAD_SLOT) ? 3 : 2;
+		break;
+
+	    case EXPR_SUBST: {
+		ExprInfo info;
+		char copyStorage[STATIC_STRING_SPACE];
+		char *copy = copyStorage;
+		int length;
+
+		/*
+		 * Work on a copy of the text:  the parsing procedures
+		 * modify it temporarily, and the same expression might
+		 * be evaluated again meanwhile (e.g. from a variable
+		 * trace).
+		 */
+
+		length = strlen(exprPtr->strings + pc[1]);
+		if (length >= STATIC_STRING_SPACE) {
+		    copy = (char *) ckalloc(memoryp, (unsigned) length + 1);
+		}
+		memcpy(copy, exprPtr->strings + pc[1], length + 1);
+		info.originalExpr = copy;
+		info.expr = copy;
+		stack[sp]->pv.next = stack[sp]->pv.buffer;
+		result = ExprLex(interp, &info, stack[sp]);
+		if (copy != copyStorage) {
+		    ckfree(memoryp, copy);
+		}
+		if (result != HAX_OK) {
+		    goto done;
+		}
+		sp++;
+		pc += 2;
+		break;
+	    }
+
+	    case EXPR_UNARY:
+		op = pc[1];
+		code = ExprUnaryOp(op, stack[sp-1], &badType);
+		if (code != EXPR_OK) {
+		    goto opError;
+		}
+		pc += 2;
+		break;
+
+	    case EXPR_BINARY:
+		op = pc[1];
+		code = ExprBinaryOp(interp, op, stack[sp-2], stack[sp-1],
+			&badType);
+		if (code != EXPR_OK) {
+		    goto opError;
+		}
+		sp--;
+		pc += 2;
+		break;
+
+	    case EXPR_AND_OR:
+		op = pc[1];
+		topPtr = stack[sp-1];
+		code = ExprTestOp(topPtr, &badType);
+		if (code != EXPR_OK) {
+		    goto opError;
+		}
+		if (((op == AND) && !topPtr->llongValue)
+			|| ((op == OR) && topPtr->llongValue)) {
+		    topPtr->llongValue = (op == OR);
+		    skipPtr = &exprPtr->skips[pc[2]];
+		    pc = exprPtr->code + pc[3];
+		    goto skip;
+		}
+		pc += 4;
+		break;
+
+	    case EXPR_IF_FALSE:
+		op = QUESTY;
+		topPtr = stack[sp-1];
+		code = ExprTestOp(topPtr, &badType);
+		if (code != EXPR_OK) {
+		    goto opError;
+		}
+		sp--;
+		if (topPtr->llongValue) {
+		    pc += 3;
+		    break;
+		}
+		skipPtr = &exprPtr->skips[pc[1]];
+		pc = exprPtr->code + pc[2];
+		goto skip;
+
+	    case EXPR_JUMP:
+		skipPtr = &exprPtr->skips[pc[1]];
+		pc = exprPtr->code + pc[2];
+		goto skip;
+
+	    default:
+		Hax_Panic((char *) "bad instruction %d in compiled expression",
+			*pc);
+	}
+	continue;
+
+	/*
+	 * Apply the outcome of skipping an operand.
+	 */
+
+	skip:
+	if (skipPtr->resetResult) {
+	    Hax_ResetResult(interp);
+	}
+	if (skipPtr->error != EXPR_OK) {
+	    ExprError(interp, skipPtr->error, skipPtr->op, skipPtr->badType);
+	    result = HAX_ERROR;
+	    goto done;
+	}
+    }
+
+    opError:
+    ExprError(interp, code, op, badType);
+    result = HAX_ERROR;
+
+    done:
+    for (i = 1; i < exprPtr->maxDepth; i++) {
+	if (stack[i]->pv.buffer != stack[i]->staticSpace) {
+	    ckfree(memoryp, stack[i]->pv.buffer);
+	}
+    }
+    if (values != valueSpace) {
+	ckfree(memoryp, (char *) values);
+	ckfree(memoryp, (char *) stack);
+    }
+    return result;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ExprInitValue, ExprLoadConst --
+ *
+ *	Set up the string storage of a Value, and copy an entry of a
+ *	constant table into a Value.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The string storage of *valuePtr may be enlarged.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ExprInitValue(
+    Value *valuePtr)
+{
+    valuePtr->pv.buffer = valuePtr->pv.next = valuePtr->staticSpace;
+    valuePtr->pv.end = valuePtr->pv.buffer + STATIC_STRING_SPACE - 1;
+    valuePtr->pv.expandProc = HaxExpandParseValue;
+    valuePtr->pv.clientData = (ClientData) NULL;
+}
+
+static void
+ExprLoadConst(
+    Hax_Interp *interp,
+    char *strings,		/* String pool of constPtr's table. */
+    ExprConst *constPtr,	/* Constant to load. */
+    Value *valuePtr)		/* Where to store it. */
+{
+    char *string;
+    int length, shortfall;
+
+    valuePtr->type = constPtr->type;
+    valuePtr->llongValue = constPtr->llongValue;
+    valuePtr->doubleValue = constPtr->doubleValue;
+    if (constPtr->type == TYPE_STRING) {
+	string = strings + constPtr->string;
+	length = strlen(string);
+	valuePtr->pv.next = valuePtr->pv.buffer;
+	shortfall = length - (valuePtr->pv.end - valuePtr->pv.buffer);
+	if (shortfall > 0) {
+	    (*valuePtr->pv.expandProc)(interp, &valuePtr->pv, shortfall);
+	}
+	strcpy(valuePtr->pv.buffer, string);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Hax_ExprLong, Hax_ExprLongLong, Hax_ExprDouble,
+ * Hax_ExprBoolean --
+ *
+ *	Procedures to evaluate an expression and return its value
+ *	in a particular form.
+ *
+ * Results:
+ *	Each of the procedures below returns a standard Hax result.
+ *	If an error occurs then an error message is left in
+ *	interp->result.  Otherwise the value of the expression,
+ *	in the appropriate form, is stored at *resultPtr.  If
+ *	the expression had a result that was incompatible with the
  *	desired form then an error is returned.
  *
  * Side effects:
@@ -1214,7 +2882,7 @@ Hax_ExprLong(
     Value value;
     int result;
 
-    result = ExprTopLevel(interp, string, &value);
+    result = ExprTopLevel(interp, (CompiledExpr *) NULL, string, &value);
     if (result == HAX_OK) {
 	if (value.type == TYPE_LLONG) {
 	    *ptr = value.llongValue;
@@ -1243,7 +2911,7 @@ Hax_ExprLongLong(
     Value value;
     int result;
 
-    result = ExprTopLevel(interp, string, &value);
+    result = ExprTopLevel(interp, (CompiledExpr *) NULL, string, &value);
     if (result == HAX_OK) {
 	if (value.type == TYPE_LLONG) {
 	    *ptr = value.llongValue;
@@ -1272,7 +2940,7 @@ Hax_ExprDouble(
     Value value;
     int result;
 
-    result = ExprTopLevel(interp, string, &value);
+    result = ExprTopLevel(interp, (CompiledExpr *) NULL, string, &value);
     if (result == HAX_OK) {
 	if (value.type == TYPE_LLONG) {
 	    *(double *)ptr = value.llongValue;
@@ -1295,13 +2963,45 @@ Hax_ExprBoolean(
 					 * expression. */
     char *string,			/* Expression to evaluate. */
     int *ptr				/* Where to store 0/1 result. */)
+{
+    return HaxExprBooleanCompiled(interp, (CompiledExpr *) NULL, string,
+	    ptr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * HaxExprBooleanCompiled --
+ *
+ *	Like Hax_ExprBoolean, for an expression whose compiled form
+ *	the caller already has (see HaxGetCompiledExpr), so that
+ *	commands like "for" and "while" don't look the condition up
+ *	on every iteration.
+ *
+ * Results:
+ *	Same as Hax_ExprBoolean.
+ *
+ * Side effects:
+ *	Depends on the expression.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+HaxExprBooleanCompiled(
+    Hax_Interp *interp,			/* Context in which to evaluate the
+					 * expression. */
+    CompiledExpr *exprPtr,		/* Compiled form of string, or
+					 * NULL. */
+    char *string,			/* Expression to evaluate. */
+    int *ptr				/* Where to store 0/1 result. */)
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
     Value value;
     int result;
 
-    result = ExprTopLevel(interp, string, &value);
+    result = ExprTopLevel(interp, exprPtr, string, &value);
     if (result == HAX_OK) {
 	if (value.type == TYPE_LLONG) {
 	    *ptr = value.llongValue != 0;
@@ -1348,7 +3048,7 @@ Hax_ExprString(
     Value value;
     int result;
 
-    result = ExprTopLevel(interp, string, &value);
+    result = ExprTopLevel(interp, (CompiledExpr *) NULL, string, &value);
     if (result == HAX_OK) {
 	if (value.type == TYPE_LLONG) {
 	    sprintf(interp->result, "%lld", value.llongValue);
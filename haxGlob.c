@@ -270,6 +270,7 @@ DoGlob(
 	struct dirent *entryPtr;
 	int l1, l2;
 	char *pattern, *newDir, *dirName;
+	Hax_Pattern compiled;
 	char static1[STATIC_SIZE], static2[STATIC_SIZE];
 	struct stat statBuf;
 
@@ -303,6 +304,7 @@ DoGlob(
 	}
 	strncpy(pattern, rem, l2);
 	pattern[l2] = '\0';
+	compiled = Hax_CompilePattern(interp, pattern);
 	result = HAX_OK;
 	while (1) {
 	    entryPtr = readdir(d);
@@ -318,7 +320,7 @@ DoGlob(
 	    if ((*entryPtr->d_name == '.') && (*pattern != '.')) {
 		continue;
 	    }
-	    if (Hax_StringMatch(entryPtr->d_name, pattern)) {
+	    if (Hax_PatternMatch(compiled, entryPtr->d_name)) {
 		int nameLength = strlen(entryPtr->d_name);
 		if (*p == 0) {
 		    AppendResult(interp, dir, (char *) separator, entryPtr->d_name,
@@ -342,6 +344,7 @@ DoGlob(
 	    }
 	}
 	closedir(d);
+	Hax_FreePattern(interp, compiled);
 	if (pattern != static2) {
 	    ckfree(memoryp, pattern);
 	}
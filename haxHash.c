@@ -19,6 +19,7 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclHash.c,v 1.10 92/08/21
 #endif /* not lint */
 
 #include "haxInt.h"
+#include <time.h>
 
 /*
  * When there are this many entries per bucket, on average, rebuild
@@ -27,6 +28,16 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclHash.c,v 1.10 92/08/21
 
 #define REBUILD_MULTIPLIER	3
 
+/*
+ * Tables are not rebuilt all at once:  the old bucket array is kept
+ * until its entries have been moved to the new one, REHASH_STEP old
+ * buckets at a time, by each later lookup, insertion or deletion.
+ * A table shrinks once its entries fall below 1/SHRINK_DIVISOR of
+ * the number that would make it grow.
+ */
+
+#define REHASH_STEP		4
+#define SHRINK_DIVISOR		16
 
 /*
  * The following macro takes a preliminary integer hash value and
@@ -36,8 +47,42 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclHash.c,v 1.10 92/08/21
  * from a random-number generator.
  */
 
-#define RANDOM_INDEX(tablePtr, i) \
-    (((((long) (i))*1103515245) >> (tablePtr)->downShift) & (tablePtr)->mask)
+#define RANDOM_INDEX(i, downShift, mask) \
+    (((((long) (i))*1103515245) >> (downShift)) & (mask))
+
+/*
+ * Control bytes for HAX_OPEN_STRING_KEYS tables.  A full slot holds
+ * OPEN_TAG of its entry's hash: the top seven bits, which are not
+ * used to pick the slot, so most probes of a full slot can be
+ * rejected without touching the entry.  OPEN_MAX_LOAD gives the
+ * number of used (full or deleted) slots, as a fraction of the
+ * table size, at which the table is rebuilt.  Slots that have been
+ * moved out of an old slot array during a rebuild are marked
+ * OPEN_DELETED, so that probes for entries not yet moved still
+ * run past them.
+ */
+
+#define OPEN_EMPTY		0
+#define OPEN_DELETED		1
+#define OPEN_TAG(hash)		(0x80 | ((hash) >> 25))
+#define OPEN_FULL(c)		((c) & 0x80)
+#define OPEN_MAX_LOAD(size)	(((size)*3)/4)
+
+/*
+ * Odd 64-bit multipliers used by HashString and InitHashSeed (the
+ * xxHash64 primes).
+ */
+
+#define HASH_PRIME1	0x9E3779B185EBCA87ULL
+#define HASH_PRIME2	0xC2B2AE3D27D4EB4FULL
+#define HASH_PRIME3	0x165667B19E3779F9ULL
+
+/*
+ * Seed mixed into every string hash; see InitHashSeed.
+ */
+
+static unsigned long long hashSeed;
+static int hashSeedInit = 0;
 
 /*
  * Procedure prototypes for static procedures in this file:
@@ -53,9 +98,30 @@ static Hax_HashEntry *	BogusFind (Hax_HashTable *tablePtr,
 static Hax_HashEntry *	BogusCreate (Hax_Interp *interp,
 			    Hax_HashTable *tablePtr,
 			    char *key, int *newPtr);
-static unsigned int	HashString (char *string);
-static void		RebuildTable (Hax_Interp *interp,
+static int		ChainIndex (Hax_HashTable *tablePtr,
+			    long value, int old);
+static long		EntryValue (Hax_HashTable *tablePtr,
+			    Hax_HashEntry *hPtr);
+static unsigned int	HashString (char *string, int *lengthPtr);
+static void		InitBuckets (Hax_HashTable *tablePtr);
+static void		InitHashSeed (void);
+static void		LinkEntry (Hax_HashTable *tablePtr,
+			    Hax_HashEntry *hPtr);
+static Hax_HashEntry *	OldChain (Hax_HashTable *tablePtr, long value);
+static Hax_HashEntry *	OpenCreate (Hax_Interp *interp,
+			    Hax_HashTable *tablePtr,
+			    char *key, int *newPtr);
+static Hax_HashEntry *	OpenFind (Hax_HashTable *tablePtr,
+			    char *key);
+static Hax_HashEntry *	OpenProbe (Hax_HashEntry **buckets,
+			    unsigned char *ctrl, int mask,
+			    unsigned int hash, char *key, int length);
+static char *		OpenStats (Hax_Interp *interp,
 			    Hax_HashTable *tablePtr);
+static void		RehashStep (Hax_HashTable *tablePtr,
+			    int count);
+static void		StartRehash (Hax_Interp *interp,
+			    Hax_HashTable *tablePtr, int newSize);
 static Hax_HashEntry *	StringFind (Hax_HashTable *tablePtr,
 			    char *key);
 static Hax_HashEntry *	StringCreate (Hax_Interp *interp,
@@ -66,7 +132,7 @@ static Hax_HashEntry *	OneWordFind (Hax_HashTable *tablePtr,
 static Hax_HashEntry *	OneWordCreate (Hax_Interp *interp,
 			    Hax_HashTable *tablePtr,
 			    char *key, int *newPtr);
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -90,21 +156,26 @@ Hax_InitHashTable(
     Hax_HashTable *tablePtr,	/* Pointer to table record, which
 					 * is supplied by the caller. */
     int keyType				/* Type of keys to use in table:
-					 * HAX_STRING_KEYS, HAX_ONE_WORD_KEYS,
-					 * or an integer >= 2. */)
+					 * HAX_STRING_KEYS, HAX_OPEN_STRING_KEYS,
+					 * HAX_ONE_WORD_KEYS, or an integer
+					 * >= 2. */)
 {
-    tablePtr->buckets = tablePtr->staticBuckets;
-    tablePtr->staticBuckets[0] = tablePtr->staticBuckets[1] = 0;
-    tablePtr->staticBuckets[2] = tablePtr->staticBuckets[3] = 0;
-    tablePtr->numBuckets = HAX_SMALL_HASH_TABLE;
     tablePtr->numEntries = 0;
-    tablePtr->rebuildSize = HAX_SMALL_HASH_TABLE*REBUILD_MULTIPLIER;
-    tablePtr->downShift = 28;
-    tablePtr->mask = 3;
     tablePtr->keyType = keyType;
+    tablePtr->firstEntryPtr = tablePtr->lastEntryPtr = NULL;
+    tablePtr->memoryp = NULL;
+    InitBuckets(tablePtr);
+    if ((keyType == HAX_STRING_KEYS) || (keyType == HAX_OPEN_STRING_KEYS)) {
+	if (!hashSeedInit) {
+	    InitHashSeed();
+	}
+    }
     if (keyType == HAX_STRING_KEYS) {
 	tablePtr->findProc = StringFind;
 	tablePtr->createProc = StringCreate;
+    } else if (keyType == HAX_OPEN_STRING_KEYS) {
+	tablePtr->findProc = OpenFind;
+	tablePtr->createProc = OpenCreate;
     } else if (keyType == HAX_ONE_WORD_KEYS) {
 	tablePtr->findProc = OneWordFind;
 	tablePtr->createProc = OneWordCreate;
@@ -113,7 +184,49 @@ Hax_InitHashTable(
 	tablePtr->createProc = ArrayCreate;
     };
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitBuckets --
+ *
+ *	Point a table at its static bucket array, with no rebuild in
+ *	progress.  Any dynamically-allocated arrays must already have
+ *	been freed, and the table must hold no entries.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The bucket fields of *tablePtr are reset.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitBuckets(
+    Hax_HashTable *tablePtr)	/* Table to reset. */
+{
+    tablePtr->buckets = tablePtr->staticBuckets;
+    tablePtr->staticBuckets[0] = tablePtr->staticBuckets[1] = 0;
+    tablePtr->staticBuckets[2] = tablePtr->staticBuckets[3] = 0;
+    tablePtr->numBuckets = HAX_SMALL_HASH_TABLE;
+    tablePtr->rebuildSize = HAX_SMALL_HASH_TABLE*REBUILD_MULTIPLIER;
+    tablePtr->downShift = 28;
+    tablePtr->mask = 3;
+    tablePtr->ctrl = NULL;
+    tablePtr->numDeleted = 0;
+    tablePtr->oldBuckets = NULL;
+    tablePtr->oldCtrl = NULL;
+    tablePtr->oldNumBuckets = 0;
+    tablePtr->rehashIndex = 0;
+    if (tablePtr->keyType == HAX_OPEN_STRING_KEYS) {
+	memset(tablePtr->staticCtrl, OPEN_EMPTY, HAX_SMALL_HASH_TABLE);
+	tablePtr->ctrl = tablePtr->staticCtrl;
+	tablePtr->rebuildSize = OPEN_MAX_LOAD(HAX_SMALL_HASH_TABLE);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -128,7 +241,8 @@ Hax_InitHashTable(
  *	The entry given by entryPtr is deleted from its table and
  *	should never again be used by the caller.  It is up to the
  *	caller to free the clientData field of the entry, if that
- *	is relevant.
+ *	is relevant.  If the table is now much larger than it needs
+ *	to be, it starts shrinking.
  *
  *----------------------------------------------------------------------
  */
@@ -140,9 +254,41 @@ Hax_DeleteHashEntry(
 {
     Interp *iPtr = (Interp *)interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_HashTable *tablePtr = entryPtr->tablePtr;
     Hax_HashEntry *prevPtr;
 
-    if (*entryPtr->bucketPtr == entryPtr) {
+    if (tablePtr->keyType == HAX_OPEN_STRING_KEYS) {
+	Hax_HashEntry **buckets = tablePtr->buckets;
+	unsigned char *ctrl = tablePtr->ctrl;
+	int index, mask = tablePtr->mask;
+
+	/*
+	 * Leave a marker in the slot so that probes continue past it.
+	 * If the next slot is empty then no probe sequence can run
+	 * through this slot and it can simply be made empty.  Markers
+	 * left in an old slot array don't count:  the array is going
+	 * away.
+	 */
+
+	if ((tablePtr->oldBuckets != NULL)
+		&& (entryPtr->bucketPtr >= tablePtr->oldBuckets)
+		&& (entryPtr->bucketPtr < tablePtr->oldBuckets
+		+ tablePtr->oldNumBuckets)) {
+	    buckets = tablePtr->oldBuckets;
+	    ctrl = tablePtr->oldCtrl;
+	    mask = tablePtr->oldNumBuckets - 1;
+	}
+	index = entryPtr->bucketPtr - buckets;
+	buckets[index] = NULL;
+	if (ctrl[(index+1) & mask] == OPEN_EMPTY) {
+	    ctrl[index] = OPEN_EMPTY;
+	} else {
+	    ctrl[index] = OPEN_DELETED;
+	    if (buckets == tablePtr->buckets) {
+		tablePtr->numDeleted++;
+	    }
+	}
+    } else if (*entryPtr->bucketPtr == entryPtr) {
 	*entryPtr->bucketPtr = entryPtr->nextPtr;
     } else {
 	for (prevPtr = *entryPtr->bucketPtr; ; prevPtr = prevPtr->nextPtr) {
@@ -156,10 +302,47 @@ Hax_DeleteHashEntry(
 	    }
 	}
     }
-    entryPtr->tablePtr->numEntries--;
+
+    if (entryPtr->prevInTablePtr == NULL) {
+	tablePtr->firstEntryPtr = entryPtr->nextInTablePtr;
+    } else {
+	entryPtr->prevInTablePtr->nextInTablePtr = entryPtr->nextInTablePtr;
+    }
+    if (entryPtr->nextInTablePtr == NULL) {
+	tablePtr->lastEntryPtr = entryPtr->prevInTablePtr;
+    } else {
+	entryPtr->nextInTablePtr->prevInTablePtr = entryPtr->prevInTablePtr;
+    }
+    tablePtr->numEntries--;
     ckfree(memoryp, (char *) entryPtr);
+
+    /*
+     * An empty table goes straight back to its static buckets, which
+     * makes unsetting every element of a big array cheap.  Otherwise
+     * keep any rebuild moving, or start shrinking a table that has
+     * lost most of its entries.
+     */
+
+    if (tablePtr->numEntries == 0) {
+	if (tablePtr->buckets != tablePtr->staticBuckets) {
+	    ckfree(memoryp, (char *) tablePtr->buckets);
+	}
+	if ((tablePtr->oldBuckets != NULL)
+		&& (tablePtr->oldBuckets != tablePtr->staticBuckets)) {
+	    ckfree(memoryp, (char *) tablePtr->oldBuckets);
+	}
+	InitBuckets(tablePtr);
+    } else if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    } else if ((tablePtr->numBuckets > HAX_SMALL_HASH_TABLE)
+	    && (tablePtr->numEntries < tablePtr->rebuildSize/SHRINK_DIVISOR)) {
+	StartRehash(interp, tablePtr, (tablePtr->numBuckets/4
+		> HAX_SMALL_HASH_TABLE) ? tablePtr->numBuckets/4
+		: HAX_SMALL_HASH_TABLE);
+	RehashStep(tablePtr, REHASH_STEP);
+    }
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -185,28 +368,29 @@ Hax_DeleteHashTable(
     Interp *iPtr = (Interp *)interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
     Hax_HashEntry *hPtr, *nextPtr;
-    int i;
 
     /*
      * Free up all the entries in the table.
      */
 
-    for (i = 0; i < tablePtr->numBuckets; i++) {
-	hPtr = tablePtr->buckets[i];
-	while (hPtr != NULL) {
-	    nextPtr = hPtr->nextPtr;
-	    ckfree(memoryp, (char *) hPtr);
-	    hPtr = nextPtr;
-	}
+    for (hPtr = tablePtr->firstEntryPtr; hPtr != NULL; hPtr = nextPtr) {
+	nextPtr = hPtr->nextInTablePtr;
+	ckfree(memoryp, (char *) hPtr);
     }
 
     /*
-     * Free up the bucket array, if it was dynamically allocated.
+     * Free up the bucket arrays, if they were dynamically allocated.
+     * For HAX_OPEN_STRING_KEYS tables this also frees the control
+     * bytes, which share their blocks.
      */
 
     if (tablePtr->buckets != tablePtr->staticBuckets) {
 	ckfree(memoryp, (char *) tablePtr->buckets);
     }
+    if ((tablePtr->oldBuckets != NULL)
+	    && (tablePtr->oldBuckets != tablePtr->staticBuckets)) {
+	ckfree(memoryp, (char *) tablePtr->oldBuckets);
+    }
 
     /*
      * Arrange for panics if the table is used again without
@@ -216,7 +400,7 @@ Hax_DeleteHashTable(
     tablePtr->findProc = BogusFind;
     tablePtr->createProc = BogusCreate;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -246,11 +430,10 @@ Hax_FirstHashEntry(
 					 * progress through the table. */)
 {
     searchPtr->tablePtr = tablePtr;
-    searchPtr->nextIndex = 0;
-    searchPtr->nextEntryPtr = NULL;
+    searchPtr->nextEntryPtr = tablePtr->firstEntryPtr;
     return Hax_NextHashEntry(searchPtr);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -258,7 +441,10 @@ Hax_FirstHashEntry(
  *
  *	Once a hash table enumeration has been initiated by calling
  *	Hax_FirstHashEntry, this procedure may be called to return
- *	successive elements of the table.
+ *	successive elements of the table.  Entries are returned in
+ *	the order in which they were created;  since the search does
+ *	not depend on the bucket arrays, it is not upset by entries
+ *	moving between buckets while a table is being rebuilt.
  *
  * Results:
  *	The return value is the next entry in the hash table being
@@ -279,19 +465,13 @@ Hax_NextHashEntry(
 {
     Hax_HashEntry *hPtr;
 
-    while (searchPtr->nextEntryPtr == NULL) {
-	if (searchPtr->nextIndex >= searchPtr->tablePtr->numBuckets) {
-	    return NULL;
-	}
-	searchPtr->nextEntryPtr =
-		searchPtr->tablePtr->buckets[searchPtr->nextIndex];
-	searchPtr->nextIndex++;
-    }
     hPtr = searchPtr->nextEntryPtr;
-    searchPtr->nextEntryPtr = hPtr->nextPtr;
+    if (hPtr != NULL) {
+	searchPtr->nextEntryPtr = hPtr->nextInTablePtr;
+    }
     return hPtr;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -306,7 +486,8 @@ Hax_NextHashEntry(
  *	this string.
  *
  * Side effects:
- *	None.
+ *	Any rebuild in progress is completed, so that the statistics
+ *	describe a single bucket array.
  *
  *----------------------------------------------------------------------
  */
@@ -324,6 +505,13 @@ Hax_HashStats(
     Hax_HashEntry *hPtr;
     char *result, *p;
 
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, tablePtr->oldNumBuckets);
+    }
+    if (tablePtr->keyType == HAX_OPEN_STRING_KEYS) {
+	return OpenStats(interp, tablePtr);
+    }
+
     /*
      * Compute a histogram of bucket usage.
      */
@@ -366,7 +554,110 @@ Hax_HashStats(
     sprintf(p, "average search distance for entry: %.1f", average);
     return result;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * OpenStats --
+ *
+ *	Hax_HashStats for HAX_OPEN_STRING_KEYS tables:  report how far
+ *	entries are from the slot their hash value selects.
+ *
+ * Results:
+ *	The return value is a malloc-ed string containing information
+ *	about tablePtr.  It is the caller's responsibility to free
+ *	this string.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+OpenStats(
+    Hax_Interp *interp,
+    Hax_HashTable *tablePtr		/* Table for which to produce stats. */)
+{
+    Interp *iPtr = (Interp *)interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    int count[NUM_COUNTERS], overflow, i, j;
+    double average;
+    char *result, *p;
+
+    for (i = 0; i < NUM_COUNTERS; i++) {
+	count[i] = 0;
+    }
+    overflow = 0;
+    average = 0.0;
+    for (i = 0; i < tablePtr->numBuckets; i++) {
+	if (!OPEN_FULL(tablePtr->ctrl[i])) {
+	    continue;
+	}
+	j = ((i - tablePtr->buckets[i]->hash) & tablePtr->mask) + 1;
+	if (j < NUM_COUNTERS) {
+	    count[j]++;
+	} else {
+	    overflow++;
+	}
+	average += ((double) j)/tablePtr->numEntries;
+    }
+
+    result = (char *) ckalloc(memoryp, (unsigned) ((NUM_COUNTERS*60) + 300));
+    sprintf(result, "%d entries in table, %d slots, %d deleted\n",
+	    tablePtr->numEntries, tablePtr->numBuckets, tablePtr->numDeleted);
+    p = result + strlen(result);
+    for (i = 1; i < NUM_COUNTERS; i++) {
+	sprintf(p, "number of entries found by probe %d: %d\n",
+		i, count[i]);
+	p += strlen(p);
+    }
+    sprintf(p, "number of entries found by probe %d or later: %d\n",
+	    NUM_COUNTERS, overflow);
+    p += strlen(p);
+    sprintf(p, "average search distance for entry: %.1f", average);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitHashSeed --
+ *
+ *	Pick the seed mixed into every string hash in this process.
+ *	Without a seed an attacker who can choose keys (array
+ *	subscripts, for example) can pile them all into one bucket.
+ *	If the environment variable HAX_HASH_SEED is set its value
+ *	is used instead, so that runs can be made reproducible.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Sets hashSeed and hashSeedInit.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitHashSeed(void)
+{
+    char *env;
+    unsigned long long seed;
+
+    env = getenv("HAX_HASH_SEED");
+    if (env != NULL) {
+	seed = strtoul(env, (char **) NULL, 0);
+    } else {
+	seed = (unsigned long long) time((time_t *) NULL);
+	seed = seed*HASH_PRIME1 + (unsigned long long) clock();
+	seed = seed*HASH_PRIME1 + (unsigned long long) (size_t) &env;
+	seed = seed*HASH_PRIME1 + (unsigned long long) (size_t) InitHashSeed;
+    }
+    hashSeed = seed;
+    hashSeedInit = 1;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -377,7 +668,7 @@ Hax_HashStats(
  *
  * Results:
  *	The return value is a one-word summary of the information in
- *	string.
+ *	string.  The length of string is stored at *lengthPtr.
  *
  * Side effects:
  *	None.
@@ -387,39 +678,50 @@ Hax_HashStats(
 
 static unsigned int
 HashString(
-    char *string	/* String from which to compute hash value. */)
+    char *string,	/* String from which to compute hash value. */
+    int *lengthPtr	/* Store length of string here. */)
 {
-    unsigned int result;
-    int c;
+    unsigned long long h, w;
+    int length, left;
 
     /*
-     * I tried a zillion different hash functions and asked many other
-     * people for advice.  Many people had their own favorite functions,
-     * all different, but no-one had much idea why they were good ones.
-     * I chose the one below (multiply by 9 and add new character)
-     * because of the following reasons:
-     *
-     * 1. Multiplying by 10 is perfect for keys that are decimal strings,
-     *    and multiplying by 9 is just about as good.
-     * 2. Times-9 is (shift-left-3) plus (old).  This means that each
-     *    character's bits hang around in the low-order bits of the
-     *    hash value for ever, plus they spread fairly rapidly up to
-     *    the high-order bits to fill out the hash value.  This seems
-     *    works well both for decimal and non-decimal strings.
+     * The old multiply-by-9 hash looked at one character at a time
+     * and left keys that differ only in their last few characters
+     * (decimal subscripts, common prefixes) in neighbouring buckets.
+     * It is also linear, so anyone can build any number of keys
+     * with the same value.  This one folds in eight bytes at a time
+     * with a multiply and shift, starting from a per-process seed,
+     * and finishes with a multiply-shift-multiply whose high half
+     * is returned, so every input bit reaches the low bits used to
+     * pick a bucket.  The length is folded into the initial state,
+     * so the zero padding of the last word cannot make two
+     * different strings collide.
      */
 
-    result = 0;
-    while (1) {
-	c = *string;
-	string++;
-	if (c == 0) {
-	    break;
-	}
-	result += (result<<3) + c;
+    length = strlen(string);
+    *lengthPtr = length;
+    h = hashSeed ^ (unsigned long long) length;
+    for (left = length; left >= 8; left -= 8, string += 8) {
+	memcpy(&w, string, 8);
+	h = (h ^ w) * HASH_PRIME1;
+	h ^= h >> 32;
     }
-    return result;
+    w = 0;
+    switch (left) {
+	case 7: w |= (unsigned long long) ((unsigned char) string[6]) << 48;
+	case 6: w |= (unsigned long long) ((unsigned char) string[5]) << 40;
+	case 5: w |= (unsigned long long) ((unsigned char) string[4]) << 32;
+	case 4: w |= (unsigned long long) ((unsigned char) string[3]) << 24;
+	case 3: w |= (unsigned long long) ((unsigned char) string[2]) << 16;
+	case 2: w |= (unsigned long long) ((unsigned char) string[1]) << 8;
+	case 1: w |= (unsigned long long) ((unsigned char) string[0]);
+    }
+    h = (h ^ w) * HASH_PRIME2;
+    h ^= h >> 29;
+    h *= HASH_PRIME3;
+    return (unsigned int) (h >> 32);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -433,7 +735,7 @@ HashString(
  *	hash table, or NULL if there was no matching entry.
  *
  * Side effects:
- *	None.
+ *	Part of a rebuild in progress may be carried out.
  *
  *----------------------------------------------------------------------
  */
@@ -443,30 +745,35 @@ StringFind(
     Hax_HashTable *tablePtr,	/* Table in which to lookup entry. */
     char *key			/* Key to use to find matching entry. */)
 {
-    Hax_HashEntry *hPtr;
-    char *p1, *p2;
-    int index;
+    Hax_HashEntry *hPtr, *chains[2];
+    unsigned int hash;
+    int length, i;
 
-    index = HashString(key) & tablePtr->mask;
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    hash = HashString(key, &length);
 
     /*
-     * Search all of the entries in the appropriate bucket.
+     * Search all of the entries in the appropriate bucket, and in
+     * the bucket of the old array if it hasn't been moved yet.
+     * Entries carry their full hash value, so the key bytes only
+     * need to be compared when the hashes agree.
      */
 
-    for (hPtr = tablePtr->buckets[index]; hPtr != NULL;
-	    hPtr = hPtr->nextPtr) {
-	for (p1 = key, p2 = hPtr->key.string; ; p1++, p2++) {
-	    if (*p1 != *p2) {
-		break;
-	    }
-	    if (*p1 == '\0') {
+    chains[0] = tablePtr->buckets[hash & tablePtr->mask];
+    chains[1] = OldChain(tablePtr, (long) hash);
+    for (i = 0; i < 2; i++) {
+	for (hPtr = chains[i]; hPtr != NULL; hPtr = hPtr->nextPtr) {
+	    if ((hPtr->hash == hash) && (memcmp(key, hPtr->key.string,
+		    (size_t) length+1) == 0)) {
 		return hPtr;
 	    }
 	}
     }
     return NULL;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -483,7 +790,8 @@ StringFind(
  *	entry the value stored in the entry will initially be 0.
  *
  * Side effects:
- *	A new entry may be added to the hash table.
+ *	A new entry may be added to the hash table.  Part of a rebuild
+ *	in progress may be carried out, or a new rebuild started.
  *
  *----------------------------------------------------------------------
  */
@@ -499,23 +807,26 @@ StringCreate(
 {
     Interp *iPtr = (Interp *)interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
-    Hax_HashEntry *hPtr;
-    char *p1, *p2;
-    int index;
+    Hax_HashEntry *hPtr, *chains[2];
+    unsigned int hash;
+    int index, length, i;
 
-    index = HashString(key) & tablePtr->mask;
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    hash = HashString(key, &length);
+    index = hash & tablePtr->mask;
 
     /*
      * Search all of the entries in this bucket.
      */
 
-    for (hPtr = tablePtr->buckets[index]; hPtr != NULL;
-	    hPtr = hPtr->nextPtr) {
-	for (p1 = key, p2 = hPtr->key.string; ; p1++, p2++) {
-	    if (*p1 != *p2) {
-		break;
-	    }
-	    if (*p1 == '\0') {
+    chains[0] = tablePtr->buckets[index];
+    chains[1] = OldChain(tablePtr, (long) hash);
+    for (i = 0; i < 2; i++) {
+	for (hPtr = chains[i]; hPtr != NULL; hPtr = hPtr->nextPtr) {
+	    if ((hPtr->hash == hash) && (memcmp(key, hPtr->key.string,
+		    (size_t) length+1) == 0)) {
 		*newPtr = 0;
 		return hPtr;
 	    }
@@ -528,26 +839,233 @@ StringCreate(
 
     *newPtr = 1;
     hPtr = (Hax_HashEntry *) ckalloc(memoryp, (unsigned)
-	    (sizeof(Hax_HashEntry) + strlen(key) - (sizeof(hPtr->key) -1)));
+	    (sizeof(Hax_HashEntry) + length - (sizeof(hPtr->key) -1)));
     hPtr->tablePtr = tablePtr;
     hPtr->bucketPtr = &(tablePtr->buckets[index]);
     hPtr->nextPtr = *hPtr->bucketPtr;
     hPtr->clientData = 0;
-    strcpy(hPtr->key.string, key);
+    hPtr->hash = hash;
+    memcpy(hPtr->key.string, key, (size_t) length+1);
     *hPtr->bucketPtr = hPtr;
-    tablePtr->numEntries++;
+    LinkEntry(tablePtr, hPtr);
 
     /*
-     * If the table has exceeded a decent size, rebuild it with many
-     * more buckets.
+     * If the table has exceeded a decent size, start rebuilding it
+     * with many more buckets.
      */
 
     if (tablePtr->numEntries >= tablePtr->rebuildSize) {
-	RebuildTable(interp, tablePtr);
+	StartRehash(interp, tablePtr, tablePtr->numBuckets*4);
     }
     return hPtr;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * OpenProbe --
+ *
+ *	Look for a string key in one slot array of a
+ *	HAX_OPEN_STRING_KEYS table.
+ *
+ * Results:
+ *	The return value is the matching entry, or NULL if there is
+ *	none in this slot array.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Hax_HashEntry *
+OpenProbe(
+    Hax_HashEntry **buckets,	/* Slot array to search. */
+    unsigned char *ctrl,	/* Control bytes for buckets. */
+    int mask,			/* Number of slots, minus one. */
+    unsigned int hash,		/* Hash value of key. */
+    char *key,			/* Key to find. */
+    int length			/* Length of key. */)
+{
+    Hax_HashEntry *hPtr;
+    int index, tag;
+
+    /*
+     * Probe successive slots until reaching one that has never held
+     * an entry.  Only slots whose control byte matches the key's
+     * tag need to be looked at any further.
+     */
+
+    tag = OPEN_TAG(hash);
+    for (index = hash & mask; ; index = (index+1) & mask) {
+	if (ctrl[index] == tag) {
+	    hPtr = buckets[index];
+	    if ((hPtr->hash == hash) && (memcmp(key, hPtr->key.string,
+		    (size_t) length+1) == 0)) {
+		return hPtr;
+	    }
+	} else if (ctrl[index] == OPEN_EMPTY) {
+	    return NULL;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * OpenFind --
+ *
+ *	Given a HAX_OPEN_STRING_KEYS hash table and a string key, find
+ *	the entry with a matching key.
+ *
+ * Results:
+ *	The return value is a token for the matching entry in the
+ *	hash table, or NULL if there was no matching entry.
+ *
+ * Side effects:
+ *	Part of a rebuild in progress may be carried out.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Hax_HashEntry *
+OpenFind(
+    Hax_HashTable *tablePtr,	/* Table in which to lookup entry. */
+    char *key			/* Key to use to find matching entry. */)
+{
+    Hax_HashEntry *hPtr;
+    unsigned int hash;
+    int length;
+
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    hash = HashString(key, &length);
+    hPtr = OpenProbe(tablePtr->buckets, tablePtr->ctrl, tablePtr->mask,
+	    hash, key, length);
+    if ((hPtr == NULL) && (tablePtr->oldBuckets != NULL)) {
+	hPtr = OpenProbe(tablePtr->oldBuckets, tablePtr->oldCtrl,
+		tablePtr->oldNumBuckets - 1, hash, key, length);
+    }
+    return hPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * OpenCreate --
+ *
+ *	Given a HAX_OPEN_STRING_KEYS hash table and a string key, find
+ *	the entry with a matching key.  If there is no matching entry,
+ *	then create a new entry that does match.
+ *
+ * Results:
+ *	The return value is a pointer to the matching entry.  If this
+ *	is a newly-created entry, then *newPtr will be set to a non-zero
+ *	value;  otherwise *newPtr will be set to 0.  If this is a new
+ *	entry the value stored in the entry will initially be 0.
+ *
+ * Side effects:
+ *	A new entry may be added to the hash table.  Part of a rebuild
+ *	in progress may be carried out, or a new rebuild started.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Hax_HashEntry *
+OpenCreate(
+    Hax_Interp *interp,
+    Hax_HashTable *tablePtr,	/* Table in which to lookup entry. */
+    char *key,			/* Key to use to find or create matching
+				 * entry. */
+    int *newPtr			/* Store info here telling whether a new
+				 * entry was created. */)
+{
+    Interp *iPtr = (Interp *)interp;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_HashEntry *hPtr;
+    unsigned int hash;
+    int index, length, tag, freeIndex;
+
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    hash = HashString(key, &length);
+    tag = OPEN_TAG(hash);
+
+    /*
+     * Search the probe sequence for the key, remembering the first
+     * deleted slot passed:  a new entry can reuse it.  Then look in
+     * the old slot array, if a rebuild is in progress.
+     */
+
+    freeIndex = -1;
+    for (index = hash & tablePtr->mask; ;
+	    index = (index+1) & tablePtr->mask) {
+	if (tablePtr->ctrl[index] == tag) {
+	    hPtr = tablePtr->buckets[index];
+	    if ((hPtr->hash == hash) && (memcmp(key, hPtr->key.string,
+		    (size_t) length+1) == 0)) {
+		*newPtr = 0;
+		return hPtr;
+	    }
+	} else if (tablePtr->ctrl[index] == OPEN_EMPTY) {
+	    break;
+	} else if ((tablePtr->ctrl[index] == OPEN_DELETED)
+		&& (freeIndex < 0)) {
+	    freeIndex = index;
+	}
+    }
+    if (tablePtr->oldBuckets != NULL) {
+	hPtr = OpenProbe(tablePtr->oldBuckets, tablePtr->oldCtrl,
+		tablePtr->oldNumBuckets - 1, hash, key, length);
+	if (hPtr != NULL) {
+	    *newPtr = 0;
+	    return hPtr;
+	}
+    }
+
+    /*
+     * Entry not found.  Reuse a deleted slot if there was one.
+     * Otherwise an empty slot is about to be used up, so first make
+     * sure the table stays below its maximum load.  Entries still in
+     * an old slot array are counted as well, so the new array can
+     * always take every entry.  Rebuilding doubles the size unless
+     * most of the used slots only hold deleted-entry markers;  either
+     * way the new array starts without markers, so probe again for
+     * an empty slot.
+     */
+
+    if (freeIndex >= 0) {
+	index = freeIndex;
+	tablePtr->numDeleted--;
+    } else if (tablePtr->numEntries + tablePtr->numDeleted
+	    >= tablePtr->rebuildSize) {
+	StartRehash(interp, tablePtr,
+		(tablePtr->numEntries >= tablePtr->rebuildSize/2)
+		? tablePtr->numBuckets*2 : tablePtr->numBuckets);
+	for (index = hash & tablePtr->mask;
+		tablePtr->ctrl[index] != OPEN_EMPTY;
+		index = (index+1) & tablePtr->mask) {
+	    /* Empty loop body. */
+	}
+    }
+
+    *newPtr = 1;
+    hPtr = (Hax_HashEntry *) ckalloc(memoryp, (unsigned)
+	    (sizeof(Hax_HashEntry) + length - (sizeof(hPtr->key) -1)));
+    hPtr->tablePtr = tablePtr;
+    hPtr->bucketPtr = &(tablePtr->buckets[index]);
+    hPtr->nextPtr = NULL;
+    hPtr->clientData = 0;
+    hPtr->hash = hash;
+    memcpy(hPtr->key.string, key, (size_t) length+1);
+    tablePtr->buckets[index] = hPtr;
+    tablePtr->ctrl[index] = tag;
+    LinkEntry(tablePtr, hPtr);
+    return hPtr;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -561,7 +1079,7 @@ StringCreate(
  *	hash table, or NULL if there was no matching entry.
  *
  * Side effects:
- *	None.
+ *	Part of a rebuild in progress may be carried out.
  *
  *----------------------------------------------------------------------
  */
@@ -571,24 +1089,29 @@ OneWordFind(
     Hax_HashTable *tablePtr,	/* Table in which to lookup entry. */
     char *key			/* Key to use to find matching entry. */)
 {
-    Hax_HashEntry *hPtr;
-    int index;
+    Hax_HashEntry *hPtr, *chains[2];
+    int i;
 
-    index = RANDOM_INDEX(tablePtr, key);
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
 
     /*
      * Search all of the entries in the appropriate bucket.
      */
 
-    for (hPtr = tablePtr->buckets[index]; hPtr != NULL;
-	    hPtr = hPtr->nextPtr) {
-	if (hPtr->key.oneWordValue == key) {
-	    return hPtr;
+    chains[0] = tablePtr->buckets[ChainIndex(tablePtr, (long) key, 0)];
+    chains[1] = OldChain(tablePtr, (long) key);
+    for (i = 0; i < 2; i++) {
+	for (hPtr = chains[i]; hPtr != NULL; hPtr = hPtr->nextPtr) {
+	    if (hPtr->key.oneWordValue == key) {
+		return hPtr;
+	    }
 	}
     }
     return NULL;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -605,7 +1128,8 @@ OneWordFind(
  *	entry the value stored in the entry will initially be 0.
  *
  * Side effects:
- *	A new entry may be added to the hash table.
+ *	A new entry may be added to the hash table.  Part of a rebuild
+ *	in progress may be carried out, or a new rebuild started.
  *
  *----------------------------------------------------------------------
  */
@@ -621,20 +1145,26 @@ OneWordCreate(
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
-    Hax_HashEntry *hPtr;
-    int index;
+    Hax_HashEntry *hPtr, *chains[2];
+    int index, i;
 
-    index = RANDOM_INDEX(tablePtr, key);
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    index = ChainIndex(tablePtr, (long) key, 0);
 
     /*
      * Search all of the entries in this bucket.
      */
 
-    for (hPtr = tablePtr->buckets[index]; hPtr != NULL;
-	    hPtr = hPtr->nextPtr) {
-	if (hPtr->key.oneWordValue == key) {
-	    *newPtr = 0;
-	    return hPtr;
+    chains[0] = tablePtr->buckets[index];
+    chains[1] = OldChain(tablePtr, (long) key);
+    for (i = 0; i < 2; i++) {
+	for (hPtr = chains[i]; hPtr != NULL; hPtr = hPtr->nextPtr) {
+	    if (hPtr->key.oneWordValue == key) {
+		*newPtr = 0;
+		return hPtr;
+	    }
 	}
     }
 
@@ -650,19 +1180,19 @@ OneWordCreate(
     hPtr->clientData = 0;
     hPtr->key.oneWordValue = key;
     *hPtr->bucketPtr = hPtr;
-    tablePtr->numEntries++;
+    LinkEntry(tablePtr, hPtr);
 
     /*
-     * If the table has exceeded a decent size, rebuild it with many
-     * more buckets.
+     * If the table has exceeded a decent size, start rebuilding it
+     * with many more buckets.
      */
 
     if (tablePtr->numEntries >= tablePtr->rebuildSize) {
-	RebuildTable(interp, tablePtr);
+	StartRehash(interp, tablePtr, tablePtr->numBuckets*4);
     }
     return hPtr;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -676,7 +1206,7 @@ OneWordCreate(
  *	hash table, or NULL if there was no matching entry.
  *
  * Side effects:
- *	None.
+ *	Part of a rebuild in progress may be carried out.
  *
  *----------------------------------------------------------------------
  */
@@ -686,36 +1216,42 @@ ArrayFind(
     Hax_HashTable *tablePtr,	/* Table in which to lookup entry. */
     char *key			/* Key to use to find matching entry. */)
 {
-    Hax_HashEntry *hPtr;
+    Hax_HashEntry *hPtr, *chains[2];
     int *arrayPtr = (int *) key;
     int *iPtr1, *iPtr2;
-    int index, count;
+    int value, count, i;
 
-    for (index = 0, count = tablePtr->keyType, iPtr1 = arrayPtr;
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    for (value = 0, count = tablePtr->keyType, iPtr1 = arrayPtr;
 	    count > 0; count--, iPtr1++) {
-	index += *iPtr1;
+	value += *iPtr1;
     }
-    index = RANDOM_INDEX(tablePtr, index);
 
     /*
      * Search all of the entries in the appropriate bucket.
      */
 
-    for (hPtr = tablePtr->buckets[index]; hPtr != NULL;
-	    hPtr = hPtr->nextPtr) {
-	for (iPtr1 = arrayPtr, iPtr2 = hPtr->key.words,
-		count = tablePtr->keyType; ; count--, iPtr1++, iPtr2++) {
-	    if (count == 0) {
-		return hPtr;
-	    }
-	    if (*iPtr1 != *iPtr2) {
-		break;
+    chains[0] = tablePtr->buckets[ChainIndex(tablePtr, (long) value, 0)];
+    chains[1] = OldChain(tablePtr, (long) value);
+    for (i = 0; i < 2; i++) {
+	for (hPtr = chains[i]; hPtr != NULL; hPtr = hPtr->nextPtr) {
+	    for (iPtr1 = arrayPtr, iPtr2 = hPtr->key.words,
+		    count = tablePtr->keyType; ;
+		    count--, iPtr1++, iPtr2++) {
+		if (count == 0) {
+		    return hPtr;
+		}
+		if (*iPtr1 != *iPtr2) {
+		    break;
+		}
 	    }
 	}
     }
     return NULL;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -732,7 +1268,8 @@ ArrayFind(
  *	entry the value stored in the entry will initially be 0.
  *
  * Side effects:
- *	A new entry may be added to the hash table.
+ *	A new entry may be added to the hash table.  Part of a rebuild
+ *	in progress may be carried out, or a new rebuild started.
  *
  *----------------------------------------------------------------------
  */
@@ -748,31 +1285,38 @@ ArrayCreate(
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
-    Hax_HashEntry *hPtr;
+    Hax_HashEntry *hPtr, *chains[2];
     int *arrayPtr = (int *) key;
     int *iPtr1, *iPtr2;
-    int index, count;
+    int index, value, count, i;
 
-    for (index = 0, count = tablePtr->keyType, iPtr1 = arrayPtr;
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, REHASH_STEP);
+    }
+    for (value = 0, count = tablePtr->keyType, iPtr1 = arrayPtr;
 	    count > 0; count--, iPtr1++) {
-	index += *iPtr1;
+	value += *iPtr1;
     }
-    index = RANDOM_INDEX(tablePtr, index);
+    index = ChainIndex(tablePtr, (long) value, 0);
 
     /*
      * Search all of the entries in the appropriate bucket.
      */
 
-    for (hPtr = tablePtr->buckets[index]; hPtr != NULL;
-	    hPtr = hPtr->nextPtr) {
-	for (iPtr1 = arrayPtr, iPtr2 = hPtr->key.words,
-		count = tablePtr->keyType; ; count--, iPtr1++, iPtr2++) {
-	    if (count == 0) {
-		*newPtr = 0;
-		return hPtr;
-	    }
-	    if (*iPtr1 != *iPtr2) {
-		break;
+    chains[0] = tablePtr->buckets[index];
+    chains[1] = OldChain(tablePtr, (long) value);
+    for (i = 0; i < 2; i++) {
+	for (hPtr = chains[i]; hPtr != NULL; hPtr = hPtr->nextPtr) {
+	    for (iPtr1 = arrayPtr, iPtr2 = hPtr->key.words,
+		    count = tablePtr->keyType; ;
+		    count--, iPtr1++, iPtr2++) {
+		if (count == 0) {
+		    *newPtr = 0;
+		    return hPtr;
+		}
+		if (*iPtr1 != *iPtr2) {
+		    break;
+		}
 	    }
 	}
     }
@@ -793,19 +1337,19 @@ ArrayCreate(
 	*iPtr2 = *iPtr1;
     }
     *hPtr->bucketPtr = hPtr;
-    tablePtr->numEntries++;
+    LinkEntry(tablePtr, hPtr);
 
     /*
-     * If the table has exceeded a decent size, rebuild it with many
-     * more buckets.
+     * If the table has exceeded a decent size, start rebuilding it
+     * with many more buckets.
      */
 
     if (tablePtr->numEntries >= tablePtr->rebuildSize) {
-	RebuildTable(interp, tablePtr);
+	StartRehash(interp, tablePtr, tablePtr->numBuckets*4);
     }
     return hPtr;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -833,7 +1377,7 @@ BogusFind(
     Hax_Panic((char *) "called Hax_FindHashEntry on deleted table");
     return NULL;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -865,90 +1409,293 @@ BogusCreate(
     Hax_Panic((char *) "called Hax_CreateHashEntry on deleted table");
     return NULL;
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * RebuildTable --
+ * LinkEntry --
  *
- *	This procedure is invoked when the ratio of entries to hash
- *	buckets becomes too large.  It creates a new table with a
- *	larger bucket array and moves all of the entries into the
- *	new table.
+ *	Add a newly-created entry to the end of its table's list of
+ *	entries, which is what Hax_NextHashEntry follows.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	Memory gets reallocated and entries get re-hashed to new
- *	buckets.
+ *	The entry is linked in and the table's entry count goes up.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-RebuildTable(
+LinkEntry(
+    Hax_HashTable *tablePtr,	/* Table containing hPtr. */
+    Hax_HashEntry *hPtr		/* New entry. */)
+{
+    hPtr->nextInTablePtr = NULL;
+    hPtr->prevInTablePtr = tablePtr->lastEntryPtr;
+    if (tablePtr->lastEntryPtr == NULL) {
+	tablePtr->firstEntryPtr = hPtr;
+    } else {
+	tablePtr->lastEntryPtr->nextInTablePtr = hPtr;
+    }
+    tablePtr->lastEntryPtr = hPtr;
+    tablePtr->numEntries++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EntryValue, ChainIndex --
+ *
+ *	For tables that use hash chains, EntryValue returns the
+ *	preliminary integer hash value of an entry's key:  the cached
+ *	hash of a string, the one-word key itself, or the sum of the
+ *	words of an array key.  ChainIndex turns such a value into an
+ *	index into the table's current bucket array or, if old is
+ *	non-zero, into the array being rebuilt from.
+ *
+ * Results:
+ *	See above.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static long
+EntryValue(
+    Hax_HashTable *tablePtr,	/* Table containing hPtr. */
+    Hax_HashEntry *hPtr		/* Entry whose key is wanted. */)
+{
+    int *iPtr;
+    int count, value;
+
+    if (tablePtr->keyType == HAX_STRING_KEYS) {
+	return (long) hPtr->hash;
+    } else if (tablePtr->keyType == HAX_ONE_WORD_KEYS) {
+	return (long) hPtr->key.oneWordValue;
+    }
+    for (value = 0, count = tablePtr->keyType, iPtr = hPtr->key.words;
+	    count > 0; count--, iPtr++) {
+	value += *iPtr;
+    }
+    return (long) value;
+}
+
+static int
+ChainIndex(
+    Hax_HashTable *tablePtr,	/* Table whose buckets are wanted. */
+    long value,			/* Preliminary hash value of a key. */
+    int old			/* Non-zero means index into oldBuckets. */)
+{
+    int downShift, mask;
+
+    if (old) {
+	downShift = tablePtr->oldDownShift;
+	mask = tablePtr->oldNumBuckets - 1;
+    } else {
+	downShift = tablePtr->downShift;
+	mask = tablePtr->mask;
+    }
+    if (tablePtr->keyType == HAX_STRING_KEYS) {
+	return (int) (value & mask);
+    }
+    return RANDOM_INDEX(value, downShift, mask);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * OldChain --
+ *
+ *	While a table with hash chains is being rebuilt, find the old
+ *	bucket that may still hold a key.
+ *
+ * Results:
+ *	The return value is the first entry in the old bucket for a
+ *	key with the given preliminary hash value, or NULL if there is
+ *	no rebuild in progress or that bucket has already been moved.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Hax_HashEntry *
+OldChain(
+    Hax_HashTable *tablePtr,	/* Table being searched. */
+    long value			/* Preliminary hash value of key. */)
+{
+    int index;
+
+    if (tablePtr->oldBuckets == NULL) {
+	return NULL;
+    }
+    index = ChainIndex(tablePtr, value, 1);
+    if (index < tablePtr->rehashIndex) {
+	return NULL;
+    }
+    return tablePtr->oldBuckets[index];
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * StartRehash --
+ *
+ *	This procedure is invoked when a table has become too full,
+ *	or too empty, for its bucket array.  It sets up a new bucket
+ *	array of the given size;  the entries are moved over a few
+ *	buckets at a time by RehashStep, so that no single operation
+ *	on a big table has to move all of them.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Any rebuild already in progress is completed first.  The
+ *	current bucket array becomes the old one and a new one is
+ *	allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+StartRehash(
     Hax_Interp *interp,
-    Hax_HashTable *tablePtr	/* Table to enlarge. */)
+    Hax_HashTable *tablePtr,	/* Table to rebuild. */
+    int newSize			/* Number of buckets in new array:  a
+				 * power of 4 for tables with hash chains,
+				 * a power of 2 for HAX_OPEN_STRING_KEYS
+				 * tables. */)
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
-    int oldSize, count, index;
-    Hax_HashEntry **oldBuckets;
-    Hax_HashEntry **oldChainPtr, **newChainPtr;
-    Hax_HashEntry *hPtr;
+    int open = (tablePtr->keyType == HAX_OPEN_STRING_KEYS);
+    int i;
 
-    oldSize = tablePtr->numBuckets;
-    oldBuckets = tablePtr->buckets;
+    tablePtr->memoryp = memoryp;
+    if (tablePtr->oldBuckets != NULL) {
+	RehashStep(tablePtr, tablePtr->oldNumBuckets);
+    }
+    tablePtr->oldBuckets = tablePtr->buckets;
+    tablePtr->oldCtrl = tablePtr->ctrl;
+    tablePtr->oldNumBuckets = tablePtr->numBuckets;
+    tablePtr->oldDownShift = tablePtr->downShift;
+    tablePtr->rehashIndex = 0;
 
     /*
-     * Allocate and initialize the new bucket array, and set up
-     * hashing constants for new array size.
+     * Slots and control bytes share one block, so that a probe
+     * touches as little memory as possible.
      */
 
-    tablePtr->numBuckets *= 4;
-    tablePtr->buckets = (Hax_HashEntry **) ckalloc(memoryp, (unsigned)
-	    (tablePtr->numBuckets * sizeof(Hax_HashEntry *)));
-    for (count = tablePtr->numBuckets, newChainPtr = tablePtr->buckets;
-	    count > 0; count--, newChainPtr++) {
-	*newChainPtr = NULL;
+    if ((newSize == HAX_SMALL_HASH_TABLE)
+	    && (tablePtr->oldBuckets != tablePtr->staticBuckets)) {
+	tablePtr->buckets = tablePtr->staticBuckets;
+	if (open) {
+	    tablePtr->ctrl = tablePtr->staticCtrl;
+	}
+    } else if (open) {
+	tablePtr->buckets = (Hax_HashEntry **) ckalloc(memoryp, (unsigned)
+		(newSize * (sizeof(Hax_HashEntry *) + 1)));
+	tablePtr->ctrl = (unsigned char *) (tablePtr->buckets + newSize);
+    } else {
+	tablePtr->buckets = (Hax_HashEntry **) ckalloc(memoryp, (unsigned)
+		(newSize * sizeof(Hax_HashEntry *)));
     }
-    tablePtr->rebuildSize *= 4;
-    tablePtr->downShift -= 2;
-    tablePtr->mask = (tablePtr->mask << 2) + 3;
+    if (open) {
 
-    /*
-     * Rehash all of the existing entries into the new bucket array.
-     */
+	/*
+	 * Slots are only looked at when their control byte says they
+	 * are full, so only the control bytes need clearing.
+	 */
 
-    for (oldChainPtr = oldBuckets; oldSize > 0; oldSize--, oldChainPtr++) {
-	for (hPtr = *oldChainPtr; hPtr != NULL; hPtr = *oldChainPtr) {
-	    *oldChainPtr = hPtr->nextPtr;
-	    if (tablePtr->keyType == HAX_STRING_KEYS) {
-		index = HashString(hPtr->key.string) & tablePtr->mask;
-	    } else if (tablePtr->keyType == HAX_ONE_WORD_KEYS) {
-		index = RANDOM_INDEX(tablePtr, hPtr->key.oneWordValue);
-	    } else {
-		int *iPtr;
-		int count;
-
-		for (index = 0, count = tablePtr->keyType,
-			iPtr = hPtr->key.words; count > 0; count--, iPtr++) {
-		    index += *iPtr;
-		}
-		index = RANDOM_INDEX(tablePtr, index);
+	memset(tablePtr->ctrl, OPEN_EMPTY, (size_t) newSize);
+	tablePtr->rebuildSize = OPEN_MAX_LOAD(newSize);
+	tablePtr->numDeleted = 0;
+    } else {
+	for (i = 0; i < newSize; i++) {
+	    tablePtr->buckets[i] = NULL;
+	}
+	for (i = tablePtr->numBuckets; i < newSize; i *= 4) {
+	    tablePtr->downShift -= 2;
+	}
+	for (i = tablePtr->numBuckets; i > newSize; i /= 4) {
+	    tablePtr->downShift += 2;
+	}
+	tablePtr->rebuildSize = newSize*REBUILD_MULTIPLIER;
+    }
+    tablePtr->numBuckets = newSize;
+    tablePtr->mask = newSize - 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RehashStep --
+ *
+ *	Move the entries of the next few buckets of a table's old
+ *	bucket array into its new one.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Entries move to new buckets.  Once the old array is empty it
+ *	is freed and the rebuild is over.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RehashStep(
+    Hax_HashTable *tablePtr,	/* Table being rebuilt. */
+    int count			/* Number of old buckets to move. */)
+{
+    Hax_HashEntry *hPtr;
+    int index;
+
+    for ( ; (count > 0) && (tablePtr->rehashIndex < tablePtr->oldNumBuckets);
+	    count--, tablePtr->rehashIndex++) {
+	if (tablePtr->keyType == HAX_OPEN_STRING_KEYS) {
+	    if (!OPEN_FULL(tablePtr->oldCtrl[tablePtr->rehashIndex])) {
+		continue;
+	    }
+	    hPtr = tablePtr->oldBuckets[tablePtr->rehashIndex];
+	    for (index = hPtr->hash & tablePtr->mask;
+		    OPEN_FULL(tablePtr->ctrl[index]);
+		    index = (index+1) & tablePtr->mask) {
+		/* Empty loop body. */
+	    }
+	    if (tablePtr->ctrl[index] == OPEN_DELETED) {
+		tablePtr->numDeleted--;
 	    }
+	    tablePtr->buckets[index] = hPtr;
+	    tablePtr->ctrl[index] = tablePtr->oldCtrl[tablePtr->rehashIndex];
+	    hPtr->bucketPtr = &(tablePtr->buckets[index]);
+	    tablePtr->oldBuckets[tablePtr->rehashIndex] = NULL;
+	    tablePtr->oldCtrl[tablePtr->rehashIndex] = OPEN_DELETED;
+	    continue;
+	}
+	while ((hPtr = tablePtr->oldBuckets[tablePtr->rehashIndex]) != NULL) {
+	    tablePtr->oldBuckets[tablePtr->rehashIndex] = hPtr->nextPtr;
+	    index = ChainIndex(tablePtr, EntryValue(tablePtr, hPtr), 0);
 	    hPtr->bucketPtr = &(tablePtr->buckets[index]);
 	    hPtr->nextPtr = *hPtr->bucketPtr;
 	    *hPtr->bucketPtr = hPtr;
 	}
     }
 
-    /*
-     * Free up the old bucket array, if it was dynamically allocated.
-     */
-
-    if (oldBuckets != tablePtr->staticBuckets) {
-	ckfree(memoryp, (char *) oldBuckets);
+    if (tablePtr->rehashIndex >= tablePtr->oldNumBuckets) {
+	if (tablePtr->oldBuckets != tablePtr->staticBuckets) {
+	    ckfree(tablePtr->memoryp, (char *) tablePtr->oldBuckets);
+	}
+	tablePtr->oldBuckets = NULL;
+	tablePtr->oldCtrl = NULL;
+	tablePtr->oldNumBuckets = 0;
+	tablePtr->rehashIndex = 0;
     }
 }
@@ -140,6 +140,28 @@ typedef struct ArraySearch {
 				 * the last one. */
 } ArraySearch;
 
+/*
+ * A variable may also remember the number that its value parses as, so
+ * that "incr" and "expr" needn't convert the string every time they use
+ * it.  The number is set by HaxSetVarNumber or by whoever parses the
+ * value, and is forgotten whenever the variable is written.
+ */
+
+typedef struct VarNumber {
+    int type;			/* VAR_NUM_NONE if the number is unknown,
+				 * otherwise says which field below is
+				 * valid. */
+    union {
+	long long int llongValue;
+				/* VAR_NUM_LLONG. */
+	double doubleValue;	/* VAR_NUM_DOUBLE. */
+    } u;
+} VarNumber;
+
+#define VAR_NUM_NONE	0
+#define VAR_NUM_LLONG	1
+#define VAR_NUM_DOUBLE	2
+
 /*
  * The structure below defines a variable, which associates a string name
  * with a string value.  Pointers to these structures are kept as the
@@ -168,6 +190,14 @@ typedef struct Var {
 				 * for this variable, or NULL if none. */
     int flags;			/* Miscellaneous bits of information about
 				 * variable.  See below for definitions. */
+    Hax_Obj *objPtr;		/* If not NULL, the variable's value is the
+				 * string form of this value, which it
+				 * shares with other holders, and
+				 * value.string is unused.  Only defined
+				 * scalar variables use this. */
+    VarNumber number;		/* Numeric form of the variable's value,
+				 * if known.  Meaningless for array and
+				 * upvar variables. */
     union {
 	char string[1];		/* String value of variable.  The actual
 				 * length of this field is given by the
@@ -219,6 +249,166 @@ typedef struct Var {
 #define VAR_TRACE_ACTIVE	0x20
 #define VAR_SEARCHES_POSSIBLE	0x40
 
+/*
+ * A value at least VALUE_SHARE_SIZE characters long is passed around
+ * by reference in a Hax_Obj (between variables, and from a variable
+ * or a command result to the command that uses it as a whole word)
+ * rather than copied.  Shorter values are cheaper to copy.
+ */
+
+#define VALUE_SHARE_SIZE	200
+
+/*
+ *----------------------------------------------------------------
+ * Data structures related to compiled scripts.   These are used
+ * primarily in haxCompile.c
+ *----------------------------------------------------------------
+ */
+
+/*
+ * The structure below describes one command in a compiled script:
+ * where its text lies in the script's copy of the source (for command
+ * traces and errorInfo) and which line it starts on.
+ */
+
+typedef struct CompiledCmd {
+    int srcOffset;		/* Offset of first character of command. */
+    int srcEnd;			/* Offset of the character that terminated
+				 * the command. */
+    int line;			/* Line number of the command within the
+				 * script or nested command containing it
+				 * (1 means first line). */
+    int literalName;		/* Non-zero means the command's name is a
+				 * literal word, so the command it resolves
+				 * to can be remembered in cmdPtr. */
+    struct Command *cmdPtr;	/* Command that the name resolved to the
+				 * last time the command was executed, or
+				 * NULL.  Only valid while the interpreter's
+				 * cmdEpoch equals cmdEpoch below. */
+    int cmdEpoch;		/* Value of the interpreter's cmdEpoch when
+				 * cmdPtr was stored. */
+    int slot;			/* For a "set" or "incr" command whose
+				 * variable name is a literal local of the
+				 * script's procedure, the variable's slot
+				 * (see CompiledScript.procPtr);  else -1. */
+    int exprWord;		/* For "if", "while", "for" and "expr":
+				 * index of the word that is the command's
+				 * (first) expression, if that word is a
+				 * literal;  else -1. */
+    struct CompiledExpr *exprPtr;
+				/* Compiled form of that expression, created
+				 * the first time it is evaluated, or NULL.
+				 * See HaxGetCompiledExpr. */
+    int exprCompiled;		/* Non-zero means an attempt has been made
+				 * to compile the expression. */
+} CompiledCmd;
+
+/*
+ * The structure below holds a script translated by HaxCompileScript.
+ * Everything lives in a single block of memory, which is freed when
+ * the reference count drops to zero.
+ */
+
+typedef struct CompiledScript {
+    int refCount;		/* Number of users of this structure (owner
+				 * plus any active executions). */
+    int *code;			/* Instructions (see haxCompile.c). */
+    int codeLength;		/* Number of words in code. */
+    CompiledCmd *cmds;		/* Information about each command. */
+    int numCmds;		/* Number of entries in cmds. */
+    char *literals;		/* Literal words and variable names, each
+				 * terminated by a null character. */
+    Hax_Obj **litObjs;		/* One slot for each literal word:  the
+				 * value passed for it to object-based
+				 * commands, created the first time it is
+				 * needed, or NULL.  Each holds a reference
+				 * for the script. */
+    int numLitObjs;		/* Number of slots in litObjs. */
+    char *source;		/* Private copy of the script text. */
+    struct Proc *procPtr;	/* Procedure whose local variable names
+				 * were resolved to slots when the script
+				 * was compiled, or NULL.  The slots are
+				 * only used while a call to this procedure
+				 * is the current variable frame;  anywhere
+				 * else names are looked up as usual.  Set
+				 * to NULL when the procedure is freed. */
+} CompiledScript;
+
+/*
+ * Scripts that are evaluated over and over (loop bodies and the like)
+ * are compiled once and kept in a per-interpreter cache, keyed by the
+ * text of the script.  The structure below is the value of each entry
+ * in the cache's hash table;  entries are also linked together in
+ * least-recently-used order so the cache can be kept to a bounded size.
+ */
+
+typedef struct ScriptCacheEntry {
+    CompiledScript *scriptPtr;	/* Compiled form of the script, or NULL if
+				 * the script couldn't be compiled. */
+    Hax_HashEntry *hPtr;	/* Entry in the cache's hash table. */
+    struct ScriptCacheEntry *prevPtr;
+				/* Next more recently used entry, or NULL. */
+    struct ScriptCacheEntry *nextPtr;
+				/* Next less recently used entry, or NULL. */
+} ScriptCacheEntry;
+
+/*
+ * Maximum number of scripts kept in an interpreter's script cache.
+ */
+
+#define MAX_CACHED_SCRIPTS	500
+
+/*
+ * Maximum number of scripts kept in a procedure's own script cache
+ * (Proc.scriptTablePtr).  Others go in the interpreter's cache.
+ */
+
+#define MAX_PROC_SCRIPTS	50
+
+/*
+ * Compiled scripts are executed without recursing on the C stack:  each
+ * running script, nested command and pending continuation is an
+ * ExecLevel on a stack kept in the heap (see RunLevels in haxCompile.c).
+ * Commands that evaluate scripts (procedures, "if", the loops and so on)
+ * have a HaxNRCmdProc as well as their ordinary procedure.  Instead of
+ * evaluating a script itself, it schedules the script with
+ * HaxNREvalScript or HaxNREvalCached, plus a HaxNRCallbackProc to run
+ * when the script finishes if there's more to do, and returns
+ * HAX_NR_PENDING.  The callback receives the script's return code and
+ * may in turn schedule more work.
+ */
+
+#define HAX_NR_PENDING		(-1)
+
+typedef struct ExecLevel ExecLevel;
+
+typedef int (HaxNRCmdProc) (ClientData clientData, Hax_Interp *interp,
+	int argc, char **argv, Hax_Obj **objv);
+typedef int (HaxNRCallbackProc) (Hax_Interp *interp, ClientData data[],
+	int result);
+
+/*
+ * Expressions are cached in the same way as scripts.  The compiled form
+ * of an expression is private to haxExpr.c.
+ */
+
+typedef struct CompiledExpr CompiledExpr;
+
+typedef struct ExprCacheEntry {
+    CompiledExpr *exprPtr;	/* Compiled form of the expression, or
+				 * NULL if it hasn't been compiled (yet). */
+    int compiled;		/* Non-zero means an attempt has been made
+				 * to compile the expression;  if exprPtr is
+				 * still NULL, it couldn't be compiled. */
+    Hax_HashEntry *hPtr;	/* Entry in the cache's hash table. */
+    struct ExprCacheEntry *prevPtr;
+				/* Next more recently used entry, or NULL. */
+    struct ExprCacheEntry *nextPtr;
+				/* Next less recently used entry, or NULL. */
+} ExprCacheEntry;
+
+#define MAX_CACHED_EXPRS	500
+
 /*
  *----------------------------------------------------------------
  * Data structures related to procedures.   These are used primarily
@@ -236,6 +426,8 @@ typedef struct Arg {
 				 * or NULL if this is the last argument. */
     char *defValue;		/* Pointer to arg's default value, or NULL
 				 * if no default value. */
+    int slot;			/* Index of the local variable slot that
+				 * holds the argument's value. */
     char name[4];		/* Name of argument starts here.  The name
 				 * is followed by space for the default,
 				 * if there is one.  The actual size of this
@@ -257,6 +449,31 @@ typedef struct Proc {
 				 * the procedure (dynamically allocated). */
     Arg *argPtr;		/* Pointer to first of procedure's formal
 				 * arguments, or NULL if none. */
+    CompiledScript *compiledPtr;/* Compiled form of command, created the
+				 * first time the procedure is invoked.
+				 * NULL means not compiled yet. */
+    int noCompile;		/* Non-zero means command couldn't be
+				 * compiled, so it is always evaluated
+				 * with Hax_Eval. */
+    int refCount;		/* Number of active invocations of the
+				 * procedure, plus 1 while it's still
+				 * registered as a command. */
+    Hax_HashTable localTable;	/* Maps the names of the procedure's
+				 * statically visible local variables
+				 * (its arguments plus variables named in
+				 * its body) to slot indexes in each call
+				 * frame.  Values are slot indexes. */
+    char **localNames;		/* Name of the variable in each slot
+				 * (keys of localTable), or NULL. */
+    int numLocals;		/* Number of slots. */
+    Hax_HashTable *scriptTablePtr;
+				/* Compiled forms of scripts evaluated
+				 * repeatedly in the procedure's frame
+				 * (loop bodies and the like), which can
+				 * use its slots.  Keyed by the text of the
+				 * script;  values are CompiledScripts, or
+				 * NULL for scripts that can't be compiled.
+				 * NULL until the first one is needed. */
 } Proc;
 
 /*
@@ -272,6 +489,32 @@ typedef struct Trace {
     struct Trace *nextPtr;	/* Next in list of traces for this interp. */
 } Trace;
 
+/*
+ * Scratch space holds temporaries that only live as long as a command,
+ * such as expanded parse buffers, argv arrays and split lists.  It is
+ * a stack of chunks:  space is taken from the top of the current chunk
+ * and given back in bulk by moving the top back to a ScratchMark saved
+ * earlier.  See HaxScratchAlloc in haxUtil.c for details.
+ */
+
+typedef struct ScratchChunk {
+    struct ScratchChunk *nextPtr;	/* Next chunk up the stack, kept for
+					 * reuse once it's empty, or NULL. */
+    char *end;				/* First byte after the chunk. */
+    double space[1];			/* Start of the usable space (the
+					 * chunk is really bigger). */
+} ScratchChunk;
+
+typedef struct ScratchMark {
+    ScratchChunk *chunkPtr;		/* Chunk holding the top, or NULL if
+					 * the scratch space was empty. */
+    char *top;				/* Top of the scratch space. */
+} ScratchMark;
+
+#define HaxScratchMark(iPtr, markPtr) \
+    ((markPtr)->chunkPtr = (iPtr)->scratchPtr, \
+    (markPtr)->top = (iPtr)->scratchTop)
+
 /*
  * The structure below defines a frame, which is a procedure invocation.
  * These structures exist only while procedures are being executed, and
@@ -279,8 +522,16 @@ typedef struct Trace {
  */
 
 typedef struct CallFrame {
-    Hax_HashTable varTable;	/* Hash table containing all of procedure's
-				 * local variables. */
+    Hax_HashEntry *slots;	/* Local variables named in the procedure's
+				 * localTable:  one entry per slot.  These
+				 * entries aren't in any hash table (their
+				 * tablePtr is NULL);  a NULL value means
+				 * the variable doesn't exist. */
+    Hax_HashTable *varTablePtr;	/* Hash table containing the procedure's
+				 * other local variables (those whose
+				 * names are computed at run time), or NULL
+				 * if none has been created yet. */
+    struct Proc *procPtr;	/* Procedure being invoked. */
     int level;			/* Level of this procedure, for "uplevel"
 				 * purposes (i.e. corresponds to nesting of
 				 * callerVarPtr's, not callerPtr's).  1 means
@@ -299,6 +550,18 @@ typedef struct CallFrame {
 				 * as callerPtr unless an "uplevel" command
 				 * or something equivalent was active in
 				 * the caller). */
+    ScratchMark mark;		/* Top of the scratch space before the
+				 * frame was allocated, so that a "tailcall"
+				 * can give the frame back before its target
+				 * runs. */
+    char **tailcall;		/* Words of the command that "tailcall"
+				 * asked to run in place of the procedure
+				 * once its body returns, or NULL.  Made by
+				 * TailcallWords in haxProc.c and freed
+				 * with ckfree. */
+    int ownArgv;		/* Non-zero means argv came from a
+				 * "tailcall" and is freed the same way
+				 * when the procedure returns. */
 } CallFrame;
 
 /*
@@ -352,13 +615,65 @@ typedef struct HistoryRev {
 typedef struct Command {
     Hax_CmdProc *proc;		/* Procedure to process command. */
     ClientData clientData;	/* Arbitrary value to pass to proc. */
+    Hax_ObjCmdProc *objProc;	/* For commands created with
+				 * Hax_CreateObjCommand, the procedure that
+				 * really processes the command (proc is
+				 * then HaxInvokeObjCommand, which converts
+				 * its arguments to values and calls this);
+				 * NULL otherwise.  A few built-in commands
+				 * have both a string proc and an objProc:
+				 * compiled scripts only use the objProc
+				 * for them when some arguments are values
+				 * held by reference. */
+    ClientData objClientData;	/* Arbitrary value to pass to objProc. */
     Hax_CmdDeleteProc *deleteProc;
 				/* Procedure to invoke when deleting
 				 * command. */
+    ClientData deleteData;	/* Arbitrary value to pass to deleteProc. */
+    HaxNRCmdProc *nrProc;	/* If not NULL, the procedure compiled
+				 * scripts call instead of proc or objProc,
+				 * with objClientData, so that any script
+				 * the command evaluates runs without
+				 * recursing (see HAX_NR_PENDING).  objv is
+				 * NULL unless objProc would have been
+				 * used. */
 } Command;
 
 #define CMD_SIZE(nameLength) ((unsigned) sizeof(Command) + nameLength - 3)
 
+/*
+ * The text of errorInfo is recorded as a stack of ErrorFrames while an
+ * error unwinds, and only turned into a string when the variable is
+ * read or the error reaches top level (see HaxFlushErrorInfo in
+ * haxBasic.c), so that errors which are caught and ignored are cheap.
+ * The characters for each frame are kept in Interp.errorText, since
+ * the script they came from may be gone by the time they're needed.
+ */
+
+typedef struct ErrorFrame {
+    int kind;			/* One of the kinds listed below. */
+    int start;			/* Offset of the frame's characters in
+				 * errorText. */
+    int length;			/* Number of characters in the frame. */
+    const char *ellipsis;	/* Static string to add after the command
+				 * ("..." or " ..." if not all of it was
+				 * recorded), or "". */
+} ErrorFrame;
+
+/*
+ * Kinds of ErrorFrame:
+ *
+ * ERROR_FRAME_TEXT:		Characters to be added to errorInfo as is.
+ * ERROR_FRAME_EXECUTING:	The command in which the error occurred,
+ *				logged as "while executing".
+ * ERROR_FRAME_INVOKED:		A command the error unwound through,
+ *				logged as "invoked from within".
+ */
+
+#define ERROR_FRAME_TEXT	0
+#define ERROR_FRAME_EXECUTING	1
+#define ERROR_FRAME_INVOKED	2
+
 typedef struct Interp {
 
     /*
@@ -380,6 +695,18 @@ typedef struct Interp {
     Hax_HashTable commandTable;	/* Contains all of the commands currently
 				 * registered in this interpreter.  Indexed
 				 * by strings; values have type (Command *). */
+    Hax_Obj *objResultPtr;	/* Value most recently passed to
+				 * Hax_SetObjResult, or NULL.  Interp->result
+				 * may point to its string form, so it holds
+				 * a reference until it is replaced, the
+				 * result is reset (see HaxReleaseObjResult)
+				 * or the interpreter is deleted. */
+    Hax_Obj *objFreePtr;	/* Blocks of freed Hax_Obj's, kept for reuse
+				 * and linked through their first word (see
+				 * haxObj.c). */
+    int cmdEpoch;		/* Incremented whenever a command is created,
+				 * deleted or renamed;  invalidates every
+				 * command lookup cached in a CompiledCmd. */
 
     /*
      * Information related to procedures and variables.  See haxProc.c
@@ -444,6 +771,23 @@ typedef struct Interp {
     int appendUsed;		/* Number of non-null bytes currently
 				 * stored at partialResult. */
 
+    /*
+     * Information about the current error that hasn't been stored in
+     * the errorInfo and errorCode variables yet.  See Hax_AddErrorInfo
+     * in haxBasic.c for details.
+     */
+
+    ErrorFrame *errorFrames;	/* Frames recorded for the current error.
+				 * Malloc-ed, or NULL if not yet
+				 * allocated. */
+    int numErrorFrames;		/* Number of frames in use. */
+    int errorFramesAvl;		/* Number of frames allocated. */
+    char *errorText;		/* Characters for the frames.  Malloc-ed,
+				 * or NULL if not yet allocated. */
+    int errorTextUsed;		/* Number of bytes in use at errorText. */
+    int errorTextAvl;		/* Number of bytes allocated at
+				 * errorText. */
+
     /*
      * A cache of compiled regular expressions.  See HaxCompileRegexp
      * in haxUtil.c for details.
@@ -461,6 +805,69 @@ typedef struct Interp {
 				/* Compiled forms of above strings.  Also
 				 * malloc-ed, or NULL if not in use yet. */
 
+    /*
+     * A cache of compiled scripts, used for loop bodies and other
+     * scripts that are evaluated repeatedly.  See HaxGetCachedScript
+     * in haxCompile.c for details.
+     */
+
+    Hax_HashTable scriptCache;	/* Maps script text to ScriptCacheEntry. */
+    ScriptCacheEntry *cacheFirstPtr;
+				/* Most recently used entry, or NULL. */
+    ScriptCacheEntry *cacheLastPtr;
+				/* Least recently used entry, or NULL. */
+    int scriptCacheHits;	/* Number of lookups that found a script
+				 * already in the cache. */
+    int scriptCacheMisses;	/* Number of lookups that had to compile
+				 * a script. */
+    Hax_HashTable exprCache;	/* Maps expression text to ExprCacheEntry.
+				 * See ExprGetCached in haxExpr.c. */
+    ExprCacheEntry *exprFirstPtr;
+				/* Most recently used entry, or NULL. */
+    ExprCacheEntry *exprLastPtr;
+				/* Least recently used entry, or NULL. */
+    int exprCacheHits;		/* Number of lookups that found an
+				 * expression already in the cache. */
+    int exprCacheMisses;	/* Number of lookups that didn't. */
+    CompiledCmd *exprCmdPtr;	/* While a command of a compiled script is
+				 * being invoked:  the command, if it has a
+				 * literal expression word;  else NULL. */
+    char *exprCmdString;	/* That word, as passed to the command.  An
+				 * expression with this address is the
+				 * command's own, compiled in exprCmdPtr. */
+    struct Proc *exprProcPtr;	/* Procedure whose slots the command's
+				 * expression may use, or NULL. */
+
+    /*
+     * Scratch space for command temporaries.  See HaxScratchAlloc in
+     * haxUtil.c for details.
+     */
+
+    ScratchChunk *scratchFirstPtr;
+				/* Bottom chunk of the scratch space, or
+				 * NULL if none has been allocated yet. */
+    ScratchChunk *scratchPtr;	/* Chunk holding the top of the scratch
+				 * space, or NULL if the space is empty. */
+    char *scratchTop;		/* First free byte in *scratchPtr. */
+
+    /*
+     * The stack of scripts being executed.  See RunLevels in
+     * haxCompile.c for details.
+     */
+
+    ExecLevel *execTopPtr;	/* Top of the stack, or NULL. */
+    ExecLevel *execFreePtr;	/* Unused levels, kept for reuse. */
+    long execBytes;		/* Memory used by the levels on the stack
+				 * and the temporaries they hold. */
+    long evalBudget;		/* Limit on execBytes;  a script that would
+				 * start beyond it fails with "too many
+				 * nested calls".  See Hax_SetEvalBudget. */
+    int evalDepth;		/* Number of calls to Hax_Eval,
+				 * Hax_EvalObjv and the like active on the
+				 * C stack;  limited to MAX_NESTING_DEPTH. */
+    int sortThreads;		/* Most threads "lsort" may use to sort a
+				 * large list.  See Hax_SetSortThreads. */
+
 
     /*
      * Miscellaneous information:
@@ -533,12 +940,51 @@ typedef struct Interp {
  *			called to record information for the current
  *			error.  Zero means Hax_Eval must clear the
  *			errorCode variable if an error is returned.
+ * ERR_INFO_PENDING:	Non-zero means errorFrames holds text that
+ *			belongs in the errorInfo variable but hasn't
+ *			been stored there yet.
+ * ERR_INFO_APPEND:	Non-zero means the pending text is to be
+ *			appended to the current value of errorInfo,
+ *			rather than replace it.
+ * ERR_CODE_PENDING:	Non-zero means errorCode is to be set to
+ *			"NONE" but hasn't been yet.
+ * ERR_INFO_TRACED:	Non-zero means the trace that stores the
+ *			pending text when errorInfo is used has been
+ *			set on the variable.
+ * ERR_CODE_TRACED:	The same for errorCode.
  */
 
 #define DELETED			1
 #define ERR_IN_PROGRESS		2
 #define ERR_ALREADY_LOGGED	4
 #define ERROR_CODE_SET		8
+#define ERR_INFO_PENDING	0x10
+#define ERR_INFO_APPEND		0x20
+#define ERR_CODE_PENDING	0x40
+#define ERR_INFO_TRACED		0x80
+#define ERR_CODE_TRACED		0x100
+
+/*
+ * The macro below stores any pending errorInfo or errorCode text in
+ * the variables, for code that looks at them without reading them.
+ */
+
+#define HaxFlushPendingError(iPtr) \
+    if ((iPtr)->flags & (ERR_INFO_PENDING|ERR_CODE_PENDING)) { \
+	HaxFlushErrorInfo(iPtr); \
+    }
+
+/*
+ * The macro below drops the interpreter's reference to the value that
+ * was last made its result, once interp->result no longer needs it, so
+ * that a large value isn't kept alive by a stale result.
+ */
+
+#define HaxReleaseObjResult(iPtr) \
+    if ((iPtr)->objResultPtr != NULL) { \
+	Hax_DecrRefCount((Hax_Interp *) (iPtr), (iPtr)->objResultPtr); \
+	(iPtr)->objResultPtr = NULL; \
+    }
 
 /*
  *----------------------------------------------------------------
@@ -620,10 +1066,24 @@ extern char haxTypeTable[];
 #define HAX_RECORD_BOUNDS	0x100
 
 /*
- * Maximum number of levels of nesting permitted in Hax commands.
+ * Maximum number of levels of nesting permitted in Hax commands that
+ * recurse on the C stack (Hax_Eval, command substitution inside
+ * expressions and C commands that evaluate scripts themselves).
+ * Nesting within compiled scripts is limited by the evaluation budget
+ * instead, which defaults to the number of bytes below.
  */
 
 #define MAX_NESTING_DEPTH	100
+#define DEFAULT_EVAL_BUDGET	(16*1024*1024)
+
+/*
+ * Largest number of threads "lsort" will use to sort a big list, by
+ * default and at most (see Hax_SetSortThreads).  Only builds compiled
+ * with HAX_THREADS use more than one.
+ */
+
+#define DEFAULT_SORT_THREADS	4
+#define MAX_SORT_THREADS	16
 
 /*
  *----------------------------------------------------------------
@@ -641,34 +1101,126 @@ extern unsigned long int Strtoul(Interp *iPtr, const char *nptr, char **endptr,
 extern double		Strtod(Interp *iPtr, const char *nptr, char **endptr);
 extern regexp *		HaxCompileRegexp (Hax_Interp *interp,
 			    char *string);
+extern CompiledScript *	HaxCompileScript (Hax_Interp *interp,
+			    char *script, struct Proc *procPtr);
+extern int		HaxCheckSubst (Hax_Interp *interp,
+			    char *string, char **termPtr);
 extern void		HaxCopyAndCollapse (int count, char *src,
 			    char *dst);
+extern void		HaxAppendVarNames (Interp *iPtr,
+			    CallFrame *framePtr, char *pattern,
+			    int skipFlags);
+extern void		HaxDeleteFrameVars (Interp *iPtr,
+			    CallFrame *framePtr);
 extern void		HaxDeleteVars (Interp *iPtr,
 			    Hax_HashTable *tablePtr);
+extern void		HaxDeleteExecLevels (Interp *iPtr);
+extern void		HaxDeleteExprCache (Interp *iPtr);
+extern void		HaxDeleteObjs (Interp *iPtr);
+extern void		HaxDeleteScratch (Interp *iPtr);
+extern void		HaxDeleteProcScripts (Interp *iPtr,
+			    Proc *procPtr);
+extern void		HaxDeleteScriptCache (Interp *iPtr);
 extern void		HaxExpandParseValue (Hax_Interp *interp,
 			    ParseValue *pvPtr, int needed);
+extern void		HaxExpandScratchParseValue (Hax_Interp *interp,
+			    ParseValue *pvPtr, int needed);
+extern int		HaxExprBooleanCompiled (Hax_Interp *interp,
+			    CompiledExpr *exprPtr, char *string, int *ptr);
+extern void		HaxExprForgetProc (CompiledExpr *exprPtr);
+extern void		HaxFlushErrorInfo (Interp *iPtr);
 extern int		HaxFindElement (Hax_Interp *interp,
 			    char *list, char **elementPtr, char **nextPtr,
 			    long int *sizePtr, int *bracePtr);
 extern Proc *		HaxFindProc (Interp *iPtr,
 			    char *procName);
+extern CompiledScript *	HaxGetCachedScript (Hax_Interp *interp,
+			    char *script);
+extern CompiledExpr *	HaxGetCompiledExpr (Hax_Interp *interp,
+			    char *string);
 extern int		HaxGetFrame (Hax_Interp *interp,
 			    char *string, CallFrame **framePtrPtr);
 extern int		HaxGetListIndex (Hax_Interp *interp,
 			    char *string, long int *indexPtr);
+extern char *		HaxGetVarNumber (Hax_Interp *interp,
+			    char *part1, char *part2, int flags,
+			    VarNumber **numberPtrPtr);
+extern char *		HaxGetVarObj (Hax_Interp *interp,
+			    char *part1, char *part2, int flags,
+			    Hax_Obj **objPtrPtr);
+extern char *		HaxGetVarSlot (Hax_Interp *interp,
+			    Hax_HashEntry *slotPtr, char *part1, char *part2,
+			    int flags, Hax_Obj **objPtrPtr,
+			    VarNumber **numberPtrPtr);
+extern int		HaxIncrSlotCmd (Hax_Interp *interp,
+			    Hax_HashEntry *slotPtr, char *varName,
+			    char *increment);
+extern int		HaxInvokeObjCommand (ClientData clientData,
+			    Hax_Interp *interp, int argc, char **argv);
+extern int		HaxInvokeObjv (Interp *iPtr, Command *cmdPtr,
+			    int argc, char **argv, Hax_Obj **refs);
 extern Proc *		HaxIsProc (Command *cmdPtr);
+extern int		HaxListObjSpans (Hax_Interp *interp,
+			    Hax_Obj *listPtr, int *objcPtr, int **spansPtr);
+extern void		HaxLogErrorCommand (Interp *iPtr, char *cmd,
+			    int numChars, const char *ellipsis);
+extern Hax_HashEntry *	HaxLookupVar (Interp *iPtr, CallFrame *framePtr,
+			    char *name, int create, int *newPtr);
+extern void		HaxNRAddCallback (Hax_Interp *interp,
+			    HaxNRCallbackProc *proc, int bytes,
+			    ClientData data0, ClientData data1,
+			    ClientData data2, ClientData data3);
+extern int		HaxNRCallCommand (Hax_Interp *interp,
+			    HaxNRCmdProc *nrProc, ClientData clientData,
+			    int argc, char **argv, Hax_Obj **objv);
+extern int		HaxNREvalCached (Hax_Interp *interp,
+			    char *script);
+extern int		HaxNREvalDynamic (Hax_Interp *interp,
+			    char *script);
+extern int		HaxNREvalScript (Hax_Interp *interp,
+			    CompiledScript *scriptPtr, char *script);
+extern void		HaxPreserveCompiled (CompiledScript *scriptPtr);
+extern void		HaxReleaseCompiled (Hax_Interp *interp,
+			    CompiledScript *scriptPtr);
+extern void		HaxReleaseCompiledExpr (Hax_Interp *interp,
+			    CompiledExpr *exprPtr);
 extern int		HaxParseBraces (Hax_Interp *interp,
 			    char *string, char **termPtr, ParseValue *pvPtr);
 extern int		HaxParseNestedCmd (Hax_Interp *interp,
 			    char *string, int flags, char **termPtr,
-			    ParseValue *pvPtr);
+			    ParseValue *pvPtr, Hax_Obj **objPtrPtr);
 extern int		HaxParseQuotes (Hax_Interp *interp,
 			    char *string, int termChar, int flags,
 			    char **termPtr, ParseValue *pvPtr);
+extern char *		HaxParseVarObj (Hax_Interp *interp,
+			    char *string, char **termPtr,
+			    Hax_Obj **objPtrPtr);
 extern int		HaxParseWords (Hax_Interp *interp,
 			    char *string, int flags, int maxWords,
 			    char **termPtr, int *argcPtr, char **argv,
-			    ParseValue *pvPtr);
+			    Hax_Obj **refs, ParseValue *pvPtr);
+extern char *		HaxScratchAlloc (Interp *iPtr, int size);
+extern void		HaxScratchRelease (Interp *iPtr,
+			    ScratchMark *markPtr);
+extern int		HaxScratchSplitList (Hax_Interp *interp,
+			    char *list, int *argcPtr, char ***argvPtr);
+extern void		HaxScriptForgetProc (CompiledScript *scriptPtr);
+extern int		HaxSetSlotCmd (Hax_Interp *interp,
+			    Hax_HashEntry *slotPtr, char *varName,
+			    char *newValue, Hax_Obj *objPtr);
+extern void		HaxSetSlotVar (Interp *iPtr, Hax_HashEntry *hPtr,
+			    char *value, Hax_Obj *objPtr);
+extern char *		HaxSetVarNumber (Hax_Interp *interp,
+			    char *part1, char *part2, char *newValue,
+			    VarNumber *numberPtr, int flags);
+extern char *		HaxSetVarObj (Hax_Interp *interp,
+			    char *part1, char *part2, Hax_Obj *objPtr,
+			    int flags);
+extern char *		HaxSetVarSlot (Hax_Interp *interp,
+			    Hax_HashEntry *slotPtr, char *part1, char *part2,
+			    char *newValue, Hax_Obj *objPtr,
+			    VarNumber *numberPtr, int flags);
+extern Hax_Obj *	HaxTakeResultObj (Interp *iPtr);
 extern char *		HaxWordEnd (char *start, int nested);
 
 /*
@@ -687,6 +1239,9 @@ extern int	Hax_CaseCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_CatchCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_CatchNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
 extern int	Hax_ConcatCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_ContinueCmd (ClientData clientData,
@@ -695,12 +1250,21 @@ extern int	Hax_ErrorCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_EvalCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_EvalNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
 extern int	Hax_ExprCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_ForCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_ForeachCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_ForNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
+extern int	Hax_ForeachObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_ForeachNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
 extern int	Hax_FormatCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_GlobalCmd (ClientData clientData,
@@ -709,30 +1273,33 @@ extern int	Hax_HistoryCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_IfCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_IncrCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_IfNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
+extern int	Hax_IncrObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
 extern int	Hax_InfoCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_JoinCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_JoinObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
 extern int	Hax_LappendCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LindexCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LinsertCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LlengthCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_ListCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LrangeCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LreplaceCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LsearchCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
-extern int	Hax_LsortCmd (ClientData clientData,
-		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_LindexObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_LinsertObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_LlengthObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_ListObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_LrangeObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_LreplaceObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_LsearchObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
+extern int	Hax_LsortObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
 extern int	Hax_ProcCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_RegexpCmd (ClientData clientData,
@@ -743,24 +1310,36 @@ extern int	Hax_RenameCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_ReturnCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_ReturnObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
 extern int	Hax_ScanCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_SetCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_SetObjCmd (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
 extern int	Hax_SplitCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_StringCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_TailcallCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_TraceCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_UnsetCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_UplevelCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_UplevelNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
 extern int	Hax_UpvarCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_WhileCmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+extern int	Hax_WhileNRCmd (ClientData clientData,
+		    Hax_Interp *interp, int argc, char **argv,
+		    Hax_Obj **objv);
 extern int	Hax_Cmd (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
 extern int	Hax_Cmd (ClientData clientData,
@@ -0,0 +1,1094 @@
+/*
+ * haxObj.c --
+ *
+ *	This file implements Hax_Obj values:  reference-counted strings
+ *	that can also cache an integer, double-precision or list form,
+ *	so that a value used over and over again as a number or a list
+ *	needn't be re-parsed each time.  Object-based commands (see
+ *	Hax_CreateObjCommand) receive their arguments as such values.
+ *
+ *	A value always has a string form or an internal form, and
+ *	often both.  The string form is generated from the internal
+ *	form only when it is asked for;  an internal form is generated
+ *	from the string form the first time the value is used as that
+ *	type, and replaces any other internal form the value had.
+ */
+
+#include "haxInt.h"
+
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static Hax_Obj *	AllocObj (Hax_Interp *interp, char *bytes,
+			    int length);
+static void		FreeBytes (Hax_Interp *interp, Hax_Obj *objPtr);
+static void		FreeInternalRep (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
+static int		SetListFromAny (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
+static void		UpdateStringRep (Hax_Interp *interp,
+			    Hax_Obj *objPtr);
+
+/*
+ * Every value is a block of OBJ_BLOCK_SIZE bytes:  the Hax_Obj itself
+ * followed by room for a short string form, so that most values need
+ * only one allocation.  Longer string forms are allocated separately.
+ * Freed blocks go on the interpreter's objFreePtr list, linked through
+ * their first word, rather than back to ckalloc, since values for
+ * command arguments are created and freed at a high rate.  Compiling
+ * with HAX_NO_SLABS turns the list off, so that tools that check
+ * memory use see each value as a separate allocation.
+ */
+
+#define OBJ_INLINE_SIZE		24
+#define OBJ_BLOCK_SIZE		(sizeof(Hax_Obj) + OBJ_INLINE_SIZE)
+#define INLINE_BYTES(objPtr)	((char *) ((objPtr) + 1))
+#define NEXT_FREE(objPtr)	(*((Hax_Obj **) (objPtr)))
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AllocObj --
+ *
+ *	Allocate a new value with a reference count of zero.
+ *
+ * Results:
+ *	The return value is the new value.  If bytes isn't NULL, the
+ *	value has a copy of the first length characters at bytes as
+ *	its string form;  otherwise it has no string form and the
+ *	caller must give it an internal form.
+ *
+ * Side effects:
+ *	A block is taken from the interpreter's free list, or
+ *	allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Hax_Obj *
+AllocObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    char *bytes,		/* String form, or NULL. */
+    int length			/* Number of characters at bytes. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Obj *objPtr;
+
+    if (iPtr->objFreePtr != NULL) {
+	objPtr = iPtr->objFreePtr;
+	iPtr->objFreePtr = NEXT_FREE(objPtr);
+    } else {
+	objPtr = (Hax_Obj *) ckalloc(iPtr->memoryp, OBJ_BLOCK_SIZE);
+    }
+    if (bytes == NULL) {
+	objPtr->bytes = NULL;
+	objPtr->length = 0;
+    } else {
+	if (length < OBJ_INLINE_SIZE) {
+	    objPtr->bytes = INLINE_BYTES(objPtr);
+	} else {
+	    objPtr->bytes = (char *) ckalloc(iPtr->memoryp,
+		    (unsigned) length + 1);
+	}
+	memcpy(objPtr->bytes, bytes, (size_t) length);
+	objPtr->bytes[length] = 0;
+	objPtr->length = length;
+    }
+    objPtr->refCount = 0;
+    objPtr->type = HAX_OBJ_STRING;
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeBytes, FreeInternalRep --
+ *
+ *	Release the storage used by the string form or the internal
+ *	form of a value.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	FreeBytes leaves the value without a string form, which also
+ *	invalidates a list's table of element offsets;  FreeInternalRep
+ *	leaves it with type HAX_OBJ_STRING, and releases the elements
+ *	of a list.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeBytes(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr		/* Value whose string form is to go. */)
+{
+    Hax_Memoryp *memoryp = ((Interp *) interp)->memoryp;
+
+    if ((objPtr->bytes != NULL) && (objPtr->bytes != INLINE_BYTES(objPtr))) {
+	ckfree(memoryp, objPtr->bytes);
+    }
+    objPtr->bytes = NULL;
+    objPtr->length = 0;
+    if ((objPtr->type == HAX_OBJ_LIST)
+	    && (objPtr->internalRep.list.spans != NULL)) {
+	ckfree(memoryp, (char *) objPtr->internalRep.list.spans);
+	objPtr->internalRep.list.spans = NULL;
+    }
+}
+
+static void
+FreeInternalRep(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr		/* Value whose internal form is to go. */)
+{
+    int i;
+
+    if (objPtr->type == HAX_OBJ_LIST) {
+	for (i = 0; i < objPtr->internalRep.list.objc; i++) {
+	    Hax_DecrRefCount(interp, objPtr->internalRep.list.objv[i]);
+	}
+	if (objPtr->internalRep.list.objv != NULL) {
+	    ckfree(((Interp *) interp)->memoryp,
+		    (char *) objPtr->internalRep.list.objv);
+	}
+	if (objPtr->internalRep.list.spans != NULL) {
+	    ckfree(((Interp *) interp)->memoryp,
+		    (char *) objPtr->internalRep.list.spans);
+	}
+    }
+    objPtr->type = HAX_OBJ_STRING;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpdateStringRep --
+ *
+ *	Generate the string form of a value from its internal form.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated for the string form, and objPtr->bytes
+ *	and objPtr->length are set.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+UpdateStringRep(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr		/* Value that has no string form. */)
+{
+    Hax_Memoryp *memoryp = ((Interp *) interp)->memoryp;
+    char buffer[100];
+    char *staticArgv[20];
+    char **argv;
+    int i, objc;
+
+    switch (objPtr->type) {
+	case HAX_OBJ_INT:
+	    sprintf(buffer, "%ld", objPtr->internalRep.longValue);
+	    break;
+	case HAX_OBJ_DOUBLE:
+	    sprintf(buffer, "%g", objPtr->internalRep.doubleValue);
+	    break;
+	case HAX_OBJ_LIST:
+	    objc = objPtr->internalRep.list.objc;
+	    if (objc <= 20) {
+		argv = staticArgv;
+	    } else {
+		argv = (char **) ckalloc(memoryp,
+			(unsigned) (objc * sizeof(char *)));
+	    }
+	    for (i = 0; i < objc; i++) {
+		argv[i] = Hax_GetStringFromObj(interp,
+			objPtr->internalRep.list.objv[i], (int *) NULL);
+	    }
+	    objPtr->bytes = Hax_Merge(interp, objc, argv);
+	    objPtr->length = strlen(objPtr->bytes);
+	    if (argv != staticArgv) {
+		ckfree(memoryp, (char *) argv);
+	    }
+	    return;
+	default:
+	    buffer[0] = 0;
+	    break;
+    }
+    objPtr->length = strlen(buffer);
+    objPtr->bytes = (char *) ckalloc(memoryp, (unsigned) objPtr->length + 1);
+    strcpy(objPtr->bytes, buffer);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_NewStringObj, Hax_NewIntObj, Hax_NewLongObj, Hax_NewDoubleObj --
+ *
+ *	Create a new value from a string or a number.  If length is
+ *	negative, all of the characters up to the first null are used.
+ *
+ * Results:
+ *	The return value is the new value.  Its reference count is
+ *	zero:  whoever keeps it must call Hax_IncrRefCount.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_Obj *
+Hax_NewStringObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    char *bytes,		/* Characters for the string form. */
+    int length			/* Number of characters at bytes, or -1. */)
+{
+    if (length < 0) {
+	length = strlen(bytes);
+    }
+    return AllocObj(interp, bytes, length);
+}
+
+Hax_Obj *
+Hax_NewIntObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    int intValue		/* Value of the new value. */)
+{
+    return Hax_NewLongObj(interp, (long) intValue);
+}
+
+Hax_Obj *
+Hax_NewLongObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    long longValue		/* Value of the new value. */)
+{
+    Hax_Obj *objPtr;
+
+    objPtr = AllocObj(interp, (char *) NULL, 0);
+    objPtr->type = HAX_OBJ_INT;
+    objPtr->internalRep.longValue = longValue;
+    return objPtr;
+}
+
+Hax_Obj *
+Hax_NewDoubleObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    double doubleValue		/* Value of the new value. */)
+{
+    Hax_Obj *objPtr;
+
+    objPtr = AllocObj(interp, (char *) NULL, 0);
+    objPtr->type = HAX_OBJ_DOUBLE;
+    objPtr->internalRep.doubleValue = doubleValue;
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_NewListObj --
+ *
+ *	Create a new list value whose elements are the given values.
+ *
+ * Results:
+ *	The return value is the new value, with a reference count of
+ *	zero.
+ *
+ * Side effects:
+ *	The list holds a reference to each of its elements.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_Obj *
+Hax_NewListObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    int objc,			/* Number of elements. */
+    Hax_Obj **objv		/* The elements. */)
+{
+    Hax_Obj *objPtr;
+    int i;
+
+    objPtr = AllocObj(interp, (char *) NULL, 0);
+    objPtr->type = HAX_OBJ_LIST;
+    objPtr->internalRep.list.objc = objc;
+    objPtr->internalRep.list.avail = objc;
+    objPtr->internalRep.list.objv = NULL;
+    objPtr->internalRep.list.spans = NULL;
+    if (objc > 0) {
+	objPtr->internalRep.list.objv = (Hax_Obj **) ckalloc(
+		((Interp *) interp)->memoryp,
+		(unsigned) (objc * sizeof(Hax_Obj *)));
+	for (i = 0; i < objc; i++) {
+	    objPtr->internalRep.list.objv[i] = objv[i];
+	    Hax_IncrRefCount(objv[i]);
+	}
+    }
+    return objPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_DuplicateObj --
+ *
+ *	Make an unshared copy of a value, so that it can be modified.
+ *
+ * Results:
+ *	The return value is a new value with the same string form and
+ *	internal form as objPtr, and a reference count of zero.  The
+ *	elements of a list are shared with the original.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_Obj *
+Hax_DuplicateObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr		/* Value to copy. */)
+{
+    Hax_Obj *dupPtr;
+
+    int i;
+
+    dupPtr = AllocObj(interp, objPtr->bytes, objPtr->length);
+    dupPtr->type = objPtr->type;
+    dupPtr->internalRep = objPtr->internalRep;
+    if (objPtr->type == HAX_OBJ_LIST) {
+	dupPtr->internalRep.list.objv = NULL;
+	dupPtr->internalRep.list.spans = NULL;
+	dupPtr->internalRep.list.avail = objPtr->internalRep.list.objc;
+	if (objPtr->internalRep.list.objc > 0) {
+	    dupPtr->internalRep.list.objv = (Hax_Obj **) ckalloc(
+		    ((Interp *) interp)->memoryp, (unsigned)
+		    (objPtr->internalRep.list.objc * sizeof(Hax_Obj *)));
+	}
+	for (i = 0; i < objPtr->internalRep.list.objc; i++) {
+	    dupPtr->internalRep.list.objv[i] = objPtr->internalRep.list.objv[i];
+	    Hax_IncrRefCount(dupPtr->internalRep.list.objv[i]);
+	}
+    }
+    return dupPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_FreeObj --
+ *
+ *	Release a value whose reference count has dropped to zero.
+ *	This is normally called from Hax_DecrRefCount.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The value's block goes back on the interpreter's free list, and
+ *	it releases its references to any list elements.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Hax_FreeObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr		/* Value to free. */)
+{
+    Interp *iPtr = (Interp *) interp;
+
+    if (objPtr->type != HAX_OBJ_STRING) {
+	FreeInternalRep(interp, objPtr);
+    }
+    if ((objPtr->bytes != NULL) && (objPtr->bytes != INLINE_BYTES(objPtr))) {
+	ckfree(iPtr->memoryp, objPtr->bytes);
+    }
+#ifdef HAX_NO_SLABS
+    ckfree(iPtr->memoryp, (char *) objPtr);
+#else
+    NEXT_FREE(objPtr) = iPtr->objFreePtr;
+    iPtr->objFreePtr = objPtr;
+#endif
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxDeleteObjs --
+ *
+ *	Free the blocks on an interpreter's list of free values.  This
+ *	is called when the interpreter is deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxDeleteObjs(
+    Interp *iPtr)		/* Interpreter being deleted. */
+{
+    Hax_Obj *objPtr;
+
+    while (iPtr->objFreePtr != NULL) {
+	objPtr = iPtr->objFreePtr;
+	iPtr->objFreePtr = NEXT_FREE(objPtr);
+	ckfree(iPtr->memoryp, (char *) objPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_GetStringFromObj --
+ *
+ *	Return the string form of a value, generating it first if
+ *	necessary.
+ *
+ * Results:
+ *	The return value is the value's string form.  It belongs to
+ *	the value and must not be modified.  If lengthPtr isn't NULL,
+ *	the number of characters in the string is stored there.
+ *
+ * Side effects:
+ *	The string form may be generated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+Hax_GetStringFromObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr,		/* Value whose string form is wanted. */
+    int *lengthPtr		/* If not NULL, store length here. */)
+{
+    if (objPtr->bytes == NULL) {
+	UpdateStringRep(interp, objPtr);
+    }
+    if (lengthPtr != NULL) {
+	*lengthPtr = objPtr->length;
+    }
+    return objPtr->bytes;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_InvalidateStringRep --
+ *
+ *	Discard the string form of a value after its internal form has
+ *	been modified;  it will be regenerated when next needed.  The
+ *	value must not be shared, and must have an internal form.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The string form is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Hax_InvalidateStringRep(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr		/* Value whose string form is stale. */)
+{
+    FreeBytes(interp, objPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_SetStringObj, Hax_SetLongObj, Hax_SetDoubleObj --
+ *
+ *	Give an unshared value a new string or numeric value.  If
+ *	length is negative, all of the characters up to the first
+ *	null are used.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Any previous string and internal forms are discarded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Hax_SetStringObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr,		/* Value to modify. */
+    char *bytes,		/* New string form. */
+    int length			/* Number of characters at bytes, or -1. */)
+{
+    char *newBytes;
+
+    if (length < 0) {
+	length = strlen(bytes);
+    }
+
+    /*
+     * Copy the new string before freeing the old forms:  bytes may
+     * refer to one of them.
+     */
+
+    if (length < OBJ_INLINE_SIZE) {
+	newBytes = INLINE_BYTES(objPtr);
+	if (bytes != objPtr->bytes) {
+	    memmove(newBytes, bytes, (size_t) length);
+	}
+    } else {
+	newBytes = (char *) ckalloc(((Interp *) interp)->memoryp,
+		(unsigned) length + 1);
+	memcpy(newBytes, bytes, (size_t) length);
+    }
+    newBytes[length] = 0;
+    if (newBytes != objPtr->bytes) {
+	FreeBytes(interp, objPtr);
+    }
+    FreeInternalRep(interp, objPtr);
+    objPtr->bytes = newBytes;
+    objPtr->length = length;
+}
+
+void
+Hax_SetLongObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr,		/* Value to modify. */
+    long longValue		/* New value. */)
+{
+    FreeInternalRep(interp, objPtr);
+    FreeBytes(interp, objPtr);
+    objPtr->type = HAX_OBJ_INT;
+    objPtr->internalRep.longValue = longValue;
+}
+
+void
+Hax_SetDoubleObj(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    Hax_Obj *objPtr,		/* Value to modify. */
+    double doubleValue		/* New value. */)
+{
+    FreeInternalRep(interp, objPtr);
+    FreeBytes(interp, objPtr);
+    objPtr->type = HAX_OBJ_DOUBLE;
+    objPtr->internalRep.doubleValue = doubleValue;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_GetLongFromObj, Hax_GetIntFromObj, Hax_GetDoubleFromObj --
+ *
+ *	Return the numeric value of a value, parsing its string form
+ *	the same way as Hax_GetLong and Hax_GetDouble the first time.
+ *
+ * Results:
+ *	The return value is normally HAX_OK, with the number stored
+ *	at *longPtr, *intPtr or *doublePtr.  If the string form isn't
+ *	a proper number, HAX_ERROR is returned and an error message is
+ *	left in interp->result.
+ *
+ * Side effects:
+ *	The number is cached as the value's internal form.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Hax_GetLongFromObj(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *objPtr,		/* Value to convert. */
+    long int *longPtr		/* Place to store converted result. */)
+{
+    long value;
+
+    if (objPtr->type != HAX_OBJ_INT) {
+	if (Hax_GetLong(interp, Hax_GetStringFromObj(interp, objPtr,
+		(int *) NULL), &value) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+	FreeInternalRep(interp, objPtr);
+	objPtr->type = HAX_OBJ_INT;
+	objPtr->internalRep.longValue = value;
+    }
+    *longPtr = objPtr->internalRep.longValue;
+    return HAX_OK;
+}
+
+int
+Hax_GetIntFromObj(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *objPtr,		/* Value to convert. */
+    int *intPtr			/* Place to store converted result. */)
+{
+    long value;
+
+    if (Hax_GetLongFromObj(interp, objPtr, &value) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    *intPtr = (int) value;
+    return HAX_OK;
+}
+
+int
+Hax_GetDoubleFromObj(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *objPtr,		/* Value to convert. */
+    double *doublePtr		/* Place to store converted result. */)
+{
+    double value;
+
+    if (objPtr->type == HAX_OBJ_INT) {
+	*doublePtr = (double) objPtr->internalRep.longValue;
+	return HAX_OK;
+    }
+    if (objPtr->type != HAX_OBJ_DOUBLE) {
+	if (Hax_GetDouble(interp, Hax_GetStringFromObj(interp, objPtr,
+		(int *) NULL), &value) != HAX_OK) {
+	    return HAX_ERROR;
+	}
+	FreeInternalRep(interp, objPtr);
+	objPtr->type = HAX_OBJ_DOUBLE;
+	objPtr->internalRep.doubleValue = value;
+    }
+    *doublePtr = objPtr->internalRep.doubleValue;
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetListFromAny --
+ *
+ *	Give a value a list internal form by splitting its string form
+ *	into elements, following the same rules as Hax_SplitList.
+ *
+ * Results:
+ *	The return value is normally HAX_OK.  If the string form isn't
+ *	a proper list, HAX_ERROR is returned and an error message is
+ *	left in interp->result.
+ *
+ * Side effects:
+ *	A value is created for each element, and any other internal
+ *	form is discarded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SetListFromAny(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *objPtr		/* Value to convert. */)
+{
+    Hax_Memoryp *memoryp = ((Interp *) interp)->memoryp;
+    Hax_Obj **objv;
+    Hax_Obj *elemPtr;
+    char *list, *p, *element;
+    long int size, i, elSize;
+    int brace;
+
+    if (objPtr->type == HAX_OBJ_LIST) {
+	return HAX_OK;
+    }
+
+    /*
+     * Estimate the number of elements by counting space characters,
+     * just as SplitList does.
+     */
+
+    list = Hax_GetStringFromObj(interp, objPtr, (int *) NULL);
+    for (size = 1, p = list; *p != 0; p++) {
+	if (isspace(*p)) {
+	    size++;
+	}
+    }
+    objv = (Hax_Obj **) ckalloc(memoryp, (unsigned) (size * sizeof(Hax_Obj *)));
+    for (i = 0; *list != 0; i++) {
+	if (HaxFindElement(interp, list, &element, &list, &elSize, &brace)
+		!= HAX_OK) {
+	    goto error;
+	}
+	if (*element == 0) {
+	    break;
+	}
+	if (i >= size) {
+	    Hax_SetResult(interp, (char *) "internal error in Hax_SplitList",
+		    HAX_STATIC);
+	    goto error;
+	}
+	elemPtr = AllocObj(interp, element, (int) elSize);
+	if (!brace) {
+	    HaxCopyAndCollapse((int) elSize, element, elemPtr->bytes);
+	    elemPtr->length = strlen(elemPtr->bytes);
+	}
+	objv[i] = elemPtr;
+	Hax_IncrRefCount(elemPtr);
+    }
+
+    FreeInternalRep(interp, objPtr);
+    objPtr->type = HAX_OBJ_LIST;
+    objPtr->internalRep.list.objc = i;
+    objPtr->internalRep.list.avail = size;
+    objPtr->internalRep.list.objv = objv;
+    objPtr->internalRep.list.spans = NULL;
+    return HAX_OK;
+
+    error:
+    while (--i >= 0) {
+	Hax_DecrRefCount(interp, objv[i]);
+    }
+    ckfree(memoryp, (char *) objv);
+    return HAX_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_ListObjGetElements, Hax_ListObjLength, Hax_ListObjIndex --
+ *
+ *	Retrieve the elements of a list value, converting it to a list
+ *	first if necessary.
+ *
+ * Results:
+ *	The return value is normally HAX_OK.  Hax_ListObjGetElements
+ *	stores the number of elements at *objcPtr and a pointer to the
+ *	array of elements at *objvPtr;  the array belongs to the list
+ *	and is only valid until the list is modified or converted to
+ *	another type.  Hax_ListObjLength stores the number of elements
+ *	at *lengthPtr.  Hax_ListObjIndex stores element index at
+ *	*objPtrPtr, or NULL if there is no such element.  If the value
+ *	isn't a proper list, HAX_ERROR is returned and an error message
+ *	is left in interp->result.
+ *
+ * Side effects:
+ *	The value may be converted to a list.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Hax_ListObjGetElements(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *listPtr,		/* List value. */
+    int *objcPtr,		/* Where to store number of elements. */
+    Hax_Obj ***objvPtr		/* Where to store array of elements. */)
+{
+    if (SetListFromAny(interp, listPtr) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    *objcPtr = listPtr->internalRep.list.objc;
+    *objvPtr = listPtr->internalRep.list.objv;
+    return HAX_OK;
+}
+
+int
+Hax_ListObjLength(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *listPtr,		/* List value. */
+    int *lengthPtr		/* Where to store number of elements. */)
+{
+    if (SetListFromAny(interp, listPtr) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    *lengthPtr = listPtr->internalRep.list.objc;
+    return HAX_OK;
+}
+
+int
+Hax_ListObjIndex(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *listPtr,		/* List value. */
+    int index,			/* Index of element wanted. */
+    Hax_Obj **objPtrPtr		/* Where to store element. */)
+{
+    if (SetListFromAny(interp, listPtr) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    if ((index < 0) || (index >= listPtr->internalRep.list.objc)) {
+	*objPtrPtr = NULL;
+    } else {
+	*objPtrPtr = listPtr->internalRep.list.objv[index];
+    }
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxListObjSpans --
+ *
+ *	Find where the text of each element of a list value lies in its
+ *	string form, so that commands which return part of the list's
+ *	text as it was written (lrange, linsert and lreplace) can go
+ *	straight to the elements they need.
+ *
+ * Results:
+ *	The return value is normally HAX_OK.  The number of elements is
+ *	stored at *objcPtr, and at *spansPtr an array holding two offsets
+ *	into the string form for each element:  that of its first
+ *	character (including any opening brace or quote) and that of the
+ *	character just after it (after any closing brace or quote).  The
+ *	array belongs to the value and is only valid until the value is
+ *	modified.  If the value isn't a proper list, HAX_ERROR is
+ *	returned and an error message is left in interp->result.
+ *
+ * Side effects:
+ *	The value may be converted to a list.  The offsets are computed
+ *	in a single pass over the string the first time they're needed
+ *	and kept until the string form changes.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxListObjSpans(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *listPtr,		/* List value. */
+    int *objcPtr,		/* Where to store number of elements. */
+    int **spansPtr		/* Where to store array of offsets. */)
+{
+    char *list, *p, *element;
+    int *spans;
+    long int size;
+    int i, objc;
+
+    if (SetListFromAny(interp, listPtr) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    objc = listPtr->internalRep.list.objc;
+    list = Hax_GetStringFromObj(interp, listPtr, (int *) NULL);
+    spans = listPtr->internalRep.list.spans;
+    if ((spans == NULL) && (objc > 0)) {
+	spans = (int *) ckalloc(((Interp *) interp)->memoryp,
+		(unsigned) (2 * objc * sizeof(int)));
+	for (i = 0, p = list; i < objc; i++) {
+	    while (isascii(*p) && isspace(*p)) {
+		p++;
+	    }
+	    spans[2*i] = p - list;
+	    if (HaxFindElement(interp, p, &element, &p, &size, (int *) NULL)
+		    != HAX_OK) {
+		Hax_Panic((char *) "HaxListObjSpans: bad list \"%s\"", list);
+	    }
+
+	    /*
+	     * If the element is in braces or quotes, element points
+	     * just after the opening one and size doesn't count either.
+	     */
+
+	    if (element != list + spans[2*i]) {
+		size += 2;
+	    }
+	    spans[2*i + 1] = spans[2*i] + size;
+	}
+	listPtr->internalRep.list.spans = spans;
+    }
+    *objcPtr = objc;
+    *spansPtr = spans;
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_ListObjAppendElement --
+ *
+ *	Add an element to the end of an unshared list value.
+ *
+ * Results:
+ *	The return value is normally HAX_OK.  If listPtr isn't a proper
+ *	list, HAX_ERROR is returned and an error message is left in
+ *	interp->result.
+ *
+ * Side effects:
+ *	The list holds a reference to objPtr, and its string form is
+ *	discarded.  The element array grows by doubling, so appending
+ *	n elements one at a time takes time proportional to n.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Hax_ListObjAppendElement(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    Hax_Obj *listPtr,		/* List value to modify. */
+    Hax_Obj *objPtr		/* Element to append. */)
+{
+    Hax_Memoryp *memoryp = ((Interp *) interp)->memoryp;
+    Hax_Obj **newObjv;
+    int objc, newAvail;
+
+    if (SetListFromAny(interp, listPtr) != HAX_OK) {
+	return HAX_ERROR;
+    }
+    objc = listPtr->internalRep.list.objc;
+    if (objc >= listPtr->internalRep.list.avail) {
+	newAvail = 2*objc;
+	if (newAvail < 4) {
+	    newAvail = 4;
+	}
+	newObjv = (Hax_Obj **) ckalloc(memoryp,
+		(unsigned) (newAvail * sizeof(Hax_Obj *)));
+	if (objc > 0) {
+	    memcpy(newObjv, listPtr->internalRep.list.objv,
+		    (size_t) (objc * sizeof(Hax_Obj *)));
+	}
+	if (listPtr->internalRep.list.objv != NULL) {
+	    ckfree(memoryp, (char *) listPtr->internalRep.list.objv);
+	}
+	listPtr->internalRep.list.objv = newObjv;
+	listPtr->internalRep.list.avail = newAvail;
+    }
+    listPtr->internalRep.list.objv[objc] = objPtr;
+    listPtr->internalRep.list.objc = objc + 1;
+    Hax_IncrRefCount(objPtr);
+    FreeBytes(interp, listPtr);
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_SetObjResult --
+ *
+ *	Make a value the result of the current command.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Interp->result is set to the value's string form.  The
+ *	interpreter holds a reference to the value until the next call
+ *	to Hax_SetObjResult or until it is deleted, so the string stays
+ *	valid as long as the result does.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Hax_SetObjResult(
+    Hax_Interp *interp,		/* Interpreter whose result is to be set. */
+    Hax_Obj *objPtr		/* New result. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_Obj *oldPtr = iPtr->objResultPtr;
+
+    Hax_IncrRefCount(objPtr);
+    Hax_FreeResult(interp);
+    iPtr->objResultPtr = objPtr;
+    if (oldPtr != NULL) {
+	Hax_DecrRefCount(interp, oldPtr);
+    }
+    iPtr->result = Hax_GetStringFromObj(interp, objPtr, (int *) NULL);
+    iPtr->freeProc = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_GetObjResult --
+ *
+ *	Return the result of the current command as a value.
+ *
+ * Results:
+ *	The return value is the result.  The caller must not modify it,
+ *	and must call Hax_IncrRefCount if it wants to keep it past the
+ *	next change to the result.
+ *
+ * Side effects:
+ *	If the result was set as a string, a value is made from it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_Obj *
+Hax_GetObjResult(
+    Hax_Interp *interp		/* Interpreter whose result is wanted. */)
+{
+    Interp *iPtr = (Interp *) interp;
+
+    if ((iPtr->objResultPtr == NULL)
+	    || (iPtr->result != iPtr->objResultPtr->bytes)) {
+	Hax_SetObjResult(interp, Hax_NewStringObj(interp, iPtr->result, -1));
+    }
+    return iPtr->objResultPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxTakeResultObj --
+ *
+ *	Take the result of the current command as a value, without
+ *	copying it if that can be avoided.
+ *
+ * Results:
+ *	If the result is a value, or is a string of at least
+ *	VALUE_SHARE_SIZE characters in storage that the interpreter
+ *	owns (a dynamic result or the append buffer), the return value
+ *	is a value for it with one reference, which belongs to the
+ *	caller.  Otherwise the return value is NULL and the result is
+ *	left alone.
+ *
+ * Side effects:
+ *	If a value is returned, the result is reset to an empty string.
+ *	The storage for a string result becomes the value's string form.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_Obj *
+HaxTakeResultObj(
+    Interp *iPtr)		/* Interpreter whose result is wanted. */
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+    Hax_Obj *objPtr = iPtr->objResultPtr;
+    int length;
+
+    if ((objPtr != NULL) && (iPtr->result == objPtr->bytes)) {
+	/*
+	 * Hand the interpreter's reference over to the caller.
+	 */
+
+	iPtr->objResultPtr = NULL;
+    } else if (iPtr->result == iPtr->appendResult) {
+	if (iPtr->appendUsed < VALUE_SHARE_SIZE) {
+	    return NULL;
+	}
+	objPtr = AllocObj(interp, (char *) NULL, 0);
+	objPtr->bytes = iPtr->appendResult;
+	objPtr->length = iPtr->appendUsed;
+	iPtr->appendResult = NULL;
+	iPtr->appendAvl = 0;
+	iPtr->appendUsed = 0;
+	Hax_IncrRefCount(objPtr);
+    } else if (iPtr->freeProc == HAX_DYNAMIC) {
+	if (memchr(iPtr->result, 0, VALUE_SHARE_SIZE) != NULL) {
+	    return NULL;
+	}
+	length = strlen(iPtr->result);
+	objPtr = AllocObj(interp, (char *) NULL, 0);
+	objPtr->bytes = iPtr->result;
+	objPtr->length = length;
+	Hax_IncrRefCount(objPtr);
+    } else {
+	return NULL;
+    }
+    iPtr->freeProc = 0;
+    iPtr->result = iPtr->resultSpace;
+    iPtr->resultSpace[0] = 0;
+    return objPtr;
+}
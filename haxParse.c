@@ -99,6 +99,7 @@ char haxTypeTable[] = {
  * Function prototypes for procedures local to this file:
  */
 
+static int	AtWordEnd (char *src, int flags);
 static char *	QuoteEnd (char *string, int term);
 static char *	VarNameEnd (char *string);
 
@@ -329,7 +330,8 @@ HaxParseQuotes(
 	    int result;
 
 	    pvPtr->next = dst;
-	    result = HaxParseNestedCmd(interp, src, flags, termPtr, pvPtr);
+	    result = HaxParseNestedCmd(interp, src, flags, termPtr, pvPtr,
+		    (Hax_Obj **) NULL);
 	    if (result != HAX_OK) {
 		return result;
 	    }
@@ -379,6 +381,12 @@ HaxParseQuotes(
  *	null-terminated, with pvPtr->next pointing to the null
  *	character.
  *
+ *	If objPtrPtr isn't NULL and the result can be taken as a
+ *	value without copying it (see HaxTakeResultObj), then the
+ *	value is stored at *objPtrPtr, with a reference for the
+ *	caller, instead of being copied to *pvPtr.  Otherwise
+ *	*objPtrPtr is set to NULL.
+ *
  * Side effects:
  *	The storage space at *pvPtr may be expanded.
  *
@@ -393,12 +401,17 @@ HaxParseNestedCmd(
     int flags,			/* Flags to pass to nested Hax_Eval. */
     char **termPtr,		/* Store address of terminating character
 				 * here. */
-    ParseValue *pvPtr		/* Information about where to place
-				 * result of command. */)
+    ParseValue *pvPtr,		/* Information about where to place
+				 * result of command. */
+    Hax_Obj **objPtrPtr		/* If not NULL, a long result may be
+				 * returned here instead of in *pvPtr. */)
 {
     int result, length, shortfall;
     Interp *iPtr = (Interp *) interp;
 
+    if (objPtrPtr != NULL) {
+	*objPtrPtr = NULL;
+    }
     result = Hax_Eval(interp, NULL, string, flags | HAX_BRACKET_TERM, termPtr);
     if (result != HAX_OK) {
 	/*
@@ -412,6 +425,12 @@ HaxParseNestedCmd(
 	return result;
     }
     (*termPtr) += 1;
+    if (objPtrPtr != NULL) {
+	*objPtrPtr = HaxTakeResultObj(iPtr);
+	if (*objPtrPtr != NULL) {
+	    return HAX_OK;
+	}
+    }
     length = strlen(iPtr->result);
     shortfall = length + 1 - (pvPtr->end - pvPtr->next);
     if (shortfall > 0) {
@@ -420,6 +439,7 @@ HaxParseNestedCmd(
     strcpy(pvPtr->next, iPtr->result);
     pvPtr->next += length;
     Hax_FreeResult(interp);
+    HaxReleaseObjResult(iPtr);
     iPtr->result = iPtr->resultSpace;
     iPtr->resultSpace[0] = '\0';
     return HAX_OK;
@@ -536,6 +556,40 @@ HaxParseBraces(
     return HAX_OK;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * AtWordEnd --
+ *
+ *	Tell whether a word being parsed by HaxParseWords ends just
+ *	before the given character.
+ *
+ * Results:
+ *	1 if the word ends at src, 0 if more of it follows.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+AtWordEnd(
+    char *src,			/* Character just after some part of a
+				 * word. */
+    int flags)			/* Flags passed to HaxParseWords. */
+{
+    int type = CHAR_TYPE((signed char) *src);
+
+    if (type == HAX_SPACE) {
+	return 1;
+    }
+    if (type == HAX_COMMAND_END) {
+	return (*src != ']') || (flags & HAX_BRACKET_TERM);
+    }
+    return 0;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -564,11 +618,18 @@ HaxParseBraces(
  *
  *	The pointers at *argv are filled in with pointers to the
  *	fully-substituted words, and the actual contents of the
- *	words are copied to the buffer at pvPtr.
+ *	words are copied to the buffer at pvPtr.  If refs isn't
+ *	NULL, a word that consists of nothing but one variable or
+ *	command substitution with a long value isn't copied:
+ *	instead the corresponding entry of refs holds a reference to
+ *	the value, and the argv entry points to its string form,
+ *	which stays valid until the caller releases the reference.
+ *	The refs entries for all other words are NULL.
  *
  *	If an error occurrs then an error message is left in
  *	interp->result and the information at *argv, *argcPtr,
- *	and *pvPtr may be incomplete.
+ *	and *pvPtr may be incomplete;  any references taken by
+ *	this call have been released again.
  *
  * Side effects:
  *	The buffer space in pvPtr may be enlarged by calling its
@@ -590,15 +651,23 @@ HaxParseWords(
     int *argcPtr,		/* Filled in with actual number of words
 				 * parsed. */
     char **argv,		/* Store addresses of individual words here. */
+    Hax_Obj **refs,		/* If not NULL, store references to words
+				 * passed by reference here (see above). */
     ParseValue *pvPtr		/* Information about where to place
 				 * fully-substituted word. */)
 {
     char *src, *dst;
     char c;
-    int type, result, argc;
+    int type, result, argc, i;
     char *oldBuffer;		/* Used to detect when pvPtr's buffer gets
 				 * reallocated, so we can adjust all of the
 				 * argv pointers. */
+    char *wordStart;		/* First character of the current word,
+				 * used to recognize a word that is a
+				 * single substitution. */
+    Hax_Obj *objPtr;
+    Hax_Obj *wordRef = NULL;	/* Value for the current word, if it is
+				 * being passed by reference. */
 
     src = string;
     oldBuffer = pvPtr->buffer;
@@ -618,6 +687,7 @@ HaxParseWords(
 	    c = *src;
 	    type = CHAR_TYPE(c);
 	}
+	wordStart = src;
 
 	/*
 	 * Handle the normal case (i.e. no leading double-quote or brace).
@@ -648,11 +718,20 @@ HaxParseWords(
 		    int length;
 		    char *value;
 
-		    value = Hax_ParseVar(interp, src, termPtr);
+		    objPtr = NULL;
+		    value = HaxParseVarObj(interp, src, termPtr,
+			    ((refs != NULL) && (src == wordStart))
+			    ? &objPtr : (Hax_Obj **) NULL);
 		    if (value == NULL) {
-			return HAX_ERROR;
+			result = HAX_ERROR;
+			goto error;
 		    }
 		    src = *termPtr;
+		    if ((objPtr != NULL) && AtWordEnd(src, flags)) {
+			Hax_IncrRefCount(objPtr);
+			wordRef = objPtr;
+			goto wordEnd;
+		    }
 		    length = strlen(value);
 		    if ((pvPtr->end - dst) <= length) {
 			pvPtr->next = dst;
@@ -675,13 +754,35 @@ HaxParseWords(
 		    goto wordEnd;
 		} else if (type == HAX_OPEN_BRACKET) {
 		    pvPtr->next = dst;
+		    objPtr = NULL;
 		    result = HaxParseNestedCmd(interp, src+1, flags, termPtr,
-			    pvPtr);
+			    pvPtr, ((refs != NULL) && (src == wordStart))
+			    ? &objPtr : (Hax_Obj **) NULL);
 		    if (result != HAX_OK) {
-			return result;
+			goto error;
 		    }
 		    src = *termPtr;
-		    dst = pvPtr->next;
+		    if (objPtr == NULL) {
+			dst = pvPtr->next;
+		    } else if (AtWordEnd(src, flags)) {
+			wordRef = objPtr;
+			goto wordEnd;
+		    } else {
+
+			/*
+			 * More of the word follows, so the result has to
+			 * be copied after all.
+			 */
+
+			if ((pvPtr->end - dst) <= objPtr->length) {
+			    (*pvPtr->expandProc)(interp, pvPtr,
+				    objPtr->length);
+			    dst = pvPtr->next;
+			}
+			memcpy(dst, objPtr->bytes, (size_t) objPtr->length);
+			dst += objPtr->length;
+			Hax_DecrRefCount(interp, objPtr);
+		    }
 		} else if (type == HAX_BACKSLASH) {
 		    int numRead;
 
@@ -707,7 +808,8 @@ HaxParseWords(
 		    if (c == '\0') {
 			Hax_SetResult(interp, (char *) "missing close-bracket",
 				HAX_STATIC);
-			return HAX_ERROR;
+			result = HAX_ERROR;
+			goto error;
 		    }
 		} else {
 		    if (c == ']') {
@@ -735,7 +837,7 @@ HaxParseWords(
 		goto normalArg;
 	    }
 	    if (result != HAX_OK) {
-		return result;
+		goto error;
 	    }
 
 	    /*
@@ -759,7 +861,8 @@ HaxParseWords(
 			    (char *) "extra characters after close-brace",
 			    HAX_STATIC);
 		}
-		return HAX_ERROR;
+		result = HAX_ERROR;
+		goto error;
 	    }
 	    src = *termPtr;
 	    dst = pvPtr->next;
@@ -767,19 +870,29 @@ HaxParseWords(
 	}
 
 	/*
-	 * We're at the end of a word, so add a null terminator.  Then
-	 * see if the buffer was re-allocated during this word.  If so,
-	 * update all of the argv pointers.
+	 * We're at the end of a word, so add a null terminator (unless
+	 * the word was passed by reference).  Then see if the buffer
+	 * was re-allocated during this word.  If so, update all of the
+	 * argv pointers that refer to it.
 	 */
 
 	wordEnd:
-	*dst = '\0';
-	dst++;
+	if (wordRef != NULL) {
+	    argv[argc] = wordRef->bytes;
+	    refs[argc] = wordRef;
+	    wordRef = NULL;
+	} else {
+	    *dst = '\0';
+	    dst++;
+	    if (refs != NULL) {
+		refs[argc] = NULL;
+	    }
+	}
 	if (oldBuffer != pvPtr->buffer) {
-	    int i;
-
 	    for (i = 0; i <= argc; i++) {
-		argv[i] = pvPtr->buffer + (argv[i] - oldBuffer);
+		if ((refs == NULL) || (refs[i] == NULL)) {
+		    argv[i] = pvPtr->buffer + (argv[i] - oldBuffer);
+		}
 	    }
 	    oldBuffer = pvPtr->buffer;
 	}
@@ -790,6 +903,15 @@ HaxParseWords(
     *termPtr = src;
     *argcPtr = argc;
     return HAX_OK;
+
+    error:
+    for (i = 0; (refs != NULL) && (i < argc); i++) {
+	if (refs[i] != NULL) {
+	    Hax_DecrRefCount(interp, refs[i]);
+	    refs[i] = NULL;
+	}
+    }
+    return result;
 }
 
 /*
@@ -857,6 +979,68 @@ HaxExpandParseValue(
     pvPtr->clientData = (ClientData) 1;
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * HaxExpandScratchParseValue --
+ *
+ *	Like HaxExpandParseValue, except that the new space comes
+ *	from the interpreter's scratch space (see HaxScratchAlloc),
+ *	so it must only be used for buffers that aren't needed once
+ *	the current command is finished.  A buffer that is still on
+ *	top of the scratch space is grown in place when possible.
+ *
+ * Results:
+ *	The buffer space in *pvPtr is reallocated to something
+ *	larger.  The old buffer is never freed:  if pvPtr->clientData
+ *	is zero it belongs to the caller, otherwise it is scratch
+ *	space.  Information is copied from the old buffer to the
+ *	new one.
+ *
+ * Side effects:
+ *	Scratch space is allocated.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+HaxExpandScratchParseValue(
+    Hax_Interp *interp,
+    ParseValue *pvPtr,			/* Information about buffer that
+					 * must be expanded.  If the clientData
+					 * in the structure is non-zero, it
+					 * means that the current buffer is
+					 * in the scratch space. */
+    int needed				/* Minimum amount of additional space
+					 * to allocate. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    int newSpace;
+    char *newBuf;
+
+    newSpace = (pvPtr->end - pvPtr->buffer) + 1;
+    if (newSpace < needed) {
+	newSpace += needed;
+    } else {
+	newSpace += newSpace;
+    }
+    newSpace = (newSpace + sizeof(double) - 1) & ~(sizeof(double) - 1);
+
+    if ((pvPtr->clientData != 0) && (pvPtr->end + 1 == iPtr->scratchTop)
+	    && (newSpace <= iPtr->scratchPtr->end - pvPtr->buffer)) {
+	iPtr->scratchTop = pvPtr->buffer + newSpace;
+	pvPtr->end = pvPtr->buffer + newSpace - 1;
+	return;
+    }
+
+    newBuf = HaxScratchAlloc(iPtr, newSpace);
+    memcpy(newBuf, pvPtr->buffer, pvPtr->next - pvPtr->buffer);
+    pvPtr->next = newBuf + (pvPtr->next - pvPtr->buffer);
+    pvPtr->buffer = newBuf;
+    pvPtr->end = newBuf + newSpace - 1;
+    pvPtr->clientData = (ClientData) 1;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1106,6 +1290,40 @@ Hax_ParseVar(
     char **termPtr			/* If non-NULL, points to word to fill
 					 * in with character just after last
 					 * one in the variable specifier. */)
+{
+    return HaxParseVarObj(interp, string, termPtr, (Hax_Obj **) NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxParseVarObj --
+ *
+ *	Like Hax_ParseVar, but also return the variable's value as a
+ *	Hax_Obj if it has one.
+ *
+ * Results:
+ *	The same as for Hax_ParseVar.  If objPtrPtr isn't NULL then
+ *	*objPtrPtr is set as by HaxGetVarObj, or to NULL if there is
+ *	no such value.
+ *
+ * Side effects:
+ *	The same as for HaxGetVarObj.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxParseVarObj(
+    Hax_Interp *interp,			/* Context for looking up variable. */
+    char *string,		/* String containing variable name.
+					 * First character must be "$". */
+    char **termPtr,			/* If non-NULL, points to word to fill
+					 * in with character just after last
+					 * one in the variable specifier. */
+    Hax_Obj **objPtrPtr			/* If non-NULL, filled in with the
+					 * value holding the variable's
+					 * string, if there is one. */)
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
@@ -1137,6 +1355,9 @@ Hax_ParseVar(
      */
 
     name2 = NULL;
+    if (objPtrPtr != NULL) {
+	*objPtrPtr = NULL;
+    }
     string++;
     if (*string == '{') {
 	string++;
@@ -1210,7 +1431,12 @@ Hax_ParseVar(
     }
     c = *name1End;
     *name1End = 0;
-    result = Hax_GetVar2(interp, name1, name2, HAX_LEAVE_ERR_MSG);
+    if (objPtrPtr != NULL) {
+	result = HaxGetVarObj(interp, name1, name2, HAX_LEAVE_ERR_MSG,
+		objPtrPtr);
+    } else {
+	result = Hax_GetVar2(interp, name1, name2, HAX_LEAVE_ERR_MSG);
+    }
     *name1End = c;
 
     done:
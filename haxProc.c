@@ -2,7 +2,7 @@
  * haxProc.c --
  *
  *	This file contains routines that implement Hax procedures,
- *	including the "proc" and "uplevel" commands.
+ *	including the "proc", "uplevel" and "tailcall" commands.
  *
  * Copyright 1987-1991 Regents of the University of California
  * Permission to use, copy, modify, and distribute this
@@ -24,9 +24,35 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclProc.c,v 1.60 92/09/14
  * Forward references to procedures defined later in this file:
  */
 
+static  int	InterpObjProc (ClientData clientData,
+		    Hax_Interp *interp, int objc, Hax_Obj **objv);
 static  int	InterpProc (ClientData clientData,
 		    Hax_Interp *interp, int argc, char **argv);
+static  int	ProcAddLocal (Interp *iPtr, Proc *procPtr, char *name,
+		    int length);
 static  void	ProcDeleteProc (Hax_Interp *interp, ClientData clientData);
+static  int	ProcDone (Hax_Interp *interp, ClientData data[],
+		    int result);
+static  void	ProcFindLocals (Interp *iPtr, Proc *procPtr);
+static  void	ProcRelease (Interp *iPtr, Proc *procPtr);
+static  int	ProcNRCmd (ClientData clientData, Hax_Interp *interp,
+		    int argc, char **argv, Hax_Obj **objv);
+static  int	Tailcall (Interp *iPtr, char **words);
+static  int	TailcallDone (Hax_Interp *interp, ClientData data[],
+		    int result);
+static  char **	TailcallWords (Interp *iPtr, char *prefix, int argc,
+		    char **argv);
+static  int	UplevelDone (Hax_Interp *interp, ClientData data[],
+		    int result);
+
+/*
+ * Procedures get a slot for each argument and for each variable whose
+ * name appears in their body (see ProcFindLocals), up to the limit
+ * below.  The slots follow the call frame in scratch space.
+ */
+
+#define MAX_BODY_LOCALS		100
+#define MAX_LOCAL_NAME		100
 
 /*
  *----------------------------------------------------------------------
@@ -56,6 +82,7 @@ Hax_ProcCmd(
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
     Proc *procPtr;
+    Command *cmdPtr;
     int result, argCount, i;
     char **argArray = NULL;
     Arg *lastArgPtr;
@@ -74,6 +101,12 @@ Hax_ProcCmd(
 	(char *) ckalloc(memoryp, (unsigned) strlen(argv[3]) + 1);
     strcpy(procPtr->command, argv[3]);
     procPtr->argPtr = NULL;
+    procPtr->compiledPtr = NULL;
+    procPtr->noCompile = 0;
+    procPtr->refCount = 1;
+    procPtr->localNames = NULL;
+    procPtr->numLocals = 0;
+    procPtr->scriptTablePtr = NULL;
 
     /*
      * Break up the argument list into argument specifiers, then process
@@ -139,8 +172,14 @@ Hax_ProcCmd(
 	ckfree(memoryp, (char *) fieldValues);
     }
 
+    ProcFindLocals(iPtr, procPtr);
     Hax_CreateCommand(interp, argv[1], InterpProc, (ClientData) procPtr,
 	    ProcDeleteProc);
+    cmdPtr = (Command *) Hax_GetHashValue(Hax_FindHashEntry(
+	    &iPtr->commandTable, argv[1]));
+    cmdPtr->objProc = InterpObjProc;
+    cmdPtr->objClientData = (ClientData) procPtr;
+    cmdPtr->nrProc = ProcNRCmd;
     ckfree(memoryp, (char *) argArray);
     return HAX_OK;
 
@@ -249,13 +288,16 @@ HaxGetFrame(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_UplevelCmd --
+ * Hax_UplevelCmd, Hax_UplevelNRCmd --
  *
- *	This procedure is invoked to process the "uplevel" Hax command.
- *	See the user documentation for details on what it does.
+ *	These procedures are invoked to process the "uplevel" Hax
+ *	command.  See the user documentation for details on what it does.
+ *	Hax_UplevelNRCmd schedules the command, followed by a call to
+ *	UplevelDone to restore the variable frame.
  *
  * Results:
- *	A standard Hax result value.
+ *	A standard Hax result value, or HAX_NR_PENDING from
+ *	Hax_UplevelNRCmd.
  *
  * Side effects:
  *	See the user documentation.
@@ -263,18 +305,30 @@ HaxGetFrame(
  *----------------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 int
 Hax_UplevelCmd(
     ClientData dummy,			/* Not used. */
     Hax_Interp *interp,			/* Current interpreter. */
     int argc,				/* Number of arguments. */
     char **argv				/* Argument strings. */)
+{
+    return HaxNRCallCommand(interp, Hax_UplevelNRCmd, dummy, argc, argv,
+	    (Hax_Obj **) NULL);
+}
+
+	/* ARGSUSED */
+int
+Hax_UplevelNRCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv,			/* Argument strings. */
+    Hax_Obj **objv			/* Not used. */)
 {
     Interp *iPtr = (Interp *) interp;
-    Hax_Memoryp *memoryp = iPtr->memoryp;
     int result;
-    CallFrame *savedVarFramePtr, *framePtr;
+    char *cmd, *toFree;
+    CallFrame *framePtr;
 
     if (argc < 2) {
 	uplevelSyntax:
@@ -298,39 +352,230 @@ Hax_UplevelCmd(
     argv += (result+1);
 
     /*
-     * Modify the interpreter state to execute in the given frame.
-     */
-
-    savedVarFramePtr = iPtr->varFramePtr;
-    iPtr->varFramePtr = framePtr;
-
-    /*
-     * Execute the residual arguments as a command.
+     * Modify the interpreter state to execute in the given frame, then
+     * execute the residual arguments as a command.  UplevelDone
+     * restores the frame.
      */
 
     if (argc == 1) {
-	result = Hax_Eval(interp, NULL, argv[0], 0, (char **) NULL);
+	cmd = argv[0];
+	toFree = NULL;
     } else {
-	char *cmd;
-
 	cmd = Hax_Concat(interp, argc, argv);
-	result = Hax_Eval(interp, NULL, cmd, 0, (char **) NULL);
-	ckfree(memoryp, cmd);
+	toFree = cmd;
+    }
+    HaxNRAddCallback(interp, UplevelDone, 0,
+	    (ClientData) iPtr->varFramePtr, (ClientData) toFree,
+	    (ClientData) NULL, (ClientData) NULL);
+    iPtr->varFramePtr = framePtr;
+    return HaxNREvalDynamic(interp, cmd);
+}
+
+static int
+UplevelDone(
+    Hax_Interp *interp,		/* Current interpreter. */
+    ClientData data[],		/* Data[0] is the variable frame to
+				 * restore, data[1] the command to free
+				 * or NULL. */
+    int result)			/* Result of the command. */
+{
+    Interp *iPtr = (Interp *) interp;
+
+    if (data[1] != NULL) {
+	ckfree(iPtr->memoryp, (char *) data[1]);
     }
     if (result == HAX_ERROR) {
 	char msg[60];
 	sprintf(msg, "\n    (\"uplevel\" body line %d)", interp->errorLine);
 	Hax_AddErrorInfo(interp, msg);
     }
+    iPtr->varFramePtr = (CallFrame *) data[0];
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_TailcallCmd --
+ *
+ *	This procedure is invoked to process the "tailcall" Hax command.
+ *	See the user documentation for details on what it does.
+ *
+ * Results:
+ *	HAX_RETURN, so that the rest of the procedure's body is skipped,
+ *	or HAX_ERROR.
+ *
+ * Side effects:
+ *	A copy of the command's words is saved in the procedure's call
+ *	frame.  ProcDone runs the command once the frame is gone.
+ *
+ *----------------------------------------------------------------------
+ */
+
+	/* ARGSUSED */
+int
+Hax_TailcallCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int argc,				/* Number of arguments. */
+    char **argv				/* Argument strings. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    CallFrame *framePtr = iPtr->framePtr;
+
+    if (argc < 2) {
+	Hax_AppendResult(interp, "wrong # args: should be \"", argv[0],
+		" command ?arg ...?\"", (char *) NULL);
+	return HAX_ERROR;
+    }
+    if ((framePtr == NULL) || (iPtr->varFramePtr != framePtr)) {
+	iPtr->result =
+		(char *) "\"tailcall\" can only be invoked from a procedure";
+	return HAX_ERROR;
+    }
+    if (framePtr->tailcall != NULL) {
+	ckfree(iPtr->memoryp, (char *) framePtr->tailcall);
+    }
+    framePtr->tailcall = TailcallWords(iPtr, (char *) NULL, argc-1, argv+1);
+    return HAX_RETURN;
+}
 
-    /*
-     * Restore the variable frame, and return.
-     */
+/*
+ *----------------------------------------------------------------------
+ *
+ * Tailcall --
+ *
+ *	Invoke the command saved by "tailcall", once the procedure that
+ *	saved it has returned and its call frame has been given back.
+ *	A Hax procedure is called with ProcNRCmd, and its new frame takes
+ *	over the words, so a chain of tail calls uses a constant amount
+ *	of C stack, scratch space and levels.
+ *
+ * Results:
+ *	A standard Hax result, or HAX_NR_PENDING if the command has
+ *	scheduled more work.
+ *
+ * Side effects:
+ *	Depends on the command.  Words is freed, now or once the command
+ *	is done.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+Tailcall(
+    Interp *iPtr,		/* Interpreter in which to invoke. */
+    char **words)		/* Words of the command, made by
+				 * TailcallWords. */
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+    Hax_HashEntry *hPtr;
+    Command *cmdPtr;
+    char **newWords;
+    int argc, result;
+
+    for (argc = 0; words[argc] != NULL; argc++) {
+	/* Empty loop body. */
+    }
+    hPtr = Hax_FindHashEntry(&iPtr->commandTable, words[0]);
+    if (hPtr == NULL) {
+	hPtr = Hax_FindHashEntry(&iPtr->commandTable, (char *) "unknown");
+	if (hPtr == NULL) {
+	    Hax_AppendResult(interp, "invalid command name: \"",
+		    words[0], "\"", (char *) NULL);
+	    ckfree(iPtr->memoryp, (char *) words);
+	    return HAX_ERROR;
+	}
+	newWords = TailcallWords(iPtr, (char *) "unknown", argc, words);
+	ckfree(iPtr->memoryp, (char *) words);
+	words = newWords;
+	argc++;
+    }
+    cmdPtr = (Command *) Hax_GetHashValue(hPtr);
+    iPtr->cmdCount++;
+    Hax_ResetResult(interp);
+    if (cmdPtr->nrProc == ProcNRCmd) {
+	result = ProcNRCmd(cmdPtr->objClientData, interp, argc, words,
+		(Hax_Obj **) NULL);
+	if (result == HAX_NR_PENDING) {
+	    iPtr->framePtr->ownArgv = 1;
+	} else {
+	    ckfree(iPtr->memoryp, (char *) words);
+	}
+	return result;
+    }
+    HaxNRAddCallback(interp, TailcallDone, 0, (ClientData) words,
+	    (ClientData) NULL, (ClientData) NULL, (ClientData) NULL);
+    if ((cmdPtr->nrProc != NULL) && (cmdPtr->proc != HaxInvokeObjCommand)) {
+	return (*cmdPtr->nrProc)(cmdPtr->objClientData, interp, argc, words,
+		(Hax_Obj **) NULL);
+    }
+    return (*cmdPtr->proc)(cmdPtr->clientData, interp, argc, words);
+}
 
-    iPtr->varFramePtr = savedVarFramePtr;
+static int
+TailcallDone(
+    Hax_Interp *interp,		/* Current interpreter. */
+    ClientData data[],		/* Data[0] is the words to free. */
+    int result)			/* Result of the command. */
+{
+    ckfree(((Interp *) interp)->memoryp, (char *) data[0]);
     return result;
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TailcallWords --
+ *
+ *	Copy the words of a command into a single block of memory, so
+ *	that they outlive the variables and stack they came from.
+ *
+ * Results:
+ *	A NULL-terminated array of words, followed by their text.  The
+ *	caller frees it with ckfree.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char **
+TailcallWords(
+    Interp *iPtr,		/* Interpreter whose memory is used. */
+    char *prefix,		/* Extra word to put first, or NULL. */
+    int argc,			/* Number of words in argv. */
+    char **argv)		/* Words to copy. */
+{
+    char **words;
+    char *dst;
+    int bytes, i, n;
+
+    n = (prefix != NULL) ? 1 : 0;
+    bytes = (argc + n + 1) * sizeof(char *);
+    if (prefix != NULL) {
+	bytes += strlen(prefix) + 1;
+    }
+    for (i = 0; i < argc; i++) {
+	bytes += strlen(argv[i]) + 1;
+    }
+    words = (char **) ckalloc(iPtr->memoryp, (unsigned) bytes);
+    dst = (char *) (words + argc + n + 1);
+    if (prefix != NULL) {
+	words[0] = dst;
+	strcpy(dst, prefix);
+	dst += strlen(dst) + 1;
+    }
+    for (i = 0; i < argc; i++) {
+	words[i + n] = dst;
+	strcpy(dst, argv[i]);
+	dst += strlen(dst) + 1;
+    }
+    words[argc + n] = NULL;
+    return words;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -400,10 +645,14 @@ HaxIsProc(
 /*
  *----------------------------------------------------------------------
  *
- * InterpProc --
+ * InterpProc, InterpObjProc --
  *
- *	When a Hax procedure gets invoked, this routine gets invoked
- *	to interpret the procedure.
+ *	When a Hax procedure gets invoked, one of these routines gets
+ *	invoked to interpret the procedure.  InterpObjProc is used by
+ *	compiled scripts when some of the arguments are values held by
+ *	reference:  the procedure's local variables then share those
+ *	values instead of copying them.  Both run the procedure with
+ *	ProcNRCmd.
  *
  * Results:
  *	A standard Hax result value, usually HAX_OK.
@@ -423,37 +672,123 @@ InterpProc(
     int argc,			/* Count of number of arguments to this
 				 * procedure. */
     char **argv			/* Argument values. */)
+{
+    return HaxNRCallCommand(interp, ProcNRCmd, clientData, argc, argv,
+	    (Hax_Obj **) NULL);
+}
+
+static int
+InterpObjProc(
+    ClientData clientData,	/* Record describing procedure to be
+				 * interpreted. */
+    Hax_Interp *interp,		/* Interpreter in which procedure was
+				 * invoked. */
+    int objc,			/* Count of number of arguments to this
+				 * procedure. */
+    Hax_Obj **objv		/* Argument values. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    ScratchMark mark;
+    char **argv;
+    int result, i;
+
+    HaxScratchMark(iPtr, &mark);
+    argv = (char **) HaxScratchAlloc(iPtr,
+	    (int) ((objc + 1) * sizeof(char *)));
+    for (i = 0; i < objc; i++) {
+	argv[i] = Hax_GetStringFromObj(interp, objv[i], (int *) NULL);
+    }
+    argv[objc] = NULL;
+    result = HaxNRCallCommand(interp, ProcNRCmd, clientData, objc, argv,
+	    objv);
+    HaxScratchRelease(iPtr, &mark);
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcNRCmd --
+ *
+ *	Bind the arguments of a call to a Hax procedure to its local
+ *	variables and schedule its body, followed by a call to ProcDone.
+ *	Compiled scripts call this directly, so calling a procedure
+ *	doesn't use any C stack.
+ *
+ * Results:
+ *	HAX_NR_PENDING, or HAX_ERROR if the arguments don't match the
+ *	procedure's parameters.
+ *
+ * Side effects:
+ *	A call frame is pushed;  it lives in scratch space, which the
+ *	caller keeps until the procedure returns.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcNRCmd(
+    ClientData clientData,	/* Record describing procedure to be
+				 * interpreted. */
+    Hax_Interp *interp,		/* Interpreter in which procedure was
+				 * invoked. */
+    int argc,			/* Count of number of arguments to this
+				 * procedure. */
+    char **argv,		/* Argument values. */
+    Hax_Obj **objv		/* If not NULL, the argument values again,
+				 * as values for the local variables to
+				 * share. */)
 {
     Proc *procPtr = (Proc *) clientData;
     Arg *argPtr;
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
     char **args;
-    CallFrame frame;
-    char *value, *end;
-    int result;
+    CallFrame *framePtr;
+    ScratchMark mark;
+    char *value;
+    int frameBytes, i;
 
     /*
-     * Set up a call frame for the new procedure invocation.
+     * Set up a call frame for the new procedure invocation.  The
+     * procedure is preserved until the call completes, since the
+     * frame refers to its table of local variables.
      */
 
     iPtr = procPtr->iPtr;
-    Hax_InitHashTable(&frame.varTable, HAX_STRING_KEYS);
+    procPtr->refCount++;
+    frameBytes = sizeof(CallFrame)
+	    + procPtr->numLocals * sizeof(Hax_HashEntry);
+    HaxScratchMark(iPtr, &mark);
+    framePtr = (CallFrame *) HaxScratchAlloc(iPtr, frameBytes);
+    framePtr->mark = mark;
+    framePtr->tailcall = NULL;
+    framePtr->ownArgv = 0;
+    framePtr->procPtr = procPtr;
+    framePtr->varTablePtr = NULL;
+    framePtr->slots = (Hax_HashEntry *) (framePtr + 1);
+    for (i = 0; i < procPtr->numLocals; i++) {
+	framePtr->slots[i].nextPtr = NULL;
+	framePtr->slots[i].tablePtr = NULL;
+	framePtr->slots[i].bucketPtr = NULL;
+	framePtr->slots[i].clientData = NULL;
+    }
     if (iPtr->varFramePtr != NULL) {
-	frame.level = iPtr->varFramePtr->level + 1;
+	framePtr->level = iPtr->varFramePtr->level + 1;
     } else {
-	frame.level = 1;
+	framePtr->level = 1;
     }
-    frame.argc = argc;
-    frame.argv = argv;
-    frame.callerPtr = iPtr->framePtr;
-    frame.callerVarPtr = iPtr->varFramePtr;
-    iPtr->framePtr = &frame;
-    iPtr->varFramePtr = &frame;
+    framePtr->argc = argc;
+    framePtr->argv = argv;
+    framePtr->callerPtr = iPtr->framePtr;
+    framePtr->callerVarPtr = iPtr->varFramePtr;
+    iPtr->framePtr = framePtr;
+    iPtr->varFramePtr = framePtr;
 
     /*
      * Match the actual arguments against the procedure's formal
-     * parameters to compute local variables.
+     * parameters to compute local variables.  Each argument has its
+     * own slot, so there's no need to look up its name.
      */
 
     for (argPtr = procPtr->argPtr, args = argv+1, argc -= 1;
@@ -472,35 +807,94 @@ InterpProc(
 		argc = 0;
 	    }
 	    value = Hax_Merge(interp, argc, args);
-	    Hax_SetVar(interp, argPtr->name, value, 0);
+	    HaxSetSlotVar(iPtr, &framePtr->slots[argPtr->slot], value,
+		    (Hax_Obj *) NULL);
 	    ckfree(memoryp, value);
 	    argc = 0;
 	    break;
 	} else if (argc > 0) {
-	    value = *args;
+	    HaxSetSlotVar(iPtr, &framePtr->slots[argPtr->slot], *args,
+		    (objv != NULL) ? objv[args - argv] : (Hax_Obj *) NULL);
+	    continue;
 	} else if (argPtr->defValue != NULL) {
 	    value = argPtr->defValue;
 	} else {
 	    Hax_AppendResult(interp, "no value given for parameter \"",
 		    argPtr->name, "\" to \"", argv[0], "\"",
 		    (char *) NULL);
-	    result = HAX_ERROR;
-	    goto procDone;
+	    goto argError;
 	}
-	Hax_SetVar(interp, argPtr->name, value, 0);
+	HaxSetSlotVar(iPtr, &framePtr->slots[argPtr->slot], value,
+		(Hax_Obj *) NULL);
     }
     if (argc > 0) {
 	Hax_AppendResult(interp, "called \"", argv[0],
 		"\" with too many arguments", (char *) NULL);
-	result = HAX_ERROR;
-	goto procDone;
+	goto argError;
     }
 
     /*
-     * Invoke the commands in the procedure's body.
+     * Schedule the commands in the procedure's body.  The body is
+     * compiled the first time the procedure is called;  after that the
+     * compiled form is reused, so the text never has to be parsed again.
+     * The compiled form is discarded along with the procedure, so
+     * redefining the procedure invalidates it.  Bodies that can't be
+     * compiled are evaluated the old way.
      */
 
-    result = Hax_Eval(interp, NULL, procPtr->command, 0, &end);
+    if ((procPtr->compiledPtr == NULL) && !procPtr->noCompile) {
+	procPtr->compiledPtr = HaxCompileScript(interp, procPtr->command,
+		procPtr);
+	if (procPtr->compiledPtr == NULL) {
+	    procPtr->noCompile = 1;
+	}
+    }
+    HaxNRAddCallback(interp, ProcDone, frameBytes, (ClientData) procPtr,
+	    (ClientData) framePtr, (ClientData) NULL, (ClientData) NULL);
+    return HaxNREvalScript(interp, procPtr->compiledPtr, procPtr->command);
+
+    argError:
+    iPtr->framePtr = framePtr->callerPtr;
+    iPtr->varFramePtr = framePtr->callerVarPtr;
+    HaxDeleteFrameVars(iPtr, framePtr);
+    ProcRelease(iPtr, procPtr);
+    return HAX_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcDone --
+ *
+ *	Callback that finishes a call to a Hax procedure once its body
+ *	has run.  Data[0] is the procedure and data[1] its call frame.
+ *
+ * Results:
+ *	The procedure's result:  a standard Hax result value, usually
+ *	HAX_OK.  If the body invoked "tailcall" and returned normally,
+ *	the result of the saved command instead, or HAX_NR_PENDING.
+ *
+ * Side effects:
+ *	The call frame is removed and its variables deleted.  After a
+ *	"tailcall" the frame's scratch space is given back before the
+ *	saved command is invoked.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcDone(
+    Hax_Interp *interp,		/* Interpreter in which procedure was
+				 * invoked. */
+    ClientData data[],		/* See above. */
+    int result)			/* Result of the procedure's body. */
+{
+    Interp *iPtr = (Interp *) interp;
+    Proc *procPtr = (Proc *) data[0];
+    CallFrame *framePtr = (CallFrame *) data[1];
+    ScratchMark mark;
+    char **words;
+
     if (result == HAX_RETURN) {
 	result = HAX_OK;
     } else if (result == HAX_ERROR) {
@@ -510,8 +904,8 @@ InterpProc(
 	 * Record information telling where the error occurred.
 	 */
 
-	sprintf(msg, "\n    (procedure \"%.50s\" line %d)", argv[0],
-		iPtr->errorLine);
+	sprintf(msg, "\n    (procedure \"%.50s\" line %d)",
+		framePtr->argv[0], iPtr->errorLine);
 	Hax_AddErrorInfo(interp, msg);
     } else if (result == HAX_BREAK) {
 	iPtr->result = (char *) "invoked \"break\" outside of a loop";
@@ -528,13 +922,26 @@ InterpProc(
      * deletion don't see the partially-deleted frame).
      */
 
-    procDone:
-    iPtr->framePtr = frame.callerPtr;
-    iPtr->varFramePtr = frame.callerVarPtr;
-    HaxDeleteVars(iPtr, &frame.varTable);
-    return result;
+    iPtr->framePtr = framePtr->callerPtr;
+    iPtr->varFramePtr = framePtr->callerVarPtr;
+    HaxDeleteFrameVars(iPtr, framePtr);
+    ProcRelease(iPtr, procPtr);
+    if (framePtr->ownArgv) {
+	ckfree(iPtr->memoryp, (char *) framePtr->argv);
+    }
+    words = framePtr->tailcall;
+    if (words == NULL) {
+	return result;
+    }
+    if (result != HAX_OK) {
+	ckfree(iPtr->memoryp, (char *) words);
+	return result;
+    }
+    mark = framePtr->mark;
+    HaxScratchRelease(iPtr, &mark);
+    return Tailcall(iPtr, words);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
@@ -558,17 +965,203 @@ ProcDeleteProc(
     Hax_Interp *interp,
     ClientData clientData		/* Procedure to be deleted. */)
 {
-    Interp *iPtr = (Interp *) interp;
+    ProcRelease((Interp *) interp, (Proc *) clientData);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcRelease --
+ *
+ *	Release a reference to a procedure, freeing it once it is no
+ *	longer a command and no invocations of it are active.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory may get freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcRelease(
+    Interp *iPtr,
+    Proc *procPtr			/* Procedure to release. */)
+{
     Hax_Memoryp *memoryp = iPtr->memoryp;
-    Proc *procPtr = (Proc *) clientData;
     Arg *argPtr;
 
+    procPtr->refCount--;
+    if (procPtr->refCount > 0) {
+	return;
+    }
     ckfree(memoryp, (char *) procPtr->command);
+    if (procPtr->compiledPtr != NULL) {
+	HaxScriptForgetProc(procPtr->compiledPtr);
+	HaxReleaseCompiled((Hax_Interp *) iPtr, procPtr->compiledPtr);
+    }
+    HaxDeleteProcScripts(iPtr, procPtr);
     for (argPtr = procPtr->argPtr; argPtr != NULL; ) {
 	Arg *nextPtr = argPtr->nextPtr;
 
 	ckfree(memoryp, (char *) argPtr);
 	argPtr = nextPtr;
     }
+    Hax_DeleteHashTable((Hax_Interp *) iPtr, &procPtr->localTable);
+    if (procPtr->localNames != NULL) {
+	ckfree(memoryp, (char *) procPtr->localNames);
+    }
     ckfree(memoryp, (char *) procPtr);
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcFindLocals --
+ *
+ *	Assign slots to a procedure's statically visible local
+ *	variables:  first its arguments, then any variable whose name
+ *	appears literally in its body after a "$" or as the first
+ *	argument of "set", "incr", "append", "lappend" or "foreach".
+ *	The body isn't parsed, so some of these names may not be
+ *	variables at all;  that does no harm, except for the space
+ *	taken by the slot.  Variables whose names are only known at
+ *	run time go in each frame's hash table instead.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Fills in the localTable, localNames and numLocals fields of
+ *	procPtr, and the slot fields of its arguments.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ProcFindLocals(
+    Interp *iPtr,
+    Proc *procPtr			/* Procedure whose locals are to be
+					 * found. */)
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    static const char *setCmds[] = {"set", "incr", "append", "lappend",
+	    "foreach", NULL};
+    Hax_HashSearch search;
+    Hax_HashEntry *hPtr;
+    Arg *argPtr;
+    char *p, *start, *end;
+    const char **cmdPtr;
+    int length;
+
+    Hax_InitHashTable(&procPtr->localTable, HAX_OPEN_STRING_KEYS);
+    for (argPtr = procPtr->argPtr; argPtr != NULL; argPtr = argPtr->nextPtr) {
+	argPtr->slot = ProcAddLocal(iPtr, procPtr, argPtr->name,
+		strlen(argPtr->name));
+    }
+
+    for (p = procPtr->command; *p != 0; p++) {
+	if (procPtr->numLocals >= MAX_BODY_LOCALS) {
+	    break;
+	}
+	start = end = NULL;
+	if (*p == '$') {
+	    if (p[1] == '{') {
+		start = p+2;
+		end = strchr(start, '}');
+	    } else {
+		start = p+1;
+		for (end = start; isalnum(*end) || (*end == '_'); end++) {
+		    /* Empty loop body. */
+		}
+	    }
+	} else if ((p == procPtr->command) || isspace(p[-1])
+		|| (p[-1] == '[') || (p[-1] == '{') || (p[-1] == ';')) {
+	    for (cmdPtr = setCmds; *cmdPtr != NULL; cmdPtr++) {
+		length = strlen(*cmdPtr);
+		if ((strncmp(p, *cmdPtr, length) == 0)
+			&& ((p[length] == ' ') || (p[length] == '\t'))) {
+		    break;
+		}
+	    }
+	    if (*cmdPtr == NULL) {
+		continue;
+	    }
+	    for (start = p + length; (*start == ' ') || (*start == '\t');
+		    start++) {
+		/* Empty loop body. */
+	    }
+	    for (end = start; isalnum(*end) || (*end == '_'); end++) {
+		/* Empty loop body. */
+	    }
+	    if ((*end != 0) && !isspace(*end) && (*end != '(')
+		    && (*end != ';') && (*end != ']') && (*end != '}')) {
+		continue;
+	    }
+	}
+	if ((end != NULL) && (end > start)) {
+	    ProcAddLocal(iPtr, procPtr, start, end - start);
+	}
+    }
+
+    if (procPtr->numLocals > 0) {
+	procPtr->localNames = (char **) ckalloc(memoryp,
+		(unsigned) (procPtr->numLocals * sizeof(char *)));
+	for (hPtr = Hax_FirstHashEntry(&procPtr->localTable, &search);
+		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
+	    procPtr->localNames[(int) (long) Hax_GetHashValue(hPtr)] =
+		    Hax_GetHashKey(&procPtr->localTable, hPtr);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ProcAddLocal --
+ *
+ *	Give a local variable of a procedure a slot, if it doesn't
+ *	have one already.
+ *
+ * Results:
+ *	The index of the variable's slot, or -1 if the name is too
+ *	long to be worth a slot.
+ *
+ * Side effects:
+ *	An entry may be added to procPtr->localTable.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+ProcAddLocal(
+    Interp *iPtr,
+    Proc *procPtr,			/* Procedure that owns variable. */
+    char *name,				/* Name of variable (need not be
+					 * null-terminated). */
+    int length)				/* Number of characters in name. */
+{
+    Hax_HashEntry *hPtr;
+    char buffer[MAX_LOCAL_NAME+1];
+    int new;
+
+    if (name[length] == 0) {
+	hPtr = Hax_CreateHashEntry((Hax_Interp *) iPtr,
+		&procPtr->localTable, name, &new);
+    } else {
+	if (length > MAX_LOCAL_NAME) {
+	    return -1;
+	}
+	memcpy(buffer, name, length);
+	buffer[length] = 0;
+	hPtr = Hax_CreateHashEntry((Hax_Interp *) iPtr,
+		&procPtr->localTable, buffer, &new);
+    }
+    if (new) {
+	Hax_SetHashValue(hPtr, (ClientData) (long) procPtr->numLocals);
+	procPtr->numLocals++;
+    }
+    return (int) (long) Hax_GetHashValue(hPtr);
+}
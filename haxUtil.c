@@ -41,12 +41,47 @@ static char rcsid[] = "$Header: /user6/ouster/tcl/RCS/tclUtil.c,v 1.66 92/10/21
 #define USE_BRACES		2
 #define BRACES_UNMATCHED	4
 
+/*
+ * Scratch space is allocated in chunks of SCRATCH_CHUNK_SIZE bytes,
+ * except for requests too big to fit in one, which get a chunk of
+ * their own.
+ */
+
+#define SCRATCH_CHUNK_SIZE	8192
+
+/*
+ * A pattern compiled by Hax_CompilePattern is described by the
+ * structure below.  Most patterns used to pick names out of a table are
+ * a literal string with a "*" at one or both ends;  those are matched
+ * with a single string comparison or search.  Anything else is left to
+ * Hax_StringMatch.
+ */
+
+#define PATTERN_ANY	0	/* Only stars:  matches everything. */
+#define PATTERN_EXACT	1	/* "abc":  matches only itself. */
+#define PATTERN_PREFIX	2	/* "abc*". */
+#define PATTERN_SUFFIX	3	/* "*abc". */
+#define PATTERN_INFIX	4	/* "*abc*". */
+#define PATTERN_GENERAL	5	/* Anything else. */
+
+typedef struct Pattern {
+    int kind;			/* PATTERN_ANY etc. */
+    int length;			/* Number of bytes in text, not counting
+				 * the null. */
+    char text[4];		/* For PATTERN_GENERAL, the pattern;  for
+				 * the other kinds, the literal part of the
+				 * pattern, with backslashes removed.  The
+				 * actual size is length+1. */
+} Pattern;
+
 /*
  * Function prototypes for local procedures in this file:
  */
 
 static void		SetupAppendBuffer (Interp *iPtr,
 			    int newSpace);
+static int		SplitList (Hax_Interp *interp, char *list,
+			    int *argcPtr, char ***argvPtr, int scratch);
 
 /*
  *----------------------------------------------------------------------
@@ -348,6 +383,70 @@ Hax_SplitList(
 				 * the number of elements in the list. */
     char ***argvPtr		/* Pointer to place to store pointer to array
 				 * of pointers to list elements. */)
+{
+    return SplitList(interp, list, argcPtr, argvPtr, 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxScratchSplitList --
+ *
+ *	Same as Hax_SplitList, except that the array and the copy of
+ *	the list are allocated in the interpreter's scratch space.
+ *	Command procedures use this for lists they only need until
+ *	they return.
+ *
+ * Results
+ *	The same as for Hax_SplitList.  The caller must not free
+ *	*argvPtr:  the space is reclaimed automatically when the
+ *	command that is executing finishes.
+ *
+ * Side effects:
+ *	Scratch space is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxScratchSplitList(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    char *list,			/* Pointer to string with list structure. */
+    int *argcPtr,		/* Pointer to location to fill in with
+				 * the number of elements in the list. */
+    char ***argvPtr		/* Pointer to place to store pointer to array
+				 * of pointers to list elements. */)
+{
+    return SplitList(interp, list, argcPtr, argvPtr, 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SplitList --
+ *
+ *	Does all the work of Hax_SplitList and HaxScratchSplitList.
+ *
+ * Results
+ *	See Hax_SplitList.
+ *
+ * Side effects:
+ *	Memory is allocated, either with ckalloc or from the scratch
+ *	space.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+SplitList(
+    Hax_Interp *interp,		/* Interpreter to use for error reporting. */
+    char *list,			/* Pointer to string with list structure. */
+    int *argcPtr,		/* Pointer to location to fill in with
+				 * the number of elements in the list. */
+    char ***argvPtr,		/* Pointer to place to store pointer to array
+				 * of pointers to list elements. */
+    int scratch			/* Non-zero means allocate from the scratch
+				 * space rather than with ckalloc. */)
 {
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
@@ -370,20 +469,29 @@ Hax_SplitList(
 	}
     }
     size++;			/* Leave space for final NULL pointer. */
-    argv = (char **) ckalloc(memoryp, (unsigned)
-	    ((size * sizeof(char *)) + (p - list) + 1));
+    if (scratch) {
+	argv = (char **) HaxScratchAlloc(iPtr,
+		(int) ((size * sizeof(char *)) + (p - list) + 1));
+    } else {
+	argv = (char **) ckalloc(memoryp, (unsigned)
+		((size * sizeof(char *)) + (p - list) + 1));
+    }
     for (i = 0, p = ((char *) argv) + size*sizeof(char *);
 	    *list != 0; i++) {
 	result = HaxFindElement(interp, list, &element, &list, &elSize, &brace);
 	if (result != HAX_OK) {
-	    ckfree(memoryp, (char *) argv);
+	    if (!scratch) {
+		ckfree(memoryp, (char *) argv);
+	    }
 	    return result;
 	}
 	if (*element == 0) {
 	    break;
 	}
 	if (i >= size) {
-	    ckfree(memoryp, (char *) argv);
+	    if (!scratch) {
+		ckfree(memoryp, (char *) argv);
+	    }
 	    Hax_SetResult(interp, (char *) "internal error in Hax_SplitList",
 		    HAX_STATIC);
 	    return HAX_ERROR;
@@ -816,45 +924,64 @@ Hax_StringMatch(
     char *pattern	/* Pattern, which may contain
 				 * special characters. */)
 {
+    char *starPattern = NULL;	/* Pattern just after the most recent
+				 * "*", or NULL if there hasn't been one. */
+    char *starString = NULL;	/* Where the text matched by that "*"
+				 * ends. */
+    char *end = NULL;		/* End of string, once it's needed. */
+    int next = -1;		/* Character that must follow the text
+				 * matched by the "*", or -1 if that isn't
+				 * a fixed character. */
     char c2;
 
     while (1) {
-	/* See if we're at the end of both the pattern and the string.
-	 * If so, we succeeded.  If we're at the end of the pattern
-	 * but not at the end of the string, we failed.
-	 */
-
-	if (*pattern == 0) {
-	    if (*string == 0) {
-		return 1;
-	    } else {
-		return 0;
-	    }
-	}
-	if ((*string == 0) && (*pattern != '*')) {
-	    return 0;
-	}
-
 	/* Check for a "*" as the next pattern character.  It matches
-	 * any substring.  We handle this by calling ourselves
-	 * recursively for each postfix of string, until either we
-	 * match or we reach the end of the string.
+	 * any substring.  Rather than trying each postfix of string
+	 * recursively, remember where we are and first let the "*"
+	 * match nothing;  whenever the rest of the pattern fails, come
+	 * back here and let it match one more character.  Only the most
+	 * recent "*" ever needs another try, since everything after it
+	 * other than another "*" matches exactly one character:  if the
+	 * rest can't be matched by moving this one, moving an earlier
+	 * one won't help either.  So the time taken is at most the
+	 * product of the string and pattern lengths.
 	 */
 
 	if (*pattern == '*') {
-	    pattern += 1;
+	    while (*pattern == '*') {
+		pattern += 1;
+	    }
 	    if (*pattern == 0) {
 		return 1;
 	    }
-	    while (1) {
-		if (Hax_StringMatch(string, pattern)) {
-		    return 1;
-		}
-		if (*string == 0) {
+	    starPattern = pattern;
+	    starString = string;
+	    next = -1;
+	    if ((*pattern != '?') && (*pattern != '[')) {
+		next = (unsigned char) ((*pattern == '\\')
+			? pattern[1] : *pattern);
+		if (next == 0) {
 		    return 0;
 		}
-		string += 1;
 	    }
+	    goto tryStar;
+	}
+
+	/* See if we're at the end of both the pattern and the string.
+	 * If so, we succeeded.  If we're at the end of the pattern
+	 * but not at the end of the string, the most recent "*" must
+	 * match more.  If we're at the end of the string but not the
+	 * pattern, nothing can help.
+	 */
+
+	if (*pattern == 0) {
+	    if (*string == 0) {
+		return 1;
+	    }
+	    goto backtrack;
+	}
+	if (*string == 0) {
+	    return 0;
 	}
 
 	/* Check for a "?" as the next pattern character.  It matches
@@ -862,7 +989,9 @@ Hax_StringMatch(
 	 */
 
 	if (*pattern == '?') {
-	    goto thisCharOK;
+	    pattern += 1;
+	    string += 1;
+	    continue;
 	}
 
 	/* Check for a "[" as the next pattern character.  It is followed
@@ -874,7 +1003,7 @@ Hax_StringMatch(
 	    pattern += 1;
 	    while (1) {
 		if ((*pattern == ']') || (*pattern == 0)) {
-		    return 0;
+		    goto backtrack;
 		}
 		if (*pattern == *string) {
 		    break;
@@ -882,7 +1011,7 @@ Hax_StringMatch(
 		if (pattern[1] == '-') {
 		    c2 = pattern[2];
 		    if (c2 == 0) {
-			return 0;
+			goto backtrack;
 		    }
 		    if ((*pattern <= *string) && (c2 >= *string)) {
 			break;
@@ -897,10 +1026,14 @@ Hax_StringMatch(
 	    while ((*pattern != ']') && (*pattern != 0)) {
 		pattern += 1;
 	    }
-	    goto thisCharOK;
+	    if (*pattern == ']') {
+		pattern += 1;
+	    }
+	    string += 1;
+	    continue;
 	}
 
-	/* If the next pattern character is '/', just strip off the '/'
+	/* If the next pattern character is '\', just strip off the '\'
 	 * so we do exact matching on the character that follows.
 	 */
 
@@ -916,14 +1049,196 @@ Hax_StringMatch(
 	 */
 
 	if (*pattern != *string) {
+	    goto backtrack;
+	}
+	pattern += 1;
+	string += 1;
+	continue;
+
+	/* The rest of the pattern didn't match here:  let the most
+	 * recent "*" take one more character, then skip straight to the
+	 * next place where the character after it appears, if that is
+	 * fixed.
+	 */
+
+	backtrack:
+	if ((starPattern == NULL) || (*starString == 0)) {
 	    return 0;
 	}
+	starString += 1;
 
-	thisCharOK: pattern += 1;
-	string += 1;
+	tryStar:
+	if (next >= 0) {
+	    if (end == NULL) {
+		end = starString + strlen(starString);
+	    }
+	    starString = (char *) memchr(starString, next,
+		    (size_t) (end - starString));
+	    if (starString == NULL) {
+		return 0;
+	    }
+	}
+	pattern = starPattern;
+	string = starString;
     }
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_CompilePattern --
+ *
+ *	Prepare a pattern for Hax_PatternMatch, for a caller that will
+ *	match it against many strings.
+ *
+ * Results:
+ *	A token for the compiled pattern.  It must eventually be passed
+ *	to Hax_FreePattern.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_Pattern
+Hax_CompilePattern(
+    Hax_Interp *interp,		/* Interpreter whose memory to use. */
+    char *pattern)		/* Pattern, which may contain special
+				 * characters. */
+{
+    Hax_Memoryp *memoryp = ((Interp *) interp)->memoryp;
+    Pattern *patPtr;
+    char *p, *q, *dst;
+    int length, leading, trailing;
+
+    length = strlen(pattern);
+    patPtr = (Pattern *) ckalloc(memoryp,
+	    (unsigned) (sizeof(Pattern) + length));
+
+    /*
+     * Strip stars from both ends, then copy the middle, which must be
+     * free of special characters other than backslashes.
+     */
+
+    p = pattern;
+    leading = trailing = 0;
+    while (*p == '*') {
+	leading = 1;
+	p++;
+    }
+    dst = patPtr->text;
+    while (*p != 0) {
+	if (*p == '*') {
+	    for (q = p; *q == '*'; q++) {
+		/* Empty loop body. */
+	    }
+	    if (*q != 0) {
+		goto general;
+	    }
+	    trailing = 1;
+	    break;
+	}
+	if ((*p == '?') || (*p == '[')) {
+	    goto general;
+	}
+	if (*p == '\\') {
+	    p++;
+	    if (*p == 0) {
+		goto general;
+	    }
+	}
+	*dst++ = *p++;
+    }
+    *dst = 0;
+    patPtr->length = dst - patPtr->text;
+    if ((leading || trailing) && (patPtr->length == 0)) {
+	patPtr->kind = PATTERN_ANY;
+    } else if (leading) {
+	patPtr->kind = trailing ? PATTERN_INFIX : PATTERN_SUFFIX;
+    } else {
+	patPtr->kind = trailing ? PATTERN_PREFIX : PATTERN_EXACT;
+    }
+    return (Hax_Pattern) patPtr;
+
+    general:
+    patPtr->kind = PATTERN_GENERAL;
+    patPtr->length = length;
+    strcpy(patPtr->text, pattern);
+    return (Hax_Pattern) patPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_PatternMatch --
+ *
+ *	See if a string matches a pattern compiled by
+ *	Hax_CompilePattern.
+ *
+ * Results:
+ *	The return value is 1 if string matches the pattern, and 0
+ *	otherwise, just as Hax_StringMatch would return.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+Hax_PatternMatch(
+    Hax_Pattern pattern,	/* Token returned by Hax_CompilePattern. */
+    char *string)		/* String to test. */
+{
+    Pattern *patPtr = (Pattern *) pattern;
+    int length;
+
+    switch (patPtr->kind) {
+	case PATTERN_ANY:
+	    return 1;
+	case PATTERN_EXACT:
+	    return strcmp(string, patPtr->text) == 0;
+	case PATTERN_PREFIX:
+	    return strncmp(string, patPtr->text, (size_t) patPtr->length)
+		    == 0;
+	case PATTERN_SUFFIX:
+	    length = strlen(string);
+	    return (length >= patPtr->length)
+		    && (memcmp(string + length - patPtr->length, patPtr->text,
+		    (size_t) patPtr->length) == 0);
+	case PATTERN_INFIX:
+	    return strstr(string, patPtr->text) != NULL;
+	default:
+	    return Hax_StringMatch(string, patPtr->text);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_FreePattern --
+ *
+ *	Release a pattern compiled by Hax_CompilePattern.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed;  the token mustn't be used again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+Hax_FreePattern(
+    Hax_Interp *interp,		/* Interpreter passed to
+				 * Hax_CompilePattern. */
+    Hax_Pattern pattern)	/* Token returned by Hax_CompilePattern. */
+{
+    ckfree(((Interp *) interp)->memoryp, (char *) pattern);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1223,6 +1538,7 @@ Hax_ResetResult(
     Interp *iPtr = (Interp *) interp;
 
     Hax_FreeResult(interp);
+    HaxReleaseObjResult(iPtr);
     iPtr->result = iPtr->resultSpace;
     iPtr->resultSpace[0] = 0;
     iPtr->flags &=
@@ -1449,3 +1765,154 @@ RegError(
 
     iPtr->haxRegexpError = string;
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxScratchAlloc --
+ *
+ *	Allocate space for a temporary that is only needed until the
+ *	command being executed finishes.  Hax_Eval saves a mark before
+ *	invoking each command and calls HaxScratchRelease afterwards,
+ *	which gives back everything allocated in between at once, so
+ *	callers never free scratch space themselves.
+ *
+ * Results:
+ *	The return value is a pointer to size bytes of space, suitably
+ *	aligned for any type.
+ *
+ * Side effects:
+ *	A new chunk may be allocated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxScratchAlloc(
+    Interp *iPtr,			/* Interpreter whose scratch space
+					 * is to be used. */
+    int size)				/* Number of bytes needed. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ScratchChunk *chunkPtr, **linkPtr;
+    int chunkSize;
+    char *result;
+
+    size = (size + sizeof(double) - 1) & ~(sizeof(double) - 1);
+    if ((iPtr->scratchPtr != NULL)
+	    && (size <= iPtr->scratchPtr->end - iPtr->scratchTop)) {
+	result = iPtr->scratchTop;
+	iPtr->scratchTop += size;
+	return result;
+    }
+
+    /*
+     * The current chunk is full.  Move up to the next one, making a
+     * new chunk if there isn't one or it's too small.
+     */
+
+    if (iPtr->scratchPtr == NULL) {
+	linkPtr = &iPtr->scratchFirstPtr;
+    } else {
+	linkPtr = &iPtr->scratchPtr->nextPtr;
+    }
+    chunkPtr = *linkPtr;
+    if ((chunkPtr == NULL)
+	    || (size > chunkPtr->end - (char *) chunkPtr->space)) {
+	chunkSize = SCRATCH_CHUNK_SIZE;
+	if (size > chunkSize - (int) offsetof(ScratchChunk, space)) {
+	    chunkSize = size + offsetof(ScratchChunk, space);
+	}
+	chunkPtr = (ScratchChunk *) ckalloc(memoryp, (unsigned) chunkSize);
+	chunkPtr->end = ((char *) chunkPtr) + chunkSize;
+	chunkPtr->nextPtr = *linkPtr;
+	*linkPtr = chunkPtr;
+    }
+    iPtr->scratchPtr = chunkPtr;
+    result = (char *) chunkPtr->space;
+    iPtr->scratchTop = result + size;
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxScratchRelease --
+ *
+ *	Give back all of the scratch space allocated since *markPtr
+ *	was filled in by HaxScratchMark.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The top of the scratch space moves back to the mark.  One
+ *	ordinary chunk above the new top is kept for reuse;  any others
+ *	are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxScratchRelease(
+    Interp *iPtr,			/* Interpreter whose scratch space
+					 * is to be released. */
+    ScratchMark *markPtr)		/* Mark saved by HaxScratchMark. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ScratchChunk *chunkPtr, *nextPtr, **linkPtr;
+
+    iPtr->scratchTop = markPtr->top;
+    if (iPtr->scratchPtr == markPtr->chunkPtr) {
+	return;
+    }
+    iPtr->scratchPtr = markPtr->chunkPtr;
+    if (markPtr->chunkPtr == NULL) {
+	linkPtr = &iPtr->scratchFirstPtr;
+    } else {
+	linkPtr = &markPtr->chunkPtr->nextPtr;
+    }
+    chunkPtr = *linkPtr;
+    if ((chunkPtr->end - (char *) chunkPtr) == SCRATCH_CHUNK_SIZE) {
+	linkPtr = &chunkPtr->nextPtr;
+	chunkPtr = *linkPtr;
+    }
+    *linkPtr = NULL;
+    for ( ; chunkPtr != NULL; chunkPtr = nextPtr) {
+	nextPtr = chunkPtr->nextPtr;
+	ckfree(memoryp, (char *) chunkPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxDeleteScratch --
+ *
+ *	Free all of the chunks of an interpreter's scratch space.  This
+ *	is called when the interpreter is deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxDeleteScratch(
+    Interp *iPtr)			/* Interpreter being deleted. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    ScratchChunk *chunkPtr, *nextPtr;
+
+    for (chunkPtr = iPtr->scratchFirstPtr; chunkPtr != NULL;
+	    chunkPtr = nextPtr) {
+	nextPtr = chunkPtr->nextPtr;
+	ckfree(memoryp, (char *) chunkPtr);
+    }
+    iPtr->scratchFirstPtr = iPtr->scratchPtr = NULL;
+    iPtr->scratchTop = NULL;
+}
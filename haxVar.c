@@ -35,6 +35,14 @@ static const char *needArray =		"variable isn't array";
 static const char *noSuchElement =	"no such element in array";
 static const char *traceActive =	"trace is active on variable";
 
+/*
+ * The string value of a defined scalar variable:
+ */
+
+#define VAR_STRING(varPtr) \
+    (((varPtr)->objPtr != NULL) ? (varPtr)->objPtr->bytes \
+	    : (varPtr)->value.string)
+
 /*
  * Forward references to procedures defined later in this file:
  */
@@ -45,9 +53,23 @@ static  char *		CallTraces (Interp *iPtr, Var *arrayPtr,
 static void		DeleteSearches (Hax_Interp *interp, Var *arrayVarPtr);
 static void		DeleteArray (Interp *iPtr, char *arrayName,
 			    Var *varPtr, int flags);
+static void		DeleteVar (Interp *iPtr, Hax_HashEntry *hPtr,
+			    char *name, int flags);
+static void		DeleteVarEntry (Interp *iPtr, Hax_HashEntry *hPtr);
+static void		DropValue (Interp *iPtr, Hax_Obj *objPtr);
+static void		FreeVar (Interp *iPtr, Var *varPtr);
 static Var *		NewVar (Hax_Interp *interp, int space);
 static ArraySearch *	ParseSearchId (Hax_Interp *interp,
 			    Var *varPtr, char *varName, char *string);
+static Var *		ReadVar (Hax_Interp *interp, Hax_HashEntry *slotPtr,
+			    char *part1, char *part2, int flags,
+			    Hax_HashEntry **hPtrPtr);
+static char *		SetVarValue (Hax_Interp *interp,
+			    Hax_HashEntry *slotPtr, char *part1, char *part2,
+			    char *newValue, Hax_Obj *objPtr,
+			    VarNumber *numberPtr, int flags);
+static char *		SplitVarName (char *varName, char **openPtr,
+			    char **closePtr);
 static void		VarErrMsg (Hax_Interp *interp,
 			    char *part1, char *part2, char *operation,
 			    char *reason);
@@ -149,6 +171,212 @@ Hax_GetVar2(
 				 * array. */
     int flags			/* OR-ed combination of HAX_GLOBAL_ONLY
 				 * or HAX_LEAVE_ERR_MSG bits. */)
+{
+    Var *varPtr;
+
+    varPtr = ReadVar(interp, (Hax_HashEntry *) NULL, part1, part2, flags,
+	    (Hax_HashEntry **) NULL);
+    if (varPtr == NULL) {
+	return NULL;
+    }
+    return VAR_STRING(varPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxGetVarNumber --
+ *
+ *	Like Hax_GetVar2, but also tell the caller where the variable
+ *	keeps the number that its value parses as.
+ *
+ * Results:
+ *	The same as for Hax_GetVar2.  If the variable was found then
+ *	*numberPtrPtr points to its VarNumber.  If the type there isn't
+ *	VAR_NUM_NONE then it gives the value's numeric form;  otherwise
+ *	the caller may parse the value and fill it in.  Like the return
+ *	value, the pointer is only valid until the variable is next
+ *	modified.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxGetVarNumber(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    char *part1,		/* Name of array (if part2 is NULL) or
+				 * name of variable. */
+    char *part2,		/* If non-null, gives name of element in
+				 * array. */
+    int flags,			/* OR-ed combination of HAX_GLOBAL_ONLY
+				 * or HAX_LEAVE_ERR_MSG bits. */
+    VarNumber **numberPtrPtr	/* If not NULL, *numberPtrPtr is set to
+				 * point to the variable's numeric form. */)
+{
+    return HaxGetVarSlot(interp, (Hax_HashEntry *) NULL, part1, part2,
+	    flags, (Hax_Obj **) NULL, numberPtrPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxGetVarObj --
+ *
+ *	Like Hax_GetVar2, but also return the variable's value as a
+ *	Hax_Obj if it has one, so that the caller can hold on to the
+ *	value without copying it.
+ *
+ * Results:
+ *	The same as for Hax_GetVar2.  If the variable was found then
+ *	*objPtrPtr is set to the value that holds its string, or to
+ *	NULL if the variable keeps its (short) value itself.  The caller
+ *	must call Hax_IncrRefCount on the value if it wants it to last
+ *	past the next change to the variable.
+ *
+ * Side effects:
+ *	A long value that the variable kept itself is moved into a new
+ *	Hax_Obj, which the variable then shares with anyone who asks.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxGetVarObj(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    char *part1,		/* Name of array (if part2 is NULL) or
+				 * name of variable. */
+    char *part2,		/* If non-null, gives name of element in
+				 * array. */
+    int flags,			/* OR-ed combination of HAX_GLOBAL_ONLY
+				 * or HAX_LEAVE_ERR_MSG bits. */
+    Hax_Obj **objPtrPtr		/* Where to store the variable's value. */)
+{
+    return HaxGetVarSlot(interp, (Hax_HashEntry *) NULL, part1, part2,
+	    flags, objPtrPtr, (VarNumber **) NULL);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxGetVarSlot --
+ *
+ *	The general form of HaxGetVarNumber and HaxGetVarObj, which can
+ *	also be given the slot that holds a procedure's local variable
+ *	(see HaxLookupVar), so that compiled code that has resolved the
+ *	name already needn't look it up again.
+ *
+ * Results:
+ *	The same as for Hax_GetVar2.  *ObjPtrPtr and *numberPtrPtr are
+ *	filled in as by HaxGetVarObj and HaxGetVarNumber, if they aren't
+ *	NULL.
+ *
+ * Side effects:
+ *	The same as for HaxGetVarObj, if objPtrPtr isn't NULL.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxGetVarSlot(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    Hax_HashEntry *slotPtr,	/* Slot in the current frame that holds
+				 * part1, or NULL to look part1 up. */
+    char *part1,		/* Name of array (if part2 is NULL) or
+				 * name of variable. */
+    char *part2,		/* If non-null, gives name of element in
+				 * array. */
+    int flags,			/* OR-ed combination of HAX_GLOBAL_ONLY
+				 * or HAX_LEAVE_ERR_MSG bits. */
+    Hax_Obj **objPtrPtr,	/* If not NULL, where to store the
+				 * variable's value. */
+    VarNumber **numberPtrPtr	/* If not NULL, *numberPtrPtr is set to
+				 * point to the variable's numeric form. */)
+{
+    Interp *iPtr = (Interp *) interp;
+    Hax_HashEntry *hPtr;
+    Var *varPtr, *newVarPtr;
+    Hax_Obj *objPtr;
+
+    varPtr = ReadVar(interp, slotPtr, part1, part2, flags, &hPtr);
+    if (varPtr == NULL) {
+	return NULL;
+    }
+    if (objPtrPtr != NULL) {
+	/*
+	 * Leave variables with traces alone:  the variable is
+	 * reallocated below, and a trace procedure higher up on the
+	 * stack may still have a pointer to it.
+	 */
+
+	if ((varPtr->objPtr == NULL)
+		&& (varPtr->valueLength >= VALUE_SHARE_SIZE)
+		&& (varPtr->tracePtr == NULL)
+		&& !(varPtr->flags & VAR_TRACE_ACTIVE)) {
+	    objPtr = Hax_NewStringObj(interp, varPtr->value.string,
+		    varPtr->valueLength);
+	    Hax_IncrRefCount(objPtr);
+	    if (iPtr->result == varPtr->value.string) {
+		Hax_SetObjResult(interp, objPtr);
+	    }
+	    newVarPtr = NewVar(interp, 0);
+	    newVarPtr->upvarUses = varPtr->upvarUses;
+	    newVarPtr->searchPtr = varPtr->searchPtr;
+	    newVarPtr->flags = varPtr->flags;
+	    newVarPtr->number = varPtr->number;
+	    newVarPtr->objPtr = objPtr;
+	    ckfree(iPtr->memoryp, (char *) varPtr);
+	    Hax_SetHashValue(hPtr, newVarPtr);
+	    varPtr = newVarPtr;
+	}
+	*objPtrPtr = varPtr->objPtr;
+    }
+    if (numberPtrPtr != NULL) {
+	*numberPtrPtr = &varPtr->number;
+    }
+    return VAR_STRING(varPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReadVar --
+ *
+ *	Find a variable for reading, calling any read traces on it.
+ *	This is the common part of Hax_GetVar2 and its relatives.
+ *
+ * Results:
+ *	The return value is the variable, which is a defined scalar.
+ *	If the variable doesn't exist or can't be read, NULL is returned
+ *	and a message is left in interp->result if the HAX_LEAVE_ERR_MSG
+ *	flag is set.  If hPtrPtr isn't NULL, the variable's hash table
+ *	entry is stored there.
+ *
+ * Side effects:
+ *	Read traces are invoked.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Var *
+ReadVar(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    Hax_HashEntry *slotPtr,	/* Slot in the current frame that holds
+				 * part1, or NULL to look part1 up. */
+    char *part1,		/* Name of array (if part2 is NULL) or
+				 * name of variable. */
+    char *part2,		/* If non-null, gives name of element in
+				 * array. */
+    int flags,			/* OR-ed combination of HAX_GLOBAL_ONLY
+				 * or HAX_LEAVE_ERR_MSG bits. */
+    Hax_HashEntry **hPtrPtr	/* If not NULL, where to store the
+				 * variable's hash table entry. */)
 {
     Hax_HashEntry *hPtr;
     Var *varPtr;
@@ -159,10 +387,13 @@ Hax_GetVar2(
      * Lookup the first name.
      */
 
-    if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
+    if (slotPtr != NULL) {
+	hPtr = (Hax_GetHashValue(slotPtr) != NULL) ? slotPtr : NULL;
+    } else if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
 	hPtr = Hax_FindHashEntry(&iPtr->globalTable, part1);
     } else {
-	hPtr = Hax_FindHashEntry(&iPtr->varFramePtr->varTable, part1);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, part1, 0,
+		(int *) NULL);
     }
     if (hPtr == NULL) {
 	if (flags & HAX_LEAVE_ERR_MSG) {
@@ -238,7 +469,10 @@ Hax_GetVar2(
 	}
 	return NULL;
     }
-    return varPtr->value.string;
+    if (hPtrPtr != NULL) {
+	*hPtrPtr = hPtr;
+    }
+    return varPtr;
 }
 
 /*
@@ -343,6 +577,165 @@ Hax_SetVar2(
 				 * any of HAX_GLOBAL_ONLY, HAX_APPEND_VALUE,
 				 * HAX_LIST_ELEMENT, and HAX_NO_SPACE, or
 				 * HAX_LEAVE_ERR_MSG . */)
+{
+    return SetVarValue(interp, (Hax_HashEntry *) NULL, part1, part2,
+	    newValue, (Hax_Obj *) NULL, (VarNumber *) NULL, flags);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxSetVarNumber --
+ *
+ *	Like Hax_SetVar2, but the caller may also supply the number
+ *	that the new value parses as, so that HaxGetVarNumber can
+ *	return it without converting the string.
+ *
+ * Results:
+ *	The same as for Hax_SetVar2.
+ *
+ * Side effects:
+ *	The value of the given variable is set, and its numeric form
+ *	is set from *numberPtr or forgotten.  Write traces are invoked
+ *	after both have been changed, so a trace that modifies the
+ *	variable discards the number again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxSetVarNumber(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    char *part1,		/* If part2 is NULL, this is name of scalar
+				 * variable.  Otherwise it is name of array. */
+    char *part2,		/* Name of an element within array, or NULL. */
+    char *newValue,		/* New value for variable. */
+    VarNumber *numberPtr,	/* Numeric form of newValue, or NULL if
+				 * not known. */
+    int flags			/* Various flags that tell how to set value:
+				 * any of HAX_GLOBAL_ONLY, HAX_APPEND_VALUE,
+				 * HAX_LIST_ELEMENT, and HAX_NO_SPACE, or
+				 * HAX_LEAVE_ERR_MSG . */)
+{
+    return SetVarValue(interp, (Hax_HashEntry *) NULL, part1, part2,
+	    newValue, (Hax_Obj *) NULL, numberPtr, flags);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxSetVarObj --
+ *
+ *	Like Hax_SetVar2, but the new value is a Hax_Obj, which the
+ *	variable shares instead of copying.
+ *
+ * Results:
+ *	The same as for Hax_SetVar2.
+ *
+ * Side effects:
+ *	The variable holds a reference to objPtr until it is next
+ *	changed.  The value must not be modified while it is shared
+ *	(see Hax_IsShared);  appending to the variable copies it first.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxSetVarObj(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    char *part1,		/* If part2 is NULL, this is name of scalar
+				 * variable.  Otherwise it is name of array. */
+    char *part2,		/* Name of an element within array, or NULL. */
+    Hax_Obj *objPtr,		/* New value for variable. */
+    int flags			/* Any of HAX_GLOBAL_ONLY or
+				 * HAX_LEAVE_ERR_MSG. */)
+{
+    return SetVarValue(interp, (Hax_HashEntry *) NULL, part1, part2,
+	    (char *) NULL, objPtr, (VarNumber *) NULL, flags);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxSetVarSlot --
+ *
+ *	The general form of Hax_SetVar2, HaxSetVarNumber and
+ *	HaxSetVarObj, which can also be given the slot that holds a
+ *	procedure's local variable (see HaxGetVarSlot).
+ *
+ * Results:
+ *	The same as for Hax_SetVar2.
+ *
+ * Side effects:
+ *	The same as for Hax_SetVar2.
+ *
+ *----------------------------------------------------------------------
+ */
+
+char *
+HaxSetVarSlot(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    Hax_HashEntry *slotPtr,	/* Slot in the current frame that holds
+				 * part1, or NULL to look part1 up. */
+    char *part1,		/* If part2 is NULL, this is name of scalar
+				 * variable.  Otherwise it is name of array. */
+    char *part2,		/* Name of an element within array, or NULL. */
+    char *newValue,		/* New value for variable, if objPtr is
+				 * NULL. */
+    Hax_Obj *objPtr,		/* If not NULL, the variable shares this
+				 * as its new value (see SetVarValue). */
+    VarNumber *numberPtr,	/* Numeric form of newValue, or NULL if
+				 * not known. */
+    int flags			/* The same as for Hax_SetVar2. */)
+{
+    return SetVarValue(interp, slotPtr, part1, part2, newValue, objPtr,
+	    numberPtr, flags);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetVarValue --
+ *
+ *	Set a variable, either from a string or by sharing a Hax_Obj.
+ *	This is the common part of Hax_SetVar2 and its relatives.
+ *
+ * Results:
+ *	The same as for Hax_SetVar2.
+ *
+ * Side effects:
+ *	The value of the given variable is set, and its numeric form
+ *	is set from *numberPtr or forgotten.  Write traces are invoked
+ *	after both have been changed, so a trace that modifies the
+ *	variable discards the number again.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+SetVarValue(
+    Hax_Interp *interp,		/* Command interpreter in which variable is
+				 * to be looked up. */
+    Hax_HashEntry *slotPtr,	/* Slot in the current frame that holds
+				 * part1, or NULL to look part1 up. */
+    char *part1,		/* If part2 is NULL, this is name of scalar
+				 * variable.  Otherwise it is name of array. */
+    char *part2,		/* Name of an element within array, or NULL. */
+    char *newValue,		/* New value for variable, if objPtr is
+				 * NULL. */
+    Hax_Obj *objPtr,		/* If not NULL, the variable shares this
+				 * as its new value, and flags mustn't
+				 * include HAX_APPEND_VALUE or
+				 * HAX_LIST_ELEMENT. */
+    VarNumber *numberPtr,	/* Numeric form of newValue, or NULL if
+				 * not known. */
+    int flags			/* Various flags that tell how to set value:
+				 * any of HAX_GLOBAL_ONLY, HAX_APPEND_VALUE,
+				 * HAX_LIST_ELEMENT, and HAX_NO_SPACE, or
+				 * HAX_LEAVE_ERR_MSG . */)
 {
     Hax_HashEntry *hPtr;
     Var *varPtr = NULL;
@@ -350,18 +743,33 @@ Hax_SetVar2(
 				 * from complaining; not really needed. */
     Interp *iPtr = (Interp *) interp;
     Hax_Memoryp *memoryp = iPtr->memoryp;
-    int length, newPtr, listFlags;
+    int length, newPtr, listFlags, sharedLength;
     Var *arrayPtr = NULL;
+    Hax_Obj *oldObjPtr = NULL;
+
+    /*
+     * Short values are cheaper to copy than to share.
+     */
+
+    if (objPtr != NULL) {
+	newValue = Hax_GetStringFromObj(interp, objPtr, &length);
+	if (length < VALUE_SHARE_SIZE) {
+	    objPtr = NULL;
+	}
+    }
 
     /*
      * Lookup the first name.
      */
 
-    if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
+    lookup:
+    if (slotPtr != NULL) {
+	hPtr = slotPtr;
+	newPtr = (Hax_GetHashValue(hPtr) == NULL);
+    } else if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
 	hPtr = Hax_CreateHashEntry(interp, &iPtr->globalTable, part1, &newPtr);
     } else {
-	hPtr = Hax_CreateHashEntry(interp, &iPtr->varFramePtr->varTable,
-		part1, &newPtr);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, part1, 1, &newPtr);
     }
     if (!newPtr) {
 	varPtr = (Var *) Hax_GetHashValue(hPtr);
@@ -369,6 +777,20 @@ Hax_SetVar2(
 	    hPtr = varPtr->value.upvarPtr;
 	    varPtr = (Var *) Hax_GetHashValue(hPtr);
 	}
+
+	/*
+	 * Appending to errorInfo or errorCode, or using either as an
+	 * array, depends on the current value, which may not have been
+	 * stored yet (see HaxFlushErrorInfo).  Storing it can move
+	 * entries in the table, so look the name up again after.
+	 */
+
+	if ((varPtr->tracePtr != NULL)
+		&& (iPtr->flags & (ERR_INFO_PENDING|ERR_CODE_PENDING))
+		&& ((flags & HAX_APPEND_VALUE) || (part2 != NULL))) {
+	    HaxFlushErrorInfo(iPtr);
+	    goto lookup;
+	}
     }
 
     /*
@@ -384,13 +806,13 @@ Hax_SetVar2(
 	    varPtr->flags = VAR_ARRAY;
 	    varPtr->value.tablePtr = (Hax_HashTable *)
 		    ckalloc(memoryp, sizeof(Hax_HashTable));
-	    Hax_InitHashTable(varPtr->value.tablePtr, HAX_STRING_KEYS);
+	    Hax_InitHashTable(varPtr->value.tablePtr, HAX_OPEN_STRING_KEYS);
 	} else {
 	    if (varPtr->flags & VAR_UNDEFINED) {
 		varPtr->flags = VAR_ARRAY;
 		varPtr->value.tablePtr = (Hax_HashTable *)
 			ckalloc(memoryp, sizeof(Hax_HashTable));
-		Hax_InitHashTable(varPtr->value.tablePtr, HAX_STRING_KEYS);
+		Hax_InitHashTable(varPtr->value.tablePtr, HAX_OPEN_STRING_KEYS);
 	    } else if (!(varPtr->flags & VAR_ARRAY)) {
 		if (flags & HAX_LEAVE_ERR_MSG) {
 		    VarErrMsg(interp, part1, part2, (char *) "set",
@@ -409,7 +831,9 @@ Hax_SetVar2(
      * for a separating space between list elements).
      */
 
-    if (flags & HAX_LIST_ELEMENT) {
+    if (objPtr != NULL) {
+	length = 0;
+    } else if (flags & HAX_LIST_ELEMENT) {
 	length = Hax_ScanElement(newValue, &listFlags) + 1;
     } else {
 	length = strlen(newValue);
@@ -439,6 +863,46 @@ Hax_SetVar2(
 	if (!(flags & HAX_APPEND_VALUE) || (varPtr->flags & VAR_UNDEFINED)) {
 	    varPtr->valueLength = 0;
 	}
+
+	/*
+	 * Let go of a shared value.  It isn't released until the new
+	 * value is in place, since newValue may point into it.  If this
+	 * is an append, copy the shared value into the variable's own
+	 * space first.
+	 */
+
+	oldObjPtr = varPtr->objPtr;
+	varPtr->objPtr = NULL;
+    }
+
+    if (objPtr != NULL) {
+	if ((varPtr->valueSpace > VALUE_SHARE_SIZE)
+		&& !(varPtr->flags & VAR_TRACE_ACTIVE)) {
+	    Var *newVarPtr;
+
+	    /*
+	     * Don't hang on to space for a long value that the variable
+	     * doesn't need any more (unless a trace procedure higher up
+	     * on the stack may still have a pointer to the variable).
+	     */
+
+	    newVarPtr = NewVar(interp, 0);
+	    newVarPtr->upvarUses = varPtr->upvarUses;
+	    newVarPtr->tracePtr = varPtr->tracePtr;
+	    newVarPtr->searchPtr = varPtr->searchPtr;
+	    newVarPtr->flags = varPtr->flags;
+	    ckfree(memoryp, (char *) varPtr);
+	    Hax_SetHashValue(hPtr, newVarPtr);
+	    varPtr = newVarPtr;
+	}
+	Hax_IncrRefCount(objPtr);
+	varPtr->objPtr = objPtr;
+	varPtr->valueLength = 0;
+	goto valueSet;
+    }
+    sharedLength = 0;
+    if ((oldObjPtr != NULL) && (flags & HAX_APPEND_VALUE)) {
+	sharedLength = oldObjPtr->length;
     }
 
     /*
@@ -446,25 +910,43 @@ Hax_SetVar2(
      * new value.  If not, enlarge the variable's space.
      */
 
-    if ((length + varPtr->valueLength) >= varPtr->valueSpace) {
+    if ((length + sharedLength + varPtr->valueLength)
+	    >= varPtr->valueSpace) {
 	Var *newVarPtr;
 	int newSize;
 
+	/*
+	 * Grow the space geometrically, so that building up a long value
+	 * a piece at a time costs amortized constant time per piece.  If
+	 * the old value is being kept, reallocate the variable in place:
+	 * for big values the allocator can often extend the block without
+	 * copying it.
+	 */
+
 	newSize = 2*varPtr->valueSpace;
-	if (newSize <= (length + varPtr->valueLength)) {
-	    newSize += length;
-	}
-	newVarPtr = NewVar(interp, newSize);
-	newVarPtr->valueLength = varPtr->valueLength;
-	newVarPtr->upvarUses = varPtr->upvarUses;
-	newVarPtr->tracePtr = varPtr->tracePtr;
-	newVarPtr->searchPtr = varPtr->searchPtr;
-	newVarPtr->flags = varPtr->flags;
-	strcpy(newVarPtr->value.string, varPtr->value.string);
+	if (newSize <= (length + sharedLength + varPtr->valueLength)) {
+	    newSize += length + sharedLength;
+	}
+	if (varPtr->valueLength > 0) {
+	    newVarPtr = (Var *) ckrealloc(memoryp, (char *) varPtr,
+		    (unsigned) (sizeof(Var) + newSize - sizeof(varPtr->value)));
+	    newVarPtr->valueSpace = newSize;
+	} else {
+	    newVarPtr = NewVar(interp, newSize);
+	    newVarPtr->upvarUses = varPtr->upvarUses;
+	    newVarPtr->tracePtr = varPtr->tracePtr;
+	    newVarPtr->searchPtr = varPtr->searchPtr;
+	    newVarPtr->flags = varPtr->flags;
+	    ckfree(memoryp, (char *) varPtr);
+	}
 	Hax_SetHashValue(hPtr, newVarPtr);
-	ckfree(memoryp, (char *) varPtr);
 	varPtr = newVarPtr;
     }
+    if (sharedLength > 0) {
+	memcpy(varPtr->value.string, oldObjPtr->bytes,
+		(size_t) (sharedLength + 1));
+	varPtr->valueLength = sharedLength;
+    }
 
     /*
      * Append the new value to the variable, either as a list
@@ -480,10 +962,22 @@ Hax_SetVar2(
 		(char *)varPtr->value.string + varPtr->valueLength, listFlags);
 	((char *)varPtr->value.string)[varPtr->valueLength] = 0;
     } else {
-	strcpy(((char *)varPtr->value.string) + varPtr->valueLength, newValue);
+	memcpy(((char *)varPtr->value.string) + varPtr->valueLength, newValue,
+		(size_t) (length + 1));
 	varPtr->valueLength += length;
     }
+
+    valueSet:
+    if (oldObjPtr != NULL) {
+	DropValue(iPtr, oldObjPtr);
+    }
     varPtr->flags &= ~VAR_UNDEFINED;
+    if ((numberPtr != NULL)
+	    && !(flags & (HAX_APPEND_VALUE|HAX_LIST_ELEMENT))) {
+	varPtr->number = *numberPtr;
+    } else {
+	varPtr->number.type = VAR_NUM_NONE;
+    }
 
     /*
      * Invoke any write traces for the variable.
@@ -508,7 +1002,7 @@ Hax_SetVar2(
 
 	varPtr = (Var *) Hax_GetHashValue(hPtr);
     }
-    return varPtr->value.string;
+    return VAR_STRING(varPtr);
 }
 
 /*
@@ -609,10 +1103,12 @@ Hax_UnsetVar2(
     Hax_Memoryp *memoryp = iPtr->memoryp;
     Var *arrayPtr = NULL;
 
+    lookup:
     if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
 	hPtr = Hax_FindHashEntry(&iPtr->globalTable, part1);
     } else {
-	hPtr = Hax_FindHashEntry(&iPtr->varFramePtr->varTable, part1);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, part1, 0,
+		(int *) NULL);
     }
     if (hPtr == NULL) {
 	if (flags & HAX_LEAVE_ERR_MSG) {
@@ -635,6 +1131,19 @@ Hax_UnsetVar2(
 	varPtr = (Var *) Hax_GetHashValue(hPtr);
     }
 
+    /*
+     * If errorInfo or errorCode has text pending for it, it may not
+     * even exist yet (see HaxFlushErrorInfo):  store the text first,
+     * then look the name up again, since storing it can move entries
+     * in the table.
+     */
+
+    if ((varPtr->tracePtr != NULL)
+	    && (iPtr->flags & (ERR_INFO_PENDING|ERR_CODE_PENDING))) {
+	HaxFlushErrorInfo(iPtr);
+	goto lookup;
+    }
+
     /*
      * If the variable being deleted is an element of an array, then
      * remember trace procedures on the overall array and find the
@@ -695,11 +1204,16 @@ Hax_UnsetVar2(
     dummyVar = *varPtr;
     Hax_SetHashValue(&dummyEntry, &dummyVar);
     if (varPtr->upvarUses == 0) {
-	Hax_DeleteHashEntry(interp, hPtr);
+	DeleteVarEntry(iPtr, hPtr);
 	ckfree(memoryp, (char *) varPtr);
     } else {
 	varPtr->flags = VAR_UNDEFINED;
 	varPtr->tracePtr = NULL;
+	varPtr->objPtr = NULL;
+    }
+    if (dummyVar.objPtr != NULL) {
+	DropValue(iPtr, dummyVar.objPtr);
+	dummyVar.objPtr = NULL;
     }
 
     /*
@@ -857,8 +1371,7 @@ Hax_TraceVar2(
     if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
 	hPtr = Hax_CreateHashEntry(interp, &iPtr->globalTable, part1, &newPtr);
     } else {
-	hPtr = Hax_CreateHashEntry(interp, &iPtr->varFramePtr->varTable, part1,
-		    &newPtr);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, part1, 1, &newPtr);
     }
     if (!newPtr) {
 	varPtr = (Var *) Hax_GetHashValue(hPtr);
@@ -882,13 +1395,13 @@ Hax_TraceVar2(
 	    varPtr->flags = VAR_ARRAY;
 	    varPtr->value.tablePtr = (Hax_HashTable *)
 		    ckalloc(memoryp, sizeof(Hax_HashTable));
-	    Hax_InitHashTable(varPtr->value.tablePtr, HAX_STRING_KEYS);
+	    Hax_InitHashTable(varPtr->value.tablePtr, HAX_OPEN_STRING_KEYS);
 	} else {
 	    if (varPtr->flags & VAR_UNDEFINED) {
 		varPtr->flags = VAR_ARRAY;
 		varPtr->value.tablePtr = (Hax_HashTable *)
 			ckalloc(memoryp, sizeof(Hax_HashTable));
-		Hax_InitHashTable(varPtr->value.tablePtr, HAX_STRING_KEYS);
+		Hax_InitHashTable(varPtr->value.tablePtr, HAX_OPEN_STRING_KEYS);
 	    } else if (!(varPtr->flags & VAR_ARRAY)) {
 		iPtr->result = (char *) needArray;
 		return HAX_ERROR;
@@ -1031,7 +1544,8 @@ Hax_UntraceVar2(
     if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
 	hPtr = Hax_FindHashEntry(&iPtr->globalTable, part1);
     } else {
-	hPtr = Hax_FindHashEntry(&iPtr->varFramePtr->varTable, part1);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, part1, 0,
+		(int *) NULL);
     }
     if (hPtr == NULL) {
 	return;
@@ -1201,7 +1715,8 @@ Hax_VarTraceInfo2(
     if ((flags & HAX_GLOBAL_ONLY) || (iPtr->varFramePtr == NULL)) {
 	hPtr = Hax_FindHashEntry(&iPtr->globalTable, part1);
     } else {
-	hPtr = Hax_FindHashEntry(&iPtr->varFramePtr->varTable, part1);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, part1, 0,
+		(int *) NULL);
     }
     if (hPtr == NULL) {
 	return NULL;
@@ -1270,13 +1785,30 @@ Hax_SetCmd(
     char **argv				/* Argument strings. */)
 {
     if (argc == 2) {
-	char *value;
+	char *part2, *open, *close, *value;
+	Hax_Obj *objPtr;
+
+	/*
+	 * A long value is made the result by reference, so that a
+	 * command substitution of "set" can take it over without
+	 * copying it (see HaxTakeResultObj).
+	 */
 
-	value = Hax_GetVar(interp, argv[1], HAX_LEAVE_ERR_MSG);
+	part2 = SplitVarName(argv[1], &open, &close);
+	value = HaxGetVarObj(interp, argv[1], part2, HAX_LEAVE_ERR_MSG,
+		&objPtr);
+	if (close != NULL) {
+	    *open = '(';
+	    *close = ')';
+	}
 	if (value == NULL) {
 	    return HAX_ERROR;
 	}
-	interp->result = value;
+	if ((objPtr != NULL) && (value == objPtr->bytes)) {
+	    Hax_SetObjResult(interp, objPtr);
+	} else {
+	    interp->result = value;
+	}
 	return HAX_OK;
     } else if (argc == 3) {
 	char *result;
@@ -1297,7 +1829,124 @@ Hax_SetCmd(
 /*
  *----------------------------------------------------------------------
  *
- * Hax_UnsetCmd --
+ * Hax_SetObjCmd --
+ *
+ *	This is the object-based form of Hax_SetCmd.  Compiled scripts
+ *	use it when an argument is a value held by reference.
+ *
+ * Results:
+ *	A standard Hax result value.
+ *
+ * Side effects:
+ *	A variable's value may be changed.  The variable and the result
+ *	share a long value rather than copying it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+	/* ARGSUSED */
+int
+Hax_SetObjCmd(
+    ClientData dummy,			/* Not used. */
+    Hax_Interp *interp,			/* Current interpreter. */
+    int objc,				/* Number of arguments. */
+    Hax_Obj **objv			/* Argument values. */)
+{
+    char *varName, *part2, *open, *close, *value;
+    Hax_Obj *objPtr;
+
+    if ((objc != 2) && (objc != 3)) {
+	Hax_AppendResult(interp, "wrong # args: should be \"",
+		Hax_GetStringFromObj(interp, objv[0], (int *) NULL),
+		" varName ?newValue?\"", (char *) NULL);
+	return HAX_ERROR;
+    }
+
+    varName = Hax_GetStringFromObj(interp, objv[1], (int *) NULL);
+    part2 = SplitVarName(varName, &open, &close);
+
+    if (objc == 2) {
+	value = HaxGetVarObj(interp, varName, part2, HAX_LEAVE_ERR_MSG,
+		&objPtr);
+    } else {
+	objPtr = objv[2];
+	value = HaxSetVarObj(interp, varName, part2, objPtr,
+		HAX_LEAVE_ERR_MSG);
+    }
+
+    if (close != NULL) {
+	*open = '(';
+	*close = ')';
+    }
+    if (value == NULL) {
+	return HAX_ERROR;
+    }
+
+    /*
+     * A write trace may have changed the value, so only share the
+     * value if it is still the variable's.
+     */
+
+    if ((objPtr != NULL) && (value == objPtr->bytes)) {
+	Hax_SetObjResult(interp, objPtr);
+    } else {
+	interp->result = value;
+    }
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxSetSlotCmd --
+ *
+ *	Execute a "set" command from a compiled script that has already
+ *	resolved the variable's name to a slot in the current frame.
+ *
+ * Results:
+ *	A standard Hax result value.
+ *
+ * Side effects:
+ *	The same as for Hax_SetObjCmd.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+HaxSetSlotCmd(
+    Hax_Interp *interp,		/* Current interpreter. */
+    Hax_HashEntry *slotPtr,	/* Slot that holds the variable. */
+    char *varName,		/* Name of the (scalar) variable. */
+    char *newValue,		/* New value for the variable, or NULL to
+				 * read it. */
+    Hax_Obj *objPtr)		/* If not NULL, the value that newValue is
+				 * the string of, which the variable may
+				 * share. */
+{
+    char *value;
+
+    if (newValue == NULL) {
+	value = HaxGetVarSlot(interp, slotPtr, varName, (char *) NULL,
+		HAX_LEAVE_ERR_MSG, &objPtr, (VarNumber **) NULL);
+    } else {
+	value = HaxSetVarSlot(interp, slotPtr, varName, (char *) NULL,
+		newValue, objPtr, (VarNumber *) NULL, HAX_LEAVE_ERR_MSG);
+    }
+    if (value == NULL) {
+	return HAX_ERROR;
+    }
+    if ((objPtr != NULL) && (value == objPtr->bytes)) {
+	Hax_SetObjResult(interp, objPtr);
+    } else {
+	interp->result = value;
+    }
+    return HAX_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * Hax_UnsetCmd --
  *
  *	This procedure is invoked to process the "unset" Hax command.
  *	See the user documentation for details on what it does.
@@ -1471,7 +2120,8 @@ Hax_ArrayCmd(
     if (iPtr->varFramePtr == NULL) {
 	hPtr = Hax_FindHashEntry(&iPtr->globalTable, argv[2]);
     } else {
-	hPtr = Hax_FindHashEntry(&iPtr->varFramePtr->varTable, argv[2]);
+	hPtr = HaxLookupVar(iPtr, iPtr->varFramePtr, argv[2], 0,
+		(int *) NULL);
     }
     if (hPtr == NULL) {
 	notArray:
@@ -1548,21 +2198,30 @@ Hax_ArrayCmd(
     } else if ((c == 'n') && (strncmp(argv[1], "names", length) == 0)
 	    && (length >= 2)) {
 	Hax_HashSearch search;
+	Hax_Pattern pattern;
 	Var *varPtr2;
+	char *name;
 
-	if (argc != 3) {
+	if ((argc != 3) && (argc != 4)) {
 	    Hax_AppendResult(interp, "wrong # args: should be \"",
-		    argv[0], " names arrayName\"", (char *) NULL);
+		    argv[0], " names arrayName ?pattern?\"", (char *) NULL);
 	    return HAX_ERROR;
 	}
+	pattern = (argc == 4) ? Hax_CompilePattern(interp, argv[3]) : NULL;
 	for (hPtr = Hax_FirstHashEntry(varPtr->value.tablePtr, &search);
 		hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
 	    varPtr2 = (Var *) Hax_GetHashValue(hPtr);
 	    if (varPtr2->flags & VAR_UNDEFINED) {
 		continue;
 	    }
-	    Hax_AppendElement(interp,
-		    Hax_GetHashKey(varPtr->value.tablePtr, hPtr), 0);
+	    name = Hax_GetHashKey(varPtr->value.tablePtr, hPtr);
+	    if ((pattern != NULL) && !Hax_PatternMatch(pattern, name)) {
+		continue;
+	    }
+	    Hax_AppendElement(interp, name, 0);
+	}
+	if (pattern != NULL) {
+	    Hax_FreePattern(interp, pattern);
 	}
     } else if ((c == 'n') && (strncmp(argv[1], "nextelement", length) == 0)
 	    && (length >= 2)) {
@@ -1701,8 +2360,7 @@ Hax_GlobalCmd(
 	} else {
 	    gVarPtr = (Var *) Hax_GetHashValue(hPtr);
 	}
-	hPtr2 = Hax_CreateHashEntry(interp, &iPtr->varFramePtr->varTable, *argv,
-		    &newPtr);
+	hPtr2 = HaxLookupVar(iPtr, iPtr->varFramePtr, *argv, 1, &newPtr);
 	if (!newPtr) {
 	    Var *varPtr;
 	    varPtr = (Var *) Hax_GetHashValue(hPtr2);
@@ -1752,7 +2410,6 @@ Hax_UpvarCmd(
     int result;
     CallFrame *framePtr;
     Var *varPtr = NULL;
-    Hax_HashTable *upVarTablePtr;
     Hax_HashEntry *hPtr, *hPtr2;
     int newPtr;
     Var *upVarPtr;
@@ -1766,7 +2423,7 @@ Hax_UpvarCmd(
     }
 
     /*
-     * Find the hash table containing the variable being referenced.
+     * Find the frame containing the variable being referenced.
      */
 
     result = HaxGetFrame(interp, argv[1], &framePtr);
@@ -1775,11 +2432,6 @@ Hax_UpvarCmd(
     }
     argc -= result+1;
     argv += result+1;
-    if (framePtr == NULL) {
-	upVarTablePtr = &iPtr->globalTable;
-    } else {
-	upVarTablePtr = &framePtr->varTable;
-    }
 
     if ((argc & 1) != 0) {
 	goto upvarSyntax;
@@ -1793,7 +2445,7 @@ Hax_UpvarCmd(
      */
 
     while (argc > 0) {
-        hPtr = Hax_CreateHashEntry(interp, upVarTablePtr, argv[0], &newPtr);
+        hPtr = HaxLookupVar(iPtr, framePtr, argv[0], 1, &newPtr);
         if (newPtr) {
             upVarPtr = NewVar(interp, 0);
             upVarPtr->flags |= VAR_UNDEFINED;
@@ -1806,8 +2458,8 @@ Hax_UpvarCmd(
 	    }
         }
 
-        hPtr2 = Hax_CreateHashEntry(interp, &iPtr->varFramePtr->varTable,
-                    argv[1], &newPtr);
+        hPtr2 = HaxLookupVar(iPtr, iPtr->varFramePtr, argv[1], 1,
+		&newPtr);
         if (!newPtr) {
             Hax_AppendResult((Hax_Interp *) iPtr, "variable \"", argv[1],
                 "\" already exists", (char *) NULL);
@@ -1828,13 +2480,220 @@ Hax_UpvarCmd(
 /*
  *----------------------------------------------------------------------
  *
- * HaxDeleteVars --
+ * HaxLookupVar --
+ *
+ *	Find the hash table entry for a variable in a given frame:  a
+ *	slot if the variable is one of the procedure's statically
+ *	visible locals, otherwise an entry in the frame's hash table
+ *	(or the global table if framePtr is NULL).
+ *
+ * Results:
+ *	The return value is the variable's entry, or NULL if the
+ *	variable doesn't exist and create is 0.  If create is non-zero
+ *	then *newPtr is set to 1 if the entry was just created (in
+ *	which case the caller must store a Var in it) and 0 otherwise.
+ *
+ * Side effects:
+ *	The frame's hash table is created if it's needed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+Hax_HashEntry *
+HaxLookupVar(
+    Interp *iPtr,		/* Interpreter containing variable. */
+    CallFrame *framePtr,	/* Frame in which to look, or NULL for
+				 * global variables. */
+    char *name,			/* Name of variable. */
+    int create,			/* Non-zero means create the entry if it
+				 * doesn't exist. */
+    int *newPtr			/* Store whether new entry was created
+				 * here (only used if create is set). */)
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Hax_HashEntry *hPtr;
+
+    if (framePtr == NULL) {
+	if (create) {
+	    return Hax_CreateHashEntry(interp, &iPtr->globalTable, name,
+		    newPtr);
+	}
+	return Hax_FindHashEntry(&iPtr->globalTable, name);
+    }
+    if (framePtr->procPtr->numLocals > 0) {
+	hPtr = Hax_FindHashEntry(&framePtr->procPtr->localTable, name);
+	if (hPtr != NULL) {
+	    hPtr = &framePtr->slots[(int) (long) Hax_GetHashValue(hPtr)];
+	    if (create) {
+		*newPtr = (Hax_GetHashValue(hPtr) == NULL);
+	    } else if (Hax_GetHashValue(hPtr) == NULL) {
+		return NULL;
+	    }
+	    return hPtr;
+	}
+    }
+    if (framePtr->varTablePtr == NULL) {
+	if (!create) {
+	    return NULL;
+	}
+	framePtr->varTablePtr = (Hax_HashTable *) ckalloc(memoryp,
+		sizeof(Hax_HashTable));
+	Hax_InitHashTable(framePtr->varTablePtr, HAX_OPEN_STRING_KEYS);
+    }
+    if (create) {
+	return Hax_CreateHashEntry(interp, framePtr->varTablePtr, name,
+		newPtr);
+    }
+    return Hax_FindHashEntry(framePtr->varTablePtr, name);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxSetSlotVar --
+ *
+ *	Create a procedure's local variable in an empty slot and give
+ *	it a value, either a string to copy or a Hax_Obj to share.  This
+ *	is used to bind arguments at the start of a call, so it needn't
+ *	worry about traces.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	A variable is created.  If the slot already holds a variable
+ *	(e.g. because an argument name was repeated) it is replaced.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxSetSlotVar(
+    Interp *iPtr,		/* Interpreter containing variable. */
+    Hax_HashEntry *hPtr,	/* Slot for variable. */
+    char *value,		/* Value for variable, if objPtr is NULL. */
+    Hax_Obj *objPtr)		/* If not NULL, value for variable. */
+{
+    Var *varPtr;
+    int length;
+
+    if (Hax_GetHashValue(hPtr) != NULL) {
+	FreeVar(iPtr, (Var *) Hax_GetHashValue(hPtr));
+    }
+    if (objPtr != NULL) {
+	value = Hax_GetStringFromObj((Hax_Interp *) iPtr, objPtr, &length);
+	if (length < VALUE_SHARE_SIZE) {
+	    objPtr = NULL;
+	}
+    }
+    if (objPtr != NULL) {
+	varPtr = NewVar((Hax_Interp *) iPtr, 0);
+	Hax_IncrRefCount(objPtr);
+	varPtr->objPtr = objPtr;
+	Hax_SetHashValue(hPtr, varPtr);
+	return;
+    }
+    length = strlen(value);
+    varPtr = NewVar((Hax_Interp *) iPtr, length + 1);
+    strcpy(varPtr->value.string, value);
+    varPtr->valueLength = length;
+    Hax_SetHashValue(hPtr, varPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxAppendVarNames --
+ *
+ *	Append to interp->result the names of the variables in a
+ *	frame, as for "info vars" and friends.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Names are appended to interp->result as list elements.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+HaxAppendVarNames(
+    Interp *iPtr,		/* Interpreter containing variables. */
+    CallFrame *framePtr,	/* Frame whose variables are wanted, or
+				 * NULL for global variables. */
+    char *pattern,		/* Only return names matching this
+				 * pattern, or NULL for all names. */
+    int skipFlags)		/* Skip variables with any of these
+				 * flags set (e.g. VAR_UNDEFINED). */
+{
+    Hax_Interp *interp = (Hax_Interp *) iPtr;
+    Hax_HashTable *tablePtr;
+    Hax_HashSearch search;
+    Hax_HashEntry *hPtr;
+    Var *varPtr;
+    Hax_Pattern compiled = NULL;
+    char *name;
+    int i;
+
+    /*
+     * Give errorInfo and errorCode their values first, in case they
+     * haven't been set yet (see HaxFlushErrorInfo).
+     */
+
+    HaxFlushPendingError(iPtr);
+    if (pattern != NULL) {
+	compiled = Hax_CompilePattern(interp, pattern);
+    }
+    if (framePtr == NULL) {
+	tablePtr = &iPtr->globalTable;
+    } else {
+	for (i = 0; i < framePtr->procPtr->numLocals; i++) {
+	    varPtr = (Var *) Hax_GetHashValue(&framePtr->slots[i]);
+	    if ((varPtr == NULL) || (varPtr->flags & skipFlags)) {
+		continue;
+	    }
+	    name = framePtr->procPtr->localNames[i];
+	    if ((compiled != NULL) && !Hax_PatternMatch(compiled, name)) {
+		continue;
+	    }
+	    Hax_AppendElement(interp, name, 0);
+	}
+	tablePtr = framePtr->varTablePtr;
+	if (tablePtr == NULL) {
+	    goto done;
+	}
+    }
+    for (hPtr = Hax_FirstHashEntry(tablePtr, &search);
+	    hPtr != NULL; hPtr = Hax_NextHashEntry(&search)) {
+	varPtr = (Var *) Hax_GetHashValue(hPtr);
+	if (varPtr->flags & skipFlags) {
+	    continue;
+	}
+	name = Hax_GetHashKey(tablePtr, hPtr);
+	if ((compiled != NULL) && !Hax_PatternMatch(compiled, name)) {
+	    continue;
+	}
+	Hax_AppendElement(interp, name, 0);
+    }
+
+    done:
+    if (compiled != NULL) {
+	Hax_FreePattern(interp, compiled);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * HaxDeleteVars, HaxDeleteFrameVars --
  *
- *	This procedure is called to recycle all the storage space
- *	associated with a table of variables.  For this procedure
- *	to work correctly, it must not be possible for any of the
- *	variable in the table to be accessed from Hax commands
- *	(e.g. from trace procedures).
+ *	These procedures are called to recycle all the storage space
+ *	associated with a table of variables or with the variables of
+ *	a procedure's call frame.  For these procedures to work
+ *	correctly, it must not be possible for any of the variables
+ *	to be accessed from Hax commands (e.g. from trace procedures).
  *
  * Results:
  *	None.
@@ -1852,11 +2711,9 @@ HaxDeleteVars(
     Hax_HashTable *tablePtr	/* Hash table containing variables to
 				 * delete. */)
 {
-    Hax_Memoryp *memoryp = iPtr->memoryp;
     Hax_HashSearch search;
     Hax_HashEntry *hPtr;
-    Var *varPtr;
-    int flags, globalFlag;
+    int flags;
 
     flags = HAX_TRACE_UNSETS;
     if (tablePtr == &iPtr->globalTable) {
@@ -1864,59 +2721,204 @@ HaxDeleteVars(
     }
     for (hPtr = Hax_FirstHashEntry(tablePtr, &search); hPtr != NULL;
 	    hPtr = Hax_NextHashEntry(&search)) {
-	varPtr = (Var *) Hax_GetHashValue(hPtr);
+	DeleteVar(iPtr, hPtr, Hax_GetHashKey(tablePtr, hPtr), flags);
+    }
+    Hax_DeleteHashTable((Hax_Interp *) iPtr, tablePtr);
+}
 
-	/*
-	 * For global/upvar variables referenced in procedures, free up the
-	 * local space and then decrement the reference count on the
-	 * variable referred to.  If there are no more references to the
-	 * global/upvar and it is undefined and has no traces set, then
-	 * follow on and delete the referenced variable too.
-	 */
+void
+HaxDeleteFrameVars(
+    Interp *iPtr,		/* Interpreter to which variables belong. */
+    CallFrame *framePtr		/* Frame whose variables are to be
+				 * deleted. */)
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    int i;
 
-	globalFlag = 0;
-	if (varPtr->flags & VAR_UPVAR) {
-	    hPtr = varPtr->value.upvarPtr;
-	    ckfree(memoryp, (char *) varPtr);
-	    varPtr = (Var *) Hax_GetHashValue(hPtr);
-	    varPtr->upvarUses--;
-	    if ((varPtr->upvarUses != 0) || !(varPtr->flags & VAR_UNDEFINED)
-		    || (varPtr->tracePtr != NULL)) {
-		continue;
-	    }
-	    globalFlag = HAX_GLOBAL_ONLY;
+    for (i = 0; i < framePtr->procPtr->numLocals; i++) {
+	if (Hax_GetHashValue(&framePtr->slots[i]) != NULL) {
+	    DeleteVar(iPtr, &framePtr->slots[i],
+		    framePtr->procPtr->localNames[i], HAX_TRACE_UNSETS);
 	}
+    }
+    if (framePtr->varTablePtr != NULL) {
+	HaxDeleteVars(iPtr, framePtr->varTablePtr);
+	ckfree(memoryp, (char *) framePtr->varTablePtr);
+    }
+}
 
-	/*
-	 * Invoke traces on the variable that is being deleted, then
-	 * free up the variable's space (no need to free the hash entry
-	 * here, unless we're dealing with a global variable:  the
-	 * hash entries will be deleted automatically when the whole
-	 * table is deleted).
-	 */
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeleteVar --
+ *
+ *	Delete one of the variables of a table or frame that is
+ *	being deleted.  The hash table entry for the variable isn't
+ *	freed:  that happens when the whole table is deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The variable is deleted and its unset traces are invoked.
+ *
+ *----------------------------------------------------------------------
+ */
 
-	if (varPtr->tracePtr != NULL) {
-	    (void) CallTraces(iPtr, (Var *) NULL, hPtr,
-		    Hax_GetHashKey(tablePtr, hPtr), (char *) NULL,
-		    flags | globalFlag);
-	    while (varPtr->tracePtr != NULL) {
-		VarTrace *tracePtr = varPtr->tracePtr;
-		varPtr->tracePtr = tracePtr->nextPtr;
-		ckfree(memoryp, (char *) tracePtr);
-	    }
-	}
-	if (varPtr->flags & VAR_ARRAY) {
-	    DeleteArray(iPtr, Hax_GetHashKey(tablePtr, hPtr), varPtr,
-		    flags | globalFlag);
+static void
+DeleteVar(
+    Interp *iPtr,		/* Interpreter to which variable belongs. */
+    Hax_HashEntry *hPtr,	/* Entry for variable. */
+    char *name,			/* Name of variable. */
+    int flags			/* Flags to pass to trace procedures. */)
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+    Var *varPtr;
+    int globalFlag;
+
+    varPtr = (Var *) Hax_GetHashValue(hPtr);
+
+    /*
+     * For global/upvar variables referenced in procedures, free up the
+     * local space and then decrement the reference count on the
+     * variable referred to.  If there are no more references to the
+     * global/upvar and it is undefined and has no traces set, then
+     * follow on and delete the referenced variable too.
+     */
+
+    globalFlag = 0;
+    if (varPtr->flags & VAR_UPVAR) {
+	hPtr = varPtr->value.upvarPtr;
+	ckfree(memoryp, (char *) varPtr);
+	varPtr = (Var *) Hax_GetHashValue(hPtr);
+	varPtr->upvarUses--;
+	if ((varPtr->upvarUses != 0) || !(varPtr->flags & VAR_UNDEFINED)
+		|| (varPtr->tracePtr != NULL)) {
+	    return;
 	}
-	if (globalFlag) {
-	    Hax_DeleteHashEntry((Hax_Interp *) iPtr, hPtr);
+	globalFlag = HAX_GLOBAL_ONLY;
+    }
+
+    /*
+     * Invoke traces on the variable that is being deleted, then
+     * free up the variable's space (no need to free the hash entry
+     * here, unless we're dealing with a global variable:  the
+     * hash entries will be deleted automatically when the whole
+     * table is deleted).
+     */
+
+    if (varPtr->tracePtr != NULL) {
+	(void) CallTraces(iPtr, (Var *) NULL, hPtr, name, (char *) NULL,
+		flags | globalFlag);
+	while (varPtr->tracePtr != NULL) {
+	    VarTrace *tracePtr = varPtr->tracePtr;
+	    varPtr->tracePtr = tracePtr->nextPtr;
+	    ckfree(memoryp, (char *) tracePtr);
 	}
-	ckfree(memoryp, (char *) varPtr);
     }
-    Hax_DeleteHashTable((Hax_Interp *) iPtr, tablePtr);
+    if (varPtr->flags & VAR_ARRAY) {
+	DeleteArray(iPtr, name, varPtr, flags | globalFlag);
+    }
+    if (globalFlag) {
+	DeleteVarEntry(iPtr, hPtr);
+    }
+    FreeVar(iPtr, varPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeleteVarEntry --
+ *
+ *	Remove the entry for a variable whose Var has been (or is about
+ *	to be) freed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The entry is deleted from its hash table, or if it is one of
+ *	a frame's slots, it is marked empty.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DeleteVarEntry(
+    Interp *iPtr,		/* Interpreter to which variable belongs. */
+    Hax_HashEntry *hPtr)	/* Entry to remove. */
+{
+    if (hPtr->tablePtr == NULL) {
+	Hax_SetHashValue(hPtr, NULL);
+    } else {
+	Hax_DeleteHashEntry((Hax_Interp *) iPtr, hPtr);
+    }
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeVar --
+ *
+ *	Free the storage for a variable that is being deleted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If the interpreter's result is the variable's value (for
+ *	example, because "set" was the last command in a procedure
+ *	that is returning), the value is copied into the result
+ *	first so that it survives.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeVar(
+    Interp *iPtr,		/* Interpreter to which variable belongs. */
+    Var *varPtr)		/* Variable to free. */
+{
+    Hax_Memoryp *memoryp = iPtr->memoryp;
+
+    if (varPtr->objPtr != NULL) {
+	DropValue(iPtr, varPtr->objPtr);
+    } else if (!(varPtr->flags & (VAR_ARRAY|VAR_UPVAR|VAR_UNDEFINED))
+	    && (iPtr->result == varPtr->value.string)) {
+	Hax_SetResult((Hax_Interp *) iPtr, iPtr->result, HAX_VOLATILE);
+    }
+    ckfree(memoryp, (char *) varPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DropValue --
+ *
+ *	Release a variable's reference to a shared value.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The value may be freed.  If the interpreter's result is the
+ *	value's string, the result takes over the reference instead so
+ *	that the string survives.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DropValue(
+    Interp *iPtr,		/* Interpreter to which variable belongs. */
+    Hax_Obj *objPtr)		/* Value the variable held. */
+{
+    if ((iPtr->result == objPtr->bytes) && (iPtr->objResultPtr != objPtr)) {
+	Hax_SetObjResult((Hax_Interp *) iPtr, objPtr);
+    }
+    Hax_DecrRefCount((Hax_Interp *) iPtr, objPtr);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2006,12 +3008,14 @@ CallTraces(
     }
 
     /*
-     * Invoke traces on the variable itself.
+     * Invoke traces on the variable itself.  The array's traces may
+     * have re-allocated the variable, so look it up again.
      */
 
     if (flags & HAX_TRACE_UNSETS) {
 	flags |= HAX_TRACE_DESTROYED;
     }
+    varPtr = (Var *) Hax_GetHashValue(hPtr);
     for (tracePtr = varPtr->tracePtr; tracePtr != NULL;
 	    tracePtr = active.nextTracePtr) {
 	active.nextTracePtr = tracePtr->nextPtr;
@@ -2089,6 +3093,8 @@ NewVar(
     varPtr->tracePtr = NULL;
     varPtr->searchPtr = NULL;
     varPtr->flags = 0;
+    varPtr->objPtr = NULL;
+    varPtr->number.type = VAR_NUM_NONE;
     varPtr->value.string[0] = 0;
     return varPtr;
 }
@@ -2163,6 +3169,53 @@ ParseSearchId(
     return NULL;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * SplitVarName --
+ *
+ *	Split a variable name of the form "array(element)" into its two
+ *	parts, the same way as Hax_GetVar does.
+ *
+ * Results:
+ *	The return value is the element name, or NULL if varName names
+ *	a scalar.  *OpenPtr and *closePtr are set to the parentheses,
+ *	or *closePtr to NULL if there is no element name.
+ *
+ * Side effects:
+ *	The parentheses are overwritten with null characters;  the
+ *	caller must put them back.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static char *
+SplitVarName(
+    char *varName,		/* Name to split. */
+    char **openPtr,		/* Where to store the open parenthesis. */
+    char **closePtr)		/* Where to store the close parenthesis. */
+{
+    char *p;
+
+    *openPtr = *closePtr = NULL;
+    for (p = varName; *p != '\0'; p++) {
+	if (*p == '(') {
+	    *openPtr = p;
+	    while (p[1] != '\0') {
+		p++;
+	    }
+	    if (*p == ')') {
+		*closePtr = p;
+		**openPtr = '\0';
+		*p = '\0';
+		return *openPtr + 1;
+	    }
+	    break;
+	}
+    }
+    return NULL;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -2250,7 +3303,7 @@ DeleteArray(
 	if (elPtr->flags & VAR_SEARCHES_POSSIBLE) {
 	    Hax_Panic((char *) "DeleteArray found searches on array alement!");
 	}
-	ckfree(memoryp, (char *) elPtr);
+	FreeVar(iPtr, elPtr);
     }
     Hax_DeleteHashTable((Hax_Interp *) iPtr, varPtr->value.tablePtr);
     ckfree(memoryp, (char *) varPtr->value.tablePtr);
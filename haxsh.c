@@ -45,7 +45,7 @@ char initCmd[] =
 static void
 usage(void)
 {
-    fprintf(stderr, "haxsh: [-f fileName] args...\n");
+    fprintf(stderr, "haxsh: [-r] [-f fileName] args...\n");
     exit(1);
 }
 #endif
@@ -138,23 +138,9 @@ main(int argc, char **argv)
 #ifndef RHAXSH
     int ch;
     char *fileName = NULL;
-#endif
+    int release = 0;
 
-    memoryp = Hax_CreateMemoryManagement(0, 0, 0, 0, 1);
-    interp = Hax_CreateInterp(memoryp);
-    Hax_InitMemory(interp);
-#ifndef RHAXSH
-    unixClientData = (ClientData) Hax_InitUnixCore(interp);
-    Hax_EnvTraceProc(interp, unixClientData, writeEnv, unsetEnv, destroyEnv);
-#endif
-    Hax_CreateCommand(interp, (char *) "echo", cmdEcho, (ClientData) "echo",
-	    (Hax_CmdDeleteProc *) NULL);
-    Hax_CreateCommand(interp, (char *) "checkmem", cmdCheckmem, (ClientData) 0,
-	    (Hax_CmdDeleteProc *) NULL);
-    buffer = Hax_CreateCmdBuf(interp);
-
-#ifndef RHAXSH
-    while ((ch = getopt(argc, argv, "f:")) != -1) {
+    while ((ch = getopt(argc, argv, "rf:")) != -1) {
 	switch (ch) {
 	case 'f':
 	    if (fileName != NULL) {
@@ -163,6 +149,9 @@ main(int argc, char **argv)
 	    fileName = optarg;
 	    argv0 = fileName;
 	    break;
+	case 'r':
+	    release = 1;
+	    break;
 	default:
 	    usage();
 	    /* NOTREACHED */
@@ -171,7 +160,26 @@ main(int argc, char **argv)
 
     argc -= optind;
     argv += optind;
+
+    if (release) {
+	memoryp = Hax_CreateReleaseMemoryManagement();
+    } else {
+	memoryp = Hax_CreateMemoryManagement(0, 0, 0, 0, 1);
+    }
+#else
+    memoryp = Hax_CreateMemoryManagement(0, 0, 0, 0, 1);
 #endif
+    interp = Hax_CreateInterp(memoryp);
+    Hax_InitMemory(interp);
+#ifndef RHAXSH
+    unixClientData = (ClientData) Hax_InitUnixCore(interp);
+    Hax_EnvTraceProc(interp, unixClientData, writeEnv, unsetEnv, destroyEnv);
+#endif
+    Hax_CreateCommand(interp, (char *) "echo", cmdEcho, (ClientData) "echo",
+	    (Hax_CmdDeleteProc *) NULL);
+    Hax_CreateCommand(interp, (char *) "checkmem", cmdCheckmem, (ClientData) 0,
+	    (Hax_CmdDeleteProc *) NULL);
+    buffer = Hax_CreateCmdBuf(interp);
 
     Hax_SetVar(interp, (char *) "argv0", argv0, HAX_GLOBAL_ONLY);
     Hax_SetVar(interp, (char *) "argv", "", HAX_GLOBAL_ONLY);